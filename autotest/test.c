@@ -44,22 +44,33 @@ extern int  exotic_run(struct exotic_handle* handle);
 
 #endif /* HAVE_EXOTIC_AUTOTEST_H */
 
+#include "test_acl.tcc"
+#include "test_admission.tcc"
 #include "test_commands.tcc"
 #include "test_credentials.tcc"
 #include "test_eventqueue.tcc"
+#include "test_hashtable.tcc"
 #include "test_hub.tcc"
 #include "test_inf.tcc"
+#include "test_ioqueue.tcc"
 #include "test_ipfilter.tcc"
 #include "test_list.tcc"
+#include "test_loginqueue.tcc"
+#include "test_logring.tcc"
 #include "test_memory.tcc"
 #include "test_message.tcc"
 #include "test_misc.tcc"
+#include "test_mux.tcc"
+#include "test_pluginasync.tcc"
+#include "test_plugininvoke.tcc"
 #include "test_rbtree.tcc"
+#include "test_shmring.tcc"
 #include "test_sid.tcc"
 #include "test_tiger.tcc"
 #include "test_timer.tcc"
 #include "test_tokenizer.tcc"
 #include "test_usermanager.tcc"
+#include "test_zlif.tcc"
 
 int main(int argc, char** argv)
 {
@@ -69,6 +80,38 @@ int main(int argc, char** argv)
 		return -1;
 
 	/* Register the tests to be run */
+	exotic_add_test(&handle, &exotic_test_acl_setup, "acl_setup");
+	exotic_add_test(&handle, &exotic_test_acl_nick_banned, "acl_nick_banned");
+	exotic_add_test(&handle, &exotic_test_acl_nick_denied, "acl_nick_denied");
+	exotic_add_test(&handle, &exotic_test_acl_cid_banned, "acl_cid_banned");
+	exotic_add_test(&handle, &exotic_test_acl_ip_banned, "acl_ip_banned");
+	exotic_add_test(&handle, &exotic_test_acl_ban_nick, "acl_ban_nick");
+	exotic_add_test(&handle, &exotic_test_acl_unban_nick, "acl_unban_nick");
+	exotic_add_test(&handle, &exotic_test_acl_ban_cid, "acl_ban_cid");
+	exotic_add_test(&handle, &exotic_test_acl_unban_cid, "acl_unban_cid");
+	exotic_add_test(&handle, &exotic_test_acl_shutdown, "acl_shutdown");
+	exotic_add_test(&handle, &exotic_test_admission_create, "admission_create");
+	exotic_add_test(&handle, &exotic_test_admission_addresses, "admission_addresses");
+	exotic_add_test(&handle, &exotic_test_admission_off, "admission_off");
+	exotic_add_test(&handle, &exotic_test_admission_conns_ipv4_1, "admission_conns_ipv4_1");
+	exotic_add_test(&handle, &exotic_test_admission_conns_ipv4_2, "admission_conns_ipv4_2");
+	exotic_add_test(&handle, &exotic_test_admission_conns_ipv4_mapped, "admission_conns_ipv4_mapped");
+	exotic_add_test(&handle, &exotic_test_admission_conns_release, "admission_conns_release");
+	exotic_add_test(&handle, &exotic_test_admission_conns_stats, "admission_conns_stats");
+	exotic_add_test(&handle, &exotic_test_admission_expire_busy, "admission_expire_busy");
+	exotic_add_test(&handle, &exotic_test_admission_expire_idle, "admission_expire_idle");
+	exotic_add_test(&handle, &exotic_test_admission_conns_ipv6_prefix, "admission_conns_ipv6_prefix");
+	exotic_add_test(&handle, &exotic_test_admission_conns_ipv6_v4_off, "admission_conns_ipv6_v4_off");
+	exotic_add_test(&handle, &exotic_test_admission_conns_ipv6_release, "admission_conns_ipv6_release");
+	exotic_add_test(&handle, &exotic_test_admission_rate_burst, "admission_rate_burst");
+	exotic_add_test(&handle, &exotic_test_admission_rate_refill_1, "admission_rate_refill_1");
+	exotic_add_test(&handle, &exotic_test_admission_rate_refill_2, "admission_rate_refill_2");
+	exotic_add_test(&handle, &exotic_test_admission_rate_refill_3, "admission_rate_refill_3");
+	exotic_add_test(&handle, &exotic_test_admission_rate_stats, "admission_rate_stats");
+	exotic_add_test(&handle, &exotic_test_admission_rate_expire_1, "admission_rate_expire_1");
+	exotic_add_test(&handle, &exotic_test_admission_rate_expire_2, "admission_rate_expire_2");
+	exotic_add_test(&handle, &exotic_test_admission_full, "admission_full");
+	exotic_add_test(&handle, &exotic_test_admission_destroy, "admission_destroy");
 	exotic_add_test(&handle, &exotic_test_setup, "setup");
 	exotic_add_test(&handle, &exotic_test_command_setup_user, "command_setup_user");
 	exotic_add_test(&handle, &exotic_test_command_create, "command_create");
@@ -149,7 +192,42 @@ int main(int argc, char** argv)
 	exotic_add_test(&handle, &exotic_test_eventqueue_size_3, "eventqueue_size_3");
 	exotic_add_test(&handle, &exotic_test_eventqueue_process_2, "eventqueue_process_2");
 	exotic_add_test(&handle, &exotic_test_eventqueue_size_4, "eventqueue_size_4");
+	exotic_add_test(&handle, &exotic_test_eventqueue_grow_1, "eventqueue_grow_1");
+	exotic_add_test(&handle, &exotic_test_eventqueue_grow_2, "eventqueue_grow_2");
+	exotic_add_test(&handle, &exotic_test_eventqueue_nested_1, "eventqueue_nested_1");
+	exotic_add_test(&handle, &exotic_test_eventqueue_nested_2, "eventqueue_nested_2");
 	exotic_add_test(&handle, &exotic_test_eventqueue_shutdown_1, "eventqueue_shutdown_1");
+	exotic_add_test(&handle, &exotic_test_hashtable_create_destroy, "hashtable_create_destroy");
+	exotic_add_test(&handle, &exotic_test_hashtable_create_1, "hashtable_create_1");
+	exotic_add_test(&handle, &exotic_test_hashtable_size_0, "hashtable_size_0");
+	exotic_add_test(&handle, &exotic_test_hashtable_insert_1, "hashtable_insert_1");
+	exotic_add_test(&handle, &exotic_test_hashtable_insert_2, "hashtable_insert_2");
+	exotic_add_test(&handle, &exotic_test_hashtable_insert_3, "hashtable_insert_3");
+	exotic_add_test(&handle, &exotic_test_hashtable_insert_3_again, "hashtable_insert_3_again");
+	exotic_add_test(&handle, &exotic_test_hashtable_insert_case, "hashtable_insert_case");
+	exotic_add_test(&handle, &exotic_test_hashtable_size_1, "hashtable_size_1");
+	exotic_add_test(&handle, &exotic_test_hashtable_get_1, "hashtable_get_1");
+	exotic_add_test(&handle, &exotic_test_hashtable_get_2, "hashtable_get_2");
+	exotic_add_test(&handle, &exotic_test_hashtable_get_3, "hashtable_get_3");
+	exotic_add_test(&handle, &exotic_test_hashtable_get_4, "hashtable_get_4");
+	exotic_add_test(&handle, &exotic_test_hashtable_get_5, "hashtable_get_5");
+	exotic_add_test(&handle, &exotic_test_hashtable_get_6, "hashtable_get_6");
+	exotic_add_test(&handle, &exotic_test_hashtable_find_nocase_1, "hashtable_find_nocase_1");
+	exotic_add_test(&handle, &exotic_test_hashtable_find_nocase_2, "hashtable_find_nocase_2");
+	exotic_add_test(&handle, &exotic_test_hashtable_remove_1, "hashtable_remove_1");
+	exotic_add_test(&handle, &exotic_test_hashtable_remove_1_again, "hashtable_remove_1_again");
+	exotic_add_test(&handle, &exotic_test_hashtable_get_7, "hashtable_get_7");
+	exotic_add_test(&handle, &exotic_test_hashtable_remove_2, "hashtable_remove_2");
+	exotic_add_test(&handle, &exotic_test_hashtable_remove_3, "hashtable_remove_3");
+	exotic_add_test(&handle, &exotic_test_hashtable_remove_4, "hashtable_remove_4");
+	exotic_add_test(&handle, &exotic_test_hashtable_size_2, "hashtable_size_2");
+	exotic_add_test(&handle, &exotic_test_hashtable_insert_10000, "hashtable_insert_10000");
+	exotic_add_test(&handle, &exotic_test_hashtable_size_3, "hashtable_size_3");
+	exotic_add_test(&handle, &exotic_test_hashtable_load_factor, "hashtable_load_factor");
+	exotic_add_test(&handle, &exotic_test_hashtable_check_10000, "hashtable_check_10000");
+	exotic_add_test(&handle, &exotic_test_hashtable_remove_10000, "hashtable_remove_10000");
+	exotic_add_test(&handle, &exotic_test_hashtable_hash_nocase, "hashtable_hash_nocase");
+	exotic_add_test(&handle, &exotic_test_hashtable_destroy_1, "hashtable_destroy_1");
 	exotic_add_test(&handle, &exotic_test_hub_net_startup, "hub_net_startup");
 	exotic_add_test(&handle, &exotic_test_hub_config_initialize, "hub_config_initialize");
 	exotic_add_test(&handle, &exotic_test_hub_acl_initialize, "hub_acl_initialize");
@@ -203,6 +281,18 @@ int main(int argc, char** argv)
 	exotic_add_test(&handle, &exotic_test_inf_limit_hubs_6, "inf_limit_hubs_6");
 	exotic_add_test(&handle, &exotic_test_inf_limit_hubs_7, "inf_limit_hubs_7");
 	exotic_add_test(&handle, &exotic_test_inf_destroy_setup, "inf_destroy_setup");
+	exotic_add_test(&handle, &exotic_test_ioq_recv_create, "ioq_recv_create");
+	exotic_add_test(&handle, &exotic_test_ioq_recv_reserve_1, "ioq_recv_reserve_1");
+	exotic_add_test(&handle, &exotic_test_ioq_recv_commit_empty, "ioq_recv_commit_empty");
+	exotic_add_test(&handle, &exotic_test_ioq_recv_commit_1, "ioq_recv_commit_1");
+	exotic_add_test(&handle, &exotic_test_ioq_recv_consume_1, "ioq_recv_consume_1");
+	exotic_add_test(&handle, &exotic_test_ioq_recv_append_1, "ioq_recv_append_1");
+	exotic_add_test(&handle, &exotic_test_ioq_recv_consume_all, "ioq_recv_consume_all");
+	exotic_add_test(&handle, &exotic_test_ioq_recv_compact, "ioq_recv_compact");
+	exotic_add_test(&handle, &exotic_test_ioq_recv_grow_1, "ioq_recv_grow_1");
+	exotic_add_test(&handle, &exotic_test_ioq_recv_grow_limit, "ioq_recv_grow_limit");
+	exotic_add_test(&handle, &exotic_test_ioq_recv_clear, "ioq_recv_clear");
+	exotic_add_test(&handle, &exotic_test_ioq_recv_destroy, "ioq_recv_destroy");
 	exotic_add_test(&handle, &exotic_test_prepare_network, "prepare_network");
 	exotic_add_test(&handle, &exotic_test_check_ipv6, "check_ipv6");
 	exotic_add_test(&handle, &exotic_test_create_addresses_1, "create_addresses_1");
@@ -492,6 +582,25 @@ int main(int argc, char** argv)
 	exotic_add_test(&handle, &exotic_test_ip_range_2, "ip_range_2");
 	exotic_add_test(&handle, &exotic_test_ip_range_3, "ip_range_3");
 	exotic_add_test(&handle, &exotic_test_ip_range_4, "ip_range_4");
+	exotic_add_test(&handle, &exotic_test_ip_trie_create, "ip_trie_create");
+	exotic_add_test(&handle, &exotic_test_ip_trie_insert_cidr, "ip_trie_insert_cidr");
+	exotic_add_test(&handle, &exotic_test_ip_trie_lookup_cidr, "ip_trie_lookup_cidr");
+	exotic_add_test(&handle, &exotic_test_ip_trie_narrowest, "ip_trie_narrowest");
+	exotic_add_test(&handle, &exotic_test_ip_trie_insert_range, "ip_trie_insert_range");
+	exotic_add_test(&handle, &exotic_test_ip_trie_lookup_range, "ip_trie_lookup_range");
+	exotic_add_test(&handle, &exotic_test_ip_trie_insert_ipv6, "ip_trie_insert_ipv6");
+	exotic_add_test(&handle, &exotic_test_ip_trie_lookup_ipv6, "ip_trie_lookup_ipv6");
+	exotic_add_test(&handle, &exotic_test_ip_trie_lookup_mapped, "ip_trie_lookup_mapped");
+	exotic_add_test(&handle, &exotic_test_ip_trie_find, "ip_trie_find");
+	exotic_add_test(&handle, &exotic_test_ip_trie_find_outside, "ip_trie_find_outside");
+	exotic_add_test(&handle, &exotic_test_ip_trie_invalid, "ip_trie_invalid");
+	exotic_add_test(&handle, &exotic_test_ip_trie_remove, "ip_trie_remove");
+	exotic_add_test(&handle, &exotic_test_ip_trie_remove_range, "ip_trie_remove_range");
+	exotic_add_test(&handle, &exotic_test_ip_trie_remove_all, "ip_trie_remove_all");
+	exotic_add_test(&handle, &exotic_test_ip_trie_same_address, "ip_trie_same_address");
+	exotic_add_test(&handle, &exotic_test_ip_trie_many, "ip_trie_many");
+	exotic_add_test(&handle, &exotic_test_ip_trie_everything, "ip_trie_everything");
+	exotic_add_test(&handle, &exotic_test_ip_trie_destroy, "ip_trie_destroy");
 	exotic_add_test(&handle, &exotic_test_shutdown_network, "shutdown_network");
 	exotic_add_test(&handle, &exotic_test_list_create_destroy, "list_create_destroy");
 	exotic_add_test(&handle, &exotic_test_list_create, "list_create");
@@ -527,6 +636,28 @@ int main(int argc, char** argv)
 	exotic_add_test(&handle, &exotic_test_list_clear_list_last, "list_clear_list_last");
 	exotic_add_test(&handle, &exotic_test_list_destroy_1, "list_destroy_1");
 	exotic_add_test(&handle, &exotic_test_list_destroy_2, "list_destroy_2");
+	exotic_add_test(&handle, &exotic_test_loginqueue_create, "loginqueue_create");
+	exotic_add_test(&handle, &exotic_test_loginqueue_off, "loginqueue_off");
+	exotic_add_test(&handle, &exotic_test_loginqueue_burst, "loginqueue_burst");
+	exotic_add_test(&handle, &exotic_test_loginqueue_wait, "loginqueue_wait");
+	exotic_add_test(&handle, &exotic_test_loginqueue_process_early, "loginqueue_process_early");
+	exotic_add_test(&handle, &exotic_test_loginqueue_process, "loginqueue_process");
+	exotic_add_test(&handle, &exotic_test_loginqueue_no_overtaking, "loginqueue_no_overtaking");
+	exotic_add_test(&handle, &exotic_test_loginqueue_drain, "loginqueue_drain");
+	exotic_add_test(&handle, &exotic_test_loginqueue_fairness, "loginqueue_fairness");
+	exotic_add_test(&handle, &exotic_test_loginqueue_remove, "loginqueue_remove");
+	exotic_add_test(&handle, &exotic_test_loginqueue_remove_first, "loginqueue_remove_first");
+	exotic_add_test(&handle, &exotic_test_loginqueue_remove_group, "loginqueue_remove_group");
+	exotic_add_test(&handle, &exotic_test_loginqueue_remove_process, "loginqueue_remove_process");
+	exotic_add_test(&handle, &exotic_test_loginqueue_max_queued, "loginqueue_max_queued");
+	exotic_add_test(&handle, &exotic_test_loginqueue_max_queued_stats, "loginqueue_max_queued_stats");
+	exotic_add_test(&handle, &exotic_test_loginqueue_rate_off, "loginqueue_rate_off");
+	exotic_add_test(&handle, &exotic_test_loginqueue_wait_stats, "loginqueue_wait_stats");
+	exotic_add_test(&handle, &exotic_test_loginqueue_destroy, "loginqueue_destroy");
+	exotic_add_test(&handle, &exotic_test_log_ring_order, "log_ring_order");
+	exotic_add_test(&handle, &exotic_test_log_ring_drop, "log_ring_drop");
+	exotic_add_test(&handle, &exotic_test_log_ring_threads, "log_ring_threads");
+	exotic_add_test(&handle, &exotic_test_log_enabled, "log_enabled");
 	exotic_add_test(&handle, &exotic_test_test_message_refc_1, "test_message_refc_1");
 	exotic_add_test(&handle, &exotic_test_test_message_refc_2, "test_message_refc_2");
 	exotic_add_test(&handle, &exotic_test_test_message_refc_3, "test_message_refc_3");
@@ -734,6 +865,46 @@ int main(int argc, char** argv)
 	exotic_add_test(&handle, &exotic_test_utf8_valid_38, "utf8_valid_38");
 	exotic_add_test(&handle, &exotic_test_utf8_valid_39, "utf8_valid_39");
 	exotic_add_test(&handle, &exotic_test_utf8_valid_40, "utf8_valid_40");
+	exotic_add_test(&handle, &exotic_test_mux1_setup, "mux1_setup");
+	exotic_add_test(&handle, &exotic_test_mux1_unicast_batch, "mux1_unicast_batch");
+	exotic_add_test(&handle, &exotic_test_mux1_multicast_fold, "mux1_multicast_fold");
+	exotic_add_test(&handle, &exotic_test_mux1_multicast_extend, "mux1_multicast_extend");
+	exotic_add_test(&handle, &exotic_test_mux1_feature_cast, "mux1_feature_cast");
+	exotic_add_test(&handle, &exotic_test_mux1_multicast_only_record, "mux1_multicast_only_record");
+	exotic_add_test(&handle, &exotic_test_mux1_parse_hello_partial, "mux1_parse_hello_partial");
+	exotic_add_test(&handle, &exotic_test_mux1_parse_hello_bad, "mux1_parse_hello_bad");
+	exotic_add_test(&handle, &exotic_test_mux1_parse_frames, "mux1_parse_frames");
+	exotic_add_test(&handle, &exotic_test_mux1_parse_frame_too_big, "mux1_parse_frame_too_big");
+	exotic_add_test(&handle, &exotic_test_mux1_parse_frame_empty, "mux1_parse_frame_empty");
+	exotic_add_test(&handle, &exotic_test_mux1_charge_setup, "mux1_charge_setup");
+	exotic_add_test(&handle, &exotic_test_mux1_charge_congested, "mux1_charge_congested");
+	exotic_add_test(&handle, &exotic_test_mux1_credit_foreign_user, "mux1_credit_foreign_user");
+	exotic_add_test(&handle, &exotic_test_mux1_credit_bad_length, "mux1_credit_bad_length");
+	exotic_add_test(&handle, &exotic_test_mux1_soft_limit_low_priority, "mux1_soft_limit_low_priority");
+	exotic_add_test(&handle, &exotic_test_mux1_charge_large_message, "mux1_charge_large_message");
+	exotic_add_test(&handle, &exotic_test_mux1_cleanup, "mux1_cleanup");
+	exotic_add_test(&handle, &exotic_test_plugin_async_setup, "plugin_async_setup");
+	exotic_add_test(&handle, &exotic_test_plugin_async_login_found, "plugin_async_login_found");
+	exotic_add_test(&handle, &exotic_test_plugin_async_login_failed, "plugin_async_login_failed");
+	exotic_add_test(&handle, &exotic_test_plugin_async_login_disconnecting, "plugin_async_login_disconnecting");
+	exotic_add_test(&handle, &exotic_test_plugin_async_login_destroyed, "plugin_async_login_destroyed");
+	exotic_add_test(&handle, &exotic_test_plugin_async_defer_not_offered, "plugin_async_defer_not_offered");
+	exotic_add_test(&handle, &exotic_test_plugin_async_shutdown, "plugin_async_shutdown");
+	exotic_add_test(&handle, &exotic_test_plugin_hooks_setup, "plugin_hooks_setup");
+	exotic_add_test(&handle, &exotic_test_plugin_hooks_entries, "plugin_hooks_entries");
+	exotic_add_test(&handle, &exotic_test_plugin_hooks_used, "plugin_hooks_used");
+	exotic_add_test(&handle, &exotic_test_plugin_hooks_invoke_status, "plugin_hooks_invoke_status");
+	exotic_add_test(&handle, &exotic_test_plugin_hooks_invoke, "plugin_hooks_invoke");
+	exotic_add_test(&handle, &exotic_test_plugin_hooks_counters, "plugin_hooks_counters");
+	exotic_add_test(&handle, &exotic_test_plugin_hooks_unused, "plugin_hooks_unused");
+	exotic_add_test(&handle, &exotic_test_plugin_hooks_names, "plugin_hooks_names");
+	exotic_add_test(&handle, &exotic_test_plugin_hooks_unload, "plugin_hooks_unload");
+	exotic_add_test(&handle, &exotic_test_message_view_init, "message_view_init");
+	exotic_add_test(&handle, &exotic_test_message_view_argument, "message_view_argument");
+	exotic_add_test(&handle, &exotic_test_message_view_named_argument, "message_view_named_argument");
+	exotic_add_test(&handle, &exotic_test_message_view_text, "message_view_text");
+	exotic_add_test(&handle, &exotic_test_message_view_free, "message_view_free");
+	exotic_add_test(&handle, &exotic_test_message_view_no_arguments, "message_view_no_arguments");
 	exotic_add_test(&handle, &exotic_test_rbtree_create_destroy, "rbtree_create_destroy");
 	exotic_add_test(&handle, &exotic_test_rbtree_create_1, "rbtree_create_1");
 	exotic_add_test(&handle, &exotic_test_rbtree_size_0, "rbtree_size_0");
@@ -762,6 +933,14 @@ int main(int argc, char** argv)
 	exotic_add_test(&handle, &exotic_test_rbtree_iterate_10000, "rbtree_iterate_10000");
 	exotic_add_test(&handle, &exotic_test_rbtree_remove_10000, "rbtree_remove_10000");
 	exotic_add_test(&handle, &exotic_test_rbtree_destroy_1, "rbtree_destroy_1");
+	exotic_add_test(&handle, &exotic_test_shm_link_setup, "shm_link_setup");
+	exotic_add_test(&handle, &exotic_test_shm_link_size, "shm_link_size");
+	exotic_add_test(&handle, &exotic_test_shm_link_both_ways, "shm_link_both_ways");
+	exotic_add_test(&handle, &exotic_test_shm_link_signal_reader, "shm_link_signal_reader");
+	exotic_add_test(&handle, &exotic_test_shm_link_full, "shm_link_full");
+	exotic_add_test(&handle, &exotic_test_shm_link_wrap, "shm_link_wrap");
+	exotic_add_test(&handle, &exotic_test_shm_link_attach_invalid, "shm_link_attach_invalid");
+	exotic_add_test(&handle, &exotic_test_shm_link_shutdown, "shm_link_shutdown");
 	exotic_add_test(&handle, &exotic_test_sid_create_pool, "sid_create_pool");
 	exotic_add_test(&handle, &exotic_test_sid_check_0a, "sid_check_0a");
 	exotic_add_test(&handle, &exotic_test_sid_check_0b, "sid_check_0b");
@@ -799,6 +978,16 @@ int main(int argc, char** argv)
 	exotic_add_test(&handle, &exotic_test_timer_add_5_events_1, "timer_add_5_events_1");
 	exotic_add_test(&handle, &exotic_test_timer_check_5_events_1, "timer_check_5_events_1");
 	exotic_add_test(&handle, &exotic_test_timer_process_5_events_1, "timer_process_5_events_1");
+	exotic_add_test(&handle, &exotic_test_timer_check_timeout_3, "timer_check_timeout_3");
+	exotic_add_test(&handle, &exotic_test_timer_add_ms_events, "timer_add_ms_events");
+	exotic_add_test(&handle, &exotic_test_timer_process_ms_events_1, "timer_process_ms_events_1");
+	exotic_add_test(&handle, &exotic_test_timer_process_ms_events_2, "timer_process_ms_events_2");
+	exotic_add_test(&handle, &exotic_test_timer_process_ms_events_3, "timer_process_ms_events_3");
+	exotic_add_test(&handle, &exotic_test_timer_process_ms_events_4, "timer_process_ms_events_4");
+	exotic_add_test(&handle, &exotic_test_timer_long_timeouts, "timer_long_timeouts");
+	exotic_add_test(&handle, &exotic_test_timer_reschedule_from_callback, "timer_reschedule_from_callback");
+	exotic_add_test(&handle, &exotic_test_timer_stress_setup, "timer_stress_setup");
+	exotic_add_test(&handle, &exotic_test_timer_stress_process, "timer_stress_process");
 	exotic_add_test(&handle, &exotic_test_timer_shutdown, "timer_shutdown");
 	exotic_add_test(&handle, &exotic_test_tokenizer_basic_0, "tokenizer_basic_0");
 	exotic_add_test(&handle, &exotic_test_tokenizer_basic_1, "tokenizer_basic_1");
@@ -851,7 +1040,27 @@ int main(int argc, char** argv)
 	exotic_add_test(&handle, &exotic_test_um_add_2, "um_add_2");
 	exotic_add_test(&handle, &exotic_test_um_size_3, "um_size_3");
 	exotic_add_test(&handle, &exotic_test_um_remove_2, "um_remove_2");
+	exotic_add_test(&handle, &exotic_test_um_size_4, "um_size_4");
+	exotic_add_test(&handle, &exotic_test_um_add_3, "um_add_3");
+	exotic_add_test(&handle, &exotic_test_um_remove_middle, "um_remove_middle");
+	exotic_add_test(&handle, &exotic_test_um_remove_twice, "um_remove_twice");
+	exotic_add_test(&handle, &exotic_test_um_foreach_1, "um_foreach_1");
+	exotic_add_test(&handle, &exotic_test_um_remove_3, "um_remove_3");
+	exotic_add_test(&handle, &exotic_test_um_lookup_1, "um_lookup_1");
+	exotic_add_test(&handle, &exotic_test_um_lookup_case, "um_lookup_case");
+	exotic_add_test(&handle, &exotic_test_um_lookup_id, "um_lookup_id");
+	exotic_add_test(&handle, &exotic_test_um_lookup_removed, "um_lookup_removed");
+	exotic_add_test(&handle, &exotic_test_um_mass_disconnect, "um_mass_disconnect");
+	exotic_add_test(&handle, &exotic_test_um_get_user_by_addr, "um_get_user_by_addr");
+	exotic_add_test(&handle, &exotic_test_um_plugin_user_layout, "um_plugin_user_layout");
 	exotic_add_test(&handle, &exotic_test_um_shutdown_4, "um_shutdown_4");
+	exotic_add_test(&handle, &exotic_test_zlif_create, "zlif_create");
+	exotic_add_test(&handle, &exotic_test_zlif_compress_one, "zlif_compress_one");
+	exotic_add_test(&handle, &exotic_test_zlif_compress_many, "zlif_compress_many");
+	exotic_add_test(&handle, &exotic_test_zlif_compress_empty, "zlif_compress_empty");
+	exotic_add_test(&handle, &exotic_test_zlif_pool_reused, "zlif_pool_reused");
+	exotic_add_test(&handle, &exotic_test_zlif_sent, "zlif_sent");
+	exotic_add_test(&handle, &exotic_test_zlif_destroy, "zlif_destroy");
 
 	return exotic_run(&handle);
 }
@@ -0,0 +1,77 @@
+#include <uhub.h>
+
+#define ACL_TEST_FILE "test_acl.conf"
+#define ACL_CID_A "AAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAA"
+#define ACL_CID_B "BBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBQ"
+
+static struct hub_config acl_config;
+static struct acl_handle acl;
+
+static int acl_cid_banned(const char* cid)
+{
+	unsigned char raw[TIGERSIZE];
+	return uman_cid_decode(cid, raw) && acl_is_cid_banned(&acl, raw);
+}
+
+static int acl_ip_banned(const char* address)
+{
+	struct ip_addr_encap addr;
+	ip_convert_to_binary(address, &addr);
+	return acl_is_ip_banned(&acl, &addr);
+}
+
+EXO_TEST(acl_setup, {
+	FILE* fp = fopen(ACL_TEST_FILE, "w");
+	if (!fp)
+		return 0;
+	fprintf(fp, "ban_nick Evil\nban_nick evil\ndeny_nick Admin\n");
+	fprintf(fp, "ban_cid %s\nban_cid not-a-cid\ndeny_ip 10.0.0.0/8\n", "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa");
+	fclose(fp);
+
+	config_defaults(&acl_config);
+	hub_free(acl_config.file_acl);
+	acl_config.file_acl = hub_strdup(ACL_TEST_FILE);
+	return acl_initialize(&acl_config, &acl) == 0;
+});
+
+EXO_TEST(acl_nick_banned, {
+	return acl_is_user_banned(&acl, "EVIL") && acl_is_user_banned(&acl, "evil") && !acl_is_user_banned(&acl, "evil2") &&
+		list_size(acl.users_banned) == 1;
+});
+
+EXO_TEST(acl_nick_denied, {
+	return acl_is_user_denied(&acl, "admin") && !acl_is_user_banned(&acl, "admin") && !acl_is_user_denied(&acl, "evil");
+});
+
+EXO_TEST(acl_cid_banned, {
+	return acl_cid_banned(ACL_CID_A) && !acl_cid_banned(ACL_CID_B) && list_size(acl.cids) == 1;
+});
+
+EXO_TEST(acl_ip_banned, {
+	return acl_ip_banned("10.1.2.3") && !acl_ip_banned("11.1.2.3");
+});
+
+EXO_TEST(acl_ban_nick, {
+	return acl_user_ban_nick(&acl, "Troll") == 0 && acl_is_user_banned(&acl, "troll") && acl_user_ban_nick(&acl, "TROLL") == 0 &&
+		list_size(acl.users_banned) == 2;
+});
+
+EXO_TEST(acl_unban_nick, {
+	return acl_user_unban_nick(&acl, "tRoLl") == 0 && !acl_is_user_banned(&acl, "Troll") && acl_user_unban_nick(&acl, "Troll") == -1 &&
+		acl_is_user_banned(&acl, "evil") && list_size(acl.users_banned) == 1;
+});
+
+EXO_TEST(acl_ban_cid, {
+	return acl_user_ban_cid(&acl, ACL_CID_B) == 0 && acl_cid_banned(ACL_CID_B) && acl_user_ban_cid(&acl, "short") == -1;
+});
+
+EXO_TEST(acl_unban_cid, {
+	return acl_user_unban_cid(&acl, "bbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbbq") == 0 && !acl_cid_banned(ACL_CID_B) &&
+		acl_user_unban_cid(&acl, ACL_CID_B) == -1 && acl_cid_banned(ACL_CID_A);
+});
+
+EXO_TEST(acl_shutdown, {
+	acl_shutdown(&acl);
+	free_config(&acl_config);
+	return remove(ACL_TEST_FILE) == 0;
+});
@@ -0,0 +1,210 @@
+#include <uhub.h>
+
+static struct hub_admission* adm = NULL;
+static struct admission_limits adm_limits;
+static struct admission_stats adm_stats;
+static struct ip_addr_encap adm_ip4_a;
+static struct ip_addr_encap adm_ip4_b;
+static struct ip_addr_encap adm_ip4_mapped;
+static struct ip_addr_encap adm_ip6_a;
+static struct ip_addr_encap adm_ip6_b;
+static struct ip_addr_encap adm_ip6_c;
+
+static void adm_set_limits(size_t conns4, size_t conns6, size_t rate, size_t burst)
+{
+	adm_limits.max_conns_ipv4 = conns4;
+	adm_limits.max_conns_ipv6 = conns6;
+	adm_limits.rate = rate;
+	adm_limits.burst = burst;
+}
+
+static int adm_accept_n(struct ip_addr_encap* addr, int n, uint64_t now)
+{
+	int accepted = 0;
+	for (; n > 0; n--)
+	{
+		if (admission_accept(adm, addr, &adm_limits, now) == 1)
+			accepted++;
+	}
+	return accepted;
+}
+
+static size_t adm_hosts()
+{
+	admission_get_stats(adm, &adm_stats);
+	return adm_stats.hosts;
+}
+
+EXO_TEST(admission_create, {
+	adm = admission_create(64);
+	return adm != NULL;
+});
+
+EXO_TEST(admission_addresses, {
+	return
+		ip_convert_to_binary("10.0.0.1", &adm_ip4_a) &&
+		ip_convert_to_binary("10.0.0.2", &adm_ip4_b) &&
+		ip_convert_to_binary("::ffff:10.0.0.1", &adm_ip4_mapped) &&
+		ip_convert_to_binary("2001:db8:0:1::1", &adm_ip6_a) &&
+		ip_convert_to_binary("2001:db8:0:1:ffff::2", &adm_ip6_b) &&
+		ip_convert_to_binary("2001:db8:0:2::1", &adm_ip6_c);
+});
+
+EXO_TEST(admission_off, {
+	adm_set_limits(0, 0, 0, 10);
+	return admission_accept(adm, &adm_ip4_a, &adm_limits, 0) == 0 && adm_hosts() == 0;
+});
+
+EXO_TEST(admission_conns_ipv4_1, {
+	adm_set_limits(3, 0, 0, 10);
+	return adm_accept_n(&adm_ip4_a, 5, 0) == 3;
+});
+
+EXO_TEST(admission_conns_ipv4_2, {
+	return admission_accept(adm, &adm_ip4_b, &adm_limits, 0) == 1 && adm_hosts() == 2;
+});
+
+EXO_TEST(admission_conns_ipv4_mapped, {
+	return admission_accept(adm, &adm_ip4_mapped, &adm_limits, 0) == -1;
+});
+
+EXO_TEST(admission_conns_release, {
+	admission_release(adm, &adm_ip4_mapped);
+	return admission_accept(adm, &adm_ip4_a, &adm_limits, 0) == 1 && admission_accept(adm, &adm_ip4_a, &adm_limits, 0) == -1;
+});
+
+EXO_TEST(admission_conns_stats, {
+	admission_get_stats(adm, &adm_stats);
+	return adm_stats.accepted == 5 && adm_stats.rejected_conns == 4 && adm_stats.rejected_rate == 0;
+});
+
+EXO_TEST(admission_expire_busy, {
+	admission_expire(adm, &adm_limits, 0);
+	return adm_hosts() == 2;
+});
+
+EXO_TEST(admission_expire_idle, {
+	admission_release(adm, &adm_ip4_a);
+	admission_release(adm, &adm_ip4_a);
+	admission_release(adm, &adm_ip4_a);
+	admission_release(adm, &adm_ip4_b);
+	admission_expire(adm, &adm_limits, 0);
+	return adm_hosts() == 0;
+});
+
+EXO_TEST(admission_conns_ipv6_prefix, {
+	adm_set_limits(0, 2, 0, 10);
+	return
+		admission_accept(adm, &adm_ip6_a, &adm_limits, 0) == 1 &&
+		admission_accept(adm, &adm_ip6_b, &adm_limits, 0) == 1 &&
+		admission_accept(adm, &adm_ip6_a, &adm_limits, 0) == -1 &&
+		admission_accept(adm, &adm_ip6_c, &adm_limits, 0) == 1;
+});
+
+EXO_TEST(admission_conns_ipv6_v4_off, {
+	return admission_accept(adm, &adm_ip4_a, &adm_limits, 0) == 0;
+});
+
+EXO_TEST(admission_conns_ipv6_release, {
+	admission_release(adm, &adm_ip6_b);
+	admission_release(adm, &adm_ip6_a);
+	admission_release(adm, &adm_ip6_c);
+	admission_expire(adm, &adm_limits, 0);
+	return adm_hosts() == 0;
+});
+
+EXO_TEST(admission_rate_burst, {
+	adm_set_limits(0, 0, 2, 3);
+	return adm_accept_n(&adm_ip4_a, 5, 1000) == 3;
+});
+
+EXO_TEST(admission_rate_refill_1, {
+	return adm_accept_n(&adm_ip4_a, 5, 1499) == 0;
+});
+
+EXO_TEST(admission_rate_refill_2, {
+	return adm_accept_n(&adm_ip4_a, 5, 1500) == 1;
+});
+
+EXO_TEST(admission_rate_refill_3, {
+	return adm_accept_n(&adm_ip4_a, 5, 1000000) == 3;
+});
+
+EXO_TEST(admission_rate_stats, {
+	admission_get_stats(adm, &adm_stats);
+	return adm_stats.rejected_rate == 13;
+});
+
+EXO_TEST(admission_rate_expire_1, {
+	adm_set_limits(0, 0, 2, 3);
+	admission_release(adm, &adm_ip4_a);
+	admission_release(adm, &adm_ip4_a);
+	admission_release(adm, &adm_ip4_a);
+	admission_release(adm, &adm_ip4_a);
+	admission_release(adm, &adm_ip4_a);
+	admission_release(adm, &adm_ip4_a);
+	admission_release(adm, &adm_ip4_a);
+	admission_expire(adm, &adm_limits, 1000000);
+	return adm_hosts() == 1;
+});
+
+EXO_TEST(admission_rate_expire_2, {
+	admission_expire(adm, &adm_limits, 1001500);
+	return adm_hosts() == 0;
+});
+
+static int adm_test_full()
+{
+	struct ip_addr_encap addr;
+	char buf[32];
+	int n;
+	int tracked = 0;
+	int untracked = 0;
+
+	adm_set_limits(1, 0, 0, 10);
+	for (n = 0; n < 100; n++)
+	{
+		snprintf(buf, sizeof(buf), "10.1.%d.%d", n / 10, n % 10);
+		ip_convert_to_binary(buf, &addr);
+		switch (admission_accept(adm, &addr, &adm_limits, 0))
+		{
+			case 1: tracked++; break;
+			case 0: untracked++; break;
+			default: return 0;
+		}
+	}
+
+	admission_get_stats(adm, &adm_stats);
+	if (tracked != 96 || untracked != 4 || adm_stats.untracked != 4 || adm_stats.hosts != 96)
+		return 0;
+
+	/* Every host is still found after removing every other one */
+	for (n = 0; n < 96; n += 2)
+	{
+		snprintf(buf, sizeof(buf), "10.1.%d.%d", n / 10, n % 10);
+		ip_convert_to_binary(buf, &addr);
+		admission_release(adm, &addr);
+	}
+	admission_expire(adm, &adm_limits, 0);
+	if (adm_hosts() != 48)
+		return 0;
+
+	for (n = 0; n < 96; n++)
+	{
+		snprintf(buf, sizeof(buf), "10.1.%d.%d", n / 10, n % 10);
+		ip_convert_to_binary(buf, &addr);
+		if (admission_accept(adm, &addr, &adm_limits, 0) != ((n & 1) ? -1 : 1))
+			return 0;
+	}
+	return 1;
+}
+
+EXO_TEST(admission_full, {
+	return adm_test_full();
+});
+
+EXO_TEST(admission_destroy, {
+	admission_destroy(adm);
+	adm = NULL;
+	return 1;
+});
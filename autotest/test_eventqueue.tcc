@@ -77,6 +77,58 @@ EXO_TEST(eventqueue_size_4, {
 	return event_queue_size(eq) == 0;
 });
 
+static struct event_queue* eq_nested;
+
+static void eq_callback_nested(void* callback_data, struct event_data* event_data)
+{
+	struct event_data message;
+	eq_val += event_data->id;
+
+	/* Re-post while the primary queue is locked */
+	if (event_data->flags)
+	{
+		message.id = event_data->id;
+		message.ptr = 0;
+		message.flags = event_data->flags - 1;
+		event_queue_post(eq_nested, &message);
+	}
+}
+
+EXO_TEST(eventqueue_grow_1, {
+	struct event_data message;
+	int i;
+	eq_val = 0;
+	for (i = 0; i < 1000; i++)
+	{
+		message.id = 1;
+		message.ptr = 0;
+		message.flags = 0;
+		event_queue_post(eq, &message);
+	}
+	return event_queue_size(eq) == 1000 && event_queue_high_water(eq) == 1000;
+});
+
+EXO_TEST(eventqueue_grow_2, {
+	return event_queue_process(eq) == 0 && eq_val == 1000 && event_queue_size(eq) == 0 && event_queue_high_water(eq) == 1000;
+});
+
+EXO_TEST(eventqueue_nested_1, {
+	struct event_data message;
+	eq_val = 0;
+	event_queue_initialize(&eq_nested, eq_callback_nested, 0);
+	message.id = 1;
+	message.ptr = 0;
+	message.flags = 2;
+	event_queue_post(eq_nested, &message);
+	return event_queue_process(eq_nested) == 1 && eq_val == 1 && event_queue_size(eq_nested) == 1;
+});
+
+EXO_TEST(eventqueue_nested_2, {
+	while (event_queue_process(eq_nested));
+	event_queue_shutdown(eq_nested);
+	return eq_val == 3;
+});
+
 EXO_TEST(eventqueue_shutdown_1, {
 	event_queue_shutdown(eq);
 	return 1;
@@ -0,0 +1,130 @@
+#include <uhub.h>
+#include <util/hashtable.h>
+
+#define HT_MAX_NODES 10000
+
+static struct hash_table* htable = NULL;
+static char ht_keys[HT_MAX_NODES][8];
+
+static int test_ht_equals(const void* a, const void* b)
+{
+	return strcmp((const char*) a, (const char*) b) == 0;
+}
+
+static int test_ht_equals_nocase(const void* a, const void* b)
+{
+	return strcasecmp((const char*) a, (const char*) b) == 0;
+}
+
+static uint32_t test_ht_hash(const char* key)
+{
+	return hash_table_hash_string_nocase(key);
+}
+
+static int test_ht_check(const char* key, const char* expect)
+{
+	const char* value = (const char*) hash_table_get(htable, test_ht_hash(key), key);
+	if (!value) return !expect;
+	if (!expect) return 0;
+	return strcmp(value, expect) == 0;
+}
+
+EXO_TEST(hashtable_create_destroy, {
+	struct hash_table* t = hash_table_create(test_ht_equals, 100);
+	int ok = t && t->capacity == 128;
+	hash_table_destroy(t);
+	return ok;
+});
+
+EXO_TEST(hashtable_create_1, {
+	htable = hash_table_create(test_ht_equals, 0);
+	return htable != NULL;
+});
+
+EXO_TEST(hashtable_size_0, { return hash_table_size(htable) == 0; });
+
+EXO_TEST(hashtable_insert_1, { return hash_table_insert(htable, test_ht_hash("one"), "one", "1") == 1; });
+EXO_TEST(hashtable_insert_2, { return hash_table_insert(htable, test_ht_hash("two"), "two", "2") == 1; });
+EXO_TEST(hashtable_insert_3, { return hash_table_insert(htable, test_ht_hash("three"), "three", "3") == 1; });
+EXO_TEST(hashtable_insert_3_again, { return hash_table_insert(htable, test_ht_hash("three"), "three", "3-again") == 0; });
+EXO_TEST(hashtable_insert_case, { return hash_table_insert(htable, test_ht_hash("ONE"), "ONE", "1-upper") == 1; });
+
+EXO_TEST(hashtable_size_1, { return hash_table_size(htable) == 4; });
+
+EXO_TEST(hashtable_get_1, { return test_ht_check("one", "1"); });
+EXO_TEST(hashtable_get_2, { return test_ht_check("two", "2"); });
+EXO_TEST(hashtable_get_3, { return test_ht_check("three", "3"); });
+EXO_TEST(hashtable_get_4, { return test_ht_check("ONE", "1-upper"); });
+EXO_TEST(hashtable_get_5, { return test_ht_check("four", NULL); });
+EXO_TEST(hashtable_get_6, { return test_ht_check("One", NULL); });
+
+EXO_TEST(hashtable_find_nocase_1, {
+	size_t matches = 0;
+	return hash_table_find(htable, test_ht_hash("One"), test_ht_equals_nocase, "One", &matches) && matches == 2;
+});
+
+EXO_TEST(hashtable_find_nocase_2, {
+	size_t matches = 0;
+	const char* value = (const char*) hash_table_find(htable, test_ht_hash("TWO"), test_ht_equals_nocase, "TWO", &matches);
+	return value && !strcmp(value, "2") && matches == 1;
+});
+
+EXO_TEST(hashtable_remove_1, { return hash_table_remove(htable, test_ht_hash("one"), "one") == 1; });
+EXO_TEST(hashtable_remove_1_again, { return hash_table_remove(htable, test_ht_hash("one"), "one") == 0; });
+EXO_TEST(hashtable_get_7, { return test_ht_check("one", NULL) && test_ht_check("ONE", "1-upper"); });
+EXO_TEST(hashtable_remove_2, { return hash_table_remove(htable, test_ht_hash("two"), "two") == 1; });
+EXO_TEST(hashtable_remove_3, { return hash_table_remove(htable, test_ht_hash("three"), "three") == 1; });
+EXO_TEST(hashtable_remove_4, { return hash_table_remove(htable, test_ht_hash("ONE"), "ONE") == 1; });
+EXO_TEST(hashtable_size_2, { return hash_table_size(htable) == 0; });
+
+EXO_TEST(hashtable_insert_10000, {
+	int i;
+	for (i = 0; i < HT_MAX_NODES; i++)
+	{
+		snprintf(ht_keys[i], sizeof(ht_keys[i]), "%d", i);
+		if (hash_table_insert(htable, test_ht_hash(ht_keys[i]), ht_keys[i], &ht_keys[i]) != 1)
+			return 0;
+	}
+	return 1;
+});
+
+EXO_TEST(hashtable_size_3, { return hash_table_size(htable) == HT_MAX_NODES; });
+
+EXO_TEST(hashtable_load_factor, { return hash_table_size(htable) * 2 <= htable->capacity; });
+
+EXO_TEST(hashtable_check_10000, {
+	int i;
+	for (i = 0; i < HT_MAX_NODES; i++)
+	{
+		if (hash_table_get(htable, test_ht_hash(uhub_itoa(i)), uhub_itoa(i)) != &ht_keys[i])
+			return 0;
+	}
+	return 1;
+});
+
+/* Remove every other key, while a resize may still be migrating */
+EXO_TEST(hashtable_remove_10000, {
+	int i;
+	int j;
+	for (j = 0; j < 2; j++)
+	{
+		for (i = j; i < HT_MAX_NODES; i += 2)
+		{
+			if (hash_table_remove(htable, test_ht_hash(ht_keys[i]), ht_keys[i]) != 1)
+				return 0;
+			if (j == 0 && i + 1 < HT_MAX_NODES && hash_table_get(htable, test_ht_hash(ht_keys[i + 1]), ht_keys[i + 1]) != &ht_keys[i + 1])
+				return 0;
+		}
+	}
+	return hash_table_size(htable) == 0 && !htable->old_slots;
+});
+
+EXO_TEST(hashtable_hash_nocase, {
+	return hash_table_hash_string_nocase("Hello World") == hash_table_hash_string_nocase("hELLO wORLD") &&
+	       hash_table_hash_string_nocase("hello") != hash_table_hash_string_nocase("hellp");
+});
+
+EXO_TEST(hashtable_destroy_1, {
+	hash_table_destroy(htable);
+	return 1;
+});
@@ -0,0 +1,119 @@
+#include <uhub.h>
+
+#define IOQ_TEST_BUFSIZE 1024
+#define IOQ_TEST_LIMIT   4096
+
+static struct ioq_recv* g_recvq;
+
+EXO_TEST(ioq_recv_create, {
+	g_recvq = ioq_recv_create(IOQ_TEST_LIMIT);
+	return g_recvq && !g_recvq->buf && ioq_recv_is_empty(g_recvq);
+});
+
+/* Buffers start small, not at the limit */
+EXO_TEST(ioq_recv_reserve_1, {
+	size_t space;
+	char* buf = ioq_recv_reserve(g_recvq, &space);
+	return buf && space == IOQ_TEST_BUFSIZE && g_recvq->buf == buf;
+});
+
+/* Nothing received, the buffer goes back to the pool */
+EXO_TEST(ioq_recv_commit_empty, {
+	ioq_recv_commit(g_recvq, 0);
+	return !g_recvq->buf && ioq_recv_is_empty(g_recvq);
+});
+
+EXO_TEST(ioq_recv_commit_1, {
+	size_t space;
+	size_t size;
+	char* buf = ioq_recv_reserve(g_recvq, &space);
+	memcpy(buf, "HSUP ADBASE\nBINF", 16);
+	ioq_recv_commit(g_recvq, 16);
+	buf = ioq_recv_data(g_recvq, &size);
+	return size == 16 && memcmp(buf, "HSUP", 4) == 0;
+});
+
+/* The unparsed tail stays in place */
+EXO_TEST(ioq_recv_consume_1, {
+	size_t size;
+	char* before = g_recvq->buf;
+	char* buf;
+	ioq_recv_consume(g_recvq, 12);
+	buf = ioq_recv_data(g_recvq, &size);
+	return size == 4 && buf == before + 12 && memcmp(buf, "BINF", 4) == 0;
+});
+
+EXO_TEST(ioq_recv_append_1, {
+	size_t space;
+	size_t size;
+	char* buf = ioq_recv_reserve(g_recvq, &space);
+	if (buf != g_recvq->buf + 16 || space != IOQ_TEST_BUFSIZE - 16)
+		return 0;
+	memcpy(buf, " AAAB\n", 6);
+	ioq_recv_commit(g_recvq, 6);
+	buf = ioq_recv_data(g_recvq, &size);
+	return size == 10 && memcmp(buf, "BINF AAAB\n", 10) == 0;
+});
+
+EXO_TEST(ioq_recv_consume_all, {
+	ioq_recv_consume(g_recvq, 10);
+	return !g_recvq->buf && g_recvq->offset == 0 && ioq_recv_is_empty(g_recvq);
+});
+
+/* The tail is only moved to the start once the buffer fills up */
+EXO_TEST(ioq_recv_compact, {
+	size_t space;
+	size_t size;
+	char* buf = ioq_recv_reserve(g_recvq, &space);
+	memset(buf, 'x', space);
+	memcpy(buf + space - 4, "BMSG", 4);
+	ioq_recv_commit(g_recvq, space);
+	ioq_recv_consume(g_recvq, space - 4);
+	buf = ioq_recv_reserve(g_recvq, &space);
+	if (g_recvq->offset != 0 || space != IOQ_TEST_BUFSIZE - 4 || buf != g_recvq->buf + 4)
+		return 0;
+	buf = ioq_recv_data(g_recvq, &size);
+	return size == 4 && memcmp(buf, "BMSG", 4) == 0;
+});
+
+/* A full buffer doubles in size, keeping the unparsed data */
+EXO_TEST(ioq_recv_grow_1, {
+	size_t space;
+	size_t size;
+	char* buf = ioq_recv_reserve(g_recvq, &space);
+	memset(buf, 'y', space);
+	ioq_recv_commit(g_recvq, space);
+	buf = ioq_recv_reserve(g_recvq, &space);
+	if (g_recvq->capacity != 2 * IOQ_TEST_BUFSIZE || space != IOQ_TEST_BUFSIZE)
+		return 0;
+	buf = ioq_recv_data(g_recvq, &size);
+	return size == IOQ_TEST_BUFSIZE && memcmp(buf, "BMSG", 4) == 0 && buf[size - 1] == 'y';
+});
+
+/* ... but never past the limit of the queue */
+EXO_TEST(ioq_recv_grow_limit, {
+	size_t space;
+	char* buf;
+	int n;
+	for (n = 0; n < 3; n++)
+	{
+		buf = ioq_recv_reserve(g_recvq, &space);
+		if (!buf)
+			return 0;
+		memset(buf, 'z', space);
+		ioq_recv_commit(g_recvq, space);
+	}
+	buf = ioq_recv_reserve(g_recvq, &space);
+	return buf && space == 0 && g_recvq->capacity == IOQ_TEST_LIMIT && g_recvq->size == IOQ_TEST_LIMIT;
+});
+
+EXO_TEST(ioq_recv_clear, {
+	ioq_recv_clear(g_recvq);
+	return !g_recvq->buf && !g_recvq->capacity && ioq_recv_is_empty(g_recvq);
+});
+
+EXO_TEST(ioq_recv_destroy, {
+	ioq_recv_destroy(g_recvq);
+	ioq_recv_pool_shutdown();
+	return 1;
+});
@@ -624,6 +624,149 @@ EXO_TEST(ip_range_4, {
 	return ip_convert_address_to_range("192.168.0.0/16", &range1) && ip_convert_address_to_range("192.168.0.0-192.168.255.255", &range2) && memcmp(&range1, &range2, sizeof(struct ip_range)) == 0;
 });
 
+/* Radix trie */
+static struct ip_trie* trie;
+static int trie_value[4];
+static struct ip_range trie_range[4];
+static size_t trie_visited;
+
+static void* trie_lookup(const char* address)
+{
+	struct ip_addr_encap addr;
+	ip_convert_to_binary(address, &addr);
+	return ip_trie_lookup(trie, &addr);
+}
+
+static void trie_visit(void* ptr, void* value)
+{
+	trie_visited++;
+}
+
+EXO_TEST(ip_trie_create, {
+	trie = ip_trie_create();
+	return trie && !trie_lookup("10.0.0.1") && ip_trie_count(trie) == 0;
+});
+
+EXO_TEST(ip_trie_insert_cidr, {
+	return ip_convert_address_to_range("192.168.0.0/16", &trie_range[0]) && ip_trie_insert(trie, &trie_range[0], &trie_value[0]);
+});
+
+EXO_TEST(ip_trie_lookup_cidr, {
+	return trie_lookup("192.168.0.0") == &trie_value[0] && trie_lookup("192.168.255.255") == &trie_value[0] &&
+		!trie_lookup("192.167.255.255") && !trie_lookup("192.169.0.0");
+});
+
+EXO_TEST(ip_trie_narrowest, {
+	return ip_convert_address_to_range("192.168.1.0/24", &trie_range[1]) && ip_trie_insert(trie, &trie_range[1], &trie_value[1]) &&
+		trie_lookup("192.168.1.77") == &trie_value[1] && trie_lookup("192.168.2.77") == &trie_value[0];
+});
+
+EXO_TEST(ip_trie_insert_range, {
+	return ip_convert_address_to_range("10.0.0.3-10.0.1.12", &trie_range[2]) && ip_trie_insert(trie, &trie_range[2], &trie_value[2]);
+});
+
+EXO_TEST(ip_trie_lookup_range, {
+	return trie_lookup("10.0.0.3") == &trie_value[2] && trie_lookup("10.0.0.200") == &trie_value[2] && trie_lookup("10.0.1.12") == &trie_value[2] &&
+		!trie_lookup("10.0.0.2") && !trie_lookup("10.0.1.13") && ip_trie_count(trie) == 3;
+});
+
+EXO_TEST(ip_trie_insert_ipv6, {
+	return ip_convert_address_to_range("2001::201:2ff:fefa:0-2001::201:2ff:fefa:ffff", &trie_range[3]) && ip_trie_insert(trie, &trie_range[3], &trie_value[3]);
+});
+
+EXO_TEST(ip_trie_lookup_ipv6, {
+	return trie_lookup("2001::201:2ff:fefa:fffe") == &trie_value[3] && !trie_lookup("2001::201:2ff:fefb:0") && !trie_lookup("2001::1");
+});
+
+EXO_TEST(ip_trie_lookup_mapped, {
+	struct ip_addr_encap addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.af = AF_INET6;
+	addr.internal_ip_data.in6.s6_addr[10] = 0xff;
+	addr.internal_ip_data.in6.s6_addr[11] = 0xff;
+	addr.internal_ip_data.in6.s6_addr[12] = 192;
+	addr.internal_ip_data.in6.s6_addr[13] = 168;
+	addr.internal_ip_data.in6.s6_addr[14] = 1;
+	addr.internal_ip_data.in6.s6_addr[15] = 1;
+	return ip_trie_lookup(trie, &addr) == &trie_value[1];
+});
+
+EXO_TEST(ip_trie_find, {
+	struct ip_range range;
+	trie_visited = 0;
+	return ip_convert_address_to_range("192.168.0.0/16", &range) && ip_trie_find(trie, &range, trie_visit, NULL) == 2 && trie_visited == 2;
+});
+
+EXO_TEST(ip_trie_find_outside, {
+	struct ip_range range;
+	return ip_convert_address_to_range("192.168.1.0/25", &range) && ip_trie_find(trie, &range, trie_visit, NULL) == 0;
+});
+
+EXO_TEST(ip_trie_invalid, {
+	struct ip_range range;
+	ip_convert_to_binary("10.0.0.9", &range.lo);
+	ip_convert_to_binary("10.0.0.1", &range.hi);
+	return !ip_trie_insert(trie, &range, &trie_value[0]) && ip_trie_count(trie) == 4;
+});
+
+EXO_TEST(ip_trie_remove, {
+	return ip_trie_remove(trie, &trie_range[1], &trie_value[1]) && !ip_trie_remove(trie, &trie_range[1], &trie_value[1]) &&
+		trie_lookup("192.168.1.77") == &trie_value[0];
+});
+
+EXO_TEST(ip_trie_remove_range, {
+	return ip_trie_remove(trie, &trie_range[2], &trie_value[2]) && !trie_lookup("10.0.0.200") && ip_trie_count(trie) == 2;
+});
+
+EXO_TEST(ip_trie_remove_all, {
+	int ok = ip_trie_remove(trie, &trie_range[0], &trie_value[0]) && ip_trie_remove(trie, &trie_range[3], &trie_value[3]);
+	return ok && !trie_lookup("192.168.1.77") && !trie_lookup("2001::201:2ff:fefa:1") && ip_trie_count(trie) == 0;
+});
+
+EXO_TEST(ip_trie_same_address, {
+	struct ip_range range;
+	int ok;
+	ip_convert_address_to_range("10.1.2.3", &range);
+	ok = ip_trie_insert(trie, &range, &trie_value[0]) && ip_trie_insert(trie, &range, &trie_value[1]);
+	trie_visited = 0;
+	ok = ok && ip_trie_find(trie, &range, trie_visit, NULL) == 2;
+	ok = ok && ip_trie_remove(trie, &range, &trie_value[0]) && trie_lookup("10.1.2.3") == &trie_value[1];
+	return ok && ip_trie_remove(trie, &range, &trie_value[1]) && !trie_lookup("10.1.2.3");
+});
+
+static int trie_test_many()
+{
+	struct ip_range range;
+	char buf[32];
+	int n, ok = 1;
+	for (n = 0; n < 1000; n++)
+	{
+		snprintf(buf, sizeof(buf), "10.%d.%d.0/24", n / 256, n % 256);
+		ok &= ip_convert_address_to_range(buf, &range) && ip_trie_insert(trie, &range, &trie_value[n % 4]);
+	}
+	ok &= trie_lookup("10.3.231.1") == &trie_value[999 % 4] && !trie_lookup("10.3.232.1");
+	for (n = 0; n < 1000; n++)
+	{
+		snprintf(buf, sizeof(buf), "10.%d.%d.0/24", n / 256, n % 256);
+		ok &= ip_convert_address_to_range(buf, &range) && ip_trie_remove(trie, &range, &trie_value[n % 4]);
+	}
+	return ok && ip_trie_count(trie) == 0 && !trie_lookup("10.0.0.1");
+}
+
+EXO_TEST(ip_trie_many, { return trie_test_many(); });
+
+EXO_TEST(ip_trie_everything, {
+	struct ip_range range;
+	int ok = ip_convert_address_to_range("0.0.0.0-255.255.255.255", &range) && ip_trie_insert(trie, &range, &trie_value[0]);
+	ok = ok && trie_lookup("0.0.0.0") == &trie_value[0] && trie_lookup("255.255.255.255") == &trie_value[0] && !trie_lookup("2001::1");
+	return ok && ip_trie_remove(trie, &range, &trie_value[0]) && ip_trie_count(trie) == 0;
+});
+
+EXO_TEST(ip_trie_destroy, {
+	ip_trie_destroy(trie);
+	return 1;
+});
+
 
 EXO_TEST(shutdown_network, {
     return net_destroy() == 0;
@@ -0,0 +1,185 @@
+#include <uhub.h>
+
+#define LQ_USERS 8
+
+static struct login_queue* lq = NULL;
+static struct login_limits lq_limits;
+static struct login_queue_stats lq_stats;
+static struct hub_user* lq_user[LQ_USERS];
+static struct hub_user* lq_order[LQ_USERS];
+static size_t lq_admitted = 0;
+
+static void lq_callback(void* ptr, struct hub_user* user)
+{
+	(void) ptr;
+	if (lq_admitted < LQ_USERS)
+		lq_order[lq_admitted] = user;
+	lq_admitted++;
+}
+
+static void lq_set_limits(size_t rate, size_t burst, size_t max_queued)
+{
+	lq_limits.rate = rate;
+	lq_limits.burst = burst;
+	lq_limits.max_queued = max_queued;
+}
+
+static int lq_create_users()
+{
+	/* Users 0-3 are on one /24, 4 and 5 on another, 6 and 7 on a third */
+	static const char* addrs[LQ_USERS] = { "10.0.0.1", "10.0.0.2", "10.0.0.3", "::ffff:10.0.0.4", "10.0.1.1", "10.0.1.2", "2001:db8:1:2::1", "2001:db8:1:ffff::1" };
+	int i;
+	for (i = 0; i < LQ_USERS; i++)
+	{
+		lq_user[i] = hub_malloc_zero(sizeof(struct hub_user));
+		if (!lq_user[i] || !ip_convert_to_binary(addrs[i], &lq_user[i]->id.addr))
+			return 0;
+	}
+	return 1;
+}
+
+static int lq_enter(int i, uint64_t now)
+{
+	return login_queue_enter(lq, lq_user[i], &lq_limits, now);
+}
+
+static size_t lq_queued()
+{
+	login_queue_get_stats(lq, &lq_stats);
+	return lq_stats.queued;
+}
+
+EXO_TEST(loginqueue_create, {
+	lq = login_queue_create(lq_callback, NULL);
+	return lq != NULL && lq_create_users();
+});
+
+EXO_TEST(loginqueue_off, {
+	lq_set_limits(0, 1, 0);
+	return lq_enter(0, 0) == 1 && lq_enter(1, 0) == 1 && lq_admitted == 2 && lq_queued() == 0;
+});
+
+EXO_TEST(loginqueue_burst, {
+	lq_admitted = 0;
+	lq_set_limits(2, 2, 0);
+	return lq_enter(0, 1000) == 1 && lq_enter(1, 1000) == 1 && lq_admitted == 2;
+});
+
+EXO_TEST(loginqueue_wait, {
+	return lq_enter(2, 1000) == 0 && lq_user[2]->login_group != NULL && lq_queued() == 1;
+});
+
+EXO_TEST(loginqueue_process_early, {
+	return login_queue_process(lq, &lq_limits, 1100) == 400 && lq_admitted == 2;
+});
+
+EXO_TEST(loginqueue_process, {
+	return login_queue_process(lq, &lq_limits, 1500) == 0 && lq_admitted == 3 && lq_order[2] == lq_user[2] && lq_user[2]->login_group == NULL;
+});
+
+EXO_TEST(loginqueue_no_overtaking, {
+	/* A token is available, but someone else is already waiting */
+	lq_admitted = 0;
+	lq_set_limits(1, 1, 0);
+	return lq_enter(0, 100000) == 1 && lq_enter(1, 100000) == 0 && lq_enter(2, 101000) == 0 && lq_admitted == 1;
+});
+
+EXO_TEST(loginqueue_drain, {
+	return login_queue_process(lq, &lq_limits, 101000) == 1000 && login_queue_process(lq, &lq_limits, 102000) == 0 && lq_admitted == 3 && lq_queued() == 0;
+});
+
+static int lq_test_fairness()
+{
+	int i;
+
+	/* Users 0-3 queue up first, but the other networks take turns with them */
+	lq_admitted = 0;
+	lq_set_limits(1, 1, 0);
+	if (lq_enter(0, 200000) != 1)
+		return 0;
+	for (i = 1; i < LQ_USERS; i++)
+	{
+		if (lq_enter(i, 200000) != 0)
+			return 0;
+	}
+
+	/* Without a rate limit, everyone waiting is let in at once */
+	lq_set_limits(0, 1, 0);
+	if (lq_queued() != 7 || login_queue_process(lq, &lq_limits, 300000) != 0 || lq_admitted != LQ_USERS)
+		return 0;
+
+	return
+		lq_order[1] == lq_user[1] &&
+		lq_order[2] == lq_user[4] &&
+		lq_order[3] == lq_user[6] &&
+		lq_order[4] == lq_user[2] &&
+		lq_order[5] == lq_user[5] &&
+		lq_order[6] == lq_user[7] &&
+		lq_order[7] == lq_user[3];
+}
+
+EXO_TEST(loginqueue_fairness, {
+	return lq_test_fairness();
+});
+
+EXO_TEST(loginqueue_remove, {
+	lq_admitted = 0;
+	lq_set_limits(1, 1, 0);
+	return lq_enter(0, 400000) == 1 && lq_enter(1, 400000) == 0 && lq_enter(2, 400000) == 0 && lq_enter(4, 400000) == 0;
+});
+
+EXO_TEST(loginqueue_remove_first, {
+	login_queue_remove(lq, lq_user[1]);
+	return lq_user[1]->login_group == NULL && lq_queued() == 2;
+});
+
+EXO_TEST(loginqueue_remove_group, {
+	login_queue_remove(lq, lq_user[4]);
+	login_queue_remove(lq, lq_user[4]);
+	return lq_queued() == 1;
+});
+
+EXO_TEST(loginqueue_remove_process, {
+	return login_queue_process(lq, &lq_limits, 500000) == 0 && lq_admitted == 2 && lq_order[1] == lq_user[2];
+});
+
+EXO_TEST(loginqueue_max_queued, {
+	lq_admitted = 0;
+	lq_set_limits(1, 1, 2);
+	return lq_enter(0, 600000) == 1 && lq_enter(1, 600000) == 0 && lq_enter(4, 600000) == 0 && lq_enter(6, 600000) == -1 && lq_user[6]->login_group == NULL;
+});
+
+EXO_TEST(loginqueue_max_queued_stats, {
+	login_queue_get_stats(lq, &lq_stats);
+	return lq_stats.queued == 2 && lq_stats.queued_peak == 7 && lq_stats.rejected == 1;
+});
+
+EXO_TEST(loginqueue_rate_off, {
+	lq_set_limits(0, 1, 0);
+	return login_queue_process(lq, &lq_limits, 600001) == 0 && lq_admitted == 3 && lq_queued() == 0;
+});
+
+EXO_TEST(loginqueue_wait_stats, {
+	login_queue_get_stats(lq, &lq_stats);
+	return lq_stats.waited == 13 && lq_stats.wait_max == 100000 && lq_stats.logins == 21 && lq_stats.wait_p50 == 500 && lq_stats.wait_p90 == 100000 && lq_stats.wait_p99 == 100000;
+});
+
+static int lq_test_destroy()
+{
+	int i;
+
+	/* Users still waiting are forgotten */
+	lq_set_limits(1, 1, 0);
+	lq_enter(0, 700000);
+	lq_enter(1, 700000);
+	login_queue_destroy(lq);
+	lq = NULL;
+
+	for (i = 0; i < LQ_USERS; i++)
+		hub_free(lq_user[i]);
+	return 1;
+}
+
+EXO_TEST(loginqueue_destroy, {
+	return lq_test_destroy();
+});
@@ -0,0 +1,136 @@
+#include <uhub.h>
+
+static uhub_mutex_t g_lr_gate;          /* Held to keep the writer inside a batch */
+static int g_lr_entered;
+static char g_lr_text[256];
+static size_t g_lr_count;
+static size_t g_lr_batches;
+static size_t g_lr_dropped;
+static int g_lr_levels_ok = 1;
+
+static void lr_write(void* ptr, struct log_ring_entry* entries, size_t count, size_t dropped)
+{
+	size_t n;
+
+	__atomic_store_n(&g_lr_entered, 1, __ATOMIC_SEQ_CST);
+	uhub_mutex_lock(&g_lr_gate);
+	for (n = 0; n < count; n++)
+	{
+		if (entries[n].level != (int) (g_lr_count % 8) || entries[n].message[entries[n].length] != '\0')
+			g_lr_levels_ok = 0;
+		strncat(g_lr_text, entries[n].message, sizeof(g_lr_text) - strlen(g_lr_text) - 1);
+		g_lr_count++;
+	}
+	g_lr_batches++;
+	g_lr_dropped += dropped;
+	uhub_mutex_unlock(&g_lr_gate);
+}
+
+static int lr_add(struct log_ring* ring, int level, const char* format, ...)
+{
+	va_list args;
+	int ret;
+	va_start(args, format);
+	ret = log_ring_add(ring, level, format, args);
+	va_end(args);
+	return ret;
+}
+
+static void lr_reset()
+{
+	g_lr_entered = 0;
+	g_lr_text[0] = '\0';
+	g_lr_count = 0;
+	g_lr_batches = 0;
+	g_lr_dropped = 0;
+	g_lr_levels_ok = 1;
+}
+
+/* Everything added is written in order, and truncated to the slot size */
+static int lr_test_order()
+{
+	struct log_ring* ring = log_ring_create(16, 16, lr_write, NULL);
+	int n, ok = 1;
+
+	lr_reset();
+	uhub_mutex_init(&g_lr_gate);
+	for (n = 0; n < 8; n++)
+		ok &= lr_add(ring, n, "%d", n);
+	ok &= lr_add(ring, 0, "%s", "0123456789abcdefghij");
+	log_ring_destroy(ring);
+	uhub_mutex_destroy(&g_lr_gate);
+
+	return ok && g_lr_count == 9 && g_lr_levels_ok && strcmp(g_lr_text, "012345670123456789abcde") == 0;
+}
+
+/* A full ring drops messages rather than waiting, and says how many */
+static int lr_test_drop()
+{
+	struct log_ring* ring = log_ring_create(4, 32, lr_write, NULL);
+	int ok, n;
+
+	lr_reset();
+	uhub_mutex_init(&g_lr_gate);
+	uhub_mutex_lock(&g_lr_gate);
+
+	/* The writer holds the first slot until it is let through */
+	ok = lr_add(ring, 0, "a");
+	while (!__atomic_load_n(&g_lr_entered, __ATOMIC_SEQ_CST))
+		usleep(1000);
+
+	for (n = 1; n < 4; n++)
+		ok &= lr_add(ring, n, "%c", 'a' + n);
+	ok &= !lr_add(ring, 4, "e");
+	ok &= !lr_add(ring, 4, "f");
+	ok &= log_ring_dropped(ring) == 2;
+
+	uhub_mutex_unlock(&g_lr_gate);
+	log_ring_destroy(ring);
+	uhub_mutex_destroy(&g_lr_gate);
+
+	return ok && g_lr_count == 4 && g_lr_dropped == 2 && g_lr_batches == 2 && strcmp(g_lr_text, "abcd") == 0;
+}
+
+/* Many threads at once, nothing lost while there is room */
+static struct log_ring* g_lr_ring;
+
+static void* lr_producer(void* ptr)
+{
+	int n;
+	for (n = 0; n < 1000; n++)
+		lr_add(g_lr_ring, 0, "x");
+	return NULL;
+}
+
+static int lr_test_threads()
+{
+	uhub_thread_t* threads[4];
+	size_t dropped;
+	int n;
+
+	lr_reset();
+	uhub_mutex_init(&g_lr_gate);
+	g_lr_ring = log_ring_create(256, 8, lr_write, NULL);
+	for (n = 0; n < 4; n++)
+		threads[n] = uhub_thread_create(lr_producer, NULL);
+	for (n = 0; n < 4; n++)
+		uhub_thread_join(threads[n]);
+	dropped = log_ring_dropped(g_lr_ring);
+	log_ring_destroy(g_lr_ring);
+	uhub_mutex_destroy(&g_lr_gate);
+
+	return g_lr_count + dropped == 4000 && g_lr_dropped == dropped;
+}
+
+EXO_TEST(log_ring_order, { return lr_test_order(); });
+EXO_TEST(log_ring_drop, { return lr_test_drop(); });
+EXO_TEST(log_ring_threads, { return lr_test_threads(); });
+
+EXO_TEST(log_enabled, {
+	int saved = hub_log_max_verbosity;
+	int ok;
+	hub_set_log_verbosity(3);
+	ok = LOG_ENABLED(log_warning) && !LOG_ENABLED(log_user);
+	hub_set_log_verbosity(saved + 1);
+	return ok;
+});
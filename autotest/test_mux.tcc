@@ -0,0 +1,185 @@
+#include <uhub.h>
+
+static struct hub_mux* g_mux;
+static struct hub_user* g_mux_user1;
+static struct hub_user* g_mux_user2;
+static struct adc_message* g_mux_msg1;
+static struct adc_message* g_mux_msg2;
+
+static uint32_t mux_test_u32(const char* p)
+{
+	const unsigned char* b = (const unsigned char*) p;
+	return ((uint32_t) b[0] << 24) | ((uint32_t) b[1] << 16) | ((uint32_t) b[2] << 8) | (uint32_t) b[3];
+}
+
+EXO_TEST(mux1_setup, {
+	g_mux = hub_malloc_zero(sizeof(struct hub_mux));
+	g_mux->version = 1;
+	g_mux_user1 = hub_malloc_zero(sizeof(struct hub_user));
+	g_mux_user2 = hub_malloc_zero(sizeof(struct hub_user));
+	g_mux_user1->id.sid = 1;
+	g_mux_user2->id.sid = 2;
+	g_mux_msg1 = adc_msg_create("BMSG AAAB hello");
+	g_mux_msg2 = adc_msg_create("BMSG AAAB world");
+	return g_mux && g_mux_msg1 && g_mux_msg2;
+});
+
+/* Unicast messages are collected as records in one frame */
+EXO_TEST(mux1_unicast_batch, {
+	char* p;
+	mux_send_to_user(g_mux, g_mux_user1, g_mux_msg1);
+	mux_send_to_user(g_mux, g_mux_user1, g_mux_msg2);
+	p = g_mux->batch->cache;
+	return g_mux->batch->length == MUX1_HEADER + 2 * (8 + g_mux_msg1->length) &&
+		mux_test_u32(p) == g_mux->batch->length - 4 &&
+		p[4] == 'M' &&
+		mux_test_u32(p + 5) == 1 &&
+		mux_test_u32(p + 9) == g_mux_msg1->length &&
+		memcmp(p + 13, "BMSG AAAB hello\n", 16) == 0;
+});
+
+/* The same message to another user turns the last record into a multicast frame */
+EXO_TEST(mux1_multicast_fold, {
+	char* p;
+	size_t first = MUX1_HEADER + 8 + g_mux_msg1->length;
+	mux_send_to_user(g_mux, g_mux_user2, g_mux_msg2);
+	p = g_mux->batch->cache;
+	return mux_test_u32(p) == first - 4 &&
+		p[first + 4] == 'S' &&
+		mux_test_u32(p + first + 5) == g_mux_msg2->length &&
+		memcmp(p + first + 9, "BMSG AAAB world\n", 16) == 0 &&
+		mux_test_u32(p + first + 9 + g_mux_msg2->length) == 1 &&
+		mux_test_u32(p + first + 13 + g_mux_msg2->length) == 2 &&
+		g_mux->batch->length == first + MUX1_HEADER + 4 + g_mux_msg2->length + 8;
+});
+
+EXO_TEST(mux1_multicast_extend, {
+	size_t length = g_mux->batch->length;
+	mux_send_to_user(g_mux, g_mux_user1, g_mux_msg2);
+	return g_mux->batch->length == length + 4 &&
+		mux_test_u32(g_mux->batch->cache + length) == 1;
+});
+
+EXO_TEST(mux1_feature_cast, {
+	size_t length = g_mux->batch->length;
+	mux_feature_cast(g_mux, g_mux_msg1);
+	return g_mux->batch->length == length + MUX1_HEADER + g_mux_msg1->length &&
+		g_mux->batch->cache[length + 4] == 'F' &&
+		!g_mux->batch_msg;
+});
+
+/* A lone record becomes a multicast frame of its own */
+EXO_TEST(mux1_multicast_only_record, {
+	size_t length = g_mux->batch->length;
+	mux_send_to_user(g_mux, g_mux_user1, g_mux_msg1);
+	mux_send_to_user(g_mux, g_mux_user2, g_mux_msg1);
+	return g_mux->batch->length == length + MUX1_HEADER + 4 + g_mux_msg1->length + 8 &&
+		g_mux->batch->cache[length + 4] == 'S';
+});
+
+EXO_TEST(mux1_parse_hello_partial, {
+	char buf[16];
+	memcpy(buf, "MUX", 3);
+	return mux_handle_frames(g_mux, buf, 3) == 0 && !g_mux->hello;
+});
+
+EXO_TEST(mux1_parse_hello_bad, {
+	char buf[16];
+	memcpy(buf, "MUX0\n", 5);
+	return mux_handle_frames(g_mux, buf, 5) == -1 && !g_mux->hello;
+});
+
+/* Unknown frames are skipped, a trailing partial frame is left */
+EXO_TEST(mux1_parse_frames, {
+	char buf[32];
+	memcpy(buf, "MUX1\n", 5);
+	memcpy(buf + 5, "\0\0\0\3?ab", 7);
+	memcpy(buf + 12, "\0\0\0\5?a", 6);
+	return mux_handle_frames(g_mux, buf, 18) == 12 && g_mux->hello;
+});
+
+EXO_TEST(mux1_parse_frame_too_big, {
+	char buf[8];
+	memcpy(buf, "\0\1\0\0?", 5);
+	return mux_handle_frames(g_mux, buf, 5) == -1;
+});
+
+EXO_TEST(mux1_parse_frame_empty, {
+	char buf[8];
+	memcpy(buf, "\0\0\0\0", 4);
+	return mux_handle_frames(g_mux, buf, 4) == -1;
+});
+
+static struct hub_info g_mux_hub;
+static struct hub_config g_mux_config;
+
+EXO_TEST(mux1_charge_setup, {
+	g_mux_config.max_send_buffer = 4096;
+	g_mux_config.max_send_buffer_soft = 2048;
+	g_mux_hub.config = &g_mux_config;
+	g_mux->hub = &g_mux_hub;
+	mux_user_charge(g_mux, g_mux_user1, 2048);
+	return g_mux_user1->mux_queued == 2048 && g_mux->congested == 0 && mux_can_fan_out(g_mux, g_mux_msg1);
+});
+
+EXO_TEST(mux1_charge_congested, {
+	mux_user_charge(g_mux, g_mux_user1, 1);
+	mux_user_charge(g_mux, g_mux_user1, 100);
+	mux_user_charge(g_mux, g_mux_user2, 3000);
+	return g_mux->congested == 2 && !mux_can_fan_out(g_mux, g_mux_msg1);
+});
+
+/* Credits are parsed from 'C' frames, but only apply to users on this link */
+EXO_TEST(mux1_credit_foreign_user, {
+	char buf[16];
+	g_mux_hub.users = uman_init();
+	memcpy(buf, "\0\0\0\x09" "C" "\0\0\0\x01" "\0\0\x10\0", 13);
+	return mux_handle_frames(g_mux, buf, 13) == 13 && g_mux_user1->mux_queued == 2149;
+});
+
+EXO_TEST(mux1_credit_bad_length, {
+	char buf[16];
+	memcpy(buf, "\0\0\0\x05" "C" "\0\0\0\x01", 9);
+	return mux_handle_frames(g_mux, buf, 9) == -1;
+});
+
+/* Past the soft limit low priority messages are discarded, others still queued */
+EXO_TEST(mux1_soft_limit_low_priority, {
+	size_t queued = g_mux_user1->mux_queued;
+	int ok;
+	g_mux_user1->mux = g_mux;
+	g_mux_msg2->priority = -1;
+	ok = queued > g_mux_config.max_send_buffer_soft && route_to_user(&g_mux_hub, g_mux_user1, g_mux_msg2) == 0 && g_mux_user1->mux_queued == queued;
+	g_mux_msg2->priority = 0;
+	ok = ok && route_to_user(&g_mux_hub, g_mux_user1, g_mux_msg2) == 1 && g_mux_user1->mux_queued == queued + g_mux_msg2->length;
+	g_mux_user1->mux = NULL;
+	return ok;
+});
+
+/* Messages larger than the gap between the limits are never fanned out */
+EXO_TEST(mux1_charge_large_message, {
+	char line[2100];
+	struct adc_message* msg;
+	int ok;
+	memset(line, 'x', sizeof(line) - 1);
+	memcpy(line, "BMSG AAAB ", 10);
+	line[sizeof(line) - 1] = 0;
+	msg = adc_msg_create(line);
+	g_mux->congested = 0;
+	ok = msg && !mux_can_fan_out(g_mux, msg) && mux_can_fan_out(g_mux, g_mux_msg1);
+	adc_msg_free(msg);
+	uman_shutdown(g_mux_hub.users);
+	g_mux->hub = NULL;
+	return ok;
+});
+
+EXO_TEST(mux1_cleanup, {
+	adc_msg_free(g_mux->batch_msg);
+	adc_msg_free(g_mux->batch);
+	adc_msg_free(g_mux_msg1);
+	adc_msg_free(g_mux_msg2);
+	hub_free(g_mux_user1);
+	hub_free(g_mux_user2);
+	hub_free(g_mux);
+	return 1;
+});
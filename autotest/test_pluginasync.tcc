@@ -0,0 +1,184 @@
+#include <uhub.h>
+
+#define PA_INF "BINF AAAB NIFriend IDGNSSMURMD7K466NGZIHU65TP3S3UZSQ6MN5B2RI PD3A4545WFVGZLSGUXZLG7OS6ULQUVG3HM2T63I7Y\n"
+
+extern int hub_handle_info_login(struct hub_info* hub, struct hub_user* user, struct adc_message* cmd);
+
+static struct hub_info* g_pa_hub;
+static struct uhub_plugins g_pa_plugins;
+static struct plugin_handle g_pa_plugin;
+static struct uhub_plugin g_pa_handle;
+static struct plugin_hub_internals g_pa_internals;
+static struct plugin_async* g_pa_async;    /* Deferred by the plugin */
+static struct auth_info* g_pa_info;        /* Where the plugin writes its answer */
+static struct hub_user* g_pa_user;
+static int g_pa_joins;
+static int g_pa_join_flags;
+
+/* An auth plugin that always answers later */
+static plugin_st pa_get_user(struct plugin_handle* plugin, const char* nickname, struct auth_info* info)
+{
+	g_pa_async = plugin->hub.async_defer(plugin);
+	g_pa_info = info;
+	return g_pa_async ? st_pending : st_default;
+}
+
+static void pa_event(void* ptr, struct event_data* event)
+{
+	if (event->id == UHUB_EVENT_USER_JOIN && event->ptr == g_pa_user)
+	{
+		g_pa_joins++;
+		g_pa_join_flags = event->flags;
+	}
+}
+
+static struct hub_user* pa_login()
+{
+	struct ip_addr_encap addr;
+	struct hub_user* user;
+	struct adc_message* msg;
+	int ret;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.af = AF_INET;
+	user = user_create(g_pa_hub, NULL, &addr);
+	if (!user)
+		return NULL;
+	user->id.sid = 1;
+	g_pa_user = user;
+	g_pa_async = NULL;
+	g_pa_joins = 0;
+
+	msg = adc_msg_parse_verify(user, PA_INF, strlen(PA_INF));
+	ret = msg ? hub_handle_info_login(g_pa_hub, user, msg) : -1;
+	adc_msg_free(msg);
+
+	if (ret != 2 || !g_pa_async || user->login_lookup != g_pa_async || user->state != state_verify)
+	{
+		user_destroy(user);
+		return NULL;
+	}
+	return user;
+}
+
+EXO_TEST(plugin_async_setup, {
+	net_initialize();
+	g_pa_hub = hub_malloc_zero(sizeof(struct hub_info));
+	g_pa_hub->users = uman_init();
+	g_pa_hub->acl = hub_malloc_zero(sizeof(struct acl_handle));
+	g_pa_hub->config = hub_malloc_zero(sizeof(struct hub_config));
+	config_defaults(g_pa_hub->config);
+	acl_initialize(g_pa_hub->config, g_pa_hub->acl);
+	event_queue_initialize(&g_pa_hub->queue, pa_event, NULL);
+
+	memset(&g_pa_plugins, 0, sizeof(g_pa_plugins));
+	memset(&g_pa_plugin, 0, sizeof(g_pa_plugin));
+	g_pa_internals.hub = g_pa_hub;
+	g_pa_handle.internals = &g_pa_internals;
+	g_pa_plugin.handle = &g_pa_handle;
+	g_pa_plugin.name = "autotest";
+	g_pa_plugin.funcs.auth_get_user = pa_get_user;
+	g_pa_plugin.hub.async_defer = plugin_async_defer;
+	g_pa_plugin.hub.async_complete = plugin_async_complete;
+
+	g_pa_plugins.loaded = list_create();
+	g_pa_plugins.hooks = hub_malloc_zero(sizeof(struct plugin_hooks));
+	list_append(g_pa_plugins.loaded, &g_pa_plugin);
+	g_pa_hub->plugins = &g_pa_plugins;
+	g_pa_plugins.async = plugin_async_queue_create(g_pa_hub);
+	return g_pa_hub->queue && g_pa_plugins.async && plugin_hooks_update(&g_pa_plugins) == 0;
+});
+
+/* A registered user: the login goes on once the answer is processed */
+EXO_TEST(plugin_async_login_found, {
+	struct hub_user* user = pa_login();
+	int ok;
+	if (!user)
+		return 0;
+
+	strcpy(g_pa_info->nickname, "Friend");
+	strcpy(g_pa_info->password, "secret");
+	g_pa_info->credentials = auth_cred_user;
+	g_pa_plugin.hub.async_complete(&g_pa_plugin, g_pa_async, st_allow);
+
+	/* Nothing happens until the event loop processes the answer */
+	ok = user->login_lookup && !user->info;
+	plugin_async_queue_process(g_pa_plugins.async);
+	event_queue_process(g_pa_hub->queue);
+
+	ok = ok && !user->login_lookup && user->info && user->credentials == auth_cred_user &&
+		user->auth && strcmp(user->auth->password, "secret") == 0 &&
+		g_pa_joins == 1 && g_pa_join_flags == 1;
+	user_destroy(user);
+	return ok;
+});
+
+/* A failed lookup logs the user in as unregistered */
+EXO_TEST(plugin_async_login_failed, {
+	struct hub_user* user = pa_login();
+	int ok;
+	if (!user)
+		return 0;
+
+	g_pa_plugin.hub.async_complete(&g_pa_plugin, g_pa_async, st_deny);
+	plugin_async_queue_process(g_pa_plugins.async);
+	event_queue_process(g_pa_hub->queue);
+
+	ok = !user->login_lookup && user->info && user->credentials == auth_cred_guest && !user->auth &&
+		g_pa_joins == 1 && g_pa_join_flags == 0;
+	user_destroy(user);
+	return ok;
+});
+
+/* A user who is on the way out when the answer comes does not log in */
+EXO_TEST(plugin_async_login_disconnecting, {
+	struct hub_user* user = pa_login();
+	int ok;
+	if (!user)
+		return 0;
+
+	user_set_state(user, state_cleanup);
+	g_pa_plugin.hub.async_complete(&g_pa_plugin, g_pa_async, st_allow);
+	plugin_async_queue_process(g_pa_plugins.async);
+	event_queue_process(g_pa_hub->queue);
+
+	ok = !user->login_lookup && !user->info && g_pa_joins == 0;
+	user_destroy(user);
+	return ok;
+});
+
+/* A user who is gone when the answer comes: the operation is cancelled */
+EXO_TEST(plugin_async_login_destroyed, {
+	struct hub_user* user = pa_login();
+	struct plugin_async* async = g_pa_async;
+	if (!user)
+		return 0;
+
+	user_destroy(user);
+	g_pa_plugin.hub.async_complete(&g_pa_plugin, async, st_allow);
+	plugin_async_queue_process(g_pa_plugins.async);
+	event_queue_process(g_pa_hub->queue);
+	return g_pa_joins == 0;
+});
+
+/* A plugin may not defer an operation that is not offered */
+EXO_TEST(plugin_async_defer_not_offered, {
+	return plugin_async_defer(&g_pa_plugin) == NULL;
+});
+
+EXO_TEST(plugin_async_shutdown, {
+	plugin_async_queue_destroy(g_pa_plugins.async);
+	plugin_hooks_clear(g_pa_plugins.hooks);
+	hub_free(g_pa_plugins.hooks);
+	list_clear(g_pa_plugins.loaded, NULL);
+	list_destroy(g_pa_plugins.loaded);
+	event_queue_shutdown(g_pa_hub->queue);
+	uman_shutdown(g_pa_hub->users);
+	acl_shutdown(g_pa_hub->acl);
+	free_config(g_pa_hub->config);
+	hub_free(g_pa_hub->acl);
+	hub_free(g_pa_hub->config);
+	hub_free(g_pa_hub);
+	net_destroy();
+	return 1;
+});
@@ -0,0 +1,146 @@
+#include <uhub.h>
+
+static struct hub_info g_pi_hub;
+static struct uhub_plugins g_pi_plugins;
+static struct plugin_handle g_pi_plugin[3];
+static int g_pi_searches[3];
+static int g_pi_logins;
+
+static int g_pi_search_ok;
+
+static plugin_st pi_search(struct plugin_handle* plugin, struct plugin_user* from, const struct plugin_message_view* search)
+{
+	int n = (int) (plugin - g_pi_plugin);
+	size_t length;
+	const char* arg = plugin_message_view_get_named_argument((struct hub_message_view*) search, "AN", &length);
+	g_pi_search_ok = arg && length == 3 && memcmp(arg, "foo", 3) == 0 && strcmp(search->command, "BSCH") == 0 && !search->to;
+	g_pi_searches[n]++;
+	return (n == 2) ? st_deny : st_default;
+}
+
+static void pi_login(struct plugin_handle* plugin, struct plugin_user* user)
+{
+	g_pi_logins++;
+}
+
+EXO_TEST(plugin_hooks_setup, {
+	int n;
+	memset(&g_pi_hub, 0, sizeof(g_pi_hub));
+	memset(&g_pi_plugins, 0, sizeof(g_pi_plugins));
+	memset(g_pi_plugin, 0, sizeof(g_pi_plugin));
+	g_pi_plugins.loaded = list_create();
+	g_pi_plugins.hooks = hub_malloc_zero(sizeof(struct plugin_hooks));
+	for (n = 0; n < 3; n++)
+		list_append(g_pi_plugins.loaded, &g_pi_plugin[n]);
+	g_pi_plugin[0].funcs.on_search = pi_search;
+	g_pi_plugin[2].funcs.on_search = pi_search;
+	g_pi_plugin[1].funcs.on_user_login = pi_login;
+	g_pi_hub.plugins = &g_pi_plugins;
+	return plugin_hooks_update(&g_pi_plugins) == 0;
+});
+
+EXO_TEST(plugin_hooks_entries, {
+	struct plugin_hook* hook = &g_pi_plugins.hooks->hook[plugin_hook_on_search];
+	return hook->count == 2 && hook->entries[0].plugin == &g_pi_plugin[0] && hook->entries[1].plugin == &g_pi_plugin[2] &&
+		g_pi_plugins.hooks->hook[plugin_hook_on_user_login].count == 1 &&
+		!g_pi_plugins.hooks->hook[plugin_hook_on_chat_msg].count && !g_pi_plugins.hooks->hook[plugin_hook_on_chat_msg].entries;
+});
+
+EXO_TEST(plugin_hooks_used, {
+	return PLUGIN_HOOK_USED(&g_pi_hub, on_search) && !PLUGIN_HOOK_USED(&g_pi_hub, on_search_result);
+});
+
+EXO_TEST(plugin_hooks_invoke_status, {
+	struct adc_message* msg = adc_msg_create("BSCH AAAB ANfoo TObar\n");
+	int ok = plugin_handle_search(&g_pi_hub, NULL, msg) == st_deny && g_pi_searches[0] == 1 && g_pi_searches[1] == 0 && g_pi_searches[2] == 1 && g_pi_search_ok;
+	adc_msg_free(msg);
+	return ok;
+});
+
+EXO_TEST(plugin_hooks_invoke, {
+	plugin_log_user_login_success(&g_pi_hub, NULL);
+	return g_pi_logins == 1;
+});
+
+EXO_TEST(plugin_hooks_counters, {
+	return g_pi_plugins.hooks->hook[plugin_hook_on_search].calls == 1 &&
+		g_pi_plugins.hooks->hook[plugin_hook_on_user_login].calls == 1 &&
+		g_pi_plugins.hooks->hook[plugin_hook_on_chat_msg].calls == 0;
+});
+
+EXO_TEST(plugin_hooks_unused, {
+	struct adc_message* msg = adc_msg_create("BMSG AAAB hello\n");
+	struct hub_message_view view;
+	int ok;
+	plugin_message_view_init(&view, msg, NULL, NULL);
+	ok = plugin_handle_chat_message(&g_pi_hub, NULL, &view, 0) == st_default && g_pi_plugins.hooks->hook[plugin_hook_on_chat_msg].calls == 0 && !view.text;
+	plugin_message_view_free(&view);
+	adc_msg_free(msg);
+	return ok;
+});
+
+EXO_TEST(plugin_hooks_names, {
+	return strcmp(plugin_hook_name(plugin_hook_on_connection_accepted), "on_connection_accepted") == 0 &&
+		strcmp(plugin_hook_name(plugin_hook_on_search), "on_search") == 0 &&
+		strcmp(plugin_hook_name(plugin_hook_auth_delete_user), "auth_delete_user") == 0;
+});
+
+EXO_TEST(plugin_hooks_unload, {
+	int ok;
+	list_remove(g_pi_plugins.loaded, &g_pi_plugin[0]);
+	ok = plugin_hooks_update(&g_pi_plugins) == 0 && g_pi_plugins.hooks->hook[plugin_hook_on_search].count == 1 &&
+		g_pi_plugins.hooks->hook[plugin_hook_on_search].calls == 1;
+	plugin_hooks_clear(g_pi_plugins.hooks);
+	ok = ok && !PLUGIN_HOOK_USED(&g_pi_hub, on_search);
+	hub_free(g_pi_plugins.hooks);
+	list_clear(g_pi_plugins.loaded, NULL);
+	list_destroy(g_pi_plugins.loaded);
+	return ok;
+});
+
+/* Message views */
+static struct adc_message* g_pi_msg;
+static struct hub_message_view g_pi_view;
+
+EXO_TEST(message_view_init, {
+	g_pi_msg = adc_msg_create("DMSG AAAB AAAC hello\\sworld\\n! PMAAAB\n");
+	plugin_message_view_init(&g_pi_view, g_pi_msg, NULL, NULL);
+	return strcmp(g_pi_view.view.command, "DMSG") == 0 && g_pi_view.view.data == g_pi_msg->cache && g_pi_view.view.data[g_pi_view.view.length - 1] == 'B';
+});
+
+EXO_TEST(message_view_argument, {
+	size_t length;
+	const char* arg0 = plugin_message_view_get_argument(&g_pi_view, 0, &length);
+	int ok = arg0 && length == 15 && memcmp(arg0, "hello\\sworld\\n!", 15) == 0;
+	const char* arg1 = plugin_message_view_get_argument(&g_pi_view, 1, &length);
+	return ok && arg1 && length == 6 && memcmp(arg1, "PMAAAB", 6) == 0 && !plugin_message_view_get_argument(&g_pi_view, 2, &length);
+});
+
+EXO_TEST(message_view_named_argument, {
+	size_t length;
+	const char* arg = plugin_message_view_get_named_argument(&g_pi_view, "PM", &length);
+	return arg && length == 4 && memcmp(arg, "AAAB", 4) == 0 && !plugin_message_view_get_named_argument(&g_pi_view, "TO", &length);
+});
+
+EXO_TEST(message_view_text, {
+	const char* text = plugin_message_view_get_text(&g_pi_view);
+	return text && strcmp(text, "hello world\n!") == 0 && plugin_message_view_get_text(&g_pi_view) == text;
+});
+
+EXO_TEST(message_view_free, {
+	plugin_message_view_free(&g_pi_view);
+	adc_msg_free(g_pi_msg);
+	return !g_pi_view.text;
+});
+
+EXO_TEST(message_view_no_arguments, {
+	struct adc_message* msg = adc_msg_create("BMSG AAAB\n");
+	struct hub_message_view view;
+	size_t length;
+	int ok;
+	plugin_message_view_init(&view, msg, NULL, NULL);
+	ok = !plugin_message_view_get_argument(&view, 0, &length) && !plugin_message_view_get_text(&view);
+	plugin_message_view_free(&view);
+	adc_msg_free(msg);
+	return ok;
+});
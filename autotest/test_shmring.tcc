@@ -0,0 +1,134 @@
+#include <uhub.h>
+
+#ifdef USE_SHM_RING
+static struct shm_link* g_ring_hub;
+static struct shm_link* g_ring_peer;
+static char g_ring_buf[3 * SHM_LINK_MIN_SIZE];
+static char g_ring_out[3 * SHM_LINK_MIN_SIZE];
+
+static int ring_test_setup()
+{
+	int fds[SHM_LINK_PEER_FDS];
+	int peer[SHM_LINK_PEER_FDS];
+	size_t n;
+
+	g_ring_hub = shm_link_create(1000);
+	if (!g_ring_hub)
+		return 0;
+
+	/* The peer would get its own descriptors over a socket */
+	shm_link_get_peer_fds(g_ring_hub, fds);
+	for (n = 0; n < SHM_LINK_PEER_FDS; n++)
+		peer[n] = dup(fds[n]);
+
+	g_ring_peer = shm_link_attach(peer);
+	for (n = 0; n < sizeof(g_ring_buf); n++)
+		g_ring_buf[n] = (char) (n * 7 + n / 251);
+	return g_ring_peer && shm_link_get_size(g_ring_hub) == SHM_LINK_MIN_SIZE && shm_link_get_size(g_ring_peer) == SHM_LINK_MIN_SIZE;
+}
+
+static int ring_test_size()
+{
+	struct shm_link* link = shm_link_create(SHM_LINK_MIN_SIZE + 1);
+	int ok = link && shm_link_get_size(link) == 2 * SHM_LINK_MIN_SIZE;
+	shm_link_destroy(link);
+	return ok;
+}
+
+static int ring_test_both_ways()
+{
+	char buf[16];
+	return shm_link_write(g_ring_hub, "hello", 5) == 5 &&
+		shm_link_write(g_ring_peer, "world", 5) == 5 &&
+		shm_link_read(g_ring_peer, buf, sizeof(buf)) == 5 && memcmp(buf, "hello", 5) == 0 &&
+		shm_link_read(g_ring_hub, buf, sizeof(buf)) == 5 && memcmp(buf, "world", 5) == 0 &&
+		shm_link_read(g_ring_hub, buf, sizeof(buf)) == 0 &&
+		shm_link_read(g_ring_peer, buf, sizeof(buf)) == 0;
+}
+
+/* Both sides have read an empty ring, so a write signals the reader only */
+static int ring_test_signal_reader()
+{
+	shm_link_clear(g_ring_hub);
+	shm_link_clear(g_ring_peer);
+	return shm_link_write(g_ring_hub, "x", 1) == 1 &&
+		shm_link_clear(g_ring_peer) == 1 &&
+		shm_link_clear(g_ring_hub) == 0 &&
+		shm_link_write(g_ring_hub, "y", 1) == 1 &&
+		shm_link_clear(g_ring_peer) == 0 && /* not waiting any more */
+		shm_link_readable(g_ring_peer) == 2;
+}
+
+/* A full ring asks the reader for a wakeup, which comes once there is room */
+static int ring_test_full()
+{
+	size_t size = shm_link_get_size(g_ring_hub);
+	size_t written = 2 + shm_link_write(g_ring_hub, g_ring_buf, size);
+	int ok = written == size &&
+		shm_link_write(g_ring_hub, g_ring_buf, 1) == 0 &&
+		shm_link_clear(g_ring_hub) == 0 &&
+		shm_link_read(g_ring_peer, g_ring_out, 2) == 2 &&
+		shm_link_clear(g_ring_hub) == 1 &&
+		shm_link_read(g_ring_peer, g_ring_out, size) == (ssize_t) (size - 2) &&
+		memcmp(g_ring_out, g_ring_buf, size - 2) == 0 &&
+		shm_link_clear(g_ring_hub) == 0;
+	return ok;
+}
+
+/* Odd sized writes and reads across the end of the ring */
+static int ring_test_wrap()
+{
+	size_t total = sizeof(g_ring_buf);
+	size_t in = 0;
+	size_t out = 0;
+	ssize_t ret;
+
+	while (out < total)
+	{
+		if (in < total)
+			in += shm_link_write(g_ring_hub, g_ring_buf + in, MIN(total - in, 9973));
+		ret = shm_link_read(g_ring_peer, g_ring_out + out, MIN(total - out, 7919));
+		if (ret < 0)
+			return 0;
+		out += ret;
+	}
+	return memcmp(g_ring_buf, g_ring_out, total) == 0 && shm_link_readable(g_ring_peer) == 0;
+}
+
+/* The memory must hold a link of the expected size */
+static int ring_test_attach_invalid()
+{
+	int fds[SHM_LINK_PEER_FDS];
+	fds[0] = memfd_create("test", MFD_CLOEXEC);
+	fds[1] = eventfd(0, EFD_NONBLOCK);
+	fds[2] = eventfd(0, EFD_NONBLOCK);
+	if (ftruncate(fds[0], 2 * SHM_LINK_MIN_SIZE + 512) == -1)
+		return 0;
+	return shm_link_attach(fds) == NULL;
+}
+
+static int ring_test_shutdown()
+{
+	shm_link_destroy(g_ring_peer);
+	shm_link_destroy(g_ring_hub);
+	return 1;
+}
+#else
+static int ring_test_setup() { return 1; }
+static int ring_test_size() { return 1; }
+static int ring_test_both_ways() { return 1; }
+static int ring_test_signal_reader() { return 1; }
+static int ring_test_full() { return 1; }
+static int ring_test_wrap() { return 1; }
+static int ring_test_attach_invalid() { return 1; }
+static int ring_test_shutdown() { return 1; }
+#endif
+
+EXO_TEST(shm_link_setup, { return ring_test_setup(); });
+EXO_TEST(shm_link_size, { return ring_test_size(); });
+EXO_TEST(shm_link_both_ways, { return ring_test_both_ways(); });
+EXO_TEST(shm_link_signal_reader, { return ring_test_signal_reader(); });
+EXO_TEST(shm_link_full, { return ring_test_full(); });
+EXO_TEST(shm_link_wrap, { return ring_test_wrap(); });
+EXO_TEST(shm_link_attach_invalid, { return ring_test_attach_invalid(); });
+EXO_TEST(shm_link_shutdown, { return ring_test_shutdown(); });
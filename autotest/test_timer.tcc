@@ -2,59 +2,40 @@
 
 #define MAX_EVENTS 15
 static struct timeout_queue* g_queue;
-static time_t g_now;
-static size_t g_max;
+static uint64_t g_now;
+static size_t g_triggered;
+static size_t g_early;
 static struct timeout_evt g_events[MAX_EVENTS];
 
-static size_t g_triggered;
+#define STRESS_EVENTS 2000
+static struct timeout_evt* g_stress;
+static uint32_t g_seed = 42;
 
-static void timeout_cb(struct timeout_evt* t)
+static uint32_t timer_rand()
 {
-	g_triggered++;
+	g_seed = g_seed * 1103515245 + 12345;
+	return (g_seed >> 8);
 }
 
-/*
-typedef void (*timeout_evt_cb)(struct timeout_evt*);
-
-struct timeout_evt
+static void timeout_cb(struct timeout_evt* t)
 {
-	time_t timestamp;
-	timeout_evt_cb callback;
-	void* ptr;
-	struct timeout_evt* prev;
-	struct timeout_evt* next;
-};
-
-void timeout_evt_initialize(struct timeout_evt*, timeout_evt_cb, void* ptr);
-void timeout_evt_reset(struct timeout_evt*);
-int  timeout_evt_is_scheduled(struct timeout_evt*);
-
+	if (t->timestamp > g_now)
+		g_early++;
+	g_triggered++;
+}
 
-struct timeout_queue
+static void timeout_cb_resched(struct timeout_evt* t)
 {
-	time_t last;
-	size_t max;
-	struct timeout_evt** events;
-};
-
-void timeout_queue_initialize(struct timeout_queue*, time_t now, size_t max);
-void timeout_queue_shutdown(struct timeout_queue*);
-size_t timeout_queue_process(struct timeout_queue*, time_t now);
-void timeout_queue_insert(struct timeout_queue*, struct timeout_evt*, size_t seconds);
-void timeout_queue_remove(struct timeout_queue*, struct timeout_evt*);
-void timeout_queue_reschedule(struct timeout_queue*, struct timeout_evt*, size_t seconds);
-
-size_t timeout_queue_get_next_timeout(struct timeout_queue*, time_t now);
-*/
-
+	g_triggered++;
+	timeout_queue_insert_ms(g_queue, t, 0);
+}
 
 EXO_TEST(timer_setup,{
 	size_t n;
 	g_queue = hub_malloc_zero(sizeof(struct timeout_queue));
 	g_now = 0;
-	g_max = 5;
 	g_triggered = 0;
-	timeout_queue_initialize(g_queue, g_now, g_max);
+	timeout_queue_initialize(g_queue, g_now);
 
 	memset(g_events, 0,  sizeof(g_events));
 	for (n = 0; n < MAX_EVENTS; n++)
@@ -67,7 +48,7 @@ EXO_TEST(timer_setup,{
 
 
 EXO_TEST(timer_check_timeout_0,{
-	return timeout_queue_get_next_timeout(g_queue, g_now) == g_max;
+	return timeout_queue_get_next_timeout(g_queue, g_now) == TIMEOUT_QUEUE_MAX_WAIT;
 });
 
 
@@ -76,8 +57,10 @@ EXO_TEST(timer_add_event_1,{
 	return g_events[0].prev != NULL;
 });
 
+/* May wake up early to cascade the event to a lower level, but never late. */
 EXO_TEST(timer_check_timeout_1,{
-	return timeout_queue_get_next_timeout(g_queue, g_now) == 2;
+	size_t next = timeout_queue_get_next_timeout(g_queue, g_now);
+	return next > 0 && next <= 2000;
 });
 
 EXO_TEST(timer_remove_event_1,{
@@ -86,7 +69,7 @@ EXO_TEST(timer_remove_event_1,{
 });
 
 EXO_TEST(timer_check_timeout_2,{
-	return timeout_queue_get_next_timeout(g_queue, g_now) == g_max;
+	return timeout_queue_get_next_timeout(g_queue, g_now) == TIMEOUT_QUEUE_MAX_WAIT;
 });
 
 /* test re-removing an event - should not crash! */
@@ -110,16 +93,123 @@ EXO_TEST(timer_add_5_events_1,{
 });
 
 EXO_TEST(timer_check_5_events_1,{
-	return timeout_queue_get_next_timeout(g_queue, g_now) == 1;
+	return timeout_queue_get_next_timeout(g_queue, g_now) == 0;
 });
 
 EXO_TEST(timer_process_5_events_1,{
-	g_now = 4;
-	return timeout_queue_process(g_queue, g_now) == g_triggered;
+	g_now = 4000;
+	return timeout_queue_process(g_queue, g_now) == 5 && g_triggered == 5 && !g_early;
+});
+
+EXO_TEST(timer_check_timeout_3,{
+	return g_queue->count == 0 && timeout_queue_get_next_timeout(g_queue, g_now) == TIMEOUT_QUEUE_MAX_WAIT;
+});
+
+/* Millisecond precision, also across level boundaries. */
+EXO_TEST(timer_add_ms_events,{
+	timeout_queue_insert_ms(g_queue, &g_events[0], 1);
+	timeout_queue_insert_ms(g_queue, &g_events[1], 63);
+	timeout_queue_insert_ms(g_queue, &g_events[2], 64);
+	timeout_queue_insert_ms(g_queue, &g_events[3], 65);
+	timeout_queue_insert_ms(g_queue, &g_events[4], 4097);
+	return g_queue->count == 5 && timeout_queue_get_next_timeout(g_queue, g_now) == 1;
+});
+
+EXO_TEST(timer_process_ms_events_1,{
+	g_triggered = 0;
+	g_now += 63;
+	return timeout_queue_process(g_queue, g_now) == 2 && !g_early;
+});
+
+EXO_TEST(timer_process_ms_events_2,{
+	g_now += 1;
+	return timeout_queue_process(g_queue, g_now) == 1 && timeout_queue_get_next_timeout(g_queue, g_now) == 1;
+});
+
+EXO_TEST(timer_process_ms_events_3,{
+	g_now += 4000;
+	return timeout_queue_process(g_queue, g_now) == 1 && !g_early && g_queue->count == 1;
+});
+
+EXO_TEST(timer_process_ms_events_4,{
+	g_now += 32;
+	if (timeout_queue_process(g_queue, g_now) != 0)
+		return 0;
+	g_now += 1;
+	return timeout_queue_process(g_queue, g_now) == 1 && !g_early && g_queue->count == 0;
+});
+
+/* There is no upper limit on the timeout (previously 120 seconds) */
+EXO_TEST(timer_long_timeouts,{
+	uint64_t start = g_now;
+	uint64_t days = ((uint64_t) 86400) * 1000;
+	g_triggered = 0;
+	timeout_queue_insert(g_queue, &g_events[0], 3600);
+	timeout_queue_insert_ms(g_queue, &g_events[1], 10 * days);
+	timeout_queue_insert_ms(g_queue, &g_events[2], 1000 * days + 7);
+
+	g_now = start + 3600000 - 1;
+	if (timeout_queue_process(g_queue, g_now) != 0) return 0;
+	g_now++;
+	if (timeout_queue_process(g_queue, g_now) != 1) return 0;
+	g_now = start + 10 * days - 1;
+	if (timeout_queue_process(g_queue, g_now) != 0) return 0;
+	g_now++;
+	if (timeout_queue_process(g_queue, g_now) != 1) return 0;
+	g_now = start + 1000 * days + 6;
+	if (timeout_queue_process(g_queue, g_now) != 0) return 0;
+	g_now++;
+	if (timeout_queue_process(g_queue, g_now) != 1) return 0;
+	return !g_early && g_queue->count == 0;
+});
+
+/* Events scheduled by a callback are not run again in the same pass */
+EXO_TEST(timer_reschedule_from_callback,{
+	int ok;
+	timeout_evt_initialize(&g_events[5], timeout_cb_resched, 0);
+	timeout_queue_insert_ms(g_queue, &g_events[5], 10);
+	g_now += 100;
+	ok = timeout_queue_process(g_queue, g_now) == 1;
+	ok = ok && timeout_evt_is_scheduled(&g_events[5]);
+	ok = ok && timeout_queue_get_next_timeout(g_queue, g_now) == 0;
+	ok = ok && timeout_queue_process(g_queue, g_now) == 1;
+	timeout_queue_remove(g_queue, &g_events[5]);
+	return ok && g_queue->count == 0;
+});
+
+EXO_TEST(timer_stress_setup,{
+	size_t n;
+	g_stress = hub_malloc_zero(sizeof(struct timeout_evt) * STRESS_EVENTS);
+	g_triggered = 0;
+	for (n = 0; n < STRESS_EVENTS; n++)
+	{
+		timeout_evt_initialize(&g_stress[n], timeout_cb, 0);
+		timeout_queue_insert_ms(g_queue, &g_stress[n], timer_rand() % 20000000);
+	}
+	for (n = 0; n < STRESS_EVENTS; n += 4)
+		timeout_queue_remove(g_queue, &g_stress[n]);
+	return g_queue->count == STRESS_EVENTS - STRESS_EVENTS / 4;
+});
+
+EXO_TEST(timer_stress_process,{
+	size_t n;
+	size_t next;
+	while (g_queue->count)
+	{
+		next = timeout_queue_get_next_timeout(g_queue, g_now);
+		/* never sleep past an event */
+		for (n = 0; n < STRESS_EVENTS; n++)
+			if (timeout_evt_is_scheduled(&g_stress[n]) && g_stress[n].timestamp < g_now + next)
+				return 0;
+		g_now += next ? (timer_rand() % next) + 1 : 0;
+		timeout_queue_process(g_queue, g_now);
+	}
+	return !g_early && g_triggered == STRESS_EVENTS - STRESS_EVENTS / 4;
 });
 
 EXO_TEST(timer_shutdown,{
 	timeout_queue_shutdown(g_queue);
+	hub_free(g_stress);
 	hub_free(g_queue);
 	return 1;
 });
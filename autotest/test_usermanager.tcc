@@ -1,4 +1,5 @@
 #include <uhub.h>
+#include <stddef.h>
 
 #define MAX_USERS 64
 
@@ -72,8 +73,146 @@ EXO_TEST(um_remove_2, {
 	return 1;
 });
 
+EXO_TEST(um_size_4, {
+	return uman->count == 0 && !uman->first && !uman->last;
+});
+
+EXO_TEST(um_add_3, {
+	int i;
+	for (i = 0; i < 3; i++)
+	{
+		if (uman_add(uman, &um_user[i]) != 0)
+			return 0;
+	}
+	return uman->first == &um_user[0] && uman->last == &um_user[2];
+});
+
+EXO_TEST(um_remove_middle, {
+	uman_remove(uman, &um_user[1]);
+	return uman->first == &um_user[0] && uman->last == &um_user[2] &&
+	       um_user[0].next == &um_user[2] && um_user[2].prev == &um_user[0] &&
+	       !um_user[1].next && !um_user[1].prev;
+});
+
+EXO_TEST(um_remove_twice, {
+	return uman_remove(uman, &um_user[1]) == -1 && uman->first == &um_user[0] && uman->last == &um_user[2];
+});
+
+EXO_TEST(um_foreach_1, {
+	struct hub_user* user;
+	int n = 0;
+	UMAN_FOREACH(uman, user,
+	{
+		n++;
+	});
+	return n == 2;
+});
+
+EXO_TEST(um_remove_3, {
+	uman_remove(uman, &um_user[2]);
+	uman_remove(uman, &um_user[0]);
+	return !uman->first && !uman->last;
+});
+
+#define UM_TEST_CID "TZA4K7VZMIYQIJ5UVHOSQUDNVXLJAZSJZ6EDXNA"
+
+EXO_TEST(um_lookup_1, {
+	int ok;
+	memcpy(um_user[3].id.nick, "Nick", 5);
+	memcpy(um_user[3].id.cid, UM_TEST_CID, MAX_CID_LEN + 1);
+	uman_add(uman, &um_user[3]);
+	ok = uman_get_user_by_nick(uman, "Nick") == &um_user[3] &&
+	     uman_get_user_by_nick(uman, "nick") == NULL &&
+	     uman_get_user_by_cid(uman, UM_TEST_CID) == &um_user[3] &&
+	     uman_get_user_by_cid(uman, "TZA4K7VZMIYQIJ5UVHOSQUDNVXLJAZSJZ6EDXNQ") == NULL &&
+	     uman_get_user_by_cid(uman, "TZA4K7VZMIYQIJ5UVHOSQUDNVXLJAZSJZ6EDXNB") == NULL &&
+	     uman_get_user_by_cid(uman, "invalid") == NULL;
+	return ok;
+});
+
+/* Nicks that only differ in case share a hash, but are different users */
+EXO_TEST(um_lookup_case, {
+	int ok;
+	memcpy(um_user[4].id.nick, "NICK", 5);
+	uman_add(uman, &um_user[4]);
+	ok = uman_get_user_by_nick(uman, "NICK") == &um_user[4] &&
+	     uman_get_user_by_nick(uman, "Nick") == &um_user[3] &&
+	     uman_get_user_by_nick(uman, "nick") == NULL;
+	uman_remove(uman, &um_user[4]);
+	return ok;
+});
+
+EXO_TEST(um_lookup_id, {
+	struct hub_user user;
+	memset(&user, 0, sizeof(user));
+	memcpy(user.id.nick, "Nick", 5);
+	user.nick_hash = uman_nick_hash(user.id.nick);
+	uman_cid_decode(UM_TEST_CID, user.cid_raw);
+	return uman_lookup_nick(uman, &user) == &um_user[3] && uman_lookup_cid(uman, &user) == &um_user[3];
+});
+
+EXO_TEST(um_lookup_removed, {
+	uman_remove(uman, &um_user[3]);
+	return uman_get_user_by_nick(uman, "Nick") == NULL && uman_get_user_by_cid(uman, UM_TEST_CID) == NULL;
+});
+
+#define MASS_USERS 16384
+
+/* Mass disconnect: removing users in reverse order used to cost O(n^2). */
+EXO_TEST(um_mass_disconnect, {
+	struct hub_user* users = hub_malloc_zero(sizeof(struct hub_user) * MASS_USERS);
+	int i;
+	int ok = 1;
+	if (!users)
+		return 0;
+
+	for (i = 0; i < MASS_USERS; i++)
+	{
+		snprintf(users[i].id.nick, sizeof(users[i].id.nick), "user%d", i);
+		snprintf(users[i].id.cid, sizeof(users[i].id.cid), "CID%d", i);
+		uman_add(uman, &users[i]);
+	}
+
+	ok = ok && uman->count == MASS_USERS;
+
+	for (i = MASS_USERS - 1; i >= 0; i--)
+		uman_remove(uman, &users[i]);
 
+	ok = ok && uman->count == 0 && !uman->first && !uman->last;
+	hub_free(users);
+	return ok;
+});
+
+/* Users are found by address through the index, and leave it on removal */
+static int um_test_by_addr()
+{
+	struct linked_list* found = list_create();
+	struct ip_range range;
+	int ok;
+
+	ip_convert_to_binary("10.0.0.1", &um_user[10].id.addr);
+	ip_convert_to_binary("10.0.0.2", &um_user[11].id.addr);
+	ip_convert_to_binary("10.0.1.1", &um_user[12].id.addr);
+	uman_add(uman, &um_user[10]);
+	uman_add(uman, &um_user[11]);
+	uman_add(uman, &um_user[12]);
+
+	ok = ip_convert_address_to_range("10.0.0.0/24", &range) && uman_get_user_by_addr(uman, found, &range) == 2 &&
+		list_size(found) == 2 && list_get_first(found) == &um_user[10];
+	list_clear(found, NULL);
+
+	uman_remove(uman, &um_user[10]);
+	ok = ok && uman_get_user_by_addr(uman, found, &range) == 1 && list_get_first(found) == &um_user[11];
+	list_clear(found, NULL);
+
+	uman_remove(uman, &um_user[11]);
+	uman_remove(uman, &um_user[12]);
+	ok = ok && uman_get_user_by_addr(uman, found, &range) == 0;
+	list_destroy(found);
+	return ok;
+}
 
+EXO_TEST(um_get_user_by_addr, { return um_test_by_addr(); });
 
 
 
@@ -83,6 +222,15 @@ EXO_TEST(um_remove_2, {
 
 
 
+
+
+
+EXO_TEST(um_plugin_user_layout, {
+	return offsetof(struct hub_user, id.user_agent) == offsetof(struct plugin_user, user_agent) &&
+	       offsetof(struct hub_user, id.addr) == offsetof(struct plugin_user, addr) &&
+	       offsetof(struct hub_user, credentials) == offsetof(struct plugin_user, credentials);
+});
+
 /* Last test */
 EXO_TEST(um_shutdown_4, {
 	return uman_shutdown(uman) == 0;
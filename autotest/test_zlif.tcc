@@ -0,0 +1,147 @@
+#include <uhub.h>
+
+#define ZLIF_MSGS 3
+
+static struct hub_zlif* zlif = NULL;
+static struct adc_message* zlif_msg[ZLIF_MSGS];
+static struct adc_message* zlif_block = NULL;
+static struct zlif_stats zlif_st;
+
+static int zlif_setup()
+{
+	static const char* infs[ZLIF_MSGS] = {
+		"BINF AAAB IDAVM4YX4BOJAXLJYSVUKAYAIDN3PHWJSGROATBOI NIuser1 SS12345678 SF123 HN1 HR0 HO0 SL3 VEuhub\n",
+		"BINF AAAC IDGA7IYC3QQYY5ZTGIONA2T2GEKA5BJDNAJCCDA5A NIuser2 SS12345678 SF123 HN1 HR0 HO0 SL3 VEuhub\n",
+		"BINF AAAD IDQHTSHSIZXBCJSKDMZWPXKBVPTXYCBMN5HTLNTTA NIuser3 SS12345678 SF123 HN1 HR0 HO0 SL3 VEuhub\n",
+	};
+	int n;
+
+	zlif = zlif_create();
+	for (n = 0; n < ZLIF_MSGS; n++)
+	{
+		zlif_msg[n] = adc_msg_create(infs[n]);
+		if (!zlif_msg[n])
+			return 0;
+	}
+#ifdef ZLIB_SUPPORT
+	return zlif != NULL;
+#else
+	return zlif == NULL;
+#endif
+}
+
+#ifdef ZLIB_SUPPORT
+/* The block must be IZON and a zlib stream of all the messages, ending exactly at the end */
+static int zlif_check_block(struct adc_message* block, struct adc_message** msgs, size_t count)
+{
+	char out[4096];
+	char expect[4096];
+	size_t expect_len = 0;
+	z_stream stream;
+	size_t n;
+	int ret;
+
+	if (!block || block->length < 5 || memcmp(block->cache, "IZON\n", 5) != 0)
+		return 0;
+
+	for (n = 0; n < count; n++)
+	{
+		memcpy(expect + expect_len, msgs[n]->cache, msgs[n]->length);
+		expect_len += msgs[n]->length;
+	}
+
+	memset(&stream, 0, sizeof(stream));
+	if (inflateInit(&stream) != Z_OK)
+		return 0;
+
+	stream.next_in = (Bytef*) block->cache + 5;
+	stream.avail_in = (uInt) (block->length - 5);
+	stream.next_out = (Bytef*) out;
+	stream.avail_out = sizeof(out);
+	ret = inflate(&stream, Z_FINISH);
+	inflateEnd(&stream);
+
+	return ret == Z_STREAM_END && stream.avail_in == 0 && sizeof(out) - stream.avail_out == expect_len && memcmp(out, expect, expect_len) == 0;
+}
+#endif
+
+static int zlif_test_compress(size_t count)
+{
+#ifdef ZLIB_SUPPORT
+	int ok;
+	zlif_block = zlif_compress(zlif, zlif_msg, count);
+	ok = zlif_check_block(zlif_block, zlif_msg, count);
+	adc_msg_free(zlif_block);
+	zlif_block = NULL;
+	return ok;
+#else
+	return 1;
+#endif
+}
+
+static int zlif_test_stats(size_t streams, size_t blocks)
+{
+#ifdef ZLIB_SUPPORT
+	zlif_get_stats(zlif, &zlif_st);
+	return zlif_st.streams == streams && zlif_st.blocks == blocks;
+#else
+	return 1;
+#endif
+}
+
+static int zlif_test_sent()
+{
+#ifdef ZLIB_SUPPORT
+	size_t raw = zlif_msg[0]->length + zlif_msg[1]->length + zlif_msg[2]->length;
+	int n;
+
+	zlif_block = zlif_compress(zlif, zlif_msg, ZLIF_MSGS);
+	if (!zlif_block)
+		return 0;
+
+	/* Compressed once, sent twice */
+	for (n = 0; n < 2; n++)
+		zlif_sent(zlif, zlif_block, raw);
+
+	zlif_get_stats(zlif, &zlif_st);
+	n = zlif_st.sent == 2 && zlif_st.raw_bytes == 2 * raw && zlif_st.sent_bytes == 2 * zlif_block->length && zlif_st.sent_bytes < zlif_st.raw_bytes;
+	adc_msg_free(zlif_block);
+	zlif_block = NULL;
+	return n;
+#else
+	return 1;
+#endif
+}
+
+EXO_TEST(zlif_create, {
+	return zlif_setup();
+});
+
+EXO_TEST(zlif_compress_one, {
+	return zlif_test_compress(1);
+});
+
+EXO_TEST(zlif_compress_many, {
+	return zlif_test_compress(ZLIF_MSGS);
+});
+
+EXO_TEST(zlif_compress_empty, {
+	return zlif_test_compress(0);
+});
+
+EXO_TEST(zlif_pool_reused, {
+	return zlif_test_stats(1, 3);
+});
+
+EXO_TEST(zlif_sent, {
+	return zlif_test_sent();
+});
+
+EXO_TEST(zlif_destroy, {
+	int n;
+	zlif_destroy(zlif);
+	zlif = NULL;
+	for (n = 0; n < ZLIF_MSGS; n++)
+		adc_msg_free(zlif_msg[n]);
+	return 1;
+});
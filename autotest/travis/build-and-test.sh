@@ -18,12 +18,14 @@ if [ "${CONFIG}" = "full" ]; then
                -DLOWLEVEL_DEBUG=ON
                -DSSL_SUPPORT=ON
                -DUSE_OPENSSL=ON
+               -DZLIB_SUPPORT=ON
                -DADC_STRESS=ON"
 else
     CMAKEOPTS="${CMAKEOPTS}
                -DRELEASE=ON
                -DLOWLEVEL_DEBUG=OFF
                -DSSL_SUPPORT=OFF
+               -DZLIB_SUPPORT=OFF
                -DADC_STRESS=OFF"
 fi
 
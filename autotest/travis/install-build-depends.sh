@@ -5,6 +5,6 @@ sudo apt-get update -qq
 sudo apt-get install -qq cmake
 
 if [ "${CONFIG}" = "full" ]; then
-    sudo apt-get install -qq libsqlite3-dev libssl-dev
+    sudo apt-get install -qq libsqlite3-dev libssl-dev zlib1g-dev
 fi
 
@@ -10,6 +10,7 @@ BuildRoot: %{_tmppath}/%{name}-%{version}-%{release}-root
 
 BuildRequires: sqlite-devel
 BuildRequires: openssl-devel
+BuildRequires: zlib-devel
 
 %description
 uhub is a high performance peer-to-peer hub for the ADC network.
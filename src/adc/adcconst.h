@@ -43,6 +43,7 @@ typedef uint32_t fourcc_t;
 #define ADC_CMD_IINF FOURCC('I','I','N','F')
 #define ADC_CMD_IMSG FOURCC('I','M','S','G')
 #define ADC_CMD_IQUI FOURCC('I','Q','U','I')
+#define ADC_CMD_IZON FOURCC('I','Z','O','N') /* ZLIF: a zlib stream follows */
 
 /* Handshake and login/passwordstuff */
 #define ADC_CMD_HSUP FOURCC('H','S','U','P')
@@ -26,7 +26,7 @@
 	uhub_assert(X->capacity); \
 	uhub_assert(X->length <= X->capacity); \
 	uhub_assert(X->references > 0); \
-	uhub_assert(X->length == strlen(X->cache));
+	uhub_assert(X->binary || X->length == strlen(X->cache));
 #define ADC_MSG_NULL_ON_FREE
 #else
 #define ADC_MSG_ASSERT(X) do { } while(0)
@@ -552,6 +552,14 @@ struct adc_message* adc_msg_construct_source_dest(fourcc_t fourcc, sid_t source,
 }
 
 
+struct adc_message* adc_msg_construct_binary(size_t size)
+{
+	struct adc_message* msg = adc_msg_construct(0, size);
+	if (msg)
+		msg->binary = 1;
+	return msg;
+}
+
 struct adc_message* adc_msg_construct(fourcc_t fourcc, size_t size)
 {
 	struct adc_message* msg = (struct adc_message*) msg_malloc_zero(sizeof(struct adc_message));
@@ -30,8 +30,9 @@ struct adc_message
 	char* cache;
 	size_t length;
 	size_t capacity;
-	size_t priority;
+	int priority;                    /* Below 0 for messages that may be dropped at the soft send queue limit */
 	size_t references;
+	int binary;                      /* Raw data that may hold zero bytes, see adc_msg_construct_binary() */
 	struct linked_list*  feature_cast_include;
 	struct linked_list*  feature_cast_exclude;
 };
@@ -91,6 +92,12 @@ extern struct adc_message* adc_msg_create(const char* string);
  */
 extern struct adc_message* adc_msg_construct(fourcc_t fourcc, size_t size);
 
+/**
+ * Construct an empty message for 'size' bytes of raw data, such as
+ * binary frames, that is sent as is and never parsed.
+ */
+extern struct adc_message* adc_msg_construct_binary(size_t size);
+
 /**
  * Construct a message for the given 'fourcc' and add a source SID to it,
  * in addition pre-allocate 'size' bytes at the end of the message.
@@ -0,0 +1,269 @@
+/*
+ * uhub - A tiny ADC p2p connection hub
+ * Copyright (C) 2007-2014, Jan Vidar Krey
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "uhub.h"
+
+#define ADMISSION_TOKEN 1000     /* Tokens are kept in thousandths */
+
+struct admission_entry
+{
+	uint64_t prefix;             /* IPv4 address, or the upper half of an IPv6 address */
+	uint64_t stamp;              /* When tokens were last refilled (ms) */
+	uint32_t tokens;
+	uint32_t conns;              /* Open connections */
+	int af;                      /* 0 if the slot is free */
+};
+
+/*
+ * Open addressing with linear probing, and no tombstones: removing an
+ * entry shifts the ones after it back, see admission_delete().
+ */
+struct hub_admission
+{
+	struct admission_entry* slots;
+	size_t mask;
+	size_t count;
+	size_t max_count;            /* Keep the load below 3/4 */
+	struct admission_stats stats;
+};
+
+static int admission_key(struct ip_addr_encap* addr, uint64_t* prefix)
+{
+	const uint8_t* bytes;
+	size_t n;
+
+	if (addr->af == AF_INET)
+	{
+		*prefix = ntohl(addr->internal_ip_data.in.s_addr);
+		return AF_INET;
+	}
+
+	if (addr->af == AF_INET6)
+	{
+		bytes = (const uint8_t*) &addr->internal_ip_data.in6;
+		if (IN6_IS_ADDR_V4MAPPED(&addr->internal_ip_data.in6))
+		{
+			*prefix = ((uint32_t) bytes[12] << 24) | ((uint32_t) bytes[13] << 16) | ((uint32_t) bytes[14] << 8) | bytes[15];
+			return AF_INET;
+		}
+
+		*prefix = 0;
+		for (n = 0; n < 8; n++)
+			*prefix = (*prefix << 8) | bytes[n];
+		return AF_INET6;
+	}
+	return 0;
+}
+
+static size_t admission_hash(int af, uint64_t prefix)
+{
+	uint64_t h = prefix + (uint64_t) af;
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+	return (size_t) h;
+}
+
+static struct admission_entry* admission_find(struct hub_admission* adm, int af, uint64_t prefix, size_t* pos)
+{
+	size_t i = admission_hash(af, prefix) & adm->mask;
+	struct admission_entry* e;
+
+	for (;; i = (i + 1) & adm->mask)
+	{
+		e = &adm->slots[i];
+		*pos = i;
+		if (!e->af)
+			return NULL;
+		if (e->af == af && e->prefix == prefix)
+			return e;
+	}
+}
+
+static void admission_delete(struct hub_admission* adm, size_t i)
+{
+	size_t j = i;
+	size_t k;
+
+	adm->count--;
+	for (;;)
+	{
+		adm->slots[i].af = 0;
+		for (;;)
+		{
+			j = (j + 1) & adm->mask;
+			if (!adm->slots[j].af)
+				return;
+
+			/* The entry at j can fill the hole, unless its home slot is in (i, j] */
+			k = admission_hash(adm->slots[j].af, adm->slots[j].prefix) & adm->mask;
+			if (i <= j ? (k <= i || k > j) : (k <= i && k > j))
+				break;
+		}
+		adm->slots[i] = adm->slots[j];
+		i = j;
+	}
+}
+
+static uint32_t admission_bucket_size(struct admission_limits* limits)
+{
+	return (uint32_t) MAX(limits->burst, 1) * ADMISSION_TOKEN;
+}
+
+static void admission_refill(struct admission_entry* e, struct admission_limits* limits, uint64_t now)
+{
+	uint64_t tokens = e->tokens;
+	uint32_t size = admission_bucket_size(limits);
+
+	/* One token per second at rate 1 is one thousandth per millisecond */
+	if (now > e->stamp)
+		tokens += (now - e->stamp) * limits->rate;
+	e->tokens = (uint32_t) MIN(tokens, (uint64_t) size);
+	e->stamp = now;
+}
+
+struct hub_admission* admission_create(size_t capacity)
+{
+	struct hub_admission* adm = hub_malloc_zero(sizeof(struct hub_admission));
+	size_t size = 16;
+
+	if (!adm)
+		return NULL;
+
+	while (size - size / 4 < capacity)
+		size <<= 1;
+
+	adm->slots = hub_malloc_zero(sizeof(struct admission_entry) * size);
+	if (!adm->slots)
+	{
+		hub_free(adm);
+		return NULL;
+	}
+	adm->mask = size - 1;
+	adm->max_count = size - size / 4;
+	return adm;
+}
+
+void admission_destroy(struct hub_admission* adm)
+{
+	if (!adm)
+		return;
+	hub_free(adm->slots);
+	hub_free(adm);
+}
+
+int admission_accept(struct hub_admission* adm, struct ip_addr_encap* addr, struct admission_limits* limits, uint64_t now)
+{
+	struct admission_entry* e;
+	uint64_t prefix;
+	size_t max_conns;
+	size_t pos;
+	int af = admission_key(addr, &prefix);
+
+	max_conns = (af == AF_INET) ? limits->max_conns_ipv4 : limits->max_conns_ipv6;
+	if (!af || (!max_conns && !limits->rate))
+		return 0;
+
+	e = admission_find(adm, af, prefix, &pos);
+	if (!e)
+	{
+		if (adm->count >= adm->max_count)
+		{
+			adm->stats.untracked++;
+			return 0;
+		}
+
+		e = &adm->slots[pos];
+		e->af = af;
+		e->prefix = prefix;
+		e->stamp = now;
+		e->tokens = admission_bucket_size(limits);
+		e->conns = 0;
+		adm->count++;
+	}
+
+	if (limits->rate)
+	{
+		admission_refill(e, limits, now);
+		if (e->tokens < ADMISSION_TOKEN)
+		{
+			adm->stats.rejected_rate++;
+			return -1;
+		}
+	}
+
+	if (max_conns && e->conns >= max_conns)
+	{
+		adm->stats.rejected_conns++;
+		return -1;
+	}
+
+	if (limits->rate)
+		e->tokens -= ADMISSION_TOKEN;
+	e->conns++;
+	adm->stats.accepted++;
+	return 1;
+}
+
+void admission_release(struct hub_admission* adm, struct ip_addr_encap* addr)
+{
+	struct admission_entry* e;
+	uint64_t prefix;
+	size_t pos;
+	int af = admission_key(addr, &prefix);
+
+	if (!af)
+		return;
+
+	e = admission_find(adm, af, prefix, &pos);
+	if (e && e->conns)
+		e->conns--;
+}
+
+void admission_expire(struct hub_admission* adm, struct admission_limits* limits, uint64_t now)
+{
+	struct admission_entry* e;
+	size_t i = 0;
+
+	while (i <= adm->mask)
+	{
+		e = &adm->slots[i];
+		if (e->af && !e->conns)
+		{
+			if (limits->rate)
+				admission_refill(e, limits, now);
+
+			if (!limits->rate || e->tokens == admission_bucket_size(limits))
+			{
+				/* Another entry may have been moved here */
+				admission_delete(adm, i);
+				continue;
+			}
+		}
+		i++;
+	}
+}
+
+void admission_get_stats(struct hub_admission* adm, struct admission_stats* stats)
+{
+	memcpy(stats, &adm->stats, sizeof(struct admission_stats));
+	stats->hosts = adm->count;
+}
@@ -0,0 +1,78 @@
+/*
+ * uhub - A tiny ADC p2p connection hub
+ * Copyright (C) 2007-2014, Jan Vidar Krey
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef HAVE_UHUB_ADMISSION_H
+#define HAVE_UHUB_ADMISSION_H
+
+/**
+ * Admission control for accepted sockets, before anything is allocated
+ * for them. Hosts are IPv4 addresses or IPv6 /64 networks, each having
+ * a count of open connections and a token bucket for accepting new ones.
+ *
+ * The table is allocated up front and never grows. When it is full,
+ * connections from new hosts are admitted without being counted.
+ */
+struct hub_admission;
+
+struct admission_limits
+{
+	size_t max_conns_ipv4;   /* Open connections per IPv4 address, 0 = no limit */
+	size_t max_conns_ipv6;   /* Open connections per IPv6 /64, 0 = no limit */
+	size_t rate;             /* Connections accepted per second, 0 = no limit */
+	size_t burst;            /* Connections accepted at once, with a full bucket */
+};
+
+struct admission_stats
+{
+	size_t accepted;         /* Admitted and counted */
+	size_t untracked;        /* Admitted without counting, since the table was full */
+	size_t rejected_conns;   /* Too many open connections */
+	size_t rejected_rate;    /* Out of tokens */
+	size_t hosts;            /* Hosts in the table */
+};
+
+/**
+ * @param capacity Number of hosts that can be counted (rounded up).
+ */
+extern struct hub_admission* admission_create(size_t capacity);
+extern void admission_destroy(struct hub_admission* adm);
+
+/**
+ * Decide whether a connection from addr can be accepted at time now (ms).
+ *
+ * @return 1 if admitted and counted, admission_release() must be called
+ *           with the same address once the connection is closed.
+ *         0 if admitted without being counted.
+ *        -1 if it should be rejected.
+ */
+extern int admission_accept(struct hub_admission* adm, struct ip_addr_encap* addr, struct admission_limits* limits, uint64_t now);
+
+/**
+ * A connection counted by admission_accept() was closed.
+ */
+extern void admission_release(struct hub_admission* adm, struct ip_addr_encap* addr);
+
+/**
+ * Forget hosts without open connections and with a full bucket.
+ */
+extern void admission_expire(struct hub_admission* adm, struct admission_limits* limits, uint64_t now);
+
+extern void admission_get_stats(struct hub_admission* adm, struct admission_stats* stats);
+
+#endif /* HAVE_UHUB_ADMISSION_H */
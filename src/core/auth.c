@@ -20,18 +20,136 @@
 #include "uhub.h"
 
 #define ACL_ADD_USER(S, L, V) do { ret = check_cmd_user(S, V, L, line, line_count); if (ret != 0) return ret; } while(0)
-#define ACL_ADD_BOOL(S, L)    do { ret = check_cmd_bool(S,    L, line, line_count); if (ret != 0) return ret; } while(0)
-#define ACL_ADD_ADDR(S, L)    do { ret = check_cmd_addr(S,    L, line, line_count); if (ret != 0) return ret; } while(0)
+#define ACL_ADD_BOOL(S, L, I, F) do { ret = check_cmd_bool(S, L, I, F, line, line_count); if (ret != 0) return ret; } while(0)
+#define ACL_ADD_ADDR(S, L, I) do { ret = check_cmd_addr(S,    L, I, line, line_count); if (ret != 0) return ret; } while(0)
 
-static int check_cmd_bool(const char* cmd, struct linked_list* list, char* line, int line_count)
+typedef int (*acl_add_f)(struct linked_list* list, struct hash_table* index, const char* data);
+
+static int acl_nick_equals(const void* a, const void* b)
+{
+	return strcasecmp((const char*) a, (const char*) b) == 0;
+}
+
+static int acl_cid_equals(const void* a, const void* b)
+{
+	return memcmp(a, b, TIGERSIZE) == 0;
+}
+
+/*
+ * The list owns the entries, the index finds them.
+ * @return 1 if added, 0 if already there or invalid, -1 if out of memory.
+ */
+static int acl_nick_add(struct linked_list* list, struct hash_table* index, const char* nick)
+{
+	uint32_t hash = hash_table_hash_string_nocase(nick);
+	char* data;
+
+	if (hash_table_get(index, hash, nick))
+		return 0;
+
+	data = hub_strdup(nick);
+	if (!data || hash_table_insert(index, hash, data, data) != 1)
+	{
+		LOG_ERROR("ACL error: Out of memory!");
+		hub_free(data);
+		return -1;
+	}
+	list_append(list, data);
+	return 1;
+}
+
+static int acl_nick_remove(struct linked_list* list, struct hash_table* index, const char* nick)
+{
+	uint32_t hash = hash_table_hash_string_nocase(nick);
+	char* data = hash_table_get(index, hash, nick);
+
+	if (!data)
+		return 0;
+
+	hash_table_remove(index, hash, data);
+	list_remove(list, data);
+	hub_free(data);
+	return 1;
+}
+
+/* Like uman_cid_decode(), but ignoring case as the ACL always has. */
+static int acl_cid_decode(const char* cid, unsigned char raw[TIGERSIZE])
+{
+	char buf[MAX_CID_LEN + 1];
+	size_t n;
+
+	for (n = 0; n < MAX_CID_LEN && cid[n]; n++)
+		buf[n] = (cid[n] >= 'a' && cid[n] <= 'z') ? (cid[n] - 'a' + 'A') : cid[n];
+	if (cid[n])
+		return 0;
+	buf[n] = '\0';
+
+	return uman_cid_decode(buf, raw);
+}
+
+static int acl_cid_add(struct linked_list* list, struct hash_table* index, const char* cid)
+{
+	unsigned char raw[TIGERSIZE];
+	unsigned char* data;
+	uint32_t hash;
+
+	if (!acl_cid_decode(cid, raw))
+	{
+		LOG_WARN("ACL: Ignoring invalid CID: '%s'", cid);
+		return 0;
+	}
+
+	hash = hash_table_hash_data(raw, TIGERSIZE);
+	if (hash_table_get(index, hash, raw))
+		return 0;
+
+	data = hub_malloc(TIGERSIZE);
+	if (!data)
+	{
+		LOG_ERROR("ACL error: Out of memory!");
+		return -1;
+	}
+	memcpy(data, raw, TIGERSIZE);
+
+	if (hash_table_insert(index, hash, data, data) != 1)
+	{
+		LOG_ERROR("ACL error: Out of memory!");
+		hub_free(data);
+		return -1;
+	}
+	list_append(list, data);
+	return 1;
+}
+
+static int acl_cid_remove(struct linked_list* list, struct hash_table* index, const char* cid)
+{
+	unsigned char raw[TIGERSIZE];
+	unsigned char* data;
+	uint32_t hash;
+
+	if (!acl_cid_decode(cid, raw))
+		return 0;
+
+	hash = hash_table_hash_data(raw, TIGERSIZE);
+	data = hash_table_get(index, hash, raw);
+	if (!data)
+		return 0;
+
+	hash_table_remove(index, hash, data);
+	list_remove(list, data);
+	hub_free(data);
+	return 1;
+}
+
+static int check_cmd_bool(const char* cmd, struct linked_list* list, struct hash_table* index, acl_add_f add, char* line, int line_count)
 {
 	char* data;
 
 	if (!strncmp(line, cmd, strlen(cmd)))
 	{
 		data = &line[strlen(cmd)];
-		data[0] = '\0';
-		data++;
+		if (*data)
+			*data++ = '\0';
 
 		data = strip_white_space(data);
 		if (!*data)
@@ -40,7 +158,8 @@ static int check_cmd_bool(const char* cmd, struct linked_list* list, char* line,
 			return -1;
 		}
 
-		list_append(list, hub_strdup(data));
+		if (add(list, index, data) == -1)
+			return -1;
 		LOG_DEBUG("ACL: Deny access for: '%s' (%s)", data, cmd);
 		return 1;
 	}
@@ -57,8 +176,8 @@ static int check_cmd_user(const char* cmd, int status, struct linked_list* list,
 	{
 		data = &line[strlen(cmd)];
 		data_extra = 0;
-		data[0] = '\0';
-		data++;
+		if (*data)
+			*data++ = '\0';
 
 		data = strip_white_space(data);
 		if (!*data)
@@ -97,7 +216,7 @@ static int check_cmd_user(const char* cmd, int status, struct linked_list* list,
 }
 
 
-static void add_ip_range(struct linked_list* list, struct ip_range* info)
+static int add_ip_range(struct linked_list* list, struct ip_trie* index, struct ip_range* info)
 {
 	char buf1[INET6_ADDRSTRLEN+1];
 	char buf2[INET6_ADDRSTRLEN+1];
@@ -112,13 +231,20 @@ static void add_ip_range(struct linked_list* list, struct ip_range* info)
 		net_address_to_string(AF_INET6, &info->lo.internal_ip_data.in6, buf1, INET6_ADDRSTRLEN);
 		net_address_to_string(AF_INET6, &info->hi.internal_ip_data.in6, buf2, INET6_ADDRSTRLEN);
 	}
-	LOG_DEBUG("ACL: Added ip range: %s-%s", buf1, buf2);
 
+	if (!ip_trie_insert(index, info, info))
+	{
+		LOG_WARN("ACL: Ignoring empty or unusable ip range: %s-%s", buf1, buf2);
+		return 0;
+	}
+
+	LOG_DEBUG("ACL: Added ip range: %s-%s", buf1, buf2);
 	list_append(list, info);
+	return 1;
 }
 
 
-static int check_cmd_addr(const char* cmd, struct linked_list* list, char* line, int line_count)
+static int check_cmd_addr(const char* cmd, struct linked_list* list, struct ip_trie* index, char* line, int line_count)
 {
 	char* data;
 	struct ip_range* range = 0;
@@ -126,8 +252,8 @@ static int check_cmd_addr(const char* cmd, struct linked_list* list, char* line,
 	if (!strncmp(line, cmd, strlen(cmd)))
 	{
 		data = &line[strlen(cmd)];
-		data[0] = '\0';
-		data++;
+		if (*data)
+			*data++ = '\0';
 
 		data = strip_white_space(data);
 		if (!*data)
@@ -146,7 +272,8 @@ static int check_cmd_addr(const char* cmd, struct linked_list* list, char* line,
 
 		if (ip_convert_address_to_range(data, range))
 		{
-			add_ip_range(list, range);
+			if (!add_ip_range(list, index, range))
+				hub_free(range);
 			return 1;
 		}
 		hub_free(range);
@@ -178,11 +305,11 @@ static int acl_parse_line(char* line, int line_count, void* ptr_data)
 	ACL_ADD_USER("user_op",    handle->users, auth_cred_operator);
 	ACL_ADD_USER("user_reg",   handle->users, auth_cred_user);
 	ACL_ADD_USER("link",       handle->users, auth_cred_link);
-	ACL_ADD_BOOL("deny_nick",  handle->users_denied);
-	ACL_ADD_BOOL("ban_nick",   handle->users_banned);
-	ACL_ADD_BOOL("ban_cid",    handle->cids);
-	ACL_ADD_ADDR("deny_ip",    handle->networks);
-	ACL_ADD_ADDR("nat_ip",     handle->nat_override);
+	ACL_ADD_BOOL("deny_nick",  handle->users_denied, handle->users_denied_index, acl_nick_add);
+	ACL_ADD_BOOL("ban_nick",   handle->users_banned, handle->users_banned_index, acl_nick_add);
+	ACL_ADD_BOOL("ban_cid",    handle->cids, handle->cids_index, acl_cid_add);
+	ACL_ADD_ADDR("deny_ip",    handle->networks, handle->networks_index);
+	ACL_ADD_ADDR("nat_ip",     handle->nat_override, handle->nat_override_index);
 
 	LOG_ERROR("Unknown ACL command on line %d: '%s'", line_count, line);
 	return -1;
@@ -200,8 +327,14 @@ int acl_initialize(struct hub_config* config, struct acl_handle* handle)
 	handle->cids         = list_create();
 	handle->networks     = list_create();
 	handle->nat_override = list_create();
-
-	if (!handle->users || !handle->cids || !handle->networks || !handle->users_denied || !handle->users_banned || !handle->nat_override)
+	handle->networks_index     = ip_trie_create();
+	handle->nat_override_index = ip_trie_create();
+	handle->cids_index         = hash_table_create(acl_cid_equals, 0);
+	handle->users_banned_index = hash_table_create(acl_nick_equals, 0);
+	handle->users_denied_index = hash_table_create(acl_nick_equals, 0);
+
+	if (!handle->users || !handle->cids || !handle->networks || !handle->users_denied || !handle->users_banned || !handle->nat_override ||
+	    !handle->networks_index || !handle->nat_override_index || !handle->cids_index || !handle->users_banned_index || !handle->users_denied_index)
 	{
 		LOG_FATAL("acl_initialize: Out of memory");
 
@@ -211,6 +344,12 @@ int acl_initialize(struct hub_config* config, struct acl_handle* handle)
 		list_destroy(handle->cids);
 		list_destroy(handle->networks);
 		list_destroy(handle->nat_override);
+		ip_trie_destroy(handle->networks_index);
+		ip_trie_destroy(handle->nat_override_index);
+		hash_table_destroy(handle->cids_index);
+		hash_table_destroy(handle->users_banned_index);
+		hash_table_destroy(handle->users_denied_index);
+		memset(handle, 0, sizeof(struct acl_handle));
 		return -1;
 	}
 
@@ -284,6 +423,13 @@ int acl_shutdown(struct acl_handle* handle)
 		list_destroy(handle->nat_override);
 	}
 
+	ip_trie_destroy(handle->networks_index);
+	ip_trie_destroy(handle->nat_override_index);
+
+	hash_table_destroy(handle->cids_index);
+	hash_table_destroy(handle->users_banned_index);
+	hash_table_destroy(handle->users_denied_index);
+
 	memset(handle, 0, sizeof(struct acl_handle));
 	return 0;
 }
@@ -332,98 +478,56 @@ struct auth_info* acl_get_access_info(struct hub_info* hub, const char* name)
 	return info;
 }
 
-#define STR_LIST_CONTAINS(LIST, STR) \
-		LIST_FOREACH(char*, str, LIST, \
-		{ \
-			if (strcasecmp(str, STR) == 0) \
-				return 1; \
-		}); \
-		return 0
-
-int acl_is_cid_banned(struct acl_handle* handle, const char* data)
+int acl_is_cid_banned(struct acl_handle* handle, const unsigned char* cid)
 {
-	char* str;
 	if (!handle) return 0;
-	STR_LIST_CONTAINS(handle->cids, data);
+	return hash_table_get(handle->cids_index, hash_table_hash_data(cid, TIGERSIZE), cid) != NULL;
 }
 
 int acl_is_user_banned(struct acl_handle* handle, const char* data)
 {
-	char* str;
 	if (!handle) return 0;
-	STR_LIST_CONTAINS(handle->users_banned, data);
+	return hash_table_get(handle->users_banned_index, hash_table_hash_string_nocase(data), data) != NULL;
 }
 
 int acl_is_user_denied(struct acl_handle* handle, const char* data)
 {
-	char* str;
 	if (!handle) return 0;
-	STR_LIST_CONTAINS(handle->users_denied, data);
+	return hash_table_get(handle->users_denied_index, hash_table_hash_string_nocase(data), data) != NULL;
 }
 
 int acl_user_ban_nick(struct acl_handle* handle, const char* nick)
 {
-	char* data = hub_strdup(nick);
-	if (!data)
-	{
-		LOG_ERROR("ACL error: Out of memory!");
-		return -1;
-	}
-
-	list_append(handle->users_banned, data);
-	return 0;
+	return acl_nick_add(handle->users_banned, handle->users_banned_index, nick) == -1 ? -1 : 0;
 }
 
 int acl_user_ban_cid(struct acl_handle* handle, const char* cid)
 {
-	char* data = hub_strdup(cid);
-	if (!data)
-	{
-		LOG_ERROR("ACL error: Out of memory!");
+	unsigned char raw[TIGERSIZE];
+	if (!acl_cid_decode(cid, raw))
 		return -1;
-	}
-
-	list_append(handle->cids, data);
-	return 0;
+	return acl_cid_add(handle->cids, handle->cids_index, cid) == -1 ? -1 : 0;
 }
 
 int acl_user_unban_nick(struct acl_handle* handle, const char* nick)
 {
-	return -1;
+	return acl_nick_remove(handle->users_banned, handle->users_banned_index, nick) ? 0 : -1;
 }
 
 int acl_user_unban_cid(struct acl_handle* handle, const char* cid)
 {
-	return -1;
+	return acl_cid_remove(handle->cids, handle->cids_index, cid) ? 0 : -1;
 }
 
 
-int acl_is_ip_banned(struct acl_handle* handle, const char* ip_address)
+int acl_is_ip_banned(struct acl_handle* handle, struct ip_addr_encap* addr)
 {
-	struct ip_addr_encap raw;
-	struct ip_range* info;
-
-	ip_convert_to_binary(ip_address, &raw);
-	LIST_FOREACH(struct ip_range*, info, handle->networks,
-	{
-		if (ip_in_range(&raw, info))
-			return 1;
-	});
-	return 0;
+	return ip_trie_lookup(handle->networks_index, addr) != NULL;
 }
 
-int acl_is_ip_nat_override(struct acl_handle* handle, const char* ip_address)
+int acl_is_ip_nat_override(struct acl_handle* handle, struct ip_addr_encap* addr)
 {
-	struct ip_addr_encap raw;
-	struct ip_range* info;
-
-	ip_convert_to_binary(ip_address, &raw);
-	LIST_FOREACH(struct ip_range*, info, handle->nat_override,
-	{
-		if (ip_in_range(&raw, info))
-			return 1;
-	});
-	return 0;
+	return ip_trie_lookup(handle->nat_override_index, addr) != NULL;
 }
 
 
@@ -462,9 +566,11 @@ int acl_password_verify(struct hub_info* hub, struct hub_user* user, const char*
 	if (!password || !user || strlen(password) != MAX_CID_LEN)
 		return 0;
 
-	access = acl_get_access_info(hub, user->id.nick);
+	/* Looked up when the user logged in, see set_credentials() */
+	access = user->auth;
 	if (!access)
 		return 0;
+	user->auth = NULL;
 
 	challenge = acl_password_generate_challenge(hub, user);
 
@@ -28,11 +28,16 @@ struct ip_addr_encap;
 struct acl_handle
 {
 	struct linked_list* users;          /* Known users. See enum user_status */
-	struct linked_list* cids;           /* Known CIDs */
+	struct linked_list* cids;           /* Banned CIDs (binary) */
 	struct linked_list* networks;       /* IP ranges, used for banning */
 	struct linked_list* nat_override;   /* IPs inside these ranges can provide their false IP. Use with care! */
+	struct ip_trie* networks_index;     /* Lookup of networks by address */
+	struct ip_trie* nat_override_index; /* Lookup of nat_override by address */
 	struct linked_list* users_banned;   /* Users permanently banned */
 	struct linked_list* users_denied;   /* bad nickname */
+	struct hash_table* cids_index;          /* Lookup of cids */
+	struct hash_table* users_banned_index;  /* Lookup of users_banned, ignoring case */
+	struct hash_table* users_denied_index;  /* Lookup of users_denied, ignoring case */
 };
 
 
@@ -45,13 +50,22 @@ extern int acl_update_user(struct hub_info* hub, struct auth_info* info);
 extern int acl_delete_user(struct hub_info* hub, const char* name);
 
 
-extern int acl_is_cid_banned(struct acl_handle* handle, const char* cid);
-extern int acl_is_ip_banned(struct acl_handle* handle, const char* ip_address);
-extern int acl_is_ip_nat_override(struct acl_handle* handle, const char* ip_address);
+/**
+ * @param cid binary CID, TIGERSIZE bytes.
+ */
+extern int acl_is_cid_banned(struct acl_handle* handle, const unsigned char* cid);
+extern int acl_is_ip_banned(struct acl_handle* handle, struct ip_addr_encap* addr);
+extern int acl_is_ip_nat_override(struct acl_handle* handle, struct ip_addr_encap* addr);
 
 extern int acl_is_user_banned(struct acl_handle* handle, const char* name);
 extern int acl_is_user_denied(struct acl_handle* handle, const char* name);
 
+/**
+ * Add or remove bans, until the ACL is read again.
+ * Nicks are matched ignoring case, CIDs are given in base32.
+ * @return 0 on success, -1 if out of memory, the CID is invalid or
+ *         there was no such ban to remove.
+ */
 extern int acl_user_ban_nick(struct acl_handle* handle, const char* nick);
 extern int acl_user_ban_cid(struct acl_handle* handle, const char* cid);
 extern int acl_user_unban_nick(struct acl_handle* handle, const char* nick);
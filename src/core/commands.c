@@ -357,6 +357,52 @@ static int command_kick(struct command_base* cbase, struct hub_user* user, struc
 	return command_status(cbase, user, cmd, buf);
 }
 
+static int command_ban(struct command_base* cbase, struct hub_user* user, struct hub_command* cmd)
+{
+	struct cbuffer* buf;
+	struct hub_command_arg_data* arg = hub_command_arg_next(cmd, type_user);
+	struct hub_user* target = arg->data.user;
+	struct acl_handle* acl = cbase->hub->acl;
+	int nick_banned = acl_is_user_banned(acl, target->id.nick);
+
+	buf = cbuf_create(128);
+	if (target == user)
+	{
+		cbuf_append(buf, "Cannot ban yourself.");
+	}
+	else if (acl_user_ban_nick(acl, target->id.nick) == -1)
+	{
+		cbuf_append_format(buf, "Unable to ban user \"%s\".", target->id.nick);
+	}
+	else if (acl_user_ban_cid(acl, target->id.cid) == -1)
+	{
+		/* Do not leave the nick banned when the ban as a whole failed */
+		if (!nick_banned)
+			acl_user_unban_nick(acl, target->id.nick);
+		cbuf_append_format(buf, "Unable to ban user \"%s\".", target->id.nick);
+	}
+	else
+	{
+		cbuf_append_format(buf, "Banning user \"%s\".", target->id.nick);
+		hub_disconnect_user(cbase->hub, target, quit_kicked);
+	}
+	return command_status(cbase, user, cmd, buf);
+}
+
+static int command_unban(struct command_base* cbase, struct hub_user* user, struct hub_command* cmd)
+{
+	struct cbuffer* buf;
+	struct hub_command_arg_data* arg = hub_command_arg_next(cmd, type_string);
+	const char* name = arg->data.string;
+
+	buf = cbuf_create(128);
+	if (acl_user_unban_nick(cbase->hub->acl, name) == 0 || acl_user_unban_cid(cbase->hub->acl, name) == 0)
+		cbuf_append_format(buf, "Ban on \"%s\" lifted.", name);
+	else
+		cbuf_append_format(buf, "No ban on \"%s\".", name);
+	return command_status(cbase, user, cmd, buf);
+}
+
 static int command_reload(struct command_base* cbase, struct hub_user* user, struct hub_command* cmd)
 {
 	cbase->hub->status = hub_status_restart;
@@ -458,7 +504,7 @@ static int command_broadcast(struct command_base* cbase, struct hub_user* user,
 	memcpy(from_sid, sid_to_string(user->id.sid), sizeof(from_sid));
 	memcpy(pm_flag + 2, from_sid, sizeof(from_sid));
 
-	LIST_FOREACH(struct hub_user*, target, cbase->hub->users->list,
+	UMAN_FOREACH(cbase->hub->users, target,
 	{
 		if (target != user)
 		{
@@ -549,6 +595,11 @@ static int command_stats(struct command_base* cbase, struct hub_user* user, stru
 {
 	struct cbuffer* buf = cbuf_create(128);
 	struct hub_info* hub = cbase->hub;
+	struct admission_stats admission;
+	struct login_queue_stats logins;
+	struct zlif_stats zlif;
+	char sentbuf[64];
+	char savedbuf[64];
 	static char rxbuf[64] = { "0 B" };
 	static char txbuf[64] = { "0 B" };
 
@@ -571,6 +622,42 @@ static int command_stats(struct command_base* cbase, struct hub_user* user, stru
 	cbuf_append_format(buf, ", total_tx=%s", txbuf);
 	cbuf_append_format(buf, ", total_rx=%s", rxbuf);
 
+	cbuf_append_format(buf, ". Events: queued=" PRINTF_SIZE_T ", peak=" PRINTF_SIZE_T, event_queue_size(hub->queue), event_queue_high_water(hub->queue));
+	cbuf_append_format(buf, ". Log: dropped=" PRINTF_SIZE_T, hub_log_dropped());
+
+	admission_get_stats(hub->admission, &admission);
+	cbuf_append_format(buf, ". Admission: hosts=" PRINTF_SIZE_T ", accepted=" PRINTF_SIZE_T ", untracked=" PRINTF_SIZE_T ", rejected_conns=" PRINTF_SIZE_T ", rejected_rate=" PRINTF_SIZE_T,
+		admission.hosts, admission.accepted, admission.untracked, admission.rejected_conns, admission.rejected_rate);
+
+	login_queue_get_stats(hub->logins, &logins);
+	cbuf_append_format(buf, ". Logins: queued=" PRINTF_SIZE_T ", peak=" PRINTF_SIZE_T ", logins=" PRINTF_SIZE_T ", waited=" PRINTF_SIZE_T ", rejected=" PRINTF_SIZE_T,
+		logins.queued, logins.queued_peak, logins.logins, logins.waited, logins.rejected);
+	cbuf_append_format(buf, ", wait p50/p90/p99/max=" PRINTF_SIZE_T "/" PRINTF_SIZE_T "/" PRINTF_SIZE_T "/" PRINTF_SIZE_T " ms",
+		(size_t) logins.wait_p50, (size_t) logins.wait_p90, (size_t) logins.wait_p99, (size_t) logins.wait_max);
+
+	if (hub->zlif)
+	{
+		zlif_get_stats(hub->zlif, &zlif);
+		format_size((size_t) zlif.sent_bytes, sentbuf, sizeof(sentbuf));
+		format_size((size_t) (zlif.raw_bytes > zlif.sent_bytes ? zlif.raw_bytes - zlif.sent_bytes : 0), savedbuf, sizeof(savedbuf));
+		cbuf_append_format(buf, ". ZLIF: blocks=" PRINTF_SIZE_T ", sent=" PRINTF_SIZE_T " (%s, saved %s, %.0f%%), cpu=%.1f ms, streams=" PRINTF_SIZE_T,
+			zlif.blocks, zlif.sent, sentbuf, savedbuf, zlif.raw_bytes ? 100.0 - (zlif.sent_bytes * 100.0 / zlif.raw_bytes) : 0.0, zlif.cpu_ns / 1e6, zlif.streams);
+	}
+
+	if (hub->plugins && hub->plugins->hooks)
+	{
+		const char* sep = ". Plugin hooks: ";
+		size_t id;
+		for (id = 0; id < plugin_hook_max; id++)
+		{
+			struct plugin_hook* hook = &hub->plugins->hooks->hook[id];
+			if (!hook->calls)
+				continue;
+			cbuf_append_format(buf, "%s%s=%.0f calls/%.1f ms", sep, plugin_hook_name(id), (double) hook->calls, hook->time / 1e6);
+			sep = ", ";
+		}
+	}
+
 	return command_status(cbase, user, cmd, buf);
 }
 
@@ -593,6 +680,7 @@ static struct command_handle* add_builtin(struct command_base* cbase, const char
 
 void commands_builtin_add(struct command_base* cbase)
 {
+	ADD_COMMAND("ban",        3, "u", auth_cred_operator,  command_ban,      "Ban a user until reload"      );
 	ADD_COMMAND("broadcast",  9, "+m",auth_cred_operator,  command_broadcast,"Send a message to all users"  );
 	ADD_COMMAND("getip",      5, "u", auth_cred_operator,  command_getip,    "Show IP address for a user"   );
 	ADD_COMMAND("help",       4, "?c",auth_cred_guest,     command_help,     "Show this help message."      );
@@ -602,6 +690,7 @@ void commands_builtin_add(struct command_base* cbase)
 	ADD_COMMAND("reload",     6, "",  auth_cred_admin,     command_reload,   "Reload configuration files."  );
 	ADD_COMMAND("shutdown",   8, "",  auth_cred_admin,     command_shutdown_hub, "Shutdown hub."            );
 	ADD_COMMAND("stats",      5, "",  auth_cred_super,     command_stats,    "Show hub statistics."         );
+	ADD_COMMAND("unban",      5, "n", auth_cred_operator,  command_unban,    "Lift a ban on a nick or CID"  );
 	ADD_COMMAND("uptime",     6, "",  auth_cred_guest,     command_uptime,   "Display hub uptime info."     );
 	ADD_COMMAND("version",    7, "",  auth_cred_guest,     command_version,  "Show hub version info."       );
 	ADD_COMMAND("whoip",      5, "r", auth_cred_operator,  command_whoip,    "Show users matching IP range" );
@@ -27,19 +27,85 @@ static void eq_debug(const char* prefix, struct event_data* data)
 #endif
 
 
+#define EVENT_RING_MIN_CAPACITY 64
+
+static struct event_ring* event_ring_create()
+{
+	struct event_ring* ring = (struct event_ring*) hub_malloc_zero(sizeof(struct event_ring));
+	if (!ring)
+		return NULL;
+
+	ring->events = (struct event_data*) hub_malloc(sizeof(struct event_data) * EVENT_RING_MIN_CAPACITY);
+	if (!ring->events)
+	{
+		hub_free(ring);
+		return NULL;
+	}
+	ring->capacity = EVENT_RING_MIN_CAPACITY;
+	return ring;
+}
+
+static void event_ring_destroy(struct event_ring* ring)
+{
+	if (ring)
+	{
+		hub_free(ring->events);
+		hub_free(ring);
+	}
+}
+
+/*
+ * Double the capacity, and unwrap the pending events so that they
+ * start at index 0.
+ */
+static int event_ring_grow(struct event_ring* ring)
+{
+	size_t capacity = ring->capacity * 2;
+	size_t first = MIN(ring->count, ring->capacity - ring->head);
+	struct event_data* events = (struct event_data*) hub_malloc(sizeof(struct event_data) * capacity);
+	if (!events)
+		return 0;
+
+	memcpy(events, &ring->events[ring->head], sizeof(struct event_data) * first);
+	memcpy(&events[first], ring->events, sizeof(struct event_data) * (ring->count - first));
+
+	hub_free(ring->events);
+	ring->events = events;
+	ring->capacity = capacity;
+	ring->head = 0;
+	return 1;
+}
+
+static int event_ring_push(struct event_ring* ring, struct event_data* message)
+{
+	struct event_data* data;
+
+	if (ring->count == ring->capacity && !event_ring_grow(ring))
+		return 0;
+
+	data = &ring->events[(ring->head + ring->count) & (ring->capacity - 1)];
+	data->id    = message->id;
+	data->ptr   = message->ptr;
+	data->flags = message->flags;
+	ring->count++;
+	return 1;
+}
+
 int event_queue_initialize(struct event_queue** queue, event_queue_callback callback, void* ptr)
 {
 	*queue = (struct event_queue*) hub_malloc_zero(sizeof(struct event_queue));
 	if (!(*queue))
 		return -1;
 
-	(*queue)->q1 = list_create();
-	(*queue)->q2 = list_create();
+	(*queue)->q1 = event_ring_create();
+	(*queue)->q2 = event_ring_create();
 
 	if (!(*queue)->q1 || !(*queue)->q2)
 	{
-		list_destroy((*queue)->q1);
-		list_destroy((*queue)->q2);
+		event_ring_destroy((*queue)->q1);
+		event_ring_destroy((*queue)->q2);
+		hub_free(*queue);
+		*queue = NULL;
 		return -1;
 	}
 
@@ -53,49 +119,49 @@ int event_queue_initialize(struct event_queue** queue, event_queue_callback call
 void event_queue_shutdown(struct event_queue* queue)
 {
 	/* Should be empty at this point! */
-	list_destroy(queue->q1);
-	list_destroy(queue->q2);
+	event_ring_destroy(queue->q1);
+	event_ring_destroy(queue->q2);
 	hub_free(queue);
 }
 
-static void event_queue_cleanup_callback(void* ptr)
-{
-#ifdef EQ_DEBUG
-	struct event_data* data = (struct event_data*) ptr;
-	eq_debug("NUKE", data);
-#endif
-
-	hub_free((struct event_data*) ptr);
-}
-
 int event_queue_process(struct event_queue* queue)
 {
+	struct event_ring* ring = queue->q1;
 	struct event_data* data;
+	size_t mask;
+
 	if (queue->locked)
 		return 0;
 
-	/* lock primary queue, and handle the primary queue messages. */
+	/*
+	 * Lock the primary queue, and handle the primary queue messages as one batch.
+	 * Events posted by the callbacks go to the secondary queue, so the primary
+	 * ring is not modified while it is being processed.
+	 */
 	queue->locked = 1;
 
-	LIST_FOREACH(struct event_data*, data, queue->q1,
+	mask = ring->capacity - 1;
+	while (ring->count)
 	{
+		data = &ring->events[ring->head];
 #ifdef EQ_DEBUG
 		eq_debug("EXEC", data);
 #endif
 		queue->callback(queue->callback_data, data);
-	});
-
-	list_clear(queue->q1, event_queue_cleanup_callback);
-	uhub_assert(list_size(queue->q1) == 0);
+		ring->head = (ring->head + 1) & mask;
+		ring->count--;
+	}
+	ring->head = 0;
 
 	/* unlock queue */
 	queue->locked = 0;
 
-	/* transfer from secondary queue to the primary queue. */
-	list_append_list(queue->q1, queue->q2);
+	/* the secondary queue becomes the primary queue. */
+	queue->q1 = queue->q2;
+	queue->q2 = ring;
 
 	/* if more events exist, schedule it */
-	if (list_size(queue->q1))
+	if (queue->q1->count)
 	{
 		return 1;
 	}
@@ -104,33 +170,31 @@ int event_queue_process(struct event_queue* queue)
 
 void event_queue_post(struct event_queue* queue, struct event_data* message)
 {
-	struct linked_list* q = (!queue->locked) ? queue->q1 : queue->q2;
-	struct event_data* data;
-
-	data = (struct event_data*) hub_malloc(sizeof(struct event_data));
-	if (data)
-	{
-		data->id    = message->id;
-		data->ptr   = message->ptr;
-		data->flags = message->flags;
+	struct event_ring* ring = (!queue->locked) ? queue->q1 : queue->q2;
+	size_t size;
 
 #ifdef EQ_DEBUG
-		eq_debug("POST", data);
+	eq_debug("POST", message);
 #endif
 
-		list_append(q, data);
-	}
-	else
+	if (!event_ring_push(ring, message))
 	{
 		LOG_ERROR("event_queue_post: OUT OF MEMORY");
+		return;
 	}
+
+	size = event_queue_size(queue);
+	if (size > queue->high_water)
+		queue->high_water = size;
 }
 
 
 size_t event_queue_size(struct event_queue* queue)
 {
-	return list_size(queue->q1) + list_size(queue->q2);
+	return queue->q1->count + queue->q2->count;
 }
 
-
-
+size_t event_queue_high_water(struct event_queue* queue)
+{
+	return queue->high_water;
+}
@@ -29,20 +29,42 @@ struct event_data
 
 typedef void (*event_queue_callback)(void* callback_data, struct event_data* event_data);
 
+/**
+ * A growable ring of inline event records.
+ * The capacity is always a power of two.
+ */
+struct event_ring
+{
+	struct event_data* events;
+	size_t capacity;
+	size_t head;  /* index of the first pending event */
+	size_t count; /* number of pending events */
+};
+
 struct event_queue
 {
 	int locked;
-	struct linked_list* q1; /* primary */
-	struct linked_list* q2; /* secondary, when primary is locked */
+	struct event_ring* q1; /* primary */
+	struct event_ring* q2; /* secondary, when primary is locked */
 	event_queue_callback callback;
 	void* callback_data;
+	size_t high_water;     /* highest number of pending events seen */
 };
 
 extern int event_queue_initialize(struct event_queue** queue, event_queue_callback callback, void* ptr);
 extern int event_queue_process(struct event_queue* queue);
 extern void event_queue_shutdown(struct event_queue* queue);
 extern void event_queue_post(struct event_queue* queue, struct event_data* message);
+
+/**
+ * @return the number of pending events (queue depth).
+ */
 extern size_t event_queue_size(struct event_queue* queue);
 
+/**
+ * @return the highest number of pending events seen since the queue was created.
+ */
+extern size_t event_queue_high_water(struct event_queue* queue);
+
 #endif /* HAVE_UHUB_EVENT_QUEUE_H */
 
@@ -1,9 +1,9 @@
 /*
  * uhub - A tiny ADC p2p connection hub
- * Copyright (C) 2007-2014, Jan Vidar Krey
+ * Copyright (C) 2007-2026, Jan Vidar Krey
  *
  * THIS FILE IS AUTOGENERATED - DO NOT MODIFY
- * Created 2014-07-29 12:22, by config.py
+ * Created 2026-10-18 23:55, by config.py
  */
 
 void config_defaults(struct hub_config* config)
@@ -13,6 +13,8 @@ void config_defaults(struct hub_config* config)
 	config->server_bind_addr = hub_strdup("any");
 	config->server_listen_backlog = 50;
 	config->server_alt_ports = hub_strdup("");
+	config->server_unix_socket = hub_strdup("");
+	config->server_unix_socket_users = hub_strdup("");
 	config->show_banner = 1;
 	config->show_banner_sys_info = 1;
 	config->max_users = 500;
@@ -27,6 +29,7 @@ void config_defaults(struct hub_config* config)
 	config->max_send_buffer = 131072;
 	config->max_send_buffer_soft = 98304;
 	config->low_bandwidth_mode = 0;
+	config->zlif_enable = 0;
 	config->max_chat_history = 20;
 	config->max_logout_log = 20;
 	config->limit_max_hubs_user = 10;
@@ -46,6 +49,12 @@ void config_defaults(struct hub_config* config)
 	config->flood_ctl_search = 0;
 	config->flood_ctl_update = 0;
 	config->flood_ctl_extras = 0;
+	config->accept_max_conns_ipv4 = 0;
+	config->accept_max_conns_ipv6 = 0;
+	config->accept_rate = 0;
+	config->accept_burst = 10;
+	config->login_rate = 0;
+	config->login_burst = 20;
 	config->tls_enable = 0;
 	config->tls_require = 0;
 	config->tls_require_redirect_addr = hub_strdup("");
@@ -78,6 +87,7 @@ void config_defaults(struct hub_config* config)
 	config->msg_auth_invalid_password = hub_strdup("Password is wrong");
 	config->msg_auth_user_not_found = hub_strdup("User not found in password database");
 	config->msg_error_no_memory = hub_strdup("No memory");
+	config->msg_login_queued = hub_strdup("Hub is busy, you will be logged in shortly");
 	config->msg_user_share_size_low = hub_strdup("User is not sharing enough");
 	config->msg_user_share_size_high = hub_strdup("User is sharing too much");
 	config->msg_user_slots_low = hub_strdup("User have too few upload slots.");
@@ -151,6 +161,26 @@ static int apply_config(struct hub_config* config, char* key, char* data, int li
 		return 0;
 	}
 
+	if (!strcmp(key, "server_unix_socket"))
+	{
+		if (!apply_string(key, data, &config->server_unix_socket, (char*) ""))
+		{
+			LOG_ERROR("Configuration parse error on line %d", line_count);
+			return -1;
+		}
+		return 0;
+	}
+
+	if (!strcmp(key, "server_unix_socket_users"))
+	{
+		if (!apply_string(key, data, &config->server_unix_socket_users, (char*) ""))
+		{
+			LOG_ERROR("Configuration parse error on line %d", line_count);
+			return -1;
+		}
+		return 0;
+	}
+
 	if (!strcmp(key, "show_banner"))
 	{
 		if (!apply_boolean(key, data, &config->show_banner))
@@ -297,6 +327,16 @@ static int apply_config(struct hub_config* config, char* key, char* data, int li
 		return 0;
 	}
 
+	if (!strcmp(key, "zlif_enable"))
+	{
+		if (!apply_boolean(key, data, &config->zlif_enable))
+		{
+			LOG_ERROR("Configuration parse error on line %d", line_count);
+			return -1;
+		}
+		return 0;
+	}
+
 	if (!strcmp(key, "max_chat_history"))
 	{
 		min = 0;
@@ -504,6 +544,72 @@ static int apply_config(struct hub_config* config, char* key, char* data, int li
 		return 0;
 	}
 
+	if (!strcmp(key, "accept_max_conns_ipv4"))
+	{
+		if (!apply_integer(key, data, &config->accept_max_conns_ipv4, 0, 0))
+		{
+			LOG_ERROR("Configuration parse error on line %d", line_count);
+			return -1;
+		}
+		return 0;
+	}
+
+	if (!strcmp(key, "accept_max_conns_ipv6"))
+	{
+		if (!apply_integer(key, data, &config->accept_max_conns_ipv6, 0, 0))
+		{
+			LOG_ERROR("Configuration parse error on line %d", line_count);
+			return -1;
+		}
+		return 0;
+	}
+
+	if (!strcmp(key, "accept_rate"))
+	{
+		if (!apply_integer(key, data, &config->accept_rate, 0, 0))
+		{
+			LOG_ERROR("Configuration parse error on line %d", line_count);
+			return -1;
+		}
+		return 0;
+	}
+
+	if (!strcmp(key, "accept_burst"))
+	{
+		min = 1;
+		max = 10000;
+		if (!apply_integer(key, data, &config->accept_burst, &min, &max))
+		{
+			LOG_ERROR("Configuration parse error on line %d", line_count);
+			return -1;
+		}
+		return 0;
+	}
+
+	if (!strcmp(key, "login_rate"))
+	{
+		min = 0;
+		max = 100000;
+		if (!apply_integer(key, data, &config->login_rate, &min, &max))
+		{
+			LOG_ERROR("Configuration parse error on line %d", line_count);
+			return -1;
+		}
+		return 0;
+	}
+
+	if (!strcmp(key, "login_burst"))
+	{
+		min = 1;
+		max = 100000;
+		if (!apply_integer(key, data, &config->login_burst, &min, &max))
+		{
+			LOG_ERROR("Configuration parse error on line %d", line_count);
+			return -1;
+		}
+		return 0;
+	}
+
 	if (!strcmp(key, "tls_enable"))
 	{
 		if (!apply_boolean(key, data, &config->tls_enable))
@@ -824,6 +930,16 @@ static int apply_config(struct hub_config* config, char* key, char* data, int li
 		return 0;
 	}
 
+	if (!strcmp(key, "msg_login_queued"))
+	{
+		if (!apply_string(key, data, &config->msg_login_queued, (char*) ""))
+		{
+			LOG_ERROR("Configuration parse error on line %d", line_count);
+			return -1;
+		}
+		return 0;
+	}
+
 	if (!strcmp(key, "msg_user_share_size_low"))
 	{
 		if (!apply_string(key, data, &config->msg_user_share_size_low, (char*) ""))
@@ -965,6 +1081,10 @@ void free_config(struct hub_config* config)
 
 	hub_free(config->server_alt_ports);
 
+	hub_free(config->server_unix_socket);
+
+	hub_free(config->server_unix_socket_users);
+
 	hub_free(config->hub_name);
 
 	hub_free(config->hub_description);
@@ -1031,6 +1151,8 @@ void free_config(struct hub_config* config)
 
 	hub_free(config->msg_error_no_memory);
 
+	hub_free(config->msg_login_queued);
+
 	hub_free(config->msg_user_share_size_low);
 
 	hub_free(config->msg_user_share_size_high);
@@ -1076,6 +1198,12 @@ void dump_config(struct hub_config* config, int ignore_defaults)
 	if (!ignore_defaults || strcmp(config->server_alt_ports, "") != 0)
 		fprintf(stdout, "server_alt_ports = \"%s\"\n", config->server_alt_ports);
 
+	if (!ignore_defaults || strcmp(config->server_unix_socket, "") != 0)
+		fprintf(stdout, "server_unix_socket = \"%s\"\n", config->server_unix_socket);
+
+	if (!ignore_defaults || strcmp(config->server_unix_socket_users, "") != 0)
+		fprintf(stdout, "server_unix_socket_users = \"%s\"\n", config->server_unix_socket_users);
+
 	if (!ignore_defaults || config->show_banner != 1)
 		fprintf(stdout, "show_banner = %s\n", config->show_banner ? "yes" : "no");
 
@@ -1118,6 +1246,9 @@ void dump_config(struct hub_config* config, int ignore_defaults)
 	if (!ignore_defaults || config->low_bandwidth_mode != 0)
 		fprintf(stdout, "low_bandwidth_mode = %s\n", config->low_bandwidth_mode ? "yes" : "no");
 
+	if (!ignore_defaults || config->zlif_enable != 0)
+		fprintf(stdout, "zlif_enable = %s\n", config->zlif_enable ? "yes" : "no");
+
 	if (!ignore_defaults || config->max_chat_history != 20)
 		fprintf(stdout, "max_chat_history = %d\n", config->max_chat_history);
 
@@ -1175,6 +1306,24 @@ void dump_config(struct hub_config* config, int ignore_defaults)
 	if (!ignore_defaults || config->flood_ctl_extras != 0)
 		fprintf(stdout, "flood_ctl_extras = %d\n", config->flood_ctl_extras);
 
+	if (!ignore_defaults || config->accept_max_conns_ipv4 != 0)
+		fprintf(stdout, "accept_max_conns_ipv4 = %d\n", config->accept_max_conns_ipv4);
+
+	if (!ignore_defaults || config->accept_max_conns_ipv6 != 0)
+		fprintf(stdout, "accept_max_conns_ipv6 = %d\n", config->accept_max_conns_ipv6);
+
+	if (!ignore_defaults || config->accept_rate != 0)
+		fprintf(stdout, "accept_rate = %d\n", config->accept_rate);
+
+	if (!ignore_defaults || config->accept_burst != 10)
+		fprintf(stdout, "accept_burst = %d\n", config->accept_burst);
+
+	if (!ignore_defaults || config->login_rate != 0)
+		fprintf(stdout, "login_rate = %d\n", config->login_rate);
+
+	if (!ignore_defaults || config->login_burst != 20)
+		fprintf(stdout, "login_burst = %d\n", config->login_burst);
+
 	if (!ignore_defaults || config->tls_enable != 0)
 		fprintf(stdout, "tls_enable = %s\n", config->tls_enable ? "yes" : "no");
 
@@ -1271,6 +1420,9 @@ void dump_config(struct hub_config* config, int ignore_defaults)
 	if (!ignore_defaults || strcmp(config->msg_error_no_memory, "No memory") != 0)
 		fprintf(stdout, "msg_error_no_memory = \"%s\"\n", config->msg_error_no_memory);
 
+	if (!ignore_defaults || strcmp(config->msg_login_queued, "Hub is busy, you will be logged in shortly") != 0)
+		fprintf(stdout, "msg_login_queued = \"%s\"\n", config->msg_login_queued);
+
 	if (!ignore_defaults || strcmp(config->msg_user_share_size_low, "User is not sharing enough") != 0)
 		fprintf(stdout, "msg_user_share_size_low = \"%s\"\n", config->msg_user_share_size_low);
 
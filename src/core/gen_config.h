@@ -1,9 +1,9 @@
 /*
  * uhub - A tiny ADC p2p connection hub
- * Copyright (C) 2007-2014, Jan Vidar Krey
+ * Copyright (C) 2007-2026, Jan Vidar Krey
  *
  * THIS FILE IS AUTOGENERATED - DO NOT MODIFY
- * Created 2014-07-29 12:22, by config.py
+ * Created 2026-10-18 23:55, by config.py
  */
 
 struct hub_config
@@ -13,6 +13,8 @@ struct hub_config
 	char* server_bind_addr;                /*<<< Server bind address (default: "any") */
 	int   server_listen_backlog;           /*<<< Server listen backlog (default: 50) */
 	char* server_alt_ports;                /*<<< Comma separated list of alternative ports to listen to (default: "") */
+	char* server_unix_socket;              /*<<< Unix domain socket to listen to (default: "") */
+	char* server_unix_socket_users;        /*<<< Comma separated list of users allowed on the unix socket (default: "") */
 	int   show_banner;                     /*<<< Show banner on connect (default: 1) */
 	int   show_banner_sys_info;            /*<<< Show banner on connect (default: 1) */
 	int   max_users;                       /*<<< Maximum number of users allowed on the hub (default: 500) */
@@ -27,6 +29,7 @@ struct hub_config
 	int   max_send_buffer;                 /*<<< Max send buffer before disconnect, per user (default: 131072) */
 	int   max_send_buffer_soft;            /*<<< Max send buffer before message drops, per user (default: 98304) */
 	int   low_bandwidth_mode;              /*<<< Enable bandwidth saving measures (default: 0) */
+	int   zlif_enable;                     /*<<< Compress the user list (ZLIF) (default: 0) */
 	int   max_chat_history;                /*<<< Number of chat messages kept in history (default: 20) */
 	int   max_logout_log;                  /*<<< Number of log entries for people leaving the hub (default: 20) */
 	int   limit_max_hubs_user;             /*<<< Max concurrent hubs as a guest user (default: 10) */
@@ -46,6 +49,12 @@ struct hub_config
 	int   flood_ctl_search;                /*<<< Max search requests allowed in time interval (default: 0) */
 	int   flood_ctl_update;                /*<<< Max updates allowed in time interval (default: 0) */
 	int   flood_ctl_extras;                /*<<< Max extra messages allowed in time interval (default: 0) */
+	int   accept_max_conns_ipv4;           /*<<< Max open connections from one IPv4 address (default: 0) */
+	int   accept_max_conns_ipv6;           /*<<< Max open connections from one IPv6 /64 network (default: 0) */
+	int   accept_rate;                     /*<<< Max new connections per second from one address (default: 0) */
+	int   accept_burst;                    /*<<< Max new connections at once from one address (default: 10) */
+	int   login_rate;                      /*<<< Max logins per second (default: 0) */
+	int   login_burst;                     /*<<< Max logins at once (default: 20) */
 	int   tls_enable;                      /*<<< Enable SSL/TLS support (default: 0) */
 	int   tls_require;                     /*<<< If SSL/TLS enabled, should it be required (default: 0) */
 	char* tls_require_redirect_addr;       /*<<< A redirect address in case a client connects using "adc://" when "adcs://" is required. (default: "") */
@@ -78,6 +87,7 @@ struct hub_config
 	char* msg_auth_invalid_password;       /*<<< "Password is wrong" */
 	char* msg_auth_user_not_found;         /*<<< "User not found in password database" */
 	char* msg_error_no_memory;             /*<<< "No memory" */
+	char* msg_login_queued;                /*<<< "Hub is busy, you will be logged in shortly" */
 	char* msg_user_share_size_low;         /*<<< "User is not sharing enough" */
 	char* msg_user_share_size_high;        /*<<< "User is sharing too much" */
 	char* msg_user_slots_low;              /*<<< "User have too few upload slots." */
@@ -97,7 +97,7 @@ int hub_handle_message(struct hub_info* hub, struct hub_user* u, const char* lin
 			case ADC_CMD_ESCH:
 			case ADC_CMD_FSCH:
 				cmd->priority = -1;
-				if (plugin_handle_search(hub, u, cmd->cache) == st_deny)
+				if (PLUGIN_HOOK_USED(hub, on_search) && plugin_handle_search(hub, u, cmd) == st_deny)
 					break;
 				CHECK_FLOOD(search, 1);
 				ROUTE_MSG;
@@ -110,21 +110,21 @@ int hub_handle_message(struct hub_info* hub, struct hub_user* u, const char* lin
 
 			case ADC_CMD_DRES:
 				cmd->priority = -1;
-				if (plugin_handle_search_result(hub, u, uman_get_user_by_sid(hub->users, cmd->target), cmd->cache) == st_deny)
+				if (PLUGIN_HOOK_USED(hub, on_search_result) && plugin_handle_search_result(hub, u, uman_get_user_by_sid(hub->users, cmd->target), cmd) == st_deny)
 					break;
 				/* CHECK_FLOOD(search, 0); */
 				ROUTE_MSG;
 
 			case ADC_CMD_DRCM:
 				cmd->priority = -1;
-				if (plugin_handle_revconnect(hub, u, uman_get_user_by_sid(hub->users, cmd->target)) == st_deny)
+				if (PLUGIN_HOOK_USED(hub, on_p2p_revconnect) && plugin_handle_revconnect(hub, u, uman_get_user_by_sid(hub->users, cmd->target)) == st_deny)
 					break;
 				CHECK_FLOOD(connect, 1);
 				ROUTE_MSG;
 
 			case ADC_CMD_DCTM:
 				cmd->priority = -1;
-				if (plugin_handle_connect(hub, u, uman_get_user_by_sid(hub->users, cmd->target)) == st_deny)
+				if (PLUGIN_HOOK_USED(hub, on_p2p_connect) && plugin_handle_connect(hub, u, uman_get_user_by_sid(hub->users, cmd->target)) == st_deny)
 					break;
 				CHECK_FLOOD(connect, 1);
 				ROUTE_MSG;
@@ -155,6 +155,11 @@ int hub_handle_message(struct hub_info* hub, struct hub_user* u, const char* lin
 }
 
 
+static int hub_zlif_enabled(struct hub_info* hub)
+{
+	return hub->zlif && hub->config->zlif_enable;
+}
+
 int hub_handle_support(struct hub_info* hub, struct hub_user* u, struct adc_message* cmd)
 {
 	int ret = 0;
@@ -197,6 +202,11 @@ int hub_handle_support(struct hub_info* hub, struct hub_user* u, struct adc_mess
 		arg = adc_msg_get_argument(cmd, index);
 	}
 
+	/* Only what the hub has announced in its own SUP can be used. Mux links
+	   frame their traffic as text, so compression is not used there. */
+	if (!hub_zlif_enabled(hub) || u->mux)
+		user_flag_unset(u, feature_zlif);
+
 	if (u->state == state_protocol)
 	{
 		if (index == 0) ok = 0; /* Need to support *SOMETHING*, at least BASE */
@@ -261,11 +271,11 @@ int hub_handle_password(struct hub_info* hub, struct hub_user* u, struct adc_mes
 	char* password = adc_msg_get_argument(cmd, 0);
 	int ret = 0;
 
-	if (u->state == state_verify)
+	if (u->state == state_verify && !u->login_group)
 	{
 		if (acl_password_verify(hub, u, password))
 		{
-			on_login_success(hub, u);
+			hub_login_enter(hub, u);
 		}
 		else
 		{
@@ -281,8 +291,11 @@ int hub_handle_password(struct hub_info* hub, struct hub_user* u, struct adc_mes
 
 int hub_handle_chat_message(struct hub_info* hub, struct hub_user* u, struct adc_message* cmd)
 {
-	char* message = adc_msg_get_argument(cmd, 0);
-	char* message_decoded = NULL;
+	struct hub_message_view view;
+	struct hub_user* target = NULL;
+	const char* message;
+	const char* text;
+	size_t length;
 	int ret = 0;
 	int relay = 1;
 	int broadcast;
@@ -290,24 +303,20 @@ int hub_handle_chat_message(struct hub_info* hub, struct hub_user* u, struct adc
 	int command;
 	int offset;
 
-	if (!message)
-		return 0;
-
-	message_decoded = adc_msg_unescape(message);
-	if (!message_decoded)
-	{
-		hub_free(message);
-		return 0;
-	}
-
 	if (!user_is_logged_in(u))
-	{
-		hub_free(message);
 		return 0;
-	}
 
 	broadcast = (cmd->cache[0] == 'B');
 	private_msg = (cmd->cache[0] == 'D' || cmd->cache[0] == 'E');
+	if (private_msg)
+		target = uman_get_user_by_sid(hub->users, cmd->target);
+
+	/* The message is only unescaped if a command or a plugin needs it */
+	plugin_message_view_init(&view, cmd, u, target);
+	message = plugin_message_view_get_argument(&view, 0, &length);
+	if (!message)
+		return 0;
+
 	command = (message[0] == '!' || message[0] == '+');
 
 	if (broadcast && command)
@@ -316,16 +325,18 @@ int hub_handle_chat_message(struct hub_info* hub, struct hub_user* u, struct adc
 		 * A message such as "++message" is handled as "+message", by removing the first character.
 		 * The first character is removed by memmoving the string one byte to the left.
 		 */
-		if (message[1] == message[0])
+		if (length > 1 && message[1] == message[0])
 		{
 			relay = 1;
 			offset = adc_msg_get_arg_offset(cmd);
 			memmove(cmd->cache+offset+1, cmd->cache+offset+2, cmd->length - offset);
 			cmd->length--;
+			plugin_message_view_init(&view, cmd, u, target);
 		}
 		else
 		{
-			relay = command_invoke(hub->commands, u, message_decoded);
+			text = plugin_message_view_get_text(&view);
+			relay = text ? command_invoke(hub->commands, u, text) : 0;
 		}
 	}
 
@@ -340,13 +351,12 @@ int hub_handle_chat_message(struct hub_info* hub, struct hub_user* u, struct adc
 		plugin_st status = st_default;
 		if (broadcast)
 		{
-			status = plugin_handle_chat_message(hub, u, message_decoded, 0);
+			status = plugin_handle_chat_message(hub, u, &view, 0);
 		}
 		else if (private_msg)
 		{
-			struct hub_user* target = uman_get_user_by_sid(hub->users, cmd->target);
 			if (target)
-				status = plugin_handle_private_message(hub, u, target, message_decoded, 0);
+				status = plugin_handle_private_message(hub, u, target, &view, 0);
 			else
 				relay = 0;
 		}
@@ -360,12 +370,11 @@ int hub_handle_chat_message(struct hub_info* hub, struct hub_user* u, struct adc
 		/* adc_msg_remove_named_argument(cmd, "PM"); */
 		if (broadcast)
 		{
-			plugin_log_chat_message(hub, u, message_decoded, 0);
+			plugin_log_chat_message(hub, u, &view, 0);
 		}
 		ret = route_message(hub, u, cmd);
 	}
-	hub_free(message);
-	hub_free(message_decoded);
+	plugin_message_view_free(&view);
 	return ret;
 }
 
@@ -527,11 +536,11 @@ static int check_duplicate_logins_ok(struct hub_info* hub, struct hub_user* user
 	struct hub_user* lookup1;
 	struct hub_user* lookup2;
 
-	lookup1 = uman_get_user_by_nick(hub->users, user->id.nick);
+	lookup1 = uman_lookup_nick(hub->users, user);
 	if (lookup1)
 		return status_msg_inf_error_nick_taken;
 
-	lookup2 = uman_get_user_by_cid(hub->users, user->id.cid);
+	lookup2 = uman_lookup_cid(hub->users, user);
 	if (lookup2)
 		return status_msg_inf_error_cid_taken;
 
@@ -540,7 +549,6 @@ static int check_duplicate_logins_ok(struct hub_info* hub, struct hub_user* user
 
 static void hub_event_dispatcher(void* callback_data, struct event_data* message)
 {
-	int status;
 	struct hub_info* hub = (struct hub_info*) callback_data;
 	struct hub_user* user = (struct hub_user*) message->ptr;
 	uhub_assert(hub != NULL);
@@ -558,17 +566,7 @@ static void hub_event_dispatcher(void* callback_data, struct event_data* message
 			}
 			else
 			{
-				/* Race condition, we could have two messages for two logins queued up.
-				   So make sure we don't let the second client in. */
-				status = check_duplicate_logins_ok(hub, user);
-				if (!status)
-				{
-					on_login_success(hub, user);
-				}
-				else
-				{
-					on_login_failure(hub, user, (enum status_message) status);
-				}
+				hub_login_enter(hub, user);
 			}
 			break;
 		}
@@ -590,12 +588,11 @@ static void hub_event_dispatcher(void* callback_data, struct event_data* message
 
 		case UHUB_EVENT_HUB_SHUTDOWN:
 		{
-			struct hub_user* u = (struct hub_user*) list_get_first(hub->users->list);
-			while (u)
+			struct hub_user* u;
+			while ((u = hub->users->first))
 			{
 				uman_remove(hub->users, u);
 				user_destroy(u);
-				u = (struct hub_user*) list_get_first(hub->users->list);
 			}
 			break;
 		}
@@ -625,10 +622,108 @@ static void hub_update_stats(struct hub_info* hub)
 	net_stats_reset();
 }
 
+static void hub_admission_limits(struct hub_info* hub, struct admission_limits* limits)
+{
+	limits->max_conns_ipv4 = (size_t) MAX(hub->config->accept_max_conns_ipv4, 0);
+	limits->max_conns_ipv6 = (size_t) MAX(hub->config->accept_max_conns_ipv6, 0);
+	limits->rate           = (size_t) MAX(hub->config->accept_rate, 0);
+	limits->burst          = (size_t) MAX(hub->config->accept_burst, 0);
+}
+
+int hub_admit_connection(struct hub_info* hub, struct ip_addr_encap* addr)
+{
+	struct admission_limits limits;
+	hub_admission_limits(hub, &limits);
+	return admission_accept(hub->admission, addr, &limits, net_get_time_ms());
+}
+
+static void hub_login_limits(struct hub_info* hub, struct login_limits* limits)
+{
+	limits->rate       = (size_t) MAX(hub->config->login_rate, 0);
+	limits->burst      = (size_t) MAX(hub->config->login_burst, 0);
+	limits->max_queued = (size_t) MAX(hub->config->max_users, 0);
+}
+
+/* The login queue lets a user in */
+static void hub_login_admitted(void* ptr, struct hub_user* user)
+{
+	struct hub_info* hub = (struct hub_info*) ptr;
+	int status;
+
+	/* Race condition, we could have two messages for two logins queued up.
+	   So make sure we don't let the second client in. */
+	status = check_duplicate_logins_ok(hub, user);
+
+	/* The hub may have filled up while the user was waiting */
+	if (!status && hub->config->max_users && hub->users->count >= (size_t) hub->config->max_users && !user_is_protected(user))
+		status = status_msg_hub_full;
+
+	if (!status)
+	{
+		on_login_success(hub, user);
+	}
+	else
+	{
+		on_login_failure(hub, user, (enum status_message) status);
+	}
+}
+
+static void hub_login_schedule(struct hub_info* hub, uint64_t ms)
+{
+	if (!ms || !hub->login_timer)
+		return;
+
+	if (timeout_evt_is_scheduled(hub->login_timer))
+		timeout_queue_reschedule_ms(net_backend_get_timeout_queue(), hub->login_timer, ms);
+	else
+		timeout_queue_insert_ms(net_backend_get_timeout_queue(), hub->login_timer, ms);
+}
+
+static void hub_timer_logins(struct timeout_evt* t)
+{
+	struct hub_info* hub = (struct hub_info*) t->ptr;
+	struct login_limits limits;
+
+	hub_login_limits(hub, &limits);
+	hub_login_schedule(hub, login_queue_process(hub->logins, &limits, net_get_time_ms()));
+}
+
+void hub_login_enter(struct hub_info* hub, struct hub_user* user)
+{
+	struct login_limits limits;
+	uint64_t now = net_get_time_ms();
+
+	hub_login_limits(hub, &limits);
+
+	/* Without a timer nobody would ever be let in from the queue */
+	if (!hub->login_timer)
+		limits.rate = 0;
+
+	switch (login_queue_enter(hub->logins, user, &limits, now))
+	{
+		case 0:
+			user_set_state(user, state_verify);
+			if (user->connection)
+				net_con_clear_timeout(user->connection);
+			hub_send_status(hub, user, status_msg_login_queued, status_level_info);
+			if (!timeout_evt_is_scheduled(hub->login_timer))
+				hub_login_schedule(hub, login_queue_process(hub->logins, &limits, now));
+			break;
+
+		case -1:
+			on_login_failure(hub, user, status_msg_hub_full);
+			break;
+	}
+}
+
 static void hub_timer_statistics(struct timeout_evt* t)
 {
 	struct hub_info* hub = (struct hub_info*) t->ptr;
+	struct admission_limits limits;
+
 	hub_update_stats(hub);
+	hub_admission_limits(hub, &limits);
+	admission_expire(hub->admission, &limits, net_get_time_ms());
 	timeout_queue_reschedule(net_backend_get_timeout_queue(), hub->stats.timeout, TIMEOUT_STATS);
 }
 
@@ -733,6 +828,126 @@ static void server_alt_port_stop(struct hub_info* hub)
 	}
 }
 
+#ifndef WIN32
+static int server_unix_user_add(char* line, int count, void* ptr)
+{
+	struct hub_info* hub = (struct hub_info*) ptr;
+	struct passwd* pw;
+	uid_t* uids;
+	int uid;
+
+	if (!is_number(line, &uid))
+	{
+		pw = getpwnam(line);
+		if (!pw)
+		{
+			LOG_WARN("Unknown user in server_unix_socket_users: %s", line);
+			return 0;
+		}
+		uid = (int) pw->pw_uid;
+	}
+
+	uids = hub_realloc(hub->server_unix_uids, (hub->server_unix_num_uids + 1) * sizeof(uid_t));
+	if (!uids)
+		return -1;
+
+	uids[hub->server_unix_num_uids++] = (uid_t) uid;
+	hub->server_unix_uids = uids;
+	return 0;
+}
+
+int hub_is_local_peer_allowed(struct hub_info* hub, int fd)
+{
+	uid_t uid;
+	size_t n;
+
+	if (net_get_peer_uid(fd, &uid) == -1)
+		return 0;
+
+	if (uid == 0 || uid == geteuid())
+		return 1;
+
+	for (n = 0; n < hub->server_unix_num_uids; n++)
+	{
+		if (hub->server_unix_uids[n] == uid)
+			return 1;
+	}
+
+	LOG_INFO("Denied connection on unix socket from uid %d", (int) uid);
+	return 0;
+}
+
+/*
+ * Connections on the unix socket are checked against the peer's user id
+ * on accept. Without any extra users the socket file is kept private.
+ */
+static void server_unix_socket_start(struct hub_info* hub, struct hub_config* config)
+{
+	struct sockaddr_un addr;
+	struct stat st;
+	const char* path = config->server_unix_socket;
+	int sd;
+
+	if (!path || !*path)
+		return;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(addr.sun_path))
+	{
+		LOG_ERROR("server_unix_socket is too long: %s", path);
+		return;
+	}
+	strcpy(addr.sun_path, path);
+
+	if (config->server_unix_socket_users && *config->server_unix_socket_users)
+		string_split(config->server_unix_socket_users, ",", hub, server_unix_user_add);
+
+	/* Left behind by an earlier run */
+	if (lstat(path, &st) == 0 && S_ISSOCK(st.st_mode))
+		unlink(path);
+
+	sd = net_socket_create(AF_UNIX, SOCK_STREAM, 0);
+	if (sd == -1)
+		return;
+
+	if (net_set_nonblocking(sd, 1) == -1 ||
+		net_bind(sd, (struct sockaddr*) &addr, sizeof(addr)) == -1 ||
+		chmod(path, hub->server_unix_num_uids ? 0666 : 0600) == -1 ||
+		net_listen(sd, config->server_listen_backlog) == -1)
+	{
+		LOG_ERROR("Unable to listen on unix socket %s: %s", path, net_error_string(net_error()));
+		net_close(sd);
+		return;
+	}
+
+	hub->server_unix = net_con_create();
+	net_con_initialize(hub->server_unix, sd, net_on_accept, hub, NET_EVENT_READ);
+	hub->server_unix_path = hub_strdup(path);
+	LOG_INFO("Listening on unix socket %s...", path);
+}
+
+static void server_unix_socket_stop(struct hub_info* hub)
+{
+	if (hub->server_unix)
+	{
+		net_con_close(hub->server_unix);
+		unlink(hub->server_unix_path);
+		hub_free(hub->server_unix_path);
+	}
+	hub_free(hub->server_unix_uids);
+	hub->server_unix = 0;
+	hub->server_unix_path = 0;
+	hub->server_unix_uids = 0;
+	hub->server_unix_num_uids = 0;
+}
+#else
+int hub_is_local_peer_allowed(struct hub_info* hub, int fd)
+{
+	return 0;
+}
+#endif /* !WIN32 */
+
 #ifdef SSL_SUPPORT
 static int load_ssl_certificates(struct hub_info* hub, struct hub_config* config)
 {
@@ -820,11 +1035,16 @@ struct hub_info* hub_start_service(struct hub_config* config)
 
 	hub->recvbuf = hub_malloc(MAX_RECV_BUF);
 	hub->sendbuf = hub_malloc(MAX_SEND_BUF);
-	if (!hub->recvbuf || !hub->sendbuf)
+	hub->admission = admission_create(net_get_max_sockets());
+	hub->logins = login_queue_create(hub_login_admitted, hub);
+	hub->zlif = zlif_create();
+	if (!hub->recvbuf || !hub->sendbuf || !hub->admission || !hub->logins)
 	{
 		net_con_close(hub->server);
 		hub_free(hub->recvbuf);
 		hub_free(hub->sendbuf);
+		admission_destroy(hub->admission);
+		login_queue_destroy(hub->logins);
 		uman_shutdown(hub->users);
 		hub_free(hub);
 		return 0;
@@ -832,6 +1052,9 @@ struct hub_info* hub_start_service(struct hub_config* config)
 
 	hub->logout_info  = (struct linked_list*) list_create();
 	server_alt_port_start(hub, config);
+#ifndef WIN32
+	server_unix_socket_start(hub, config);
+#endif
 
 	hub->status = hub_status_running;
 
@@ -842,6 +1065,9 @@ struct hub_info* hub_start_service(struct hub_config* config)
 		hub->stats.timeout = hub_malloc_zero(sizeof(struct timeout_evt));
 		timeout_evt_initialize(hub->stats.timeout, hub_timer_statistics, hub);
 		timeout_queue_insert(net_backend_get_timeout_queue(), hub->stats.timeout, TIMEOUT_STATS);
+
+		hub->login_timer = hub_malloc_zero(sizeof(struct timeout_evt));
+		timeout_evt_initialize(hub->login_timer, hub_timer_logins, hub);
 	}
 
 	// Start the hub command sub-system
@@ -863,6 +1089,10 @@ void hub_shutdown_service(struct hub_info* hub)
 	{
 		timeout_queue_remove(net_backend_get_timeout_queue(), hub->stats.timeout);
 		hub_free(hub->stats.timeout);
+
+		if (timeout_evt_is_scheduled(hub->login_timer))
+			timeout_queue_remove(net_backend_get_timeout_queue(), hub->login_timer);
+		hub_free(hub->login_timer);
 	}
 
 #ifdef SSL_SUPPORT
@@ -872,12 +1102,19 @@ void hub_shutdown_service(struct hub_info* hub)
 	event_queue_shutdown(hub->queue);
 	net_con_close(hub->server);
 	server_alt_port_stop(hub);
+#ifndef WIN32
+	server_unix_socket_stop(hub);
+#endif
 	uman_shutdown(hub->users);
 	list_clear(hub->muxes, &hub_mux_destroy);
 	list_destroy(hub->muxes);
+	admission_destroy(hub->admission);
+	login_queue_destroy(hub->logins);
+	zlif_destroy(hub->zlif);
 	hub->status = hub_status_stopped;
 	hub_free(hub->sendbuf);
 	hub_free(hub->recvbuf);
+	ioq_recv_pool_shutdown();
 	list_clear(hub->logout_info, &hub_free);
 	list_destroy(hub->logout_info);
 	command_shutdown(hub->commands);
@@ -936,10 +1173,12 @@ void hub_set_variables(struct hub_info* hub, struct acl_handle* acl)
 		hub_free(tmp);
 	}
 
-	hub->command_support = adc_msg_construct(ADC_CMD_ISUP, 6 + strlen(ADC_PROTO_SUPPORT));
+	hub->command_support = adc_msg_construct(ADC_CMD_ISUP, 6 + strlen(ADC_PROTO_SUPPORT " " ADC_SUP_FLAG_ADD "ZLIF"));
 	if (hub->command_support)
 	{
 		adc_msg_add_argument(hub->command_support, ADC_PROTO_SUPPORT);
+		if (hub_zlif_enabled(hub))
+			adc_msg_add_argument(hub->command_support, ADC_SUP_FLAG_ADD "ZLIF");
 	}
 
 	hub->command_banner = adc_msg_construct(ADC_CMD_ISTA, 100 + strlen(server));
@@ -1035,6 +1274,7 @@ void hub_send_status(struct hub_info* hub, struct hub_user* user, enum status_me
 		STATUS(23, msg_auth_invalid_password, 0, 0, 0);
 		STATUS(20, msg_auth_user_not_found, 0, 0, 0);
 		STATUS(30, msg_error_no_memory, 0, 0, 0);
+		STATUS(0,  msg_login_queued, 0, 0, 0);
 		STATUS(43, msg_user_share_size_low,   "FB" ADC_INF_FLAG_SHARED_SIZE, 0, 1);
 		STATUS(43, msg_user_share_size_high,  "FB" ADC_INF_FLAG_SHARED_SIZE, 0, 1);
 		STATUS(43, msg_user_slots_low,        "FB" ADC_INF_FLAG_UPLOAD_SLOTS, 0, 1);
@@ -1113,6 +1353,7 @@ const char* hub_get_status_message(struct hub_info* hub, enum status_message msg
 		STATUS(msg_auth_invalid_password);
 		STATUS(msg_auth_user_not_found);
 		STATUS(msg_error_no_memory);
+		STATUS(msg_login_queued);
 		STATUS(msg_user_share_size_low);
 		STATUS(msg_user_share_size_high);
 		STATUS(msg_user_slots_low);
@@ -1154,6 +1395,7 @@ const char* hub_get_status_message_log(struct hub_info* hub, enum status_message
 		STATUS(msg_auth_invalid_password);
 		STATUS(msg_auth_user_not_found);
 		STATUS(msg_error_no_memory);
+		STATUS(msg_login_queued);
 		STATUS(msg_user_share_size_low);
 		STATUS(msg_user_share_size_high);
 		STATUS(msg_user_slots_low);
@@ -1276,6 +1518,7 @@ void hub_event_loop(struct hub_info* hub)
 	{
 		net_backend_process();
 		while(event_queue_process(hub->queue));
+		mux_flush_all(hub);
 	}
 	while (hub->status == hub_status_running || hub->status == hub_status_disabled);
 
@@ -1286,6 +1529,7 @@ void hub_event_loop(struct hub_info* hub)
 		while(event_queue_process(hub->queue));
 		hub_disconnect_all(hub);
 		while(event_queue_process(hub->queue));
+		mux_flush_all(hub);
 		hub->status = hub_status_stopped;
 	}
 }
@@ -1311,7 +1555,12 @@ void hub_disconnect_user(struct hub_info* hub, struct hub_user* user, int reason
 
 	LOG_TRACE("hub_disconnect_user(), user=%p, reason=%d, state=%d", user, reason, user->state);
 
-	need_notify = user_is_logged_in(user) && hub->status == hub_status_running;
+	/* Users waiting to log in must not be let in later */
+	if (user->login_group)
+		login_queue_remove(hub->logins, user);
+
+	/* Logged in users must also leave the user list while disabled or reloading */
+	need_notify = user_is_logged_in(user) && hub->status != hub_status_shutdown && hub->status != hub_status_stopped;
 	user->quit_reason = reason;
 	user_set_state(user, state_cleanup);
 
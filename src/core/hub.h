@@ -45,6 +45,7 @@ enum status_message
 	status_msg_auth_invalid_password     = -21, /* Password is wrong */
 	status_msg_auth_user_not_found       = -22, /* User not found in password database */
 	status_msg_error_no_memory           = -23, /* Hub is out of memory */
+	status_msg_login_queued              = -24, /* User is waiting to be let in */
 
 	status_msg_user_share_size_low       = -40, /* User is not sharing enough. */
 	status_msg_user_share_size_high      = -41, /* User is sharing too much. */
@@ -97,12 +98,22 @@ struct hub_info
 {
 	struct net_connection* server;
 	struct linked_list* server_alt_ports;
+	struct net_connection* server_unix;  /* Listening on server_unix_socket */
+	char* server_unix_path;
+#ifndef WIN32
+	uid_t* server_unix_uids;             /* Users allowed on the unix socket, besides ourselves and root */
+	size_t server_unix_num_uids;
+#endif
 	struct hub_stats stats;
 	struct event_queue* queue;
 	struct hub_config* config;
 	struct hub_user_manager* users;
 	struct linked_list* muxes;
 	struct acl_handle* acl;
+	struct hub_admission* admission;     /* Admission control of accepted connections */
+	struct login_queue* logins;          /* Users waiting to be let in, see login_rate */
+	struct timeout_evt* login_timer;     /* Lets the next waiting users in */
+	struct hub_zlif* zlif;               /* ZLIF compression, NULL if not supported */
 	struct adc_message* command_info;    /* The hub's INF command */
 	struct adc_message* command_support; /* The hub's SUP command */
 	struct adc_message* command_banner;  /* The default welcome message */
@@ -224,6 +235,24 @@ extern struct hub_info* hub_start_service(struct hub_config* config);
  */
 extern void hub_shutdown_service(struct hub_info* hub);
 
+/**
+ * Check the user at the other end of a connection on the unix socket.
+ * @return 1 if the user may connect, 0 otherwise.
+ */
+extern int hub_is_local_peer_allowed(struct hub_info* hub, int fd);
+
+/**
+ * Admission control for a connection accepted from addr,
+ * with the limits currently configured. See admission_accept().
+ */
+extern int hub_admit_connection(struct hub_info* hub, struct ip_addr_encap* addr);
+
+/**
+ * Log in a user that has passed all login checks, or have it wait
+ * until login_rate allows it. See login_queue_enter().
+ */
+extern void hub_login_enter(struct hub_info* hub, struct hub_user* user);
+
 /**
  * This configures the hub.
  */
@@ -144,6 +144,7 @@ static int check_cid(struct hub_info* hub, struct hub_user* user, struct adc_mes
 	/* Set the cid in the user object */
 	memcpy(user->id.cid, cid, MAX_CID_LEN);
 	user->id.cid[MAX_CID_LEN] = 0;
+	uman_cid_decode(user->id.cid, user->cid_raw);
 
 	hub_free(cid);
 	hub_free(pid);
@@ -192,7 +193,7 @@ static int check_network(struct hub_info* hub, struct hub_user* user, struct adc
 	const char* address = user_get_address(user);
 
 	/* Check for NAT override address */
-	if (acl_is_ip_nat_override(hub->acl, address))
+	if (acl_is_ip_nat_override(hub->acl, &user->id.addr))
 	{
 		char* client_given_ip = adc_msg_get_named_argument(cmd, ADC_INF_FLAG_IPV4_ADDR);
 		if (client_given_ip && strcmp(client_given_ip, "0.0.0.0") != 0)
@@ -316,6 +317,7 @@ static int check_nick(struct hub_info* hub, struct hub_user* user, struct adc_me
 	{
 		memcpy(user->id.nick, nick, strlen(nick));
 		user->id.nick[strlen(nick)] = 0;
+		user->nick_hash = uman_nick_hash(user->id.nick);
 	}
 
 	hub_free(nick);
@@ -325,8 +327,8 @@ static int check_nick(struct hub_info* hub, struct hub_user* user, struct adc_me
 
 static int check_logged_in(struct hub_info* hub, struct hub_user* user, struct adc_message* cmd)
 {
-	struct hub_user* lookup1 = uman_get_user_by_nick(hub->users, user->id.nick);
-	struct hub_user* lookup2 = uman_get_user_by_cid(hub->users, user->id.cid);
+	struct hub_user* lookup1 = uman_lookup_nick(hub->users, user);
+	struct hub_user* lookup2 = uman_lookup_cid(hub->users, user);
 
 	if (lookup1 == user)
 	{
@@ -403,7 +405,7 @@ static int check_user_agent(struct hub_info* hub, struct hub_user* user, struct
 
 static int check_acl(struct hub_info* hub, struct hub_user* user, struct adc_message* cmd)
 {
-	if (acl_is_cid_banned(hub->acl, user->id.cid))
+	if (acl_is_cid_banned(hub->acl, user->cid_raw))
 	{
 		return status_msg_ban_permanently;
 	}
@@ -541,26 +543,29 @@ static int check_limits(struct hub_info* hub, struct hub_user* user, struct adc_
 }
 
 /*
- * Set the expected credentials, and returns 1 if authentication is needed,
+ * Set the expected credentials from the user's registration (info, or
+ * NULL if not registered), and returns 1 if authentication is needed,
  * or 0 if not.
- * If the hub is configured to allow only registered users and the user
- * is not recognized this will return 1.
  */
-static int set_credentials(struct hub_info* hub, struct hub_user* user, struct adc_message* cmd)
+static int set_credentials(struct hub_info* hub, struct hub_user* user, struct adc_message* cmd, struct auth_info* info)
 {
 	int ret = 0;
-	struct auth_info* info = acl_get_access_info(hub, user->id.nick);
 
 	if (info)
 	{
 		user->credentials = info->credentials;
+
+		/* Kept until the password is verified, see acl_password_verify() */
+		hub_free(user->auth);
+		user->auth = hub_malloc(sizeof(struct auth_info));
+		if (user->auth)
+			memcpy(user->auth, info, sizeof(struct auth_info));
 		ret = 1;
 	}
 	else
 	{
 		user->credentials = auth_cred_guest;
 	}
-	hub_free(info);
 
 	switch (user->credentials)
 	{
@@ -689,20 +694,14 @@ static int hub_perform_login_checks(struct hub_info* hub, struct hub_user* user,
 }
 
 /**
- * Perform additional INF checks used at time of login.
+ * Perform the INF checks that depend on the user's registration,
+ * which is info, or NULL if not registered.
  *
  * @return 0 if success, <0 if error, >0 if authentication needed.
  */
-int hub_handle_info_login(struct hub_info* hub, struct hub_user* user, struct adc_message* cmd)
+static int hub_handle_info_login_registered(struct hub_info* hub, struct hub_user* user, struct adc_message* cmd, struct auth_info* info)
 {
-	int code = 0;
-
-	INF_CHECK(hub_perform_login_checks, hub, user, cmd);
-
-	/* Private ID must never be broadcasted - drop it! */
-	adc_msg_remove_named_argument(cmd, ADC_INF_FLAG_PRIVATE_ID);
-
-	code = set_credentials(hub, user, cmd);
+	int code = set_credentials(hub, user, cmd, info);
 
 	/* Note: this must be done *after* set_credentials. */
 	if (check_is_hub_full(hub, user))
@@ -726,6 +725,105 @@ int hub_handle_info_login(struct hub_info* hub, struct hub_user* user, struct ad
 	return code;
 }
 
+/*
+ * Refuse the login, or post a message that the user has joined,
+ * for the result of hub_handle_info_login_registered().
+ */
+static void hub_handle_info_login_done(struct hub_info* hub, struct hub_user* user, int ret)
+{
+	struct event_data post;
+
+	if (ret < 0)
+	{
+		on_login_failure(hub, user, ret);
+		return;
+	}
+
+	memset(&post, 0, sizeof(post));
+	post.id    = UHUB_EVENT_USER_JOIN;
+	post.ptr   = user;
+	post.flags = ret; /* 0 - all OK, 1 - need authentication */
+	event_queue_post(hub->queue, &post);
+}
+
+/*
+ * A registration lookup that a plugin answers later.
+ * The nickname and info are handed to the plugin.
+ */
+struct inf_login_lookup
+{
+	char nickname[MAX_NICK_LEN+1];
+	struct auth_info info;
+	struct adc_message* cmd;
+};
+
+static void hub_handle_info_login_lookup_done(struct hub_info* hub, struct plugin_async* async, plugin_st status)
+{
+	struct hub_user* user = (struct hub_user*) plugin_async_get_ptr(async);
+	struct inf_login_lookup* lookup = (struct inf_login_lookup*) plugin_async_get_data(async);
+	int ret;
+
+	if (user)
+	{
+		user->login_lookup = NULL;
+		if (!user_is_disconnecting(user))
+		{
+			ret = hub_handle_info_login_registered(hub, user, lookup->cmd, status == st_allow ? &lookup->info : NULL);
+			hub_handle_info_login_done(hub, user, ret);
+		}
+	}
+	adc_msg_free(lookup->cmd);
+}
+
+#define INF_LOGIN_PENDING 2
+
+/**
+ * Perform additional INF checks used at time of login.
+ *
+ * If a plugin looks up the user's registration later, the user waits in
+ * state_verify until the answer comes, see hub_handle_info_login_lookup_done().
+ *
+ * @return 0 if success, <0 if error, 1 if authentication needed,
+ *         or INF_LOGIN_PENDING if waiting for a plugin.
+ */
+int hub_handle_info_login(struct hub_info* hub, struct hub_user* user, struct adc_message* cmd)
+{
+	struct plugin_async* async;
+	struct inf_login_lookup* lookup;
+	struct auth_info* info;
+	plugin_st status;
+	int ret;
+
+	INF_CHECK(hub_perform_login_checks, hub, user, cmd);
+
+	/* Private ID must never be broadcasted - drop it! */
+	adc_msg_remove_named_argument(cmd, ADC_INF_FLAG_PRIVATE_ID);
+
+	async = plugin_async_create(hub, hub_handle_info_login_lookup_done, user, sizeof(struct inf_login_lookup));
+	if (!async)
+	{
+		info = acl_get_access_info(hub, user->id.nick);
+		ret = hub_handle_info_login_registered(hub, user, cmd, info);
+		hub_free(info);
+		return ret;
+	}
+
+	lookup = (struct inf_login_lookup*) plugin_async_get_data(async);
+	strcpy(lookup->nickname, user->id.nick);
+	status = plugin_auth_get_user_async(hub, lookup->nickname, &lookup->info, async);
+	if (status == st_pending)
+	{
+		lookup->cmd = adc_msg_incref(cmd);
+		user->login_lookup = async;
+		user_set_state(user, state_verify);
+		return INF_LOGIN_PENDING;
+	}
+
+	ret = hub_handle_info_login_registered(hub, user, cmd, status == st_allow ? &lookup->info : NULL);
+	plugin_async_free(async);
+	return ret;
+}
+
 /*
  * If user is in the connecting state, we need to do fairly
  * strict checking of all arguments.
@@ -758,31 +856,17 @@ int hub_handle_info(struct hub_info* hub, struct hub_user* user, const struct ad
 		 * Don't allow the user to send multiple INF messages in this stage!
 		 * Since that can have serious side-effects.
 		 */
-		if (user->info)
+		if (user->info || user->login_lookup)
 		{
 			adc_msg_free(cmd);
 			return 0;
 		}
 
 		ret = hub_handle_info_login(hub, user, cmd);
-		if (ret < 0)
-		{
-			on_login_failure(hub, user, ret);
-			adc_msg_free(cmd);
-			return -1;
-		}
-		else
-		{
-			/* Post a message, the user has joined */
-			struct event_data post;
-			memset(&post, 0, sizeof(post));
-			post.id    = UHUB_EVENT_USER_JOIN;
-			post.ptr   = user;
-			post.flags = ret; /* 0 - all OK, 1 - need authentication */
-			event_queue_post(hub->queue, &post);
-			adc_msg_free(cmd);
-			return 0;
-		}
+		if (ret != INF_LOGIN_PENDING)
+			hub_handle_info_login_done(hub, user, ret);
+		adc_msg_free(cmd);
+		return (ret < 0) ? -1 : 0;
 	}
 	else
 	{
@@ -814,6 +898,7 @@ int hub_handle_info(struct hub_info* hub, struct hub_user* user, const struct ad
 		hub_handle_info_low_bandwidth(hub, user, cmd);
 
 		user_update_info(user, cmd);
+		uman_update(hub->users, user);
 
 		if (!adc_msg_is_empty(cmd))
 		{
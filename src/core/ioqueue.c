@@ -34,9 +34,45 @@ static void debug_msg(const char* prefix, struct adc_message* msg)
 }
 #endif
 
-struct ioq_recv* ioq_recv_create()
+#define IOQ_RECV_BUFSIZE   1024
+#define IOQ_RECV_POOL_MAX  (64 * 1024)
+
+/*
+ * Receive buffers are only held while a connection has unparsed data.
+ * They start at IOQ_RECV_BUFSIZE and grow up to the limit of the queue
+ * when a message does not fit. Free buffers of the initial size are
+ * kept for reuse, up to IOQ_RECV_POOL_MAX bytes in total.
+ */
+static char* ioq_recv_pool[IOQ_RECV_POOL_MAX / IOQ_RECV_BUFSIZE];
+static size_t ioq_recv_pool_count = 0;
+
+static char* ioq_recv_pool_get()
+{
+	if (ioq_recv_pool_count)
+		return ioq_recv_pool[--ioq_recv_pool_count];
+	/* One spare byte so the data can always be terminated in place */
+	return hub_malloc(IOQ_RECV_BUFSIZE + 1);
+}
+
+static void ioq_recv_pool_put(char* buf, size_t capacity)
+{
+	if (capacity == IOQ_RECV_BUFSIZE && (ioq_recv_pool_count + 1) * IOQ_RECV_BUFSIZE <= IOQ_RECV_POOL_MAX)
+		ioq_recv_pool[ioq_recv_pool_count++] = buf;
+	else
+		hub_free(buf);
+}
+
+void ioq_recv_pool_shutdown()
+{
+	while (ioq_recv_pool_count)
+		hub_free(ioq_recv_pool[--ioq_recv_pool_count]);
+}
+
+struct ioq_recv* ioq_recv_create(size_t limit)
 {
 	struct ioq_recv* q = hub_malloc_zero(sizeof(struct ioq_recv));
+	if (q)
+		q->limit = limit;
 	return q;
 }
 
@@ -44,49 +80,95 @@ void ioq_recv_destroy(struct ioq_recv* q)
 {
 	if (q)
 	{
-		hub_free(q->buf);
+		ioq_recv_clear(q);
 		hub_free(q);
 	}
 }
 
-size_t ioq_recv_get(struct ioq_recv* q, void* buf, size_t bufsize)
+static size_t ioq_recv_usable(struct ioq_recv* q)
 {
-	uhub_assert(bufsize >= q->size);
-	if (q->size)
-	{
-		size_t n = q->size;
-		memcpy(buf, q->buf, n);
-		hub_free(q->buf);
-		q->buf = 0;
-		q->size = 0;
-		return n;
-	}
-	return 0;
+	return MIN(q->capacity, q->limit);
 }
 
-size_t ioq_recv_set(struct ioq_recv* q, void* buf, size_t bufsize)
+char* ioq_recv_reserve(struct ioq_recv* q, size_t* space)
 {
-	if (q->buf)
+	if (!q->buf)
 	{
-		hub_free(q->buf);
-		q->buf = 0;
+		q->buf = ioq_recv_pool_get();
+		if (!q->buf)
+		{
+			*space = 0;
+			return 0;
+		}
+		q->capacity = IOQ_RECV_BUFSIZE;
+		q->offset = 0;
 		q->size = 0;
 	}
-
-	if (!bufsize)
+	else
 	{
-		return 0;
+		if (q->offset && q->offset + q->size > ioq_recv_usable(q) / 2)
+		{
+			memmove(q->buf, q->buf + q->offset, q->size);
+			q->offset = 0;
+		}
+
+		if (q->size == ioq_recv_usable(q) && q->capacity < q->limit)
+		{
+			size_t capacity = MIN(q->capacity * 2, q->limit);
+			char* buf = hub_realloc(q->buf, capacity + 1);
+			if (!buf)
+			{
+				*space = 0;
+				return 0;
+			}
+			q->buf = buf;
+			q->capacity = capacity;
+		}
 	}
 
-	q->buf = hub_malloc(bufsize);
+	*space = ioq_recv_usable(q) - q->offset - q->size;
+	return q->buf + q->offset + q->size;
+}
+
+void ioq_recv_commit(struct ioq_recv* q, size_t bytes)
+{
+	uhub_assert(q->buf && q->offset + q->size + bytes <= ioq_recv_usable(q));
+	q->size += bytes;
+	if (!q->size)
+		ioq_recv_clear(q);
+}
+
+char* ioq_recv_data(struct ioq_recv* q, size_t* size)
+{
+	*size = q->size;
 	if (!q->buf)
 		return 0;
+	return q->buf + q->offset;
+}
+
+void ioq_recv_consume(struct ioq_recv* q, size_t bytes)
+{
+	uhub_assert(bytes <= q->size);
+	q->offset += bytes;
+	q->size -= bytes;
+	if (!q->size)
+		ioq_recv_clear(q);
+}
 
-	q->size = bufsize;
-	memcpy(q->buf, buf, bufsize);
-	return bufsize;
+void ioq_recv_clear(struct ioq_recv* q)
+{
+	if (q->buf)
+		ioq_recv_pool_put(q->buf, q->capacity);
+	q->buf = 0;
+	q->capacity = 0;
+	q->offset = 0;
+	q->size = 0;
 }
 
+int ioq_recv_is_empty(struct ioq_recv* q)
+{
+	return q->size == 0;
+}
 
 struct ioq_send* ioq_send_create()
 {
@@ -125,7 +207,7 @@ void ioq_send_add(struct ioq_send* q, struct adc_message* msg_)
 #ifdef DEBUG_SENDQ
 	debug_msg("ioq_send_add", msg);
 #endif
-	uhub_assert(msg->cache && *msg->cache);
+	uhub_assert(msg->cache && msg->length);
 	list_append(q->queue, msg);
 	q->size += msg->length;
 }
@@ -141,13 +223,23 @@ static void ioq_send_remove(struct ioq_send* q, struct adc_message* msg)
 	q->offset = 0;
 }
 
+static int ioq_send_con(void* desc, const void* buf, size_t len)
+{
+	return (int) net_con_send((struct net_connection*) desc, buf, len);
+}
+
 int ioq_send_send(struct ioq_send* q, struct net_connection* con)
+{
+	return ioq_send_write(q, ioq_send_con, con);
+}
+
+int ioq_send_write(struct ioq_send* q, ioq_write write, void* desc)
 {
 	int ret;
 	struct adc_message* msg = list_get_first(q->queue);
 	if (!msg) return 0;
-	uhub_assert(msg->cache && *msg->cache);
-	ret = net_con_send(con, msg->cache + q->offset, msg->length - q->offset);
+	uhub_assert(msg->cache && msg->length);
+	ret = write(desc, msg->cache + q->offset, msg->length - q->offset);
 
 	if (ret > 0)
 	{
@@ -37,8 +37,11 @@ struct ioq_send
 
 struct ioq_recv
 {
-	char* buf;
-	size_t size;
+	char*                buf;       /** Receive buffer, NULL if nothing is buffered */
+	size_t               capacity;  /** Allocated size of buf, grows on demand */
+	size_t               limit;     /** Largest size buf may grow to */
+	size_t               offset;    /** Offset of the first unparsed byte in buf */
+	size_t               size;      /** Number of unparsed bytes */
 };
 
 /**
@@ -62,6 +65,12 @@ extern void ioq_send_add(struct ioq_send*, struct adc_message* msg);
  */
 extern int  ioq_send_send(struct ioq_send*, struct net_connection* con);
 
+/**
+ * As ioq_send_send(), but write through the given function, which
+ * returns the number of bytes written, 0 if it would block, or -1.
+ */
+extern int  ioq_send_write(struct ioq_send*, ioq_write write, void* desc);
+
 /**
  * @returns 1 if send queue is empty, 0 otherwise.
  */
@@ -76,8 +85,9 @@ extern size_t ioq_send_get_bytes(struct ioq_send*);
 
 /**
  * Create a receive queue.
+ * @param limit the most unparsed data that can be buffered, in bytes.
  */
-extern struct ioq_recv* ioq_recv_create();
+extern struct ioq_recv* ioq_recv_create(size_t limit);
 
 /**
  * Destroy a receive queue.
@@ -85,16 +95,47 @@ extern struct ioq_recv* ioq_recv_create();
 extern void ioq_recv_destroy(struct ioq_recv*);
 
 /**
- * Gets the buffer, copies it into buf and deallocates it.
- * NOTE: bufsize *MUST* be larger than the buffer, otherwise it asserts.
- * @return the number of bytes copied into buf.
+ * Get space to receive data into, directly after any unparsed data.
+ * A small buffer is taken from the shared pool if the queue has none,
+ * the unparsed data is moved to the start of the buffer if needed, and
+ * a full buffer is grown until it reaches the limit of the queue.
+ *
+ * @param space set to the number of bytes available, 0 if the buffer
+ *        is full at the limit.
+ * @return a pointer to receive into, or NULL if out of memory.
+ */
+extern char* ioq_recv_reserve(struct ioq_recv*, size_t* space);
+
+/**
+ * Mark bytes received into the space returned by ioq_recv_reserve()
+ * as unparsed data. If the queue is left empty the buffer is returned
+ * to the pool.
+ */
+extern void ioq_recv_commit(struct ioq_recv*, size_t bytes);
+
+/**
+ * @param size set to the number of unparsed bytes.
+ * @return a pointer to the unparsed data, which can be parsed in place.
+ *         The byte following the data may be overwritten temporarily.
+ */
+extern char* ioq_recv_data(struct ioq_recv*, size_t* size);
+
+/**
+ * Remove parsed bytes from the start of the unparsed data.
+ * The buffer is returned to the pool once everything is consumed,
+ * so idle connections do not hold a buffer.
+ */
+extern void ioq_recv_consume(struct ioq_recv*, size_t bytes);
+
+/**
+ * Drop all unparsed data and return the buffer to the pool.
  */
-extern size_t ioq_recv_get(struct ioq_recv*, void* buf, size_t bufsize);
+extern void ioq_recv_clear(struct ioq_recv*);
 
 /**
- * Sets the buffer
+ * Free the receive buffers cached in the shared pool.
  */
-extern size_t ioq_recv_set(struct ioq_recv*, void* buf, size_t bufsize);
+extern void ioq_recv_pool_shutdown();
 
 /**
  * @return 1 if size is zero, 0 otherwise.
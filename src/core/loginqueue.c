@@ -0,0 +1,343 @@
+/*
+ * uhub - A tiny ADC p2p connection hub
+ * Copyright (C) 2007-2014, Jan Vidar Krey
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "uhub.h"
+
+#define LOGIN_TOKEN 1000         /* Tokens are kept in thousandths */
+#define LOGIN_WAIT_SAMPLES 1024  /* Recent wait times kept for percentiles */
+
+struct login_prefix
+{
+	uint8_t addr[8];             /* IPv4 /24 or IPv6 /48, zero padded */
+	int af;
+};
+
+/*
+ * Users from the same network, waiting in FIFO order
+ * (linked through hub_user::login_next and login_prev).
+ */
+struct login_group
+{
+	struct login_prefix prefix;
+	struct hub_user* first;
+	struct hub_user* last;
+	struct login_group* next;    /* Groups take turns in this order */
+	struct login_group* prev;
+};
+
+struct login_queue
+{
+	login_queue_cb callback;
+	void* ptr;
+	struct hash_table* groups;   /* struct login_prefix -> struct login_group */
+	struct login_group* first;   /* Group to let a user in next */
+	struct login_group* last;
+	uint64_t tokens;
+	uint64_t stamp;              /* When tokens were last refilled (ms) */
+	int started;
+	struct login_queue_stats stats;
+	uint64_t waits[LOGIN_WAIT_SAMPLES];
+	size_t wait_count;           /* Samples written, in total */
+};
+
+static int login_prefix_equals(const void* a, const void* b)
+{
+	return memcmp(a, b, sizeof(struct login_prefix)) == 0;
+}
+
+static void login_prefix_set(struct login_prefix* prefix, struct ip_addr_encap* addr)
+{
+	const uint8_t* bytes;
+
+	memset(prefix, 0, sizeof(struct login_prefix));
+	if (addr->af == AF_INET)
+	{
+		memcpy(prefix->addr, &addr->internal_ip_data.in, 3);
+		prefix->af = AF_INET;
+	}
+	else if (addr->af == AF_INET6)
+	{
+		bytes = (const uint8_t*) &addr->internal_ip_data.in6;
+		if (IN6_IS_ADDR_V4MAPPED(&addr->internal_ip_data.in6))
+		{
+			memcpy(prefix->addr, bytes + 12, 3);
+			prefix->af = AF_INET;
+		}
+		else
+		{
+			memcpy(prefix->addr, bytes, 6);
+			prefix->af = AF_INET6;
+		}
+	}
+}
+
+static void login_group_unlink(struct login_queue* queue, struct login_group* group)
+{
+	if (group->next)
+		group->next->prev = group->prev;
+	else
+		queue->last = group->prev;
+
+	if (group->prev)
+		group->prev->next = group->next;
+	else
+		queue->first = group->next;
+
+	group->next = NULL;
+	group->prev = NULL;
+}
+
+static void login_group_append(struct login_queue* queue, struct login_group* group)
+{
+	group->next = NULL;
+	group->prev = queue->last;
+	if (queue->last)
+		queue->last->next = group;
+	else
+		queue->first = group;
+	queue->last = group;
+}
+
+static void login_group_destroy(struct login_queue* queue, struct login_group* group)
+{
+	login_group_unlink(queue, group);
+	hash_table_remove(queue->groups, hash_table_hash_data(&group->prefix, sizeof(struct login_prefix)), &group->prefix);
+	hub_free(group);
+}
+
+static struct hub_user* login_group_pop(struct login_queue* queue, struct login_group* group)
+{
+	struct hub_user* user = group->first;
+
+	group->first = user->login_next;
+	if (group->first)
+		group->first->login_prev = NULL;
+	else
+		group->last = NULL;
+
+	user->login_next = NULL;
+	user->login_group = NULL;
+	queue->stats.queued--;
+	return user;
+}
+
+static void login_refill(struct login_queue* queue, struct login_limits* limits, uint64_t now)
+{
+	uint64_t size = (uint64_t) MAX(limits->burst, 1) * LOGIN_TOKEN;
+
+	if (!queue->started)
+	{
+		queue->tokens = size;
+		queue->started = 1;
+	}
+	else if (now > queue->stamp)
+	{
+		/* One token per second at rate 1 is one thousandth per millisecond */
+		queue->tokens = MIN(queue->tokens + (now - queue->stamp) * limits->rate, size);
+	}
+	queue->stamp = now;
+}
+
+static void login_let_in(struct login_queue* queue, struct hub_user* user, uint64_t wait)
+{
+	queue->waits[queue->wait_count % LOGIN_WAIT_SAMPLES] = wait;
+	queue->wait_count++;
+	queue->stats.logins++;
+	if (wait)
+		queue->stats.waited++;
+	queue->stats.wait_max = MAX(queue->stats.wait_max, wait);
+	queue->callback(queue->ptr, user);
+}
+
+struct login_queue* login_queue_create(login_queue_cb callback, void* ptr)
+{
+	struct login_queue* queue = hub_malloc_zero(sizeof(struct login_queue));
+	if (!queue)
+		return NULL;
+
+	queue->groups = hash_table_create(login_prefix_equals, 0);
+	if (!queue->groups)
+	{
+		hub_free(queue);
+		return NULL;
+	}
+	queue->callback = callback;
+	queue->ptr = ptr;
+	return queue;
+}
+
+void login_queue_destroy(struct login_queue* queue)
+{
+	struct login_group* group;
+
+	if (!queue)
+		return;
+
+	/* The users may be gone already, so they are not touched */
+	while ((group = queue->first))
+		login_group_destroy(queue, group);
+	hash_table_destroy(queue->groups);
+	hub_free(queue);
+}
+
+int login_queue_enter(struct login_queue* queue, struct hub_user* user, struct login_limits* limits, uint64_t now)
+{
+	struct login_group* group;
+	struct login_prefix prefix;
+	uint32_t hash;
+
+	if (!limits->rate)
+	{
+		login_let_in(queue, user, 0);
+		return 1;
+	}
+
+	login_refill(queue, limits, now);
+	if (!queue->first && queue->tokens >= LOGIN_TOKEN)
+	{
+		queue->tokens -= LOGIN_TOKEN;
+		login_let_in(queue, user, 0);
+		return 1;
+	}
+
+	if (limits->max_queued && queue->stats.queued >= limits->max_queued)
+	{
+		queue->stats.rejected++;
+		return -1;
+	}
+
+	login_prefix_set(&prefix, &user->id.addr);
+	hash = hash_table_hash_data(&prefix, sizeof(struct login_prefix));
+	group = hash_table_get(queue->groups, hash, &prefix);
+	if (!group)
+	{
+		group = hub_malloc_zero(sizeof(struct login_group));
+		if (!group)
+		{
+			queue->stats.rejected++;
+			return -1;
+		}
+
+		memcpy(&group->prefix, &prefix, sizeof(struct login_prefix));
+		if (hash_table_insert(queue->groups, hash, &group->prefix, group) != 1)
+		{
+			hub_free(group);
+			queue->stats.rejected++;
+			return -1;
+		}
+		login_group_append(queue, group);
+	}
+
+	user->login_group = group;
+	user->login_queued = now;
+	user->login_next = NULL;
+	user->login_prev = group->last;
+	if (group->last)
+		group->last->login_next = user;
+	else
+		group->first = user;
+	group->last = user;
+
+	queue->stats.queued++;
+	queue->stats.queued_peak = MAX(queue->stats.queued, queue->stats.queued_peak);
+	return 0;
+}
+
+void login_queue_remove(struct login_queue* queue, struct hub_user* user)
+{
+	struct login_group* group = user->login_group;
+
+	if (!group)
+		return;
+
+	if (user->login_next)
+		user->login_next->login_prev = user->login_prev;
+	else
+		group->last = user->login_prev;
+
+	if (user->login_prev)
+		user->login_prev->login_next = user->login_next;
+	else
+		group->first = user->login_next;
+
+	user->login_next = NULL;
+	user->login_prev = NULL;
+	user->login_group = NULL;
+	queue->stats.queued--;
+
+	if (!group->first)
+		login_group_destroy(queue, group);
+}
+
+uint64_t login_queue_process(struct login_queue* queue, struct login_limits* limits, uint64_t now)
+{
+	struct login_group* group;
+	struct hub_user* user;
+
+	if (limits->rate)
+		login_refill(queue, limits, now);
+
+	while ((group = queue->first))
+	{
+		if (limits->rate)
+		{
+			if (queue->tokens < LOGIN_TOKEN)
+				return (LOGIN_TOKEN - queue->tokens + limits->rate - 1) / limits->rate;
+			queue->tokens -= LOGIN_TOKEN;
+		}
+
+		/* The group goes to the back of the line, or away if it is empty */
+		user = login_group_pop(queue, group);
+		if (group->first)
+		{
+			login_group_unlink(queue, group);
+			login_group_append(queue, group);
+		}
+		else
+		{
+			login_group_destroy(queue, group);
+		}
+
+		login_let_in(queue, user, now > user->login_queued ? now - user->login_queued : 0);
+	}
+	return 0;
+}
+
+static int login_wait_compare(const void* a, const void* b)
+{
+	uint64_t x = *((const uint64_t*) a);
+	uint64_t y = *((const uint64_t*) b);
+	return (x > y) - (x < y);
+}
+
+void login_queue_get_stats(struct login_queue* queue, struct login_queue_stats* stats)
+{
+	uint64_t waits[LOGIN_WAIT_SAMPLES];
+	size_t count = MIN(queue->wait_count, LOGIN_WAIT_SAMPLES);
+
+	memcpy(stats, &queue->stats, sizeof(struct login_queue_stats));
+	if (!count)
+		return;
+
+	memcpy(waits, queue->waits, count * sizeof(uint64_t));
+	qsort(waits, count, sizeof(uint64_t), login_wait_compare);
+	stats->wait_p50 = waits[count / 2];
+	stats->wait_p90 = waits[count * 90 / 100];
+	stats->wait_p99 = waits[count * 99 / 100];
+}
@@ -0,0 +1,91 @@
+/*
+ * uhub - A tiny ADC p2p connection hub
+ * Copyright (C) 2007-2014, Jan Vidar Krey
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef HAVE_UHUB_LOGIN_QUEUE_H
+#define HAVE_UHUB_LOGIN_QUEUE_H
+
+/**
+ * Paces logins, so that a storm of reconnecting users does not have
+ * every user list sent and every user announced at once.
+ *
+ * Users that have passed all login checks get a token from a bucket
+ * refilled at a fixed rate. When it is empty they wait in a queue until
+ * a token is available. Users wait in FIFO order with others from the
+ * same IPv4 /24 or IPv6 /48 network, and the networks take turns, so a
+ * single network reconnecting many clients cannot hold up everyone else.
+ */
+struct login_queue;
+struct login_group;
+
+typedef void (*login_queue_cb)(void* ptr, struct hub_user* user);
+
+struct login_limits
+{
+	size_t rate;             /* Logins per second, 0 = no limit */
+	size_t burst;            /* Logins at once, with a full bucket */
+	size_t max_queued;       /* Users waiting at most, 0 = no limit */
+};
+
+struct login_queue_stats
+{
+	size_t queued;           /* Users waiting now */
+	size_t queued_peak;
+	size_t logins;           /* Users let through, waiting or not */
+	size_t waited;           /* Users let through after waiting */
+	size_t rejected;         /* Users refused since the queue was full */
+	uint64_t wait_p50;       /* Wait time percentiles (ms) of recent logins */
+	uint64_t wait_p90;
+	uint64_t wait_p99;
+	uint64_t wait_max;
+};
+
+/**
+ * @param callback Called for users that may log in.
+ */
+extern struct login_queue* login_queue_create(login_queue_cb callback, void* ptr);
+
+/**
+ * Users still waiting are simply forgotten.
+ */
+extern void login_queue_destroy(struct login_queue* queue);
+
+/**
+ * Let the user log in at time now (ms), or queue it.
+ *
+ * @return 1 if the callback was called, 0 if the user is waiting,
+ *        -1 if the queue is full.
+ */
+extern int login_queue_enter(struct login_queue* queue, struct hub_user* user, struct login_limits* limits, uint64_t now);
+
+/**
+ * Stop waiting, if the user is.
+ */
+extern void login_queue_remove(struct login_queue* queue, struct hub_user* user);
+
+/**
+ * Let the users in that there are tokens for.
+ *
+ * @return the number of milliseconds until the next user can log in,
+ *         or 0 if nobody is waiting.
+ */
+extern uint64_t login_queue_process(struct login_queue* queue, struct login_limits* limits, uint64_t now);
+
+extern void login_queue_get_stats(struct login_queue* queue, struct login_queue_stats* stats);
+
+#endif /* HAVE_UHUB_LOGIN_QUEUE_H */
@@ -103,52 +103,141 @@ void shutdown_signal_handlers(struct hub_info* hub)
 #endif /* !WIN32 */
 
 
-int main_loop()
+/*
+ * On reload the configuration and ACL files are read in a separate thread
+ * while the hub keeps serving users with the current ones. Once read, the
+ * thread wakes up the event loop, and the new ones are swapped in between
+ * two loop iterations.
+ */
+struct hub_reload
 {
-	struct hub_config configuration;
+	struct hub_info* hub;
+	struct uhub_notify_handle* notify;
+	struct hub_config config;
 	struct acl_handle acl;
-	struct hub_info* hub = 0;
+	int status;                     /* 0 if read, -1 on error */
+};
 
-	if (net_initialize() == -1)
-		return -1;
+static void* reload_files(void* ptr)
+{
+	struct hub_reload* reload = (struct hub_reload*) ptr;
 
-	do
+	reload->status = -1;
+	if (read_config(arg_config, &reload->config, !arg_have_config) != -1)
 	{
-		if (hub)
+		if (acl_initialize(&reload->config, &reload->acl) != -1)
 		{
-			LOG_INFO("Reloading configuration files...");
-			LOG_DEBUG("Hub status: %d", (int) hub->status);
-
-			/* Reinitialize logs */
-			hub_log_shutdown();
-			hub_log_initialize(arg_log, arg_log_syslog);
-			hub_set_log_verbosity(arg_verbose);
+			reload->status = 0;
 		}
+		else
+		{
+			acl_shutdown(&reload->acl);
+			free_config(&reload->config);
+		}
+	}
 
-		if (read_config(arg_config, &configuration, !arg_have_config) == -1)
-			return -1;
+	if (reload->notify)
+		net_notify_signal(reload->notify, 1);
+	return NULL;
+}
 
-		if (acl_initialize(&configuration, &acl) == -1)
-			return -1;
+static void reload_done(struct uhub_notify_handle* handle, void* ptr)
+{
+	struct hub_reload* reload = (struct hub_reload*) ptr;
+	struct hub_info* hub = reload->hub;
+
+	/* Stop the event loop, unless it is already shutting down */
+	if (hub->status == hub_status_running || hub->status == hub_status_disabled)
+		hub->status = hub_status_restart;
+}
 
-		/*
-		 * Don't restart networking when re-reading configuration.
-		 * This might not be possible either, since we might have
-		 * dropped our privileges to do so.
-		 */
-		if (!hub)
+/**
+ * Read the files while running the event loop.
+ * @return 1 if read and ready to swap in, 0 to keep the current ones,
+ *         or -1 if the hub is shutting down.
+ */
+static int main_reload(struct hub_info* hub, struct hub_reload* reload)
+{
+	uhub_thread_t* thread = NULL;
+
+	LOG_INFO("Reloading configuration files...");
+	memset(reload, 0, sizeof(struct hub_reload));
+	reload->hub = hub;
+	hub->status = hub->config->hub_enabled ? hub_status_running : hub_status_disabled;
+
+#ifndef WIN32
+	reload->notify = net_notify_create(reload_done, reload);
+	if (reload->notify)
+		thread = uhub_thread_create(reload_files, reload);
+#endif
+
+	if (thread)
+	{
+		hub_event_loop(hub);
+		uhub_thread_join(thread);
+	}
+	else
+	{
+		reload_files(reload);
+	}
+
+	if (reload->notify)
+		net_notify_destroy(reload->notify);
+	reload->notify = NULL;
+
+	if (hub->status == hub_status_shutdown || hub->status == hub_status_stopped)
+	{
+		if (reload->status == 0)
 		{
-			hub = hub_start_service(&configuration);
-			if (!hub)
-			{
-				acl_shutdown(&acl);
-				free_config(&configuration);
-				net_destroy();
-				hub_log_shutdown();
-				return -1;
-			}
+			acl_shutdown(&reload->acl);
+			free_config(&reload->config);
+		}
+		return -1;
+	}
+
+	hub->status = hub->config->hub_enabled ? hub_status_running : hub_status_disabled;
+	if (reload->status == -1)
+	{
+		LOG_ERROR("Unable to reload configuration files, keeping the current configuration.");
+		return 0;
+	}
+	return 1;
+}
+
+
+int main_loop()
+{
+	struct hub_config configuration;
+	struct acl_handle acl;
+	struct hub_reload reload;
+	struct hub_info* hub = 0;
+	int ret;
+
+	if (net_initialize() == -1)
+		return -1;
+
+	if (read_config(arg_config, &configuration, !arg_have_config) == -1)
+		return -1;
+
+	if (acl_initialize(&configuration, &acl) == -1)
+		return -1;
+
+	/*
+	 * Networking is only started once, it is not restarted when
+	 * re-reading configuration. This might not be possible either,
+	 * since we might have dropped our privileges to do so.
+	 */
+	hub = hub_start_service(&configuration);
+	if (!hub)
+	{
+		acl_shutdown(&acl);
+		free_config(&configuration);
+		net_destroy();
+		hub_log_shutdown();
+		return -1;
+	}
 #if !defined(WIN32)
-			setup_signal_handlers(hub);
+	setup_signal_handlers(hub);
 #ifdef SYSTEMD
                         /* Notify the service manager that this daemon has
                          * been successfully initalized and shall enter the
@@ -159,26 +248,45 @@ int main_loop()
 #endif /* SYSTEMD */
 
 #endif /* ! WIN32 */
-		}
 
-		hub_set_variables(hub, &acl);
+	hub_set_variables(hub, &acl);
 
+	for (;;)
+	{
 		hub_event_loop(hub);
+		if (hub->status != hub_status_restart)
+			break;
 
+		ret = main_reload(hub, &reload);
+		if (ret == -1)
+			break;
+		if (ret == 0)
+			continue;
+
+		LOG_DEBUG("Hub status: %d", (int) hub->status);
 		hub_free_variables(hub);
 		acl_shutdown(&acl);
 		free_config(&configuration);
+		memcpy(&configuration, &reload.config, sizeof(struct hub_config));
+		memcpy(&acl, &reload.acl, sizeof(struct acl_handle));
 
-	} while (hub->status == hub_status_restart);
+		/* Reinitialize logs */
+		hub_log_shutdown();
+		hub_log_initialize(arg_log, arg_log_syslog);
+		hub_set_log_verbosity(arg_verbose);
+
+		hub_set_variables(hub, &acl);
+	}
+
+	hub_free_variables(hub);
+	acl_shutdown(&acl);
+	free_config(&configuration);
 
 #if !defined(WIN32)
 	shutdown_signal_handlers(hub);
 #endif
 
-	if (hub)
-	{
-		hub_shutdown_service(hub);
-	}
+	hub_shutdown_service(hub);
 
 	net_destroy();
 	hub_log_shutdown();
@@ -494,6 +602,7 @@ int main(int argc, char** argv)
 		return -1;
 #endif /* WIN32 */
 
+	hub_log_set_async(1);
 	ret = main_loop();
 
 #ifndef WIN32
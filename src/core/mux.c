@@ -19,7 +19,75 @@
 
 #include "uhub.h"
 
-struct hub_mux* mux_create(struct hub_info* hub, struct net_connection* con, struct ip_addr_encap* addr)
+static void mux_user_list_append(struct hub_mux* mux, struct hub_user* user)
+{
+	user->mux_next = NULL;
+	user->mux_prev = mux->last_user;
+
+	if (mux->last_user)
+		mux->last_user->mux_next = user;
+	else
+		mux->first_user = user;
+
+	mux->last_user = user;
+}
+
+static int mux_user_is_congested(struct hub_mux* mux, struct hub_user* user)
+{
+	return mux->hub && user->mux_queued > (size_t) mux->hub->config->max_send_buffer_soft;
+}
+
+void mux_user_charge(struct hub_mux* mux, struct hub_user* user, size_t bytes)
+{
+	int congested = mux_user_is_congested(mux, user);
+	user->mux_queued += bytes;
+	if (!congested && mux_user_is_congested(mux, user))
+		mux->congested++;
+}
+
+static void mux_user_credit(struct hub_mux* mux, struct hub_user* user, size_t bytes)
+{
+	int congested = mux_user_is_congested(mux, user);
+	user->mux_queued -= MIN(bytes, user->mux_queued);
+	if (mux_user_is_congested(mux, user))
+		return;
+
+	if (congested)
+		mux->congested--;
+
+	/* The user list has been delivered, see check_send_queue() */
+	user_flag_unset(user, flag_user_list);
+}
+
+int mux_can_fan_out(struct hub_mux* mux, struct adc_message* msg)
+{
+	struct hub_config* config = mux->hub->config;
+	return !mux->congested && msg->length <= (size_t) (config->max_send_buffer - config->max_send_buffer_soft);
+}
+
+static void mux_user_list_remove(struct hub_mux* mux, struct hub_user* user)
+{
+	if (user->mux_next)
+		user->mux_next->mux_prev = user->mux_prev;
+	else if (mux->last_user == user)
+		mux->last_user = user->mux_prev;
+	else
+		return; /* not in the list */
+
+	if (user->mux_prev)
+		user->mux_prev->mux_next = user->mux_next;
+	else
+		mux->first_user = user->mux_next;
+
+	if (mux_user_is_congested(mux, user))
+		mux->congested--;
+	user->mux_queued = 0;
+
+	user->mux_next = NULL;
+	user->mux_prev = NULL;
+}
+
+struct hub_mux* mux_create(struct hub_info* hub, struct net_connection* con, struct ip_addr_encap* addr, int version)
 {
 	struct hub_mux* mux = NULL;
 
@@ -30,19 +98,21 @@ struct hub_mux* mux_create(struct hub_info* hub, struct net_connection* con, str
 		return NULL; /* OOM */
 
 	mux->send_queue = ioq_send_create();
-	mux->recv_queue = ioq_recv_create();
+	mux->recv_queue = ioq_recv_create(MAX_RECV_BUF);
 
 	mux->connection = con;
-	mux->users = list_create();
 	net_con_reinitialize(mux->connection, net_event_mux, mux, NET_EVENT_READ);
 
 	mux->hub = hub;
+	mux->version = version;
+	memcpy(&mux->addr, addr, sizeof(struct ip_addr_encap));
 	return mux;
 }
 
 void mux_net_io_want_write(struct hub_mux* mux)
 {
-	if (mux->is_disconnecting)
+	/* A full ring is written again when the frontend signals */
+	if (mux->is_disconnecting || mux->ring_state >= mux_ring_tx)
 		return;
 	net_con_update(mux->connection, NET_EVENT_READ | NET_EVENT_WRITE);
 }
@@ -54,21 +124,26 @@ void mux_net_io_want_read(struct hub_mux* mux)
 	net_con_update(mux->connection, NET_EVENT_READ);
 }
 
-static int mux_user_disconnected(struct hub_mux *mux, const char* line, size_t length)
+static int mux_user_quit(struct hub_mux *mux, sid_t sid)
 {
-	if (mux->is_disconnecting)
-		return 0;
-
-	sid_t sid = string_to_sid(line);
 	struct hub_user* user = uman_get_user_by_sid(mux->hub->users, sid);
 
-	if (!user)
+	if (!user || user->mux != mux)
 	{
-		LOG_WARN("received message from unknown user: %s", line);
+		LOG_WARN("received message from unknown user: %s", sid_to_string(sid));
 		return 0;
 	}
 
 	hub_disconnect_user(user->hub, user, quit_disconnected);
+	return 0;
+}
+
+static int mux_user_disconnected(struct hub_mux *mux, const char* line, size_t length)
+{
+	if (mux->is_disconnecting)
+		return 0;
+
+	return mux_user_quit(mux, string_to_sid(line));
 }
 
 static int mux_send(struct hub_mux *mux, struct adc_message *msg)
@@ -76,9 +151,7 @@ static int mux_send(struct hub_mux *mux, struct adc_message *msg)
 	if (mux->is_disconnecting)
 		return 0;
 
-	uhub_assert(msg->cache && *msg->cache);
-	
-	//LOG_WARN("%s", msg->cache);
+	uhub_assert(msg->cache && msg->length);
 
 	if (ioq_send_is_empty(mux->send_queue))
 	{
@@ -95,6 +168,332 @@ static int mux_send(struct hub_mux *mux, struct adc_message *msg)
 	
 }
 
+static void mux1_put_u32(char* p, uint32_t value)
+{
+	p[0] = (char) ((value >> 24) & 0xff);
+	p[1] = (char) ((value >> 16) & 0xff);
+	p[2] = (char) ((value >>  8) & 0xff);
+	p[3] = (char) ((value      ) & 0xff);
+}
+
+static uint32_t mux1_get_u32(const char* p)
+{
+	const unsigned char* b = (const unsigned char*) p;
+	return ((uint32_t) b[0] << 24) | ((uint32_t) b[1] << 16) | ((uint32_t) b[2] << 8) | (uint32_t) b[3];
+}
+
+/*
+ * Make room for 'size' more bytes in the batch, growing it geometrically.
+ * Returns a pointer to the end of the batch.
+ */
+static char* mux1_batch_reserve(struct hub_mux* mux, size_t size)
+{
+	size_t need;
+	size_t capacity;
+
+	if (!mux->batch)
+	{
+		mux->batch = adc_msg_construct_binary(MUX1_BATCH_SIZE);
+		if (!mux->batch)
+			return NULL; /* OOM */
+	}
+
+	need = mux->batch->length + size;
+	if (need >= mux->batch->capacity)
+	{
+		capacity = mux->batch->capacity * 2;
+		while (capacity <= need)
+			capacity *= 2;
+		if (!adc_msg_grow(mux->batch, capacity))
+			return NULL; /* OOM */
+	}
+	return mux->batch->cache + mux->batch->length;
+}
+
+static void mux1_batch_forget(struct hub_mux* mux)
+{
+	if (mux->batch_msg)
+	{
+		adc_msg_free(mux->batch_msg);
+		mux->batch_msg = NULL;
+	}
+}
+
+/* @return the type of the last frame in the batch, or 0 if there is none. */
+static char mux1_frame_type(struct hub_mux* mux)
+{
+	if (!mux->batch || mux->batch_frame + MUX1_HEADER > mux->batch->length)
+		return 0;
+	return mux->batch->cache[mux->batch_frame + 4];
+}
+
+/* Append a new frame with room for 'size' bytes of body, and return the body. */
+static char* mux1_frame_begin(struct hub_mux* mux, char type, size_t size)
+{
+	char* p = mux1_batch_reserve(mux, MUX1_HEADER + size);
+	if (!p)
+		return NULL;
+
+	mux1_put_u32(p, (uint32_t) (size + 1));
+	p[4] = type;
+	mux->batch_frame = mux->batch->length;
+	mux->batch->length += MUX1_HEADER + size;
+	return p + MUX1_HEADER;
+}
+
+/* Grow the last frame by 'size' bytes, and return the new space. */
+static char* mux1_frame_extend(struct hub_mux* mux, size_t size)
+{
+	char* frame;
+	char* p = mux1_batch_reserve(mux, size);
+	if (!p)
+		return NULL;
+
+	frame = mux->batch->cache + mux->batch_frame;
+	mux1_put_u32(frame, mux1_get_u32(frame) + (uint32_t) size);
+	mux->batch->length += size;
+	return p;
+}
+
+static void mux1_batch_check(struct hub_mux* mux)
+{
+	if (mux->batch && mux->batch->length >= MUX1_BATCH_FLUSH)
+		mux_flush(mux);
+}
+
+/* A frame with a SID and an optional 32 bit prefix */
+static void mux1_send_sid_frame(struct hub_mux* mux, char type, sid_t sid, int have_cookie, uint32_t cookie)
+{
+	char* p;
+
+	mux1_batch_forget(mux);
+	p = mux1_frame_begin(mux, type, have_cookie ? 8 : 4);
+	if (!p)
+		return;
+
+	if (have_cookie)
+	{
+		mux1_put_u32(p, cookie);
+		p += 4;
+	}
+	mux1_put_u32(p, sid);
+	mux1_batch_check(mux);
+}
+
+static int mux1_send_payload(struct hub_mux* mux, char type, struct adc_message* msg)
+{
+	char* p;
+
+	mux1_batch_forget(mux);
+	p = mux1_frame_begin(mux, type, msg->length);
+	if (!p)
+		return 0;
+
+	memcpy(p, msg->cache, msg->length);
+	mux1_batch_check(mux);
+	return 1;
+}
+
+/*
+ * Unicast messages are appended as records to the last 'M' frame.
+ * When the same message goes to several users in a row, as when
+ * iterating the user list, the records are folded into one 'S' frame
+ * carrying the message once followed by the recipients.
+ */
+static int mux1_send_to_user(struct hub_mux* mux, struct hub_user* user, struct adc_message* msg)
+{
+	sid_t sid = user->id.sid;
+	char type = mux1_frame_type(mux);
+	char* p;
+
+	if (mux->batch_msg == msg && type == 'S')
+	{
+		p = mux1_frame_extend(mux, 4);
+		if (!p)
+			return 0;
+		mux1_put_u32(p, sid);
+	}
+	else if (mux->batch_msg == msg && type == 'M' && mux->batch_sid != sid)
+	{
+		struct adc_message* batch = mux->batch;
+		sid_t first = mux->batch_sid;
+
+		/* Take the last record out of its frame, or drop the frame if it was the only one */
+		if (mux->batch_record == mux->batch_frame + MUX1_HEADER)
+		{
+			batch->length = mux->batch_frame;
+		}
+		else
+		{
+			batch->length = mux->batch_record;
+			mux1_put_u32(batch->cache + mux->batch_frame, (uint32_t) (batch->length - mux->batch_frame - 4));
+		}
+
+		p = mux1_frame_begin(mux, 'S', 4 + msg->length + 8);
+		if (!p)
+		{
+			mux1_batch_forget(mux);
+			return 0;
+		}
+		mux1_put_u32(p, (uint32_t) msg->length);
+		memcpy(p + 4, msg->cache, msg->length);
+		mux1_put_u32(p + 4 + msg->length, first);
+		mux1_put_u32(p + 8 + msg->length, sid);
+	}
+	else
+	{
+		size_t size = 8 + msg->length;
+
+		mux1_batch_forget(mux);
+		if (type == 'M')
+			p = mux1_frame_extend(mux, size);
+		else
+			p = mux1_frame_begin(mux, 'M', size);
+
+		if (!p)
+			return 0;
+
+		mux1_put_u32(p, sid);
+		mux1_put_u32(p + 4, (uint32_t) msg->length);
+		memcpy(p + 8, msg->cache, msg->length);
+
+		mux->batch_record = p - mux->batch->cache;
+		mux->batch_msg = adc_msg_incref(msg);
+		mux->batch_sid = sid;
+	}
+
+	mux1_batch_check(mux);
+	return 1;
+}
+
+void mux_flush(struct hub_mux* mux)
+{
+	struct adc_message* batch = mux->batch;
+
+	mux1_batch_forget(mux);
+	if (!batch)
+		return;
+
+	/* Frames after a ring offer must not go out on the socket */
+	if (mux->ring_state == mux_ring_offer || mux->ring_state == mux_ring_switch)
+		return;
+
+	mux->batch = NULL;
+	if (batch->length)
+		mux_send(mux, batch);
+	adc_msg_free(batch);
+}
+
+void mux_flush_all(struct hub_info* hub)
+{
+	struct hub_mux* mux;
+	LIST_FOREACH(struct hub_mux*, mux, hub->muxes,
+	{
+		if (mux->batch)
+			mux_flush(mux);
+	});
+}
+
+int mux_ring_progress(struct hub_mux* mux)
+{
+#ifdef USE_SHM_RING
+	char reply[MUX1_HEADER + 5];
+	int fds[SHM_LINK_PEER_FDS];
+	ssize_t ret;
+
+	if (mux->ring_state == mux_ring_offer)
+	{
+		mux1_put_u32(reply, 6);
+		reply[4] = 'U';
+		reply[5] = 1;
+		mux1_put_u32(reply + 6, (uint32_t) shm_link_get_size(mux->ring));
+		shm_link_get_peer_fds(mux->ring, fds);
+
+		ret = net_send_fds(net_con_get_sd(mux->connection), reply, sizeof(reply), fds, SHM_LINK_PEER_FDS);
+		if (ret == -1)
+		{
+			if (net_error() != EWOULDBLOCK)
+				return -1;
+			net_con_blocked(mux->connection, NET_EVENT_WRITE);
+			mux_net_io_want_write(mux);
+			return 0;
+		}
+
+		mux->ring_state = mux_ring_switch;
+		if ((size_t) ret < sizeof(reply))
+		{
+			/* The descriptors went with the first byte, the rest is sent as usual */
+			struct adc_message* rest = adc_msg_construct_binary(sizeof(reply) - ret);
+			if (!rest)
+				return -1;
+			memcpy(rest->cache, reply + ret, sizeof(reply) - ret);
+			rest->length = sizeof(reply) - ret;
+			mux_send(mux, rest);
+			adc_msg_free(rest);
+			return 0;
+		}
+	}
+
+	if (mux->ring_state == mux_ring_switch)
+	{
+		/* Wakeups go through a dup, as the connection closes its descriptor */
+		int fd = dup(shm_link_get_fd(mux->ring));
+		if (fd == -1)
+			return -1;
+
+		mux->ring_state = mux_ring_tx;
+		mux->ring_con = net_con_create();
+		net_con_initialize(mux->ring_con, fd, net_event_mux_ring, mux, NET_EVENT_READ);
+		LOG_DEBUG("mux link moved to a shared memory ring of %d bytes", (int) shm_link_get_size(mux->ring));
+		mux_flush(mux);
+	}
+#endif
+	return 0;
+}
+
+static int mux1_ring_request(struct hub_mux* mux, const char* body)
+{
+	char* p;
+
+	if (mux->ring_state != mux_ring_none)
+		return -1;
+
+#ifdef USE_SHM_RING
+	if (!mux->ring && net_is_local_socket(net_con_get_sd(mux->connection)))
+		mux->ring = shm_link_create(mux1_get_u32(body));
+
+	if (mux->ring)
+	{
+		mux_flush(mux);
+		mux->ring_state = mux_ring_offer;
+		return handle_net_write_mux(mux) ? -1 : 0;
+	}
+#endif
+
+	/* Not granted, the link stays on the socket */
+	mux1_batch_forget(mux);
+	p = mux1_frame_begin(mux, 'U', 5);
+	if (p)
+	{
+		p[0] = 0;
+		mux1_put_u32(p + 1, 0);
+	}
+	return 0;
+}
+
+static int mux1_ring_confirm(struct hub_mux* mux)
+{
+	if (mux->ring_state != mux_ring_tx)
+		return -1;
+
+#ifdef USE_SHM_RING
+	mux->ring_state = mux_ring_up;
+	/* The frontend may have written to the ring already */
+	shm_link_wakeup(mux->ring);
+#endif
+	return 0;
+}
+
 int mux_send_to_user(struct hub_mux *mux, struct hub_user *user, struct adc_message *msg)
 {
 	int ret;
@@ -103,6 +502,9 @@ int mux_send_to_user(struct hub_mux *mux, struct hub_user *user, struct adc_mess
 
 	uhub_assert(msg->cache && *msg->cache);
 
+	if (mux->version)
+		return mux1_send_to_user(mux, user, msg);
+
 	msg = adc_msg_copy(msg);
 
 	if(!adc_msg_grow(msg, msg->length + 7))
@@ -128,6 +530,17 @@ int mux_broadcast(struct hub_mux *mux, struct adc_message *msg)
 
 	uhub_assert(msg->cache && *msg->cache);
 
+	if (mux->version)
+	{
+		struct hub_user* user;
+		for (user = mux->first_user; user; user = user->mux_next)
+		{
+			if (user_is_logged_in(user))
+				mux_user_charge(mux, user, msg->length);
+		}
+		return mux1_send_payload(mux, 'B', msg);
+	}
+
 	msg = adc_msg_copy(msg);
 
 	if(!adc_msg_grow(msg, msg->length + 2))
@@ -143,11 +556,26 @@ int mux_broadcast(struct hub_mux *mux, struct adc_message *msg)
 	return ret;
 }
 
+int mux_feature_cast(struct hub_mux *mux, struct adc_message *msg)
+{
+	if (mux->is_disconnecting || !mux->version)
+		return 0;
+
+	uhub_assert(msg->cache && *msg->cache);
+	return mux1_send_payload(mux, 'F', msg);
+}
+
 static void mux_notify_user(struct hub_mux *mux, struct hub_user* user, char type)
 {
 	if (mux->is_disconnecting)
 		return;
 
+	if (mux->version)
+	{
+		mux1_send_sid_frame(mux, type, user->id.sid, 0, 0);
+		return;
+	}
+
 	/* FIXME: evil, but this way we can reuse the ioqueue stuff unchanged */
 	struct adc_message* msg = adc_msg_construct(0, 2);
 	
@@ -162,8 +590,22 @@ static void mux_notify_user(struct hub_mux *mux, struct hub_user* user, char typ
 	adc_msg_free(msg);
 }
 
+static struct hub_user* mux_add_user(struct hub_mux *mux, struct ip_addr_encap* raw_addr)
+{
+	struct hub_user* user = user_create(mux->hub, NULL, raw_addr);
+	if (!user) /* OOM */
+		return NULL;
+
+	user->mux = mux;
+	/* We need a SID early */
+	uman_get_free_sid(mux->hub->users, user);
+	mux_user_list_append(mux, user);
+	return user;
+}
+
 static int mux_new_user(struct hub_mux *mux, const char* line, size_t length)
 {
+	struct hub_user* user;
 	struct ip_addr_encap raw_addr;
 	if (ip_convert_to_binary(line, &raw_addr) < 0)
 	{
@@ -172,51 +614,57 @@ static int mux_new_user(struct hub_mux *mux, const char* line, size_t length)
 		return quit_protocol_error;
 	}
 
-	struct hub_user* user = user_create(mux->hub, NULL, &raw_addr);
-	if (!user) /* OOM */
+	user = mux_add_user(mux, &raw_addr);
+	if (!user)
 		return quit_protocol_error;
 
-	user->mux = mux;
-	/* We need a SID early */
-	uman_get_free_sid(mux->hub->users, user);
-	list_append(mux->users, user);
 	mux_notify_user(mux, user, '+');
 	return 0;
 }
 
+void mux_user_logged_in(struct hub_mux* mux, struct hub_user* user)
+{
+	if (mux->is_disconnecting || !mux->version)
+		return;
+	mux_notify_user(mux, user, 'L');
+}
+
 void mux_disconnect_user(struct hub_mux *mux, struct hub_user* user)
 {
 	if (mux->is_disconnecting)
 		return;
 
 	mux_notify_user(mux, user, '-');
-	list_remove(mux->users, user);
+	mux_user_list_remove(mux, user);
 }
 
-static int mux_message_from_user(struct hub_mux *mux, const char* line, size_t length)
+static int mux_user_message(struct hub_mux *mux, sid_t sid, const char* line, size_t length)
 {
-	char* p = memchr(line, ' ', length);
-	if (!p)
+	struct hub_user* user = uman_get_user_by_sid(mux->hub->users, sid);
+
+	if (!user || user->mux != mux)
 	{
-		LOG_WARN("invalid mux message: %s", line);
+		LOG_WARN("received message from unknown user: %s", sid_to_string(sid));
 		return 0;
 	}
 
-	p[0] = '\0';
+	if (hub_handle_message(user->hub, user, line, length))
+		hub_disconnect_user(user->hub, user, quit_protocol_error);
 
-	sid_t sid = string_to_sid(line);
-	struct hub_user* user = uman_get_user_by_sid(mux->hub->users, sid);
+	return 0;
+}
 
-	if (!user)
+static int mux_message_from_user(struct hub_mux *mux, const char* line, size_t length)
+{
+	char* p = memchr(line, ' ', length);
+	if (!p)
 	{
-		LOG_WARN("received message from unknown user: %s", line);
+		LOG_WARN("invalid mux message: %s", line);
 		return 0;
 	}
 
-	if (hub_handle_message(user->hub, user, p + 1, length - (p - line + 1)))
-		hub_disconnect_user(user->hub, user, quit_protocol_error);
-
-	return 0;
+	p[0] = '\0';
+	return mux_user_message(mux, string_to_sid(line), p + 1, length - (p - line + 1));
 }
 
 int mux_handle_message(struct hub_mux* mux, const char* line, size_t length)
@@ -255,51 +703,220 @@ int mux_handle_message(struct hub_mux* mux, const char* line, size_t length)
 	}
 }
 
-static void disconnect_user(void* ptr)
+static int mux1_new_user(struct hub_mux *mux, const char* body, size_t size)
 {
-	if (ptr)
+	struct hub_user* user;
+	struct ip_addr_encap raw_addr;
+	uint32_t cookie;
+
+	memset(&raw_addr, 0, sizeof(raw_addr));
+	if (size == 9 && body[4] == 4)
 	{
-		struct hub_user* user = (struct hub_user*) ptr;
-		hub_disconnect_user(user->hub, user, quit_disconnected);
+		raw_addr.af = AF_INET;
+		memcpy(&raw_addr.internal_ip_data.in, body + 5, 4);
 	}
+	else if (size == 21 && body[4] == 6)
+	{
+		raw_addr.af = AF_INET6;
+		memcpy(&raw_addr.internal_ip_data.in6, body + 5, 16);
+	}
+	else
+	{
+		LOG_WARN("invalid mux user address");
+		return -1;
+	}
+
+	cookie = mux1_get_u32(body);
+	user = mux_add_user(mux, &raw_addr);
+	if (!user)
+		return -1;
+
+	mux1_send_sid_frame(mux, '+', user->id.sid, 1, cookie);
+	return 0;
 }
 
-static void clear_user(void* ptr)
+static int mux1_user_messages(struct hub_mux *mux, char* body, size_t size)
 {
-	if (ptr)
+	size_t offset = 0;
+	size_t length;
+	sid_t sid;
+	char* line;
+	char end;
+
+	while (offset < size)
 	{
-		struct hub_user* u = (struct hub_user*) ptr;
+		if (size - offset < 8)
+			return -1;
 
-		/* Mark the user as already being disconnected.
-		 * This prevents the hub from trying to send
-		 * quit messages to other users.
-		 */
-		u->credentials = auth_cred_none;
-		user_destroy(u);
+		sid = mux1_get_u32(body + offset);
+		length = mux1_get_u32(body + offset + 4);
+		offset += 8;
+		if (length > size - offset)
+			return -1;
+
+		line = body + offset;
+		offset += length;
+
+		if (!length)
+			continue;
+
+		/* Terminate in place like a received line, there is always room after the frame */
+		end = line[length];
+		line[length] = '\0';
+		mux_user_message(mux, sid, line, length);
+		line[length] = end;
+
+		if (mux->is_disconnecting)
+			break;
+	}
+	return 0;
+}
+
+static int mux1_user_credits(struct hub_mux *mux, const char* body, size_t size)
+{
+	struct hub_user* user;
+	size_t offset;
+
+	if (size % 8)
+		return -1;
+
+	for (offset = 0; offset < size; offset += 8)
+	{
+		user = uman_get_user_by_sid(mux->hub->users, mux1_get_u32(body + offset));
+		if (user && user->mux == mux)
+			mux_user_credit(mux, user, mux1_get_u32(body + offset + 4));
+	}
+	return 0;
+}
+
+static int mux1_handle_frame(struct hub_mux *mux, char type, char* body, size_t size)
+{
+	switch (type)
+	{
+		case '+':
+			return mux1_new_user(mux, body, size);
+
+		case '-':
+			if (size != 4)
+				return -1;
+			return mux_user_quit(mux, mux1_get_u32(body));
+
+		case 'M':
+			return mux1_user_messages(mux, body, size);
+
+		case 'C':
+			return mux1_user_credits(mux, body, size);
+
+		case 'U':
+			if (size == 4)
+				return mux1_ring_request(mux, body);
+			if (size == 0)
+				return mux1_ring_confirm(mux);
+			return -1;
+
+		default:
+			/* Unknown frames are skipped */
+			LOG_DEBUG("unknown mux frame: %d", (int) type);
+			return 0;
+	}
+}
+
+ssize_t mux_handle_frames(struct hub_mux* mux, char* data, size_t length)
+{
+	size_t offset = 0;
+	size_t size;
+
+	if (!mux->hello)
+	{
+		if (length < MUX1_HELLO_LEN)
+			return 0;
+
+		if (memcmp(data, MUX1_HELLO, MUX1_HELLO_LEN) != 0)
+			return -1;
+
+		mux->hello = 1;
+		offset = MUX1_HELLO_LEN;
+	}
+
+	while (!mux->is_disconnecting && length - offset >= 4)
+	{
+		size = mux1_get_u32(data + offset);
+		if (size == 0 || size > MUX1_MAX_FRAME)
+		{
+			LOG_WARN("invalid mux frame length: %u", (unsigned) size);
+			return -1;
+		}
+
+		if (length - offset - 4 < size)
+			break; /* partial frame */
+
+		if (mux1_handle_frame(mux, data[offset + 4], data + offset + MUX1_HEADER, size - 1) == -1)
+			return -1;
+
+		offset += 4 + size;
+
+		/* The rest comes over the ring */
+		if (size == 1 && data[offset - 1] == 'U')
+			break;
 	}
+	return offset;
 }
 
 void mux_disconnect(struct hub_mux *mux)
 {
+	struct hub_user* user;
 	mux->is_disconnecting = 1;
 
-	list_clear(mux->users, &disconnect_user);
+	/* Detach the users first, they may outlive the mux until the
+	 * hub has processed their quit events. */
+	while ((user = mux->first_user))
+	{
+		mux_user_list_remove(mux, user);
+		user->mux = NULL;
+		hub_disconnect_user(user->hub, user, quit_disconnected);
+	}
 
 	mux_destroy(mux);
 }
 
 void mux_destroy(struct hub_mux *mux)
 {
+	struct hub_user* user;
 	mux->is_disconnecting = 1;
 
+	mux1_batch_forget(mux);
+	if (mux->batch)
+		adc_msg_free(mux->batch);
+
 	ioq_recv_destroy(mux->recv_queue);
 	ioq_send_destroy(mux->send_queue);
 
+#ifdef USE_SHM_RING
+	if (mux->ring_con)
+		net_con_close(mux->ring_con);
+	shm_link_destroy(mux->ring);
+	mux->ring_con = 0;
+	mux->ring = 0;
+#endif
+
 	net_shutdown_r(net_con_get_sd(mux->connection));
 	net_con_close(mux->connection);
 	mux->connection = 0;
-	
-	list_clear(mux->users, &clear_user);
-	list_destroy(mux->users);
+	if (mux->admitted)
+		admission_release(mux->hub->admission, &mux->addr);
+	mux->admitted = 0;
+
+	while ((user = mux->first_user))
+	{
+		mux_user_list_remove(mux, user);
+		user->mux = NULL;
+
+		/* Mark the user as already being disconnected.
+		 * This prevents the hub from trying to send
+		 * quit messages to other users.
+		 */
+		user->credentials = auth_cred_none;
+		user_destroy(user);
+	}
 	hub_free(mux);
 }
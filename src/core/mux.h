@@ -19,27 +19,155 @@
 
 #include "uhub.h"
 
+/*
+ * A mux link carries many users over one connection to a frontend.
+ *
+ * MUX0 is line based: "+ <addr>", "- <sid>" and "M <sid> <message>" from
+ * the frontend, and "+ <sid>", "- <sid>", "M <sid> <message>" and
+ * "B <message>" from the hub.
+ *
+ * MUX1 starts with the line "MUX1\n" from the frontend, after which
+ * both directions carry binary frames:
+ *
+ *   [length u32][type u8][body]
+ *
+ * where the length covers the type and the body, and all integers are in
+ * network byte order. SIDs are sent as 32 bit integers.
+ *
+ * Frontend to hub:
+ *   '+'  [cookie u32][family u8 (4 or 6)][address (4 or 16 bytes)]
+ *   '-'  [sid u32]
+ *   'M'  one or more [sid u32][length u32][message without '\n']
+ *   'C'  one or more [sid u32][bytes u32]   credits, see below
+ *   'U'  [size u32]                 ask for a shared memory ring, see below
+ *   'U'  (empty)                    the frontend has moved to the ring
+ *
+ * Hub to frontend:
+ *   '+'  [cookie u32][sid u32]      the user was assigned a SID
+ *   '-'  [sid u32]                  the user must be disconnected
+ *   'L'  [sid u32]                  the user is logged in and receives broadcasts
+ *   'M'  one or more [sid u32][length u32][message]
+ *   'S'  [length u32][message][sid u32]...   the same message to several users
+ *   'B'  [message]                  to all logged in users
+ *   'F'  [message]                  feature cast, the frontend matches the
+ *                                   +/- features against each user's INF SU
+ *   'U'  [status u8][size u32]      reply to a ring request, status 1 if granted
+ *
+ * Frames to the frontend are collected while the hub processes events and
+ * are written once per event loop iteration, see mux_flush_all().
+ *
+ * Flow control: the hub counts the message bytes it sends to each MUX1
+ * user, including the 'B' and 'F' frames the user is meant to receive,
+ * and the frontend hands the bytes back in 'C' frames once they are
+ * written to the client. The outstanding bytes are held against
+ * max_send_buffer and max_send_buffer_soft as for any other user. While
+ * any user on a link is above the soft limit, broadcasts and feature
+ * casts for that link are sent as multicasts to the users that still
+ * accept them, rather than as 'B' or 'F' frames.
+ *
+ * Shared memory: on a local (unix socket) link the frontend may ask for a
+ * ring of the given size in each direction. The hub sends its reply as
+ * the last bytes on the socket, with the memfd and eventfds attached (see
+ * network/shmring.h), and writes all later frames to the ring. Once the
+ * frontend has attached it sends an empty 'U' frame as the last bytes on
+ * the socket and writes all later frames to the ring. The socket stays
+ * open to tell when either side goes away.
+ */
+#define MUX1_HELLO       "MUX1\n"
+#define MUX1_HELLO_LEN   5
+#define MUX1_HEADER      5                    /* length + type */
+#define MUX1_MAX_FRAME   (MAX_RECV_BUF - 4)   /* largest frame accepted from a frontend */
+#define MUX1_BATCH_SIZE  4096
+#define MUX1_BATCH_FLUSH 65536
+
+enum mux_ring_state
+{
+	mux_ring_none   = 0,  /** Frames go over the socket */
+	mux_ring_offer  = 1,  /** A ring is offered once the send queue is empty */
+	mux_ring_switch = 2,  /** The offer is queued, frames go to the ring once it is sent */
+	mux_ring_tx     = 3,  /** Frames to the frontend go over the ring */
+	mux_ring_up     = 4,  /** Frames in both directions go over the ring */
+};
+
 struct hub_mux
 {
-	struct linked_list*    users;
+	struct hub_user*        first_user;         /** Users on this link (intrusive list, linked through hub_user::mux_next) */
+	struct hub_user*        last_user;
 	struct hub_info*        hub;                /** The hub instance this user belong to */
 	void* ptr;
 	struct ioq_recv*        recv_queue;
 	struct ioq_send*        send_queue;
 	struct net_connection*  connection;         /** Connection data */
 	int is_disconnecting;
+	int                     version;            /** 0 for MUX0 (lines), 1 for MUX1 (binary frames) */
+	int                     hello;              /** MUX1 hello has been received */
+	struct adc_message*     batch;              /** MUX1 frames not yet handed to the send queue */
+	size_t                  batch_frame;        /** Offset of the last frame in the batch */
+	size_t                  batch_record;       /** Offset of the last 'M' record in the batch */
+	struct adc_message*     batch_msg;          /** Message of the last 'M' record or 'S' frame (referenced) */
+	sid_t                   batch_sid;          /** Recipient of the last 'M' record */
+	size_t                  congested;          /** Users above max_send_buffer_soft (MUX1) */
+	int                     fan_out;            /** Feature cast goes out as one 'F' frame, see route_to_subscribers() */
+	enum mux_ring_state     ring_state;
+	struct shm_link*        ring;               /** Shared memory link to the frontend, if any */
+	struct net_connection*  ring_con;           /** Wakeups from the frontend, on a dup of the ring's eventfd */
+	struct ip_addr_encap    addr;               /** Address of the frontend */
+	int                     admitted;           /** Counted by the admission control, see admission_release() */
 };
 
 extern void mux_net_io_want_write(struct hub_mux* mux);
 extern void mux_net_io_want_read(struct hub_mux* mux);
 
-extern struct hub_mux* mux_create(struct hub_info* hub, struct net_connection* con, struct ip_addr_encap* addr);
+extern struct hub_mux* mux_create(struct hub_info* hub, struct net_connection* con, struct ip_addr_encap* addr, int version);
 
 extern int mux_handle_message(struct hub_mux* mux, const char* line, size_t length);
 
+/**
+ * Parse MUX1 frames received from the frontend.
+ * The data may be modified temporarily, but is restored.
+ *
+ * @return the number of bytes consumed, which excludes a trailing partial frame,
+ *         or -1 on a protocol error.
+ */
+extern ssize_t mux_handle_frames(struct hub_mux* mux, char* data, size_t length);
+
 extern void mux_disconnect_user(struct hub_mux* mux, struct hub_user* user);
 extern int mux_send_to_user(struct hub_mux *mux, struct hub_user *user, struct adc_message *msg);
 extern int mux_broadcast(struct hub_mux *mux, struct adc_message *msg);
 
+/**
+ * Send a feature cast message once to a MUX1 frontend, which
+ * delivers it to the subscribing users.
+ */
+extern int mux_feature_cast(struct hub_mux *mux, struct adc_message *msg);
+
+/**
+ * Account for 'bytes' sent to the frontend for the user.
+ */
+extern void mux_user_charge(struct hub_mux* mux, struct hub_user* user, size_t bytes);
+
+/**
+ * @return 1 if the message can go to all users on the link as one
+ *         frame without passing any user's send buffer limits.
+ */
+extern int mux_can_fan_out(struct hub_mux* mux, struct adc_message* msg);
+
+/**
+ * Tell the frontend that a user has logged in and should receive broadcasts.
+ */
+extern void mux_user_logged_in(struct hub_mux* mux, struct hub_user* user);
+
+/**
+ * Hand the batched MUX1 frames to the send queue.
+ */
+extern void mux_flush(struct hub_mux* mux);
+extern void mux_flush_all(struct hub_info* hub);
+
+/**
+ * Carry on with a ring upgrade once the socket send queue is empty.
+ * @return -1 if the link has failed.
+ */
+extern int mux_ring_progress(struct hub_mux* mux);
+
 extern void mux_destroy(struct hub_mux* mux);
 extern void mux_disconnect(struct hub_mux* mux);
@@ -21,13 +21,16 @@
 #include "ioqueue.h"
 #include "probe.h"
 
+#define MUX_RING_READS 16  /* Reads from a ring per wakeup, before others get a go */
+
 int handle_net_read(struct hub_user* user, struct hub_mux *mux)
 {
-	static char buf[MAX_RECV_BUF];
 	struct net_connection* con;
 	struct ioq_recv* q;
-	size_t buf_size;
+	char* buf;
+	size_t space;
 	ssize_t size;
+	int from_ring = 0;
 	
 	if (user) {
 		con = user->connection;
@@ -37,18 +40,42 @@ int handle_net_read(struct hub_user* user, struct hub_mux *mux)
 		q = mux->recv_queue;
 	}
 
-	buf_size = ioq_recv_get(q, buf, MAX_RECV_BUF);
-
-	if (user && user_flag_get(user, flag_maxbuf))
-		buf_size = 0;
+	buf = ioq_recv_reserve(q, &space);
+	if (!buf)
+		return quit_memory_error;
 
-	size = net_con_recv(con, buf + buf_size, MAX_RECV_BUF - buf_size);
+	if (!space)
+	{
+		/* Buffer is full without a complete message */
+		if (!user)
+			return quit_protocol_error;
+		ioq_recv_clear(q);
+		user_flag_set(user, flag_maxbuf);
+		LOG_WARN("Received message past max_recv_buffer, dropping message.");
+		buf = ioq_recv_reserve(q, &space);
+		if (!buf)
+			return quit_memory_error;
+	}
 
-	if (size > 0)
-		buf_size += size;
+#ifdef USE_SHM_RING
+	if (mux && mux->ring_state == mux_ring_up)
+	{
+		from_ring = 1;
+		size = shm_link_read(mux->ring, buf, space);
+		if (size < 0)
+		{
+			ioq_recv_commit(q, 0);
+			LOG_WARN("Invalid data in shared memory ring, disconnecting mux.");
+			return quit_protocol_error;
+		}
+	}
+	else
+#endif
+	size = net_con_recv(con, buf, space);
 
 	if (size < 0)
 	{
+		ioq_recv_commit(q, 0);
 		if (size == -1)
 			return quit_disconnected;
 		else
@@ -56,18 +83,34 @@ int handle_net_read(struct hub_user* user, struct hub_mux *mux)
 	}
 	else if (size == 0)
 	{
+		ioq_recv_commit(q, 0);
 		return 0;
 	}
 	else
 	{
-		char* lastPos = 0;
-		char* start = buf;
+		char* start;
 		char* pos = 0;
-		size_t remaining = buf_size;
+		size_t remaining;
+
+		ioq_recv_commit(q, size);
+		buf = ioq_recv_data(q, &remaining);
+		start = buf;
+
+		if (mux && mux->version)
+		{
+			ssize_t consumed = mux_handle_frames(mux, buf, remaining);
+			if (consumed < 0)
+				return quit_protocol_error;
+			ioq_recv_consume(q, consumed);
+
+			/* Nothing may follow the move to the ring on the socket */
+			if (!from_ring && mux->ring_state == mux_ring_up && !ioq_recv_is_empty(q))
+				return quit_protocol_error;
+			return 0;
+		}
 
 		while ((pos = memchr(start, '\n', remaining)))
 		{
-			lastPos = pos+1;
 			pos[0] = '\0';
 
 #ifdef DEBUG_SENDQ
@@ -102,22 +145,19 @@ int handle_net_read(struct hub_user* user, struct hub_mux *mux)
 			start = pos;
 		}
 
-		if (lastPos || remaining)
+		/* The unparsed tail stays in the buffer */
+		ioq_recv_consume(q, start - buf);
+
+		if (remaining && user && user_flag_get(user, flag_maxbuf))
 		{
-			if (!user || (remaining < (size_t) user->hub->config->max_recv_buffer))
-			{
-				ioq_recv_set(q, lastPos ? lastPos : buf, remaining);
-			}
-			else
-			{
-				ioq_recv_set(q, 0, 0);
-				user_flag_set(user, flag_maxbuf);
-				LOG_WARN("Received message past max_recv_buffer, dropping message.");
-			}
+			/* Still the rest of a message that is being dropped */
+			ioq_recv_clear(q);
 		}
-		else
+		else if (remaining && user && remaining >= (size_t) user->hub->config->max_recv_buffer)
 		{
-			ioq_recv_set(q, 0, 0);
+			ioq_recv_clear(q);
+			user_flag_set(user, flag_maxbuf);
+			LOG_WARN("Received message past max_recv_buffer, dropping message.");
 		}
 	}
 	return 0;
@@ -147,9 +187,55 @@ int handle_net_write(struct hub_user* user)
 	return 0;
 }
 
+#ifdef USE_SHM_RING
+static int handle_ring_write(void* desc, const void* buf, size_t len)
+{
+	return (int) shm_link_write((struct shm_link*) desc, buf, len);
+}
+
+/*
+ * Write to the ring until it is full. A full ring has asked the
+ * frontend for a wakeup, see net_event_mux_ring().
+ */
+static int handle_ring_write_mux(struct hub_mux* mux)
+{
+	size_t bytes;
+	while ((bytes = ioq_send_get_bytes(mux->send_queue)))
+	{
+		ioq_send_write(mux->send_queue, handle_ring_write, mux->ring);
+		if (ioq_send_get_bytes(mux->send_queue) == bytes)
+			break;
+	}
+	return 0;
+}
+
+/*
+ * Once frames go over the ring in both directions, the socket only
+ * tells when the frontend goes away.
+ */
+static int handle_net_read_mux_socket(struct hub_mux* mux)
+{
+	char buf[1];
+	ssize_t size = net_con_recv(mux->connection, buf, sizeof(buf));
+	if (size == -1)
+		return quit_disconnected;
+	if (size < 0)
+		return quit_socket_error;
+	if (size > 0)
+		return quit_protocol_error;
+	return 0;
+}
+#endif
+
 int handle_net_write_mux(struct hub_mux* mux)
 {
 	int ret = 0;
+
+#ifdef USE_SHM_RING
+	if (mux->ring_state >= mux_ring_tx)
+		return handle_ring_write_mux(mux);
+#endif
+
 	while (ioq_send_get_bytes(mux->send_queue))
 	{
 		ret = ioq_send_send(mux->send_queue, mux->connection);
@@ -167,6 +253,8 @@ int handle_net_write_mux(struct hub_mux* mux)
 	else
 	{
 		mux_net_io_want_read(mux);
+		if (mux->ring_state == mux_ring_offer || mux->ring_state == mux_ring_switch)
+			return mux_ring_progress(mux) == -1 ? quit_socket_error : 0;
 	}
 	return 0;
 }
@@ -227,6 +315,11 @@ void net_event_mux(struct net_connection* con, int event, void *arg)
 
 	if (event & NET_EVENT_READ)
 	{
+#ifdef USE_SHM_RING
+		if (mux->ring_state == mux_ring_up)
+			flag_close = handle_net_read_mux_socket(mux);
+		else
+#endif
 		flag_close = handle_net_read(NULL, mux);
 		if (flag_close)
 		{
@@ -250,12 +343,53 @@ void net_event_mux(struct net_connection* con, int event, void *arg)
 	}
 }
 
+#ifdef USE_SHM_RING
+void net_event_mux_ring(struct net_connection* con, int event, void *arg)
+{
+	struct hub_mux* mux = (struct hub_mux*) arg;
+	int flag_close = 0;
+	int n = 0;
+
+	if (event == NET_EVENT_TIMEOUT)
+		return;
+
+	/* Reading the eventfd resets it, so it is drained */
+	shm_link_clear(mux->ring);
+	net_con_blocked(con, NET_EVENT_READ);
+
+	/* The frontend has made room in a full ring */
+	if (ioq_send_get_bytes(mux->send_queue))
+		flag_close = handle_net_write_mux(mux);
+
+	if (mux->ring_state == mux_ring_up)
+	{
+		for (; !flag_close && n < MUX_RING_READS && shm_link_readable(mux->ring); n++)
+			flag_close = handle_net_read(NULL, mux);
+
+		if (!flag_close && n == MUX_RING_READS && shm_link_readable(mux->ring))
+			shm_link_wakeup(mux->ring);
+	}
+
+	if (flag_close)
+	{
+		struct hub_info *hub = mux->hub;
+		mux_disconnect(mux);
+		list_remove(hub->muxes, mux);
+	}
+}
+#else
+void net_event_mux_ring(struct net_connection* con, int event, void *arg)
+{
+}
+#endif
+
 void net_on_accept(struct net_connection* con, int event, void *arg)
 {
 	struct hub_info* hub = (struct hub_info*) arg;
 	struct hub_probe* probe = 0;
 	struct ip_addr_encap ipaddr;
 	int server_fd = net_con_get_sd(con);
+	int admitted;
 	plugin_st status;
 
 	for (;;)
@@ -269,6 +403,7 @@ void net_on_accept(struct net_connection* con, int event, void *arg)
 			if (net_error() == EWOULDBLOCK)
 #endif
 			{
+				net_con_blocked(con, NET_EVENT_READ);
 				break;
 			}
 			else
@@ -278,9 +413,34 @@ void net_on_accept(struct net_connection* con, int event, void *arg)
 			}
 		}
 
-		status = plugin_check_ip_early(hub, &ipaddr);
+		if (ipaddr.af == AF_UNIX)
+		{
+			/* On the unix socket, users get the loopback address */
+			if (!hub_is_local_peer_allowed(hub, fd))
+			{
+				net_close(fd);
+				continue;
+			}
+			ip_convert_to_binary("127.0.0.1", &ipaddr);
+			admitted = 0;
+		}
+		else
+		{
+			/* Cheap enough to do for every connection in a flood, so it comes first */
+			admitted = hub_admit_connection(hub, &ipaddr);
+			if (admitted == -1)
+			{
+				LOG_TRACE("Connection from %s not admitted", ip_convert_to_string(&ipaddr));
+				net_close(fd);
+				continue;
+			}
+		}
+
+		status = acl_is_ip_banned(hub->acl, &ipaddr) ? st_deny : plugin_check_ip_early(hub, &ipaddr);
 		if (status == st_deny)
 		{
+			if (admitted)
+				admission_release(hub->admission, &ipaddr);
 			plugin_log_connection_denied(hub, &ipaddr);
 			net_close(fd);
 			continue;
@@ -292,9 +452,12 @@ void net_on_accept(struct net_connection* con, int event, void *arg)
 		if (!probe)
 		{
 			LOG_ERROR("Unable to create probe after socket accepted. Out of memory?");
+			if (admitted)
+				admission_release(hub->admission, &ipaddr);
 			net_close(fd);
 			break;
 		}
+		probe->admitted = admitted;
 	}
 }
 
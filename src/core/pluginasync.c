@@ -0,0 +1,199 @@
+/*
+ * uhub - A tiny ADC p2p connection hub
+ * Copyright (C) 2007-2014, Jan Vidar Krey
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "uhub.h"
+
+struct plugin_async
+{
+	struct plugin_async*        next;       /** Completion queue */
+	struct plugin_async_queue*  queue;
+	struct plugin_handle*       plugin;     /** The plugin that deferred it, if any */
+	plugin_async_cb             callback;
+	void*                       ptr;        /** NULL once cancelled */
+	plugin_st                   status;
+	size_t                      size;
+	/* data follows */
+};
+
+/*
+ * The lock only covers the completion list, which plugin threads append
+ * to. Everything else is only touched by the event loop.
+ */
+struct plugin_async_queue
+{
+	struct hub_info*            hub;
+	uhub_mutex_t                lock;
+	struct plugin_async*        first;      /** Completed, not yet processed */
+	struct plugin_async*        last;
+	struct uhub_notify_handle*  notify;
+	struct plugin_async*        offered;    /** Offered to the hook being called */
+	size_t                      deferred;   /** Deferred and not yet processed */
+};
+
+#define PLUGIN_ASYNC_DATA_OFFSET ((sizeof(struct plugin_async) + 15) & ~((size_t) 15))
+
+static void plugin_async_notify(struct uhub_notify_handle* handle, void* ptr)
+{
+	plugin_async_queue_process((struct plugin_async_queue*) ptr);
+}
+
+struct plugin_async_queue* plugin_async_queue_create(struct hub_info* hub)
+{
+	struct plugin_async_queue* queue = hub_malloc_zero(sizeof(struct plugin_async_queue));
+	if (!queue)
+		return NULL;
+
+	queue->hub = hub;
+	queue->notify = net_notify_create(plugin_async_notify, queue);
+	if (!queue->notify)
+	{
+		hub_free(queue);
+		return NULL;
+	}
+	uhub_mutex_init(&queue->lock);
+	return queue;
+}
+
+void plugin_async_queue_destroy(struct plugin_async_queue* queue)
+{
+	if (!queue)
+		return;
+
+	plugin_async_queue_process(queue);
+	if (queue->deferred)
+		LOG_ERROR("%d plugin operations were never completed", (int) queue->deferred);
+
+	net_notify_destroy(queue->notify);
+	uhub_mutex_destroy(&queue->lock);
+	hub_free(queue);
+}
+
+void plugin_async_queue_process(struct plugin_async_queue* queue)
+{
+	struct plugin_async* async;
+	struct plugin_async* next;
+
+	uhub_mutex_lock(&queue->lock);
+	async = queue->first;
+	queue->first = NULL;
+	queue->last = NULL;
+	uhub_mutex_unlock(&queue->lock);
+
+	for (; async; async = next)
+	{
+		next = async->next;
+		queue->deferred--;
+		async->callback(queue->hub, async, async->status);
+		hub_free(async);
+	}
+}
+
+struct plugin_async* plugin_async_create(struct hub_info* hub, plugin_async_cb callback, void* ptr, size_t size)
+{
+	struct plugin_async* async;
+
+	if (!hub->plugins || !hub->plugins->async)
+		return NULL;
+
+	async = hub_malloc_zero(PLUGIN_ASYNC_DATA_OFFSET + size);
+	if (!async)
+		return NULL;
+
+	async->queue = hub->plugins->async;
+	async->callback = callback;
+	async->ptr = ptr;
+	async->size = size;
+	return async;
+}
+
+void plugin_async_free(struct plugin_async* async)
+{
+	uhub_assert(!async || !async->plugin);
+	hub_free(async);
+}
+
+void plugin_async_cancel(struct plugin_async* async)
+{
+	async->ptr = NULL;
+}
+
+void* plugin_async_get_data(struct plugin_async* async)
+{
+	return ((char*) async) + PLUGIN_ASYNC_DATA_OFFSET;
+}
+
+void* plugin_async_get_ptr(struct plugin_async* async)
+{
+	return async->ptr;
+}
+
+void plugin_async_offer(struct hub_info* hub, struct plugin_async* async)
+{
+	if (hub->plugins && hub->plugins->async)
+		hub->plugins->async->offered = async;
+}
+
+int plugin_async_is_deferred(struct hub_info* hub, struct plugin_handle* plugin)
+{
+	struct plugin_async* async;
+	if (!hub->plugins || !hub->plugins->async)
+		return 0;
+	async = hub->plugins->async->offered;
+	return async && async->plugin == plugin;
+}
+
+struct plugin_async* plugin_async_defer(struct plugin_handle* plugin)
+{
+	struct hub_info* hub = plugin_get_hub(plugin);
+	struct plugin_async* async;
+
+	if (!hub->plugins || !hub->plugins->async)
+		return NULL;
+
+	async = hub->plugins->async->offered;
+	if (!async || async->plugin)
+		return NULL;
+
+	async->plugin = plugin;
+	async->queue->deferred++;
+	return async;
+}
+
+void plugin_async_complete(struct plugin_handle* plugin, struct plugin_async* async, plugin_st status)
+{
+	struct plugin_async_queue* queue = async->queue;
+	int wakeup;
+
+	uhub_assert(async->plugin == plugin);
+	async->status = (status == st_pending) ? st_default : status;
+	async->next = NULL;
+
+	uhub_mutex_lock(&queue->lock);
+	wakeup = !queue->first;
+	if (queue->last)
+		queue->last->next = async;
+	else
+		queue->first = async;
+	queue->last = async;
+	uhub_mutex_unlock(&queue->lock);
+
+	/* One wakeup is enough until the loop has taken the list */
+	if (wakeup)
+		net_notify_signal(queue->notify, 1);
+}
@@ -0,0 +1,95 @@
+/*
+ * uhub - A tiny ADC p2p connection hub
+ * Copyright (C) 2007-2014, Jan Vidar Krey
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef HAVE_UHUB_PLUGIN_ASYNC_H
+#define HAVE_UHUB_PLUGIN_ASYNC_H
+
+/*
+ * Hooks that plugins may answer later.
+ *
+ * The hub creates a struct plugin_async for a hook call that may be
+ * answered later, and holds the hook's arguments in its data. While the
+ * hook runs the operation is offered to the plugin (plugin_async_offer()),
+ * which takes it with async_defer() and returns st_pending. The plugin
+ * later calls async_complete(), from any thread, which queues the
+ * operation for the event loop. The loop then calls the operation's
+ * callback with the answer, and frees it.
+ *
+ * If the hub is no longer interested, for instance because the user has
+ * left, it cancels the operation: the callback is still called, with a
+ * NULL ptr, so the data can be released.
+ */
+
+struct plugin_async;
+struct plugin_async_queue;
+
+typedef void (*plugin_async_cb)(struct hub_info* hub, struct plugin_async* async, plugin_st status);
+
+/**
+ * Create the completion queue, which wakes up the event loop.
+ * @return the queue, or NULL on error.
+ */
+extern struct plugin_async_queue* plugin_async_queue_create(struct hub_info* hub);
+
+/**
+ * Call the callbacks of all operations completed so far, and free the queue.
+ * Operations that are still deferred are not freed.
+ */
+extern void plugin_async_queue_destroy(struct plugin_async_queue* queue);
+
+/**
+ * Call the callbacks of the operations completed so far.
+ */
+extern void plugin_async_queue_process(struct plugin_async_queue* queue);
+
+/**
+ * Create an operation with size bytes of zeroed data for the hook's arguments.
+ * @return an operation, or NULL if the plugins cannot answer later.
+ */
+extern struct plugin_async* plugin_async_create(struct hub_info* hub, plugin_async_cb callback, void* ptr, size_t size);
+
+/**
+ * Free an operation that was not deferred.
+ */
+extern void plugin_async_free(struct plugin_async* async);
+
+/**
+ * Cancel a deferred operation, see above.
+ */
+extern void plugin_async_cancel(struct plugin_async* async);
+
+extern void* plugin_async_get_data(struct plugin_async* async);
+extern void* plugin_async_get_ptr(struct plugin_async* async);
+
+/**
+ * Offer the operation to the plugins for the duration of a hook call,
+ * or stop offering it when async is NULL.
+ */
+extern void plugin_async_offer(struct hub_info* hub, struct plugin_async* async);
+
+/**
+ * @return 1 if the plugin has deferred the operation being offered.
+ */
+extern int plugin_async_is_deferred(struct hub_info* hub, struct plugin_handle* plugin);
+
+/* Implementation of the hub functions async_defer() and async_complete() */
+extern struct plugin_async* plugin_async_defer(struct plugin_handle* plugin);
+extern void plugin_async_complete(struct plugin_handle* plugin, struct plugin_async* async, plugin_st status);
+
+#endif /* HAVE_UHUB_PLUGIN_ASYNC_H */
@@ -65,6 +65,43 @@ static int cbfunc_send_message(struct plugin_handle* plugin, struct plugin_user*
 	return 1;
 }
 
+/* A struct plugin_message is an IMSG, so message_create() must match cbfunc_send_message() */
+static struct plugin_message* cbfunc_message_create(struct plugin_handle* plugin, const char* message)
+{
+	char* buffer = adc_msg_escape(message);
+	struct adc_message* command = adc_msg_construct(ADC_CMD_IMSG, strlen(buffer) + 6);
+	adc_msg_add_argument(command, buffer);
+	hub_free(buffer);
+	return (struct plugin_message*) command;
+}
+
+static int cbfunc_send_prepared_message(struct plugin_handle* plugin, struct plugin_user* user, struct plugin_message* message)
+{
+	route_to_user(plugin_get_hub(plugin), convert_user_type(user), (struct adc_message*) message);
+	return 1;
+}
+
+static void cbfunc_message_release(struct plugin_handle* plugin, struct plugin_message* message)
+{
+	adc_msg_free((struct adc_message*) message);
+}
+
+/* Views are only handed to plugins as the first member of a struct hub_message_view */
+static const char* cbfunc_message_get_argument(struct plugin_handle* plugin, const struct plugin_message_view* message, size_t index, size_t* length)
+{
+	return plugin_message_view_get_argument((struct hub_message_view*) message, index, length);
+}
+
+static const char* cbfunc_message_get_named_argument(struct plugin_handle* plugin, const struct plugin_message_view* message, const char* prefix, size_t* length)
+{
+	return plugin_message_view_get_named_argument((struct hub_message_view*) message, prefix, length);
+}
+
+static const char* cbfunc_message_get_text(struct plugin_handle* plugin, const struct plugin_message_view* message)
+{
+	return plugin_message_view_get_text((struct hub_message_view*) message);
+}
+
 static int cbfunc_send_broadcast(struct plugin_handle* plugin, const char* message)
 {
 	char* buffer = adc_msg_escape(message);
@@ -212,6 +249,14 @@ void plugin_register_callback_functions(struct plugin_handle* handle)
 	handle->hub.set_name = cbfunc_set_hub_name;
 	handle->hub.get_description = cbfunc_get_hub_description;
 	handle->hub.set_description = cbfunc_set_hub_description;
+	handle->hub.async_defer = plugin_async_defer;
+	handle->hub.async_complete = plugin_async_complete;
+	handle->hub.message_create = cbfunc_message_create;
+	handle->hub.send_prepared_message = cbfunc_send_prepared_message;
+	handle->hub.message_release = cbfunc_message_release;
+	handle->hub.message_get_argument = cbfunc_message_get_argument;
+	handle->hub.message_get_named_argument = cbfunc_message_get_named_argument;
+	handle->hub.message_get_text = cbfunc_message_get_text;
 }
 
 void plugin_unregister_callback_functions(struct plugin_handle* handle)
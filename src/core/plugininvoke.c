@@ -19,58 +19,195 @@
 
 #include "uhub.h"
 #include "plugin_api/handle.h"
+#include <stddef.h>
 
-#define PLUGIN_DEBUG(hub, name) LOG_PLUGIN("Invoke %s on %d plugins", name, (int) (hub->plugins ? list_size(hub->plugins->loaded) : -1));
+#define PLUGIN_DEBUG(hook, name) LOG_PLUGIN("Invoke %s on %d plugins", name, (int) hook->count);
 
+#define PLUGIN_HOOK(FUNCNAME) { #FUNCNAME, offsetof(struct plugin_funcs, FUNCNAME) }
 
-#define INVOKE(HUB, FUNCNAME, CODE) \
-	PLUGIN_DEBUG(HUB, # FUNCNAME) \
-	if (HUB->plugins && HUB->plugins->loaded) \
+/* Same order as enum plugin_hook_id */
+static const struct
+{
+	const char* name;
+	size_t offset;
+} plugin_hook_funcs[plugin_hook_max] = {
+	PLUGIN_HOOK(on_connection_accepted),
+	PLUGIN_HOOK(on_connection_refused),
+	PLUGIN_HOOK(on_user_login),
+	PLUGIN_HOOK(on_user_login_error),
+	PLUGIN_HOOK(on_user_logout),
+	PLUGIN_HOOK(on_user_nick_change),
+	PLUGIN_HOOK(on_user_update_error),
+	PLUGIN_HOOK(on_user_chat_message),
+	PLUGIN_HOOK(on_hub_started),
+	PLUGIN_HOOK(on_hub_reloaded),
+	PLUGIN_HOOK(on_hub_shutdown),
+	PLUGIN_HOOK(on_hub_error),
+	PLUGIN_HOOK(on_check_ip_early),
+	PLUGIN_HOOK(on_check_ip_late),
+	PLUGIN_HOOK(on_change_nick),
+	PLUGIN_HOOK(on_chat_msg),
+	PLUGIN_HOOK(on_private_msg),
+	PLUGIN_HOOK(on_search),
+	PLUGIN_HOOK(on_search_result),
+	PLUGIN_HOOK(on_p2p_connect),
+	PLUGIN_HOOK(on_p2p_revconnect),
+	PLUGIN_HOOK(auth_get_user),
+	PLUGIN_HOOK(auth_register_user),
+	PLUGIN_HOOK(auth_update_user),
+	PLUGIN_HOOK(auth_delete_user),
+};
+
+static uint64_t plugin_hook_clock()
+{
+#ifdef WIN32
+	static LARGE_INTEGER frequency;
+	LARGE_INTEGER counter;
+	if (!frequency.QuadPart)
+		QueryPerformanceFrequency(&frequency);
+	QueryPerformanceCounter(&counter);
+	return (uint64_t) (counter.QuadPart * (1000000000.0 / frequency.QuadPart));
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t) ts.tv_sec) * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+const char* plugin_hook_name(enum plugin_hook_id id)
+{
+	return plugin_hook_funcs[id].name;
+}
+
+void plugin_hooks_clear(struct plugin_hooks* hooks)
+{
+	size_t id;
+	for (id = 0; id < plugin_hook_max; id++)
+	{
+		hub_free(hooks->hook[id].entries);
+		hooks->hook[id].entries = NULL;
+		hooks->hook[id].count = 0;
+	}
+}
+
+int plugin_hooks_update(struct uhub_plugins* plugins)
+{
+	struct plugin_hook* hook;
+	struct plugin_handle* plugin;
+	plugin_hook_func func;
+	size_t id;
+
+	plugin_hooks_clear(plugins->hooks);
+	if (!plugins->loaded || !list_size(plugins->loaded))
+		return 0;
+
+	for (id = 0; id < plugin_hook_max; id++)
+	{
+		hook = &plugins->hooks->hook[id];
+		hook->entries = hub_malloc(list_size(plugins->loaded) * sizeof(struct plugin_hook_entry));
+		if (!hook->entries)
+		{
+			plugin_hooks_clear(plugins->hooks);
+			return -1;
+		}
+
+		LIST_FOREACH(struct plugin_handle*, plugin, plugins->loaded,
+		{
+			memcpy(&func, ((char*) &plugin->funcs) + plugin_hook_funcs[id].offset, sizeof(func));
+			if (func)
+			{
+				hook->entries[hook->count].plugin = plugin;
+				hook->entries[hook->count].func = func;
+				hook->count++;
+			}
+		});
+
+		if (!hook->count)
+		{
+			hub_free(hook->entries);
+			hook->entries = NULL;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Only hooks that some plugin implements get as far as the loop,
+ * and only those are counted.
+ */
+#define INVOKE(HUB, FUNCNAME, FUNCTYPE, CODE) \
+	if (PLUGIN_HOOK_USED(HUB, FUNCNAME)) \
 	{ \
-		struct plugin_handle* plugin;\
-		LIST_FOREACH(struct plugin_handle*, plugin, HUB->plugins->loaded, \
+		struct plugin_hook* hook = &HUB->plugins->hooks->hook[plugin_hook_ ## FUNCNAME]; \
+		struct plugin_handle* plugin; \
+		FUNCTYPE func; \
+		uint64_t started = plugin_hook_clock(); \
+		size_t n; \
+		PLUGIN_DEBUG(hook, # FUNCNAME) \
+		for (n = 0; n < hook->count; n++) \
 		{ \
-			if (plugin->funcs.FUNCNAME) \
-				CODE \
-		}); \
+			plugin = hook->entries[n].plugin; \
+			func = (FUNCTYPE) hook->entries[n].func; \
+			CODE \
+		} \
+		hook->calls++; \
+		hook->time += plugin_hook_clock() - started; \
+	}
+
+/*
+ * A hook may only answer st_pending if it has deferred the operation
+ * offered to it, see pluginasync.h. Once deferred, the answer always
+ * comes through async_complete().
+ */
+static plugin_st plugin_check_status(struct hub_info* hub, struct plugin_handle* plugin, plugin_st status)
+{
+	if (plugin_async_is_deferred(hub, plugin))
+		return st_pending;
+
+	if (status == st_pending)
+	{
+		LOG_ERROR("Plugin %s answered st_pending without deferring, ignored.", plugin->name);
+		return st_default;
 	}
+	return status;
+}
 
-#define PLUGIN_INVOKE_STATUS_1(HUB, FUNCNAME, ARG1) \
+#define PLUGIN_INVOKE_STATUS_1(HUB, FUNCNAME, FUNCTYPE, ARG1) \
 	do { \
 		plugin_st status = st_default; \
-		INVOKE(HUB, FUNCNAME, { \
-			status = plugin->funcs.FUNCNAME(plugin, ARG1); \
+		INVOKE(HUB, FUNCNAME, FUNCTYPE, { \
+			status = plugin_check_status(HUB, plugin, func(plugin, ARG1)); \
 			if (status != st_default) \
 				break; \
 		}); \
 		return status; \
 	} while(0)
 
-#define PLUGIN_INVOKE_STATUS_2(HUB, FUNCNAME, ARG1, ARG2) \
+#define PLUGIN_INVOKE_STATUS_2(HUB, FUNCNAME, FUNCTYPE, ARG1, ARG2) \
 	do { \
 		plugin_st status = st_default; \
-		INVOKE(HUB, FUNCNAME, { \
-			status = plugin->funcs.FUNCNAME(plugin, ARG1, ARG2); \
+		INVOKE(HUB, FUNCNAME, FUNCTYPE, { \
+			status = plugin_check_status(HUB, plugin, func(plugin, ARG1, ARG2)); \
 			if (status != st_default) \
 				break; \
 		}); \
 		return status; \
 	} while(0)
 
-#define PLUGIN_INVOKE_STATUS_3(HUB, FUNCNAME, ARG1, ARG2, ARG3) \
+#define PLUGIN_INVOKE_STATUS_3(HUB, FUNCNAME, FUNCTYPE, ARG1, ARG2, ARG3) \
 	do { \
 		plugin_st status = st_default; \
-		INVOKE(HUB, FUNCNAME, { \
-			status = plugin->funcs.FUNCNAME(plugin, ARG1, ARG2, ARG3); \
+		INVOKE(HUB, FUNCNAME, FUNCTYPE, { \
+			status = plugin_check_status(HUB, plugin, func(plugin, ARG1, ARG2, ARG3)); \
 			if (status != st_default) \
 				break; \
 		}); \
 		return status; \
 	} while(0)
 
-#define PLUGIN_INVOKE_1(HUB, FUNCNAME, ARG1) INVOKE(HUB, FUNCNAME, { plugin->funcs.FUNCNAME(plugin, ARG1); })
-#define PLUGIN_INVOKE_2(HUB, FUNCNAME, ARG1, ARG2) INVOKE(HUB, FUNCNAME, { plugin->funcs.FUNCNAME(plugin, ARG1, ARG2); })
-#define PLUGIN_INVOKE_3(HUB, FUNCNAME, ARG1, ARG2, ARG3) INVOKE(HUB, FUNCNAME, { plugin->funcs.FUNCNAME(plugin, ARG1, ARG2, ARG3); })
+#define PLUGIN_INVOKE_1(HUB, FUNCNAME, FUNCTYPE, ARG1) INVOKE(HUB, FUNCNAME, FUNCTYPE, { func(plugin, ARG1); })
+#define PLUGIN_INVOKE_2(HUB, FUNCNAME, FUNCTYPE, ARG1, ARG2) INVOKE(HUB, FUNCNAME, FUNCTYPE, { func(plugin, ARG1, ARG2); })
+#define PLUGIN_INVOKE_3(HUB, FUNCNAME, FUNCTYPE, ARG1, ARG2, ARG3) INVOKE(HUB, FUNCNAME, FUNCTYPE, { func(plugin, ARG1, ARG2, ARG3); })
 
 
 static struct plugin_user* convert_user_type(struct hub_user* user)
@@ -79,119 +216,242 @@ static struct plugin_user* convert_user_type(struct hub_user* user)
 	return puser;
 }
 
+void plugin_message_view_init(struct hub_message_view* view, struct adc_message* msg, struct hub_user* from, struct hub_user* to)
+{
+	int offset = adc_msg_get_arg_offset(msg);
+
+	memcpy(view->view.command, msg->cache, 4);
+	view->view.command[4] = '\0';
+	view->view.from = convert_user_type(from);
+	view->view.to = to ? convert_user_type(to) : NULL;
+	view->view.data = msg->cache;
+	view->view.length = msg->length;
+	if (view->view.length && msg->cache[view->view.length - 1] == '\n')
+		view->view.length--;
+
+	/* The offset is that of the space before the first argument */
+	if (offset > 0 && (size_t) offset < view->view.length)
+		view->offset = offset + 1;
+	else
+		view->offset = view->view.length;
+	view->text = NULL;
+}
+
+void plugin_message_view_free(struct hub_message_view* view)
+{
+	hub_free(view->text);
+	view->text = NULL;
+}
+
+const char* plugin_message_view_get_argument(struct hub_message_view* view, size_t index, size_t* length)
+{
+	const char* start = view->view.data + view->offset;
+	const char* end = view->view.data + view->view.length;
+	const char* next;
+
+	if (start >= end)
+		return NULL;
+
+	for (;;)
+	{
+		next = memchr(start, ' ', end - start);
+		if (!next)
+			next = end;
+
+		if (!index)
+		{
+			*length = next - start;
+			return start;
+		}
+
+		if (next == end)
+			return NULL;
+		start = next + 1;
+		index--;
+	}
+}
+
+const char* plugin_message_view_get_named_argument(struct hub_message_view* view, const char* prefix, size_t* length)
+{
+	const char* arg;
+	size_t size;
+	size_t n;
+
+	for (n = 0; (arg = plugin_message_view_get_argument(view, n, &size)); n++)
+	{
+		if (size >= 2 && arg[0] == prefix[0] && arg[1] == prefix[1])
+		{
+			*length = size - 2;
+			return arg + 2;
+		}
+	}
+	return NULL;
+}
+
+const char* plugin_message_view_get_text(struct hub_message_view* view)
+{
+	const char* arg;
+	size_t length;
+
+	if (view->text)
+		return view->text;
+
+	arg = plugin_message_view_get_argument(view, 0, &length);
+	if (!arg)
+		return NULL;
+
+	/* Unescaping never makes it longer, so it can be done in place */
+	view->text = hub_strndup(arg, length);
+	if (view->text)
+		adc_msg_unescape_to_target(view->text, view->text, length + 1);
+	return view->text;
+}
+
 plugin_st plugin_check_ip_early(struct hub_info* hub, struct ip_addr_encap* addr)
 {
-	PLUGIN_INVOKE_STATUS_1(hub, on_check_ip_early, addr);
+	PLUGIN_INVOKE_STATUS_1(hub, on_check_ip_early, on_check_ip_early_t, addr);
 }
 
 plugin_st plugin_check_ip_late(struct hub_info* hub, struct hub_user* who, struct ip_addr_encap* addr)
 {
 	struct plugin_user* user = convert_user_type(who);
-	PLUGIN_INVOKE_STATUS_2(hub, on_check_ip_late, user, addr);
+	PLUGIN_INVOKE_STATUS_2(hub, on_check_ip_late, on_check_ip_late_t, user, addr);
 }
 
 void plugin_log_connection_accepted(struct hub_info* hub, struct ip_addr_encap* ipaddr)
 {
-	PLUGIN_INVOKE_1(hub, on_connection_accepted, ipaddr);
+	PLUGIN_INVOKE_1(hub, on_connection_accepted, on_connection_accepted_t, ipaddr);
 }
 
 void plugin_log_connection_denied(struct hub_info* hub, struct ip_addr_encap* ipaddr)
 {
-	PLUGIN_INVOKE_1(hub, on_connection_refused, ipaddr);
+	PLUGIN_INVOKE_1(hub, on_connection_refused, on_connection_refused_t, ipaddr);
 }
 
 void plugin_log_user_login_success(struct hub_info* hub, struct hub_user* who)
 {
 	struct plugin_user* user = convert_user_type(who);
-	PLUGIN_INVOKE_1(hub, on_user_login, user);
+	PLUGIN_INVOKE_1(hub, on_user_login, on_user_login_t, user);
 }
 
 void plugin_log_user_login_error(struct hub_info* hub, struct hub_user* who, const char* reason)
 {
 	struct plugin_user* user = convert_user_type(who);
-	PLUGIN_INVOKE_2(hub, on_user_login_error, user, reason);
+	PLUGIN_INVOKE_2(hub, on_user_login_error, on_user_login_error_t, user, reason);
 }
 
 void plugin_log_user_logout(struct hub_info* hub, struct hub_user* who, const char* reason)
 {
 	struct plugin_user* user = convert_user_type(who);
-	PLUGIN_INVOKE_2(hub, on_user_logout, user, reason);
+	PLUGIN_INVOKE_2(hub, on_user_logout, on_user_logout_t, user, reason);
 }
 
 void plugin_log_user_nick_change(struct hub_info* hub, struct hub_user* who, const char* new_nick)
 {
 	struct plugin_user* user = convert_user_type(who);
-	PLUGIN_INVOKE_2(hub, on_user_nick_change, user, new_nick);
+	PLUGIN_INVOKE_2(hub, on_user_nick_change, on_user_nick_change_t, user, new_nick);
 }
 
 void plugin_log_user_update_error(struct hub_info* hub, struct hub_user* who, const char* reason)
 {
 	struct plugin_user* user = convert_user_type(who);
-	PLUGIN_INVOKE_2(hub, on_user_update_error, user, reason);
+	PLUGIN_INVOKE_2(hub, on_user_update_error, on_user_update_error_t, user, reason);
 }
 
-void plugin_log_chat_message(struct hub_info* hub, struct hub_user* who, const char* message, int flags)
+void plugin_log_chat_message(struct hub_info* hub, struct hub_user* who, struct hub_message_view* view, int flags)
 {
 	struct plugin_user* user = convert_user_type(who);
-	PLUGIN_INVOKE_3(hub, on_user_chat_message, user, message, flags);
+	const char* message;
+
+	if (!PLUGIN_HOOK_USED(hub, on_user_chat_message) || !(message = plugin_message_view_get_text(view)))
+		return;
+	PLUGIN_INVOKE_3(hub, on_user_chat_message, on_user_chat_msg_t, user, message, flags);
 }
 
-plugin_st plugin_handle_chat_message(struct hub_info* hub, struct hub_user* from, const char* message, int flags)
+plugin_st plugin_handle_chat_message(struct hub_info* hub, struct hub_user* from, struct hub_message_view* view, int flags)
 {
 	struct plugin_user* user = convert_user_type(from);
-	PLUGIN_INVOKE_STATUS_2(hub, on_chat_msg, user, message);
+	PLUGIN_INVOKE_STATUS_2(hub, on_chat_msg, on_chat_msg_t, user, &view->view);
 }
 
-plugin_st plugin_handle_private_message(struct hub_info* hub, struct hub_user* from, struct hub_user* to, const char* message, int flags)
+plugin_st plugin_handle_private_message(struct hub_info* hub, struct hub_user* from, struct hub_user* to, struct hub_message_view* view, int flags)
 {
 	struct plugin_user* user1 = convert_user_type(from);
 	struct plugin_user* user2 = convert_user_type(to);
-	PLUGIN_INVOKE_STATUS_3(hub, on_private_msg, user1, user2, message);
+	PLUGIN_INVOKE_STATUS_3(hub, on_private_msg, on_private_msg_t, user1, user2, &view->view);
 }
 
-plugin_st plugin_handle_search(struct hub_info* hub, struct hub_user* from, const char* data)
+static plugin_st plugin_invoke_search(struct hub_info* hub, struct plugin_user* user, struct hub_message_view* view)
 {
-	struct plugin_user* user = convert_user_type(from);
-	PLUGIN_INVOKE_STATUS_2(hub, on_search, user, data);
+	PLUGIN_INVOKE_STATUS_2(hub, on_search, on_search_t, user, &view->view);
 }
 
-plugin_st plugin_handle_search_result(struct hub_info* hub, struct hub_user* from, struct hub_user* to, const char* data)
+plugin_st plugin_handle_search(struct hub_info* hub, struct hub_user* from, struct adc_message* msg)
 {
-	struct plugin_user* user1 = convert_user_type(from);
-	struct plugin_user* user2 = convert_user_type(to);
-	PLUGIN_INVOKE_STATUS_3(hub, on_search_result, user1, user2, data);
+	struct hub_message_view view;
+	plugin_st status;
+
+	plugin_message_view_init(&view, msg, from, NULL);
+	status = plugin_invoke_search(hub, view.view.from, &view);
+	plugin_message_view_free(&view);
+	return status;
+}
+
+static plugin_st plugin_invoke_search_result(struct hub_info* hub, struct plugin_user* from, struct plugin_user* to, struct hub_message_view* view)
+{
+	PLUGIN_INVOKE_STATUS_3(hub, on_search_result, on_search_result_t, from, to, &view->view);
+}
+
+plugin_st plugin_handle_search_result(struct hub_info* hub, struct hub_user* from, struct hub_user* to, struct adc_message* msg)
+{
+	struct hub_message_view view;
+	plugin_st status;
+
+	plugin_message_view_init(&view, msg, from, to);
+	status = plugin_invoke_search_result(hub, view.view.from, view.view.to, &view);
+	plugin_message_view_free(&view);
+	return status;
 }
 
 plugin_st plugin_handle_connect(struct hub_info* hub, struct hub_user* from, struct hub_user* to)
 {
 	struct plugin_user* user1 = convert_user_type(from);
 	struct plugin_user* user2 = convert_user_type(to);
-	PLUGIN_INVOKE_STATUS_2(hub, on_p2p_connect, user1, user2);
+	PLUGIN_INVOKE_STATUS_2(hub, on_p2p_connect, on_p2p_connect_t, user1, user2);
 }
 
 plugin_st plugin_handle_revconnect(struct hub_info* hub, struct hub_user* from, struct hub_user* to)
 {
 	struct plugin_user* user1 = convert_user_type(from);
 	struct plugin_user* user2 = convert_user_type(to);
-	PLUGIN_INVOKE_STATUS_2(hub, on_p2p_revconnect, user1, user2);
+	PLUGIN_INVOKE_STATUS_2(hub, on_p2p_revconnect, on_p2p_revconnect_t, user1, user2);
 }
 
 plugin_st plugin_auth_get_user(struct hub_info* hub, const char* nickname, struct auth_info* info)
 {
-	PLUGIN_INVOKE_STATUS_2(hub, auth_get_user, nickname, info);
+	PLUGIN_INVOKE_STATUS_2(hub, auth_get_user, auth_get_user_t, nickname, info);
+}
+
+plugin_st plugin_auth_get_user_async(struct hub_info* hub, const char* nickname, struct auth_info* info, struct plugin_async* async)
+{
+	plugin_st status;
+	plugin_async_offer(hub, async);
+	status = plugin_auth_get_user(hub, nickname, info);
+	plugin_async_offer(hub, NULL);
+	return status;
 }
 
 plugin_st plugin_auth_register_user(struct hub_info* hub, struct auth_info* info)
 {
-	PLUGIN_INVOKE_STATUS_1(hub, auth_register_user, info);
+	PLUGIN_INVOKE_STATUS_1(hub, auth_register_user, auth_register_user_t, info);
 }
 
 plugin_st plugin_auth_update_user(struct hub_info* hub, struct auth_info* info)
 {
-	PLUGIN_INVOKE_STATUS_1(hub, auth_update_user, info);
+	PLUGIN_INVOKE_STATUS_1(hub, auth_update_user, auth_update_user_t, info);
 }
 
 plugin_st plugin_auth_delete_user(struct hub_info* hub, struct auth_info* info)
 {
-	PLUGIN_INVOKE_STATUS_1(hub, auth_delete_user, info);
+	PLUGIN_INVOKE_STATUS_1(hub, auth_delete_user, auth_delete_user_t, info);
 }
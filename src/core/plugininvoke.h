@@ -25,6 +25,108 @@
 
 struct hub_info;
 struct ip_addr_encap;
+struct uhub_plugins;
+struct adc_message;
+
+/* One for each function in struct plugin_funcs */
+enum plugin_hook_id
+{
+	plugin_hook_on_connection_accepted,
+	plugin_hook_on_connection_refused,
+	plugin_hook_on_user_login,
+	plugin_hook_on_user_login_error,
+	plugin_hook_on_user_logout,
+	plugin_hook_on_user_nick_change,
+	plugin_hook_on_user_update_error,
+	plugin_hook_on_user_chat_message,
+	plugin_hook_on_hub_started,
+	plugin_hook_on_hub_reloaded,
+	plugin_hook_on_hub_shutdown,
+	plugin_hook_on_hub_error,
+	plugin_hook_on_check_ip_early,
+	plugin_hook_on_check_ip_late,
+	plugin_hook_on_change_nick,
+	plugin_hook_on_chat_msg,
+	plugin_hook_on_private_msg,
+	plugin_hook_on_search,
+	plugin_hook_on_search_result,
+	plugin_hook_on_p2p_connect,
+	plugin_hook_on_p2p_revconnect,
+	plugin_hook_auth_get_user,
+	plugin_hook_auth_register_user,
+	plugin_hook_auth_update_user,
+	plugin_hook_auth_delete_user,
+	plugin_hook_max
+};
+
+typedef void (*plugin_hook_func)(void);
+
+struct plugin_hook_entry
+{
+	struct plugin_handle* plugin;
+	plugin_hook_func func;              /* Cast back to the hook's own type when called */
+};
+
+/**
+ * The plugins implementing a hook, in the order they were loaded,
+ * so that invoking a hook nobody implements costs nothing.
+ */
+struct plugin_hook
+{
+	struct plugin_hook_entry* entries;
+	size_t count;
+	uint64_t calls;                     /* Times the hook was invoked with plugins to call */
+	uint64_t time;                      /* Nanoseconds spent in those calls */
+};
+
+struct plugin_hooks
+{
+	struct plugin_hook hook[plugin_hook_max];
+};
+
+/**
+ * True if any plugin implements the hook, for callers that can save
+ * work by not invoking it at all.
+ */
+#define PLUGIN_HOOK_USED(HUB, FUNCNAME) ((HUB)->plugins && (HUB)->plugins->hooks && (HUB)->plugins->hooks->hook[plugin_hook_ ## FUNCNAME].count)
+
+/**
+ * Rebuild the hooks from the loaded plugins.
+ * Must be called whenever plugins are loaded or unloaded.
+ * @return 0 on success, -1 if out of memory (no hooks are called then).
+ */
+extern int plugin_hooks_update(struct uhub_plugins* plugins);
+
+/**
+ * Forget all plugins, the counters are kept.
+ */
+extern void plugin_hooks_clear(struct plugin_hooks* hooks);
+
+/**
+ * @return the name of the hook, as in struct plugin_funcs.
+ */
+extern const char* plugin_hook_name(enum plugin_hook_id id);
+
+/**
+ * The hub's side of a struct plugin_message_view. It points into the
+ * message, which must not change while the view is in use.
+ */
+struct hub_message_view
+{
+	struct plugin_message_view view;    /* Must be first */
+	size_t offset;                      /* Where the arguments start */
+	char* text;                         /* First argument unescaped, once asked for */
+};
+
+extern void plugin_message_view_init(struct hub_message_view* view, struct adc_message* msg, struct hub_user* from, struct hub_user* to);
+extern void plugin_message_view_free(struct hub_message_view* view);
+extern const char* plugin_message_view_get_argument(struct hub_message_view* view, size_t index, size_t* length);
+extern const char* plugin_message_view_get_named_argument(struct hub_message_view* view, const char* prefix, size_t* length);
+
+/**
+ * @return the first argument unescaped, or NULL if there is none.
+ */
+extern const char* plugin_message_view_get_text(struct hub_message_view* view);
 
 /* All log related functions */
 void plugin_log_connection_accepted(struct hub_info* hub, struct ip_addr_encap* addr);
@@ -34,7 +136,7 @@ void plugin_log_user_login_error(struct hub_info* hub, struct hub_user* user, co
 void plugin_log_user_logout(struct hub_info* hub, struct hub_user* user, const char* reason);
 void plugin_log_user_nick_change(struct hub_info* hub, struct hub_user* user, const char* new_nick);
 void plugin_log_user_update_error(struct hub_info* hub, struct hub_user* user, const char* reason);
-void plugin_log_chat_message(struct hub_info* hub, struct hub_user* from, const char* message, int flags);
+void plugin_log_chat_message(struct hub_info* hub, struct hub_user* from, struct hub_message_view* message, int flags);
 
 /* IP ban related */
 plugin_st plugin_check_ip_early(struct hub_info* hub, struct ip_addr_encap* addr);
@@ -45,12 +147,12 @@ plugin_st plugin_check_nickname_valid(struct hub_info* hub, const char* nick);
 plugin_st plugin_check_nickname_reserved(struct hub_info* hub, const char* nick);
 
 /* Handle chat messages */
-plugin_st plugin_handle_chat_message(struct hub_info* hub, struct hub_user* from, const char* message, int flags);
-plugin_st plugin_handle_private_message(struct hub_info* hub, struct hub_user* from, struct hub_user* to, const char* message, int flags);
+plugin_st plugin_handle_chat_message(struct hub_info* hub, struct hub_user* from, struct hub_message_view* message, int flags);
+plugin_st plugin_handle_private_message(struct hub_info* hub, struct hub_user* from, struct hub_user* to, struct hub_message_view* message, int flags);
 
 /* Handle searches */
-plugin_st plugin_handle_search(struct hub_info* hub, struct hub_user* user, const char* data);
-plugin_st plugin_handle_search_result(struct hub_info* hub, struct hub_user* from, struct hub_user* to, const char* data);
+plugin_st plugin_handle_search(struct hub_info* hub, struct hub_user* user, struct adc_message* msg);
+plugin_st plugin_handle_search_result(struct hub_info* hub, struct hub_user* from, struct hub_user* to, struct adc_message* msg);
 
 /* Handle p2p connections */
 plugin_st plugin_handle_connect(struct hub_info* hub, struct hub_user* from, struct hub_user* to);
@@ -58,6 +160,14 @@ plugin_st plugin_handle_revconnect(struct hub_info* hub, struct hub_user* from,
 
 /* Authentication related */
 plugin_st plugin_auth_get_user(struct hub_info* hub, const char* nickname, struct auth_info* info);
+
+/**
+ * Like plugin_auth_get_user(), but a plugin may answer later.
+ * The nickname and info must be in the operation's data.
+ *
+ * @return st_pending if the answer comes through the operation's callback.
+ */
+plugin_st plugin_auth_get_user_async(struct hub_info* hub, const char* nickname, struct auth_info* info, struct plugin_async* async);
 plugin_st plugin_auth_register_user(struct hub_info* hub, struct auth_info* user);
 plugin_st plugin_auth_update_user(struct hub_info* hub, struct auth_info* user);
 plugin_st plugin_auth_delete_user(struct hub_info* hub, struct auth_info* user);
@@ -212,17 +212,35 @@ int plugin_initialize(struct hub_config* config, struct hub_info* hub)
 	if (!hub->plugins->loaded)
 		return -1;
 
+	hub->plugins->hooks = hub_malloc_zero(sizeof(struct plugin_hooks));
+	hub->plugins->async = plugin_async_queue_create(hub);
+	if (!hub->plugins->async || !hub->plugins->hooks)
+	{
+		hub_free(hub->plugins->hooks);
+		hub->plugins->hooks = 0;
+		plugin_async_queue_destroy(hub->plugins->async);
+		hub->plugins->async = 0;
+		list_destroy(hub->plugins->loaded);
+		hub->plugins->loaded = 0;
+		return -1;
+	}
+
 	if (config)
 	{
 		if (!*config->file_plugins)
 			return 0;
 
 		ret = file_read_lines(config->file_plugins, hub, &plugin_parse_line);
-		if (ret == -1)
+		if (ret == -1 || plugin_hooks_update(hub->plugins) == -1)
 		{
 			list_clear(hub->plugins->loaded, hub_free);
 			list_destroy(hub->plugins->loaded);
 			hub->plugins->loaded = 0;
+			plugin_async_queue_destroy(hub->plugins->async);
+			hub->plugins->async = 0;
+			plugin_hooks_clear(hub->plugins->hooks);
+			hub_free(hub->plugins->hooks);
+			hub->plugins->hooks = 0;
 			return -1;
 		}
 	}
@@ -238,8 +256,17 @@ static void plugin_unload_ptr(void* ptr)
 
 void plugin_shutdown(struct uhub_plugins* handle)
 {
+	/* No hooks are called into plugins being unloaded */
+	plugin_hooks_clear(handle->hooks);
 	list_clear(handle->loaded, plugin_unload_ptr);
+
+	/* The plugins have completed what they deferred, let the hub finish it */
+	plugin_async_queue_destroy(handle->async);
+	handle->async = 0;
 	list_destroy(handle->loaded);
+	handle->loaded = 0;
+	hub_free(handle->hooks);
+	handle->hooks = 0;
 }
 
 // Used internally only
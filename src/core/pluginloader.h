@@ -38,6 +38,8 @@ struct uhub_plugin
 struct uhub_plugins
 {
 	struct linked_list* loaded;
+	struct plugin_async_queue* async;   /* Hooks answered later, see pluginasync.h */
+	struct plugin_hooks* hooks;         /* Plugins to call for each hook, see plugininvoke.h */
 };
 
 // High level plugin loader code
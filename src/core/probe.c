@@ -26,6 +26,7 @@ static char probe_recvbuf[PROBE_RECV_SIZE];
 static void probe_net_event(struct net_connection* con, int events, void *arg)
 {
 	struct hub_probe* probe = (struct hub_probe*) net_con_get_ptr(con);
+	struct hub_user* user;
 	if (events == NET_EVENT_TIMEOUT)
 	{
 		probe_destroy(probe);
@@ -64,8 +65,9 @@ static void probe_net_event(struct net_connection* con, int events, void *arg)
 				}
 				else
 #endif
-				if (user_create(probe->hub, probe->connection, &probe->addr))
+				if ((user = user_create(probe->hub, probe->connection, &probe->addr)))
 				{
+					user->admitted = probe->admitted;
 					probe->connection = 0;
 				}
 				probe_destroy(probe);
@@ -80,12 +82,14 @@ static void probe_net_event(struct net_connection* con, int events, void *arg)
 				const char* buf = "501 Not implemented\r\n\r\n";
 				net_con_send(con, buf, strlen(buf));
 			}
-			if (memcmp(probe_recvbuf, "MUX0", 4) == 0)
+			if (memcmp(probe_recvbuf, "MUX0", 4) == 0 || memcmp(probe_recvbuf, "MUX1", 4) == 0)
 			{
 				struct hub_mux* mux;
-				LOG_TRACE("Probed MUX");
-				if (mux = mux_create(probe->hub, probe->connection, &probe->addr))
+				int version = probe_recvbuf[3] - '0';
+				LOG_TRACE("Probed MUX%d", version);
+				if (mux = mux_create(probe->hub, probe->connection, &probe->addr, version))
 				{
+					mux->admitted = probe->admitted;
 					list_append(probe->hub->muxes, mux);
 					probe->connection = 0;
 				}
@@ -102,8 +106,9 @@ static void probe_net_event(struct net_connection* con, int events, void *arg)
 				if (probe->hub->config->tls_enable)
 				{
 					LOG_TRACE("Probed TLS %d.%d connection", (int) probe_recvbuf[9], (int) probe_recvbuf[10]);
-					if (user_create(probe->hub, probe->connection, &probe->addr))
+					if ((user = user_create(probe->hub, probe->connection, &probe->addr)))
 					{
+						user->admitted = probe->admitted;
 						probe->connection = 0;
 					}
 					net_con_ssl_handshake(con, net_con_ssl_mode_server, probe->hub->ctx);
@@ -147,6 +152,8 @@ void probe_destroy(struct hub_probe* probe)
 	LOG_TRACE("probe_destroy(): %p (connection=%p)", probe, probe->connection);
 	if (probe->connection)
 	{
+		if (probe->admitted)
+			admission_release(probe->hub->admission, &probe->addr);
 		net_con_close(probe->connection);
 		probe->connection = 0;
 	}
@@ -27,6 +27,7 @@ struct hub_probe
 	struct hub_info*        hub;                /** The hub instance this probe belong to */
 	struct net_connection*  connection;         /** Connection data */
 	struct ip_addr_encap    addr;               /** IP address */
+	int                     admitted;           /** Counted by the admission control, see admission_release() */
 };
 
 extern struct hub_probe* probe_create(struct hub_info* hub, int sd, struct ip_addr_encap* addr);
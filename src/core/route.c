@@ -70,24 +70,44 @@ static size_t get_max_send_queue_soft(struct hub_info* hub)
 	return hub->config->max_send_buffer_soft;
 }
 
+static size_t get_send_queue_size(struct hub_user* user)
+{
+	/* Users on a mux link are charged for what the frontend has not yet delivered */
+	if (user->mux)
+		return user->mux_queued;
+	return user->send_queue->size;
+}
+
 /*
  * @return 1 if send queue is OK.
- *         -1 if send queue is overflowed
- *         0 if soft send queue is overflowed (not implemented at the moment)
+ *         -1 if send queue is overflowed, or soft overflowed and the message has low priority.
+ *         0 if soft send queue is overflowed
  */
 static int check_send_queue(struct hub_info* hub, struct hub_user* user, struct adc_message* msg)
 {
+	size_t size = get_send_queue_size(user);
+
 	if (user_flag_get(user, flag_user_list))
-		return 1;
+	{
+		/* The user list bypasses the limits until most of it has been delivered */
+		if (size > get_max_send_queue_soft(hub))
+			return 1;
+		user_flag_unset(user, flag_user_list);
+	}
 
-	if ((user->send_queue->size + msg->length) > get_max_send_queue(hub))
+	if ((size + msg->length) > get_max_send_queue(hub))
 	{
 		LOG_WARN("send queue overflowed, message discarded.");
 		return -1;
 	}
 
-	if (user->send_queue->size > get_max_send_queue_soft(hub))
+	if (size > get_max_send_queue_soft(hub))
 	{
+		if (msg->priority < 0)
+		{
+			LOG_DEBUG("send queue soft overflowed, low priority message discarded.");
+			return -1;
+		}
 		LOG_WARN("send queue soft overflowed.");
 		return 0;
 	}
@@ -104,7 +124,17 @@ int route_to_user(struct hub_info* hub, struct hub_user* user, struct adc_messag
 #endif
 
 	if (user->mux) {
-		return mux_send_to_user(user->mux, user, msg);
+		if (!user->mux->version)
+			return mux_send_to_user(user->mux, user, msg);
+
+		if (check_send_queue(hub, user, msg) < 0)
+			return 0;
+
+		if (!mux_send_to_user(user->mux, user, msg))
+			return 0;
+
+		mux_user_charge(user->mux, user, msg->length);
+		return 1;
 	}
 
 	if (!user->connection)
@@ -145,14 +175,26 @@ int route_to_all(struct hub_info* hub, struct adc_message* command) /* iterate u
 {
 	struct hub_user* user;
 	struct hub_mux* mux;
-	LIST_FOREACH(struct hub_user*, user, hub->users->list,
+	UMAN_FOREACH(hub->users, user,
 	{
 		if (!user->mux)
 			route_to_user(hub, user, command);
 	});
 	LIST_FOREACH(struct hub_mux*, mux, hub->muxes,
 	{
-		mux_broadcast(mux, command);
+		if (!mux->version || mux_can_fan_out(mux, command))
+		{
+			mux_broadcast(mux, command);
+		}
+		else
+		{
+			/* Some users are backlogged, send it to the others one by one */
+			for (user = mux->first_user; user; user = user->mux_next)
+			{
+				if (user_is_logged_in(user))
+					route_to_user(hub, user, command);
+			}
+		}
 	});
 
 	return 0;
@@ -164,7 +206,15 @@ int route_to_subscribers(struct hub_info* hub, struct adc_message* command) /* i
 	char* tmp;
 
 	struct hub_user* user;
-	LIST_FOREACH(struct hub_user*, user, hub->users->list,
+	struct hub_mux* mux;
+
+	/* MUX1 frontends get the message once and filter it themselves */
+	LIST_FOREACH(struct hub_mux*, mux, hub->muxes,
+	{
+		mux->fan_out = mux->version && mux_can_fan_out(mux, command);
+	});
+
+	UMAN_FOREACH(hub->users, user,
 	{
 		if (user->feature_cast)
 		{
@@ -191,11 +241,22 @@ int route_to_subscribers(struct hub_info* hub, struct adc_message* command) /* i
 				}
 			});
 
-			if (do_send)
+			if (!do_send)
+				continue;
+
+			if (user->mux && user->mux->fan_out)
+				mux_user_charge(user->mux, user, command->length);
+			else
 				route_to_user(hub, user, command);
 		}
 	});
 
+	LIST_FOREACH(struct hub_mux*, mux, hub->muxes,
+	{
+		if (mux->fan_out)
+			mux_feature_cast(mux, command);
+	});
+
 	return 0;
 }
 
@@ -214,11 +275,15 @@ int route_info_message(struct hub_info* hub, struct hub_user* u)
 		adc_msg_remove_named_argument(cmd, ADC_INF_FLAG_IPV4_ADDR);
 		adc_msg_add_named_argument(cmd, ADC_INF_FLAG_IPV4_ADDR, address);
 
-		LIST_FOREACH(struct hub_user*, user, hub->users->list,
+		/* Two passes, so runs of users on a MUX1 link share one multicast frame */
+		UMAN_FOREACH(hub->users, user,
 		{
 			if (user_is_nat_override(user))
 				route_to_user(hub, user, cmd);
-			else
+		});
+		UMAN_FOREACH(hub->users, user,
+		{
+			if (!user_is_nat_override(user))
 				route_to_user(hub, user, u->info);
 		});
 		adc_msg_free(cmd);
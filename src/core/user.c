@@ -47,13 +47,14 @@ struct hub_user* user_create(struct hub_info* hub, struct net_connection* con, s
 		return NULL; /* OOM */
 
 	user->send_queue = ioq_send_create();
-	user->recv_queue = ioq_recv_create();
+	user->recv_queue = ioq_recv_create(hub->config->max_recv_buffer);
 
 	user->connection = con;
 	if (con)
 		net_con_reinitialize(user->connection, net_event, user, NET_EVENT_READ);
 
 	memcpy(&user->id.addr, addr, sizeof(struct ip_addr_encap));
+	memcpy(&user->peer_addr, addr, sizeof(struct ip_addr_encap));
 	user_set_state(user, state_protocol);
 
 	flood_control_reset(&user->flood_chat);
@@ -81,11 +82,17 @@ void user_destroy(struct hub_user* user)
 		LOG_TRACE("user_destory() -> net_con_close(%p)", user->connection);
 		net_con_close(user->connection);
 	}
+	if (user->admitted)
+		admission_release(user->hub->admission, &user->peer_addr);
 	if (user->mux)
 	{
 		mux_disconnect_user(user->mux, user);
 	}
 
+	if (user->login_lookup)
+		plugin_async_cancel(user->login_lookup);
+	hub_free(user->auth);
+
 	adc_msg_free(user->info);
 	user_clear_feature_cast_support(user);
 	hub_free(user);
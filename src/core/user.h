@@ -40,7 +40,7 @@ enum user_flags
 	feature_auto    = 0x00000002, /** AUT0: Automatic nat detection traversal */
 	feature_bbs     = 0x00000004, /** BBS0: Bulletin board system (not supported) */
 	feature_ucmd    = 0x00000008, /** UCMD: User commands (not supported by this software) */
-	feature_zlif    = 0x00000010, /** ZLIF: gzip stream compression (not supported) */
+	feature_zlif    = 0x00000010, /** ZLIF: zlib stream compression (only for the user list) */
 	feature_tiger   = 0x00000020, /** TIGR: Client supports the tiger hash algorithm */
 	feature_bloom   = 0x00000040, /** BLO0: Bloom filter (not supported) */
 	feature_ping    = 0x00000080, /** PING: Hub pinger information extension */
@@ -104,10 +104,17 @@ struct hub_user_limits
 	size_t              hub_count_total;       /** The number of hubs connected to in total */
 };
 
+/*
+ * Plugins see the start of this, up to and including the credentials,
+ * as a struct plugin_user (see plugin_api/types.h), so those members
+ * must be kept in the same order.
+ */
 struct hub_user
 {
 	struct hub_user_info    id;                 /** Contains nick name and CID */
 	enum auth_credentials   credentials;        /** see enum user_credentials */
+	uint32_t                nick_hash;          /** Hash of the case folded nick name, see uman_nick_hash() */
+	unsigned char           cid_raw[TIGERSIZE]; /** global client ID (binary, base32 decoded) */
 	enum user_state         state;              /** see enum user_state */
 	uint32_t                flags;              /** see enum user_flags */
 	struct linked_list*     feature_cast;       /** Features supported by feature cast */
@@ -125,6 +132,23 @@ struct hub_user
 	struct flood_control   flood_update;
 	struct flood_control   flood_extras;
 	struct hub_mux*        mux;
+	size_t                 mux_queued;         /** Bytes sent to the mux frontend for this user, not yet credited back (MUX1) */
+
+	struct hub_user*       next;               /** Next user in the user manager list (intrusive, see uman_add()) */
+	struct hub_user*       prev;               /** Previous user in the user manager list */
+	struct hub_user*       mux_next;           /** Next user on the same mux link (intrusive, see mux_create()) */
+	struct hub_user*       mux_prev;           /** Previous user on the same mux link */
+
+	struct plugin_async*   login_lookup;       /** Registration lookup a plugin answers later, while logging in */
+	struct auth_info*      auth;               /** Registration, until the password is verified */
+
+	struct login_group*    login_group;        /** Waiting to log in with these users, see login_queue_enter() */
+	struct hub_user*       login_next;         /** Next user waiting in the same group */
+	struct hub_user*       login_prev;         /** Previous user waiting in the same group */
+	uint64_t               login_queued;       /** When the user started waiting (ms) */
+
+	struct ip_addr_encap   peer_addr;          /** Address the connection was accepted from, id.addr may be overridden */
+	int                    admitted;           /** Counted by the admission control, see admission_release() */
 };
 
 
@@ -19,15 +19,61 @@
 
 #include "uhub.h"
 
+#define UMAN_CHUNK_SIDS 128
+
+/*
+ * The user INFs of a range of SIDs, compressed once and sent to every
+ * user logging in with ZLIF, until one of the users changes.
+ */
+struct uman_chunk
+{
+	struct adc_message* block;      /* NULL if no users, or not compressed */
+	size_t raw;                     /* Size of the INFs before compression */
+	int valid;
+};
+
+static void uman_list_append(struct hub_user_manager* users, struct hub_user* user)
+{
+	user->next = NULL;
+	user->prev = users->last;
+
+	if (users->last)
+		users->last->next = user;
+	else
+		users->first = user;
+
+	users->last = user;
+}
+
+static int uman_list_remove(struct hub_user_manager* users, struct hub_user* user)
+{
+	if (user->next)
+		user->next->prev = user->prev;
+	else if (users->last == user)
+		users->last = user->prev;
+	else
+		return 0; /* not in the list */
+
+	if (user->prev)
+		user->prev->next = user->next;
+	else
+		users->first = user->next;
+
+	user->next = NULL;
+	user->prev = NULL;
+	return 1;
+}
+
 /*
- * This callback function is used to clear user objects from the userlist.
+ * This function is used to clear user objects from the userlist.
  * Should only be used in uman_shutdown().
  */
-static void clear_user_list_callback(void* ptr)
+static void clear_user_list(struct hub_user_manager* users)
 {
-	if (ptr)
+	struct hub_user* u;
+	while ((u = users->first))
 	{
-		struct hub_user* u = (struct hub_user*) ptr;
+		uman_list_remove(users, u);
 
 		/* Mark the user as already being disconnected.
 		 * This prevents the hub from trying to send
@@ -38,9 +84,50 @@ static void clear_user_list_callback(void* ptr)
 	}
 }
 
-static int uman_map_compare(const void* a, const void* b)
+static int uman_nick_equals(const void* a, const void* b)
+{
+	return strcmp((const char*) a, (const char*) b) == 0;
+}
+
+static int uman_cid_equals(const void* a, const void* b)
+{
+	return memcmp(a, b, TIGERSIZE) == 0;
+}
+
+static uint32_t uman_cid_hash(const unsigned char* raw)
+{
+	return hash_table_hash_data(raw, TIGERSIZE);
+}
+
+uint32_t uman_nick_hash(const char* nick)
+{
+	return hash_table_hash_string_nocase(nick);
+}
+
+int uman_cid_decode(const char* cid, unsigned char raw[TIGERSIZE])
+{
+	size_t n;
+	for (n = 0; n < MAX_CID_LEN; n++)
+	{
+		if (!is_valid_base32_char(cid[n]))
+			return 0;
+	}
+
+	if (cid[MAX_CID_LEN])
+		return 0;
+
+	base32_decode(cid, raw, TIGERSIZE);
+
+	/* Only 2 of the 5 bits in the last character are used, the rest must be
+	 * zero, otherwise several encodings would map to the same binary CID. */
+	return (strchr("AIQY", cid[MAX_CID_LEN - 1]) != NULL);
+}
+
+
+static void uman_addr_range(struct hub_user* user, struct ip_range* range)
 {
-	return strcmp((const char*) a, (const char*) b);
+	memcpy(&range->lo, &user->id.addr, sizeof(struct ip_addr_encap));
+	memcpy(&range->hi, &user->id.addr, sizeof(struct ip_addr_encap));
 }
 
 
@@ -50,10 +137,12 @@ struct hub_user_manager* uman_init()
 	if (!users)
 		return NULL;
 
-	users->list = list_create();
-	users->nickmap = rb_tree_create(uman_map_compare, NULL, NULL);
-	users->cidmap = rb_tree_create(uman_map_compare, NULL, NULL);
+	users->nickmap = hash_table_create(uman_nick_equals, 0);
+	users->cidmap = hash_table_create(uman_cid_equals, 0);
+	users->addrmap = ip_trie_create();
 	users->sids = sid_pool_create(net_get_max_sockets());
+	users->num_chunks = net_get_max_sockets() / UMAN_CHUNK_SIDS + 1;
+	users->chunks = hub_malloc_zero(sizeof(struct uman_chunk) * users->num_chunks);
 
 	return users;
 }
@@ -61,37 +150,64 @@ struct hub_user_manager* uman_init()
 
 int uman_shutdown(struct hub_user_manager* users)
 {
+	size_t n;
+
 	if (!users)
 		return -1;
 
-	if (users->nickmap)
-		rb_tree_destroy(users->nickmap);
+	hash_table_destroy(users->nickmap);
+	hash_table_destroy(users->cidmap);
+	ip_trie_destroy(users->addrmap);
+
+	clear_user_list(users);
 
-	if (users->cidmap)
-		rb_tree_destroy(users->cidmap);
+	sid_pool_destroy(users->sids);
 
-	if (users->list)
+	if (users->chunks)
 	{
-		list_clear(users->list, &clear_user_list_callback);
-		list_destroy(users->list);
+		for (n = 0; n < users->num_chunks; n++)
+			adc_msg_free(users->chunks[n].block);
+		hub_free(users->chunks);
 	}
 
-	sid_pool_destroy(users->sids);
-
 	hub_free(users);
 	return 0;
 }
 
 
+static void uman_chunk_invalidate(struct hub_user_manager* users, struct hub_user* user)
+{
+	struct uman_chunk* chunk;
+	size_t n = user->id.sid / UMAN_CHUNK_SIDS;
+
+	if (!users->chunks || n >= users->num_chunks)
+		return;
+
+	chunk = &users->chunks[n];
+	adc_msg_free(chunk->block);
+	chunk->block = NULL;
+	chunk->valid = 0;
+}
+
 int uman_add(struct hub_user_manager* users, struct hub_user* user)
 {
+	struct ip_range range;
+
 	if (!users || !user)
 		return -1;
 
-	rb_tree_insert(users->nickmap, user->id.nick, user);
-	rb_tree_insert(users->cidmap, user->id.cid, user);
+	user->nick_hash = uman_nick_hash(user->id.nick);
+	hash_table_insert(users->nickmap, user->nick_hash, user->id.nick, user);
+
+	if (uman_cid_decode(user->id.cid, user->cid_raw))
+		hash_table_insert(users->cidmap, uman_cid_hash(user->cid_raw), user->cid_raw, user);
 
-	list_append(users->list, user);
+	/* Users without a usable address are simply not indexed */
+	uman_addr_range(user, &range);
+	ip_trie_insert(users->addrmap, &range, user);
+
+	uman_list_append(users, user);
+	uman_chunk_invalidate(users, user);
 	users->count++;
 	users->count_peak = MAX(users->count, users->count_peak);
 
@@ -102,12 +218,24 @@ int uman_add(struct hub_user_manager* users, struct hub_user* user)
 
 int uman_remove(struct hub_user_manager* users, struct hub_user* user)
 {
+	struct ip_range range;
+
 	if (!users || !user)
 		return -1;
 
-	list_remove(users->list, user);
-	rb_tree_remove(users->nickmap, user->id.nick);
-	rb_tree_remove(users->cidmap, user->id.cid);
+	if (!uman_list_remove(users, user))
+		return -1;
+
+	/* Only remove the map entries if they belong to this user */
+	if (hash_table_get(users->nickmap, user->nick_hash, user->id.nick) == user)
+		hash_table_remove(users->nickmap, user->nick_hash, user->id.nick);
+
+	if (hash_table_get(users->cidmap, uman_cid_hash(user->cid_raw), user->cid_raw) == user)
+		hash_table_remove(users->cidmap, uman_cid_hash(user->cid_raw), user->cid_raw);
+
+	uman_addr_range(user, &range);
+	ip_trie_remove(users->addrmap, &range, user);
+	uman_chunk_invalidate(users, user);
 
 	if (users->count > 0)
 	{
@@ -124,6 +252,12 @@ int uman_remove(struct hub_user_manager* users, struct hub_user* user)
 }
 
 
+void uman_update(struct hub_user_manager* users, struct hub_user* user)
+{
+	uman_chunk_invalidate(users, user);
+}
+
+
 struct hub_user* uman_get_user_by_sid(struct hub_user_manager* users, sid_t sid)
 {
 	return sid_lookup(users->sids, sid);
@@ -132,30 +266,93 @@ struct hub_user* uman_get_user_by_sid(struct hub_user_manager* users, sid_t sid)
 
 struct hub_user* uman_get_user_by_cid(struct hub_user_manager* users, const char* cid)
 {
-	struct hub_user* user = (struct hub_user*) rb_tree_get(users->cidmap, (const void*) cid);
-	return user;
+	unsigned char raw[TIGERSIZE];
+	if (!uman_cid_decode(cid, raw))
+		return NULL;
+	return (struct hub_user*) hash_table_get(users->cidmap, uman_cid_hash(raw), raw);
 }
 
 
 struct hub_user* uman_get_user_by_nick(struct hub_user_manager* users, const char* nick)
 {
-	struct hub_user* user = (struct hub_user*) rb_tree_get(users->nickmap, nick);
-	return user;
+	return (struct hub_user*) hash_table_get(users->nickmap, uman_nick_hash(nick), nick);
+}
+
+
+struct hub_user* uman_lookup_nick(struct hub_user_manager* users, struct hub_user* user)
+{
+	return (struct hub_user*) hash_table_get(users->nickmap, user->nick_hash, user->id.nick);
+}
+
+
+struct hub_user* uman_lookup_cid(struct hub_user_manager* users, struct hub_user* user)
+{
+	return (struct hub_user*) hash_table_get(users->cidmap, uman_cid_hash(user->cid_raw), user->cid_raw);
+}
+
+static void uman_append_user(void* ptr, void* user)
+{
+	list_append((struct linked_list*) ptr, user);
 }
 
 size_t uman_get_user_by_addr(struct hub_user_manager* users, struct linked_list* target, struct ip_range* range)
 {
-	size_t num = 0;
+	return ip_trie_find(users->addrmap, range, uman_append_user, target);
+}
+
+static void uman_chunk_compress(struct hub_info* hub, struct hub_user_manager* users, size_t n)
+{
+	struct adc_message* infos[UMAN_CHUNK_SIDS];
+	struct uman_chunk* chunk = &users->chunks[n];
 	struct hub_user* user;
-	LIST_FOREACH(struct hub_user*, user, users->list,
+	size_t count = 0;
+	size_t i;
+
+	chunk->raw = 0;
+	for (i = 0; i < UMAN_CHUNK_SIDS; i++)
 	{
-		if (ip_in_range(&user->id.addr, range))
+		user = sid_lookup(users->sids, (sid_t) (n * UMAN_CHUNK_SIDS + i));
+		if (user && user_is_logged_in(user) && user->info)
 		{
-			list_append(target, user);
-			num++;
+			infos[count++] = user->info;
+			chunk->raw += user->info->length;
 		}
-	});
-	return num;
+	}
+
+	/* If compression fails the users in this chunk are sent uncompressed */
+	chunk->block = count ? zlif_compress(hub->zlif, infos, count) : NULL;
+	chunk->valid = !count || chunk->block;
+}
+
+static int uman_send_user_list_compressed(struct hub_info* hub, struct hub_user_manager* users, struct hub_user* target)
+{
+	struct uman_chunk* chunk;
+	struct hub_user* user;
+	size_t n;
+	size_t i;
+
+	for (n = 0; n < users->num_chunks; n++)
+	{
+		chunk = &users->chunks[n];
+		if (!chunk->valid)
+			uman_chunk_compress(hub, users, n);
+
+		if (chunk->block)
+		{
+			if (!route_to_user(hub, target, chunk->block))
+				return 0;
+			zlif_sent(hub->zlif, chunk->block, chunk->raw);
+			continue;
+		}
+
+		for (i = 0; !chunk->valid && i < UMAN_CHUNK_SIDS; i++)
+		{
+			user = sid_lookup(users->sids, (sid_t) (n * UMAN_CHUNK_SIDS + i));
+			if (user && user_is_logged_in(user) && user->info && !route_to_user(hub, target, user->info))
+				return 0;
+		}
+	}
+	return 1;
 }
 
 int uman_send_user_list(struct hub_info* hub, struct hub_user_manager* users, struct hub_user* target)
@@ -164,7 +361,10 @@ int uman_send_user_list(struct hub_info* hub, struct hub_user_manager* users, st
 	struct hub_user* user;
 	user_flag_set(target, flag_user_list);
 
-	LIST_FOREACH(struct hub_user*, user, users->list,
+	if (hub->zlif && users->chunks && user_flag_get(target, feature_zlif))
+		return uman_send_user_list_compressed(hub, users, target);
+
+	UMAN_FOREACH(users, user,
 	{
 		if (user_is_logged_in(user))
 		{
@@ -174,13 +374,7 @@ int uman_send_user_list(struct hub_info* hub, struct hub_user_manager* users, st
 		}
 	});
 
-#if 0
-	FIXME: FIXME FIXME handle send queue excess
-	if (!target->send_queue_size)
-	{
-	    user_flag_unset(target, flag_user_list);
-	}
-#endif
+	/* flag_user_list is cleared by the router once the send queue has drained below max_send_buffer_soft */
 	return ret;
 }
 
@@ -27,9 +27,13 @@ struct hub_user_manager
 	uint64_t shared_size;           /**<< "The total number of shared bytes among fully connected users." */
 	uint64_t shared_files;          /**<< "The total number of shared files among fully connected users." */
 	struct sid_pool* sids;          /**<< "Maps SIDs to users (constant time)" */
-	struct linked_list* list;       /**<< "Contains all logged in users" */
-	struct rb_tree* nickmap;        /**<< "Maps nicknames to users (red black tree)" */
-	struct rb_tree* cidmap;         /**<< "Maps CIDs to users (red black tree)" */
+	struct hub_user* first;         /**<< "First logged in user (intrusive list, linked through hub_user::next)" */
+	struct hub_user* last;          /**<< "Last logged in user" */
+	struct hash_table* nickmap;     /**<< "Maps nicknames to users (hashed on case folded nick)" */
+	struct hash_table* cidmap;      /**<< "Maps binary CIDs to users" */
+	struct ip_trie* addrmap;        /**<< "Maps IP addresses to users" */
+	struct uman_chunk* chunks;      /**<< "The user list compressed for ZLIF, in chunks of UMAN_CHUNK_SIDS sessions" */
+	size_t num_chunks;
 };
 
 /**
@@ -52,8 +56,19 @@ extern int uman_shutdown(struct hub_user_manager* users);
 extern void uman_update_stats(struct hub_user_manager* users);
 extern void uman_print_stats(struct hub_user_manager* users);
 
+/**
+ * Iterate all logged in users.
+ * The list is intrusive, so removing ITEM from the user manager inside
+ * BLOCK is not allowed.
+ */
+#define UMAN_FOREACH(USERS, ITEM, BLOCK) \
+		for (ITEM = (USERS)->first; ITEM; ITEM = ITEM->next) \
+			BLOCK
+
 /**
  * Add a user to the user manager.
+ * This is a constant time operation, apart from indexing the user's
+ * address which is bounded by the address width.
  *
  * @param users The usermanager to add the user to
  * @param user The user to be added to the hub.
@@ -64,11 +79,17 @@ extern int uman_add(struct hub_user_manager* users, struct hub_user* user);
  * Remove a user from the user manager.
  * This user is connected, and will be moved to the leaving queue, pending
  * all messages in the message queue, and resource cleanup.
+ * This is a constant time operation.
  *
- * @return 0 if successfully removed, -1 if error.
+ * @return 0 if successfully removed, -1 if error (or user not added).
  */
 extern int uman_remove(struct hub_user_manager* users, struct hub_user* user);
 
+/**
+ * The INF of a logged in user was updated.
+ */
+extern void uman_update(struct hub_user_manager* users, struct hub_user* user);
+
 /**
  * Returns and allocates an unused session ID (SID).
  */
@@ -101,8 +122,29 @@ extern struct hub_user* uman_get_user_by_cid(struct hub_user_manager* users, con
  */
 extern struct hub_user* uman_get_user_by_nick(struct hub_user_manager* users, const char* nick);
 
+/**
+ * Lookup a user with the same nick name or CID as the given (connecting) user,
+ * using its precomputed nick_hash and cid_raw keys.
+ * @return a user if found, or NULL if not found
+ */
+extern struct hub_user* uman_lookup_nick(struct hub_user_manager* users, struct hub_user* user);
+extern struct hub_user* uman_lookup_cid(struct hub_user_manager* users, struct hub_user* user);
+
+/**
+ * Compute the nick name hash used as key in the nick map.
+ * Nick names differing only by case produce the same hash.
+ */
+extern uint32_t uman_nick_hash(const char* nick);
+
+/**
+ * Decode a base32 encoded CID into its binary form.
+ * @return 1 if the CID is valid, 0 otherwise.
+ */
+extern int uman_cid_decode(const char* cid, unsigned char raw[TIGERSIZE]);
+
 /**
  * Lookup users based on an ip address range.
+ * Users are found through the address index, in address order.
  *
  * @param[out] target the list of users matching the address
  * @param range the IP range of users to match
@@ -113,6 +155,7 @@ extern size_t uman_get_user_by_addr(struct hub_user_manager* users, struct linke
 /**
  * Send the user list of connected clients to 'user'.
  * Usually part of the login process.
+ * Users that negotiated ZLIF get it compressed, see zlif_compress().
  *
  * @return 1 if sending the user list succeeded, 0 otherwise.
  */
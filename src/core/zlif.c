@@ -0,0 +1,195 @@
+/*
+ * uhub - A tiny ADC p2p connection hub
+ * Copyright (C) 2007-2014, Jan Vidar Krey
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "uhub.h"
+
+#ifdef ZLIB_SUPPORT
+
+#define ZLIF_POOL_MAX 4          /* Idle deflate states kept */
+
+struct hub_zlif
+{
+	z_stream* pool[ZLIF_POOL_MAX];
+	size_t pool_count;
+	struct zlif_stats stats;
+};
+
+static uint64_t zlif_clock()
+{
+#ifdef WIN32
+	static LARGE_INTEGER frequency;
+	LARGE_INTEGER counter;
+	if (!frequency.QuadPart)
+		QueryPerformanceFrequency(&frequency);
+	QueryPerformanceCounter(&counter);
+	return (uint64_t) (counter.QuadPart * (1000000000.0 / frequency.QuadPart));
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t) ts.tv_sec) * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+static z_stream* zlif_stream_get(struct hub_zlif* zlif)
+{
+	z_stream* stream;
+
+	if (zlif->pool_count)
+		return zlif->pool[--zlif->pool_count];
+
+	stream = hub_malloc_zero(sizeof(z_stream));
+	if (!stream)
+		return NULL;
+
+	if (deflateInit(stream, Z_DEFAULT_COMPRESSION) != Z_OK)
+	{
+		hub_free(stream);
+		return NULL;
+	}
+	zlif->stats.streams++;
+	return stream;
+}
+
+static void zlif_stream_put(struct hub_zlif* zlif, z_stream* stream)
+{
+	if (zlif->pool_count < ZLIF_POOL_MAX && deflateReset(stream) == Z_OK)
+	{
+		zlif->pool[zlif->pool_count++] = stream;
+		return;
+	}
+	deflateEnd(stream);
+	hub_free(stream);
+}
+
+struct hub_zlif* zlif_create()
+{
+	return hub_malloc_zero(sizeof(struct hub_zlif));
+}
+
+void zlif_destroy(struct hub_zlif* zlif)
+{
+	if (!zlif)
+		return;
+
+	while (zlif->pool_count)
+	{
+		z_stream* stream = zlif->pool[--zlif->pool_count];
+		deflateEnd(stream);
+		hub_free(stream);
+	}
+	hub_free(zlif);
+}
+
+struct adc_message* zlif_compress(struct hub_zlif* zlif, struct adc_message** msgs, size_t count)
+{
+	struct adc_message* block;
+	z_stream* stream;
+	uint64_t started = zlif_clock();
+	size_t raw = 0;
+	size_t bound;
+	size_t n;
+	int ret = Z_OK;
+
+	stream = zlif_stream_get(zlif);
+	if (!stream)
+		return NULL;
+
+	for (n = 0; n < count; n++)
+		raw += msgs[n]->length;
+
+	/* Compressing into a buffer of this size never runs out of space */
+	bound = deflateBound(stream, raw);
+	block = adc_msg_construct_binary(5 + bound);
+	if (!block)
+	{
+		zlif_stream_put(zlif, stream);
+		return NULL;
+	}
+	memcpy(block->cache, "IZON\n", 5);
+	block->length = 5;
+	block->cmd = ADC_CMD_IZON;
+
+	stream->next_out = (Bytef*) block->cache + block->length;
+	stream->avail_out = (uInt) bound;
+	for (n = 0; n < count && ret == Z_OK; n++)
+	{
+		stream->next_in = (Bytef*) msgs[n]->cache;
+		stream->avail_in = (uInt) msgs[n]->length;
+		ret = deflate(stream, Z_NO_FLUSH);
+	}
+
+	if (ret == Z_OK)
+		ret = deflate(stream, Z_FINISH);
+
+	if (ret != Z_STREAM_END)
+	{
+		LOG_ERROR("zlif_compress(): deflate failed: %d", ret);
+		adc_msg_free(block);
+		deflateEnd(stream);
+		hub_free(stream);
+		return NULL;
+	}
+
+	block->length += bound - stream->avail_out;
+	block->cache[block->length] = 0;
+	zlif_stream_put(zlif, stream);
+
+	zlif->stats.blocks++;
+	zlif->stats.cpu_ns += zlif_clock() - started;
+	return block;
+}
+
+void zlif_sent(struct hub_zlif* zlif, struct adc_message* block, size_t raw)
+{
+	zlif->stats.sent++;
+	zlif->stats.raw_bytes += raw;
+	zlif->stats.sent_bytes += block->length;
+}
+
+void zlif_get_stats(struct hub_zlif* zlif, struct zlif_stats* stats)
+{
+	memcpy(stats, &zlif->stats, sizeof(struct zlif_stats));
+}
+
+#else /* ZLIB_SUPPORT */
+
+struct hub_zlif* zlif_create()
+{
+	return NULL;
+}
+
+void zlif_destroy(struct hub_zlif* zlif)
+{
+}
+
+struct adc_message* zlif_compress(struct hub_zlif* zlif, struct adc_message** msgs, size_t count)
+{
+	return NULL;
+}
+
+void zlif_sent(struct hub_zlif* zlif, struct adc_message* block, size_t raw)
+{
+}
+
+void zlif_get_stats(struct hub_zlif* zlif, struct zlif_stats* stats)
+{
+	memset(stats, 0, sizeof(struct zlif_stats));
+}
+
+#endif /* ZLIB_SUPPORT */
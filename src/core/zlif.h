@@ -0,0 +1,62 @@
+/*
+ * uhub - A tiny ADC p2p connection hub
+ * Copyright (C) 2007-2014, Jan Vidar Krey
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef HAVE_UHUB_ZLIF_H
+#define HAVE_UHUB_ZLIF_H
+
+/**
+ * ZLIF compression. The hub sends IZON and then a complete zlib stream,
+ * after which the connection is back to plain text. This is used for
+ * the user list, which is large, highly compressible, and the same for
+ * every user logging in, so each block is compressed once and sent to
+ * many. Deflate states are expensive to set up, so they are pooled.
+ *
+ * Without ZLIB_SUPPORT zlif_create() returns NULL.
+ */
+struct hub_zlif;
+
+struct zlif_stats
+{
+	size_t streams;          /* Deflate states set up */
+	size_t blocks;           /* Blocks compressed */
+	size_t sent;             /* Blocks sent */
+	uint64_t raw_bytes;      /* Sent, before compression */
+	uint64_t sent_bytes;     /* Sent, after compression */
+	uint64_t cpu_ns;         /* Time spent compressing */
+};
+
+extern struct hub_zlif* zlif_create();
+extern void zlif_destroy(struct hub_zlif* zlif);
+
+/**
+ * Compress a number of messages into one block.
+ *
+ * @return an IZON message followed by the compressed messages,
+ *         or NULL if out of memory.
+ */
+extern struct adc_message* zlif_compress(struct hub_zlif* zlif, struct adc_message** msgs, size_t count);
+
+/**
+ * A block holding raw bytes of messages was sent.
+ */
+extern void zlif_sent(struct hub_zlif* zlif, struct adc_message* block, size_t raw);
+
+extern void zlif_get_stats(struct hub_zlif* zlif, struct zlif_stats* stats);
+
+#endif /* HAVE_UHUB_ZLIF_H */
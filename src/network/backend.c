@@ -34,7 +34,8 @@ struct net_cleanup_handler
 struct net_backend
 {
 	struct net_backend_common common;
-	time_t now; /* the time now (used for timeout handling) */
+	time_t now; /* the wall clock time now (seconds) */
+	uint64_t now_ms; /* monotonic time now in milliseconds (used for timeout handling) */
 	struct timeout_queue timeout_queue; /* used for timeout handling */
 	struct net_cleanup_handler* cleaner; /* handler to cleanup connections at a safe point */
 	struct net_backend_handler handler; /* backend event handler */
@@ -56,6 +57,31 @@ extern struct net_backend* net_backend_init_kqueue(struct net_backend_handler*,
 extern struct net_backend* net_backend_init_select(struct net_backend_handler*, struct net_backend_common*);
 #endif
 
+/*
+ * Read the monotonic clock in milliseconds.
+ * A coarse clock is good enough here, and it is much cheaper to read.
+ */
+static uint64_t net_backend_clock_ms()
+{
+#ifdef WIN32
+	return (uint64_t) GetTickCount64();
+#else
+	struct timespec ts;
+#ifdef CLOCK_MONOTONIC_COARSE
+	if (clock_gettime(CLOCK_MONOTONIC_COARSE, &ts) == 0)
+		return ((uint64_t) ts.tv_sec) * 1000 + (ts.tv_nsec / 1000000);
+#endif
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t) ts.tv_sec) * 1000 + (ts.tv_nsec / 1000000);
+#endif
+}
+
+static void net_backend_update_time()
+{
+	g_backend->now = time(0);
+	g_backend->now_ms = net_backend_clock_ms();
+}
+
 static net_backend_init_t net_backend_init_funcs[] = {
 #ifdef USE_EPOLL
 	net_backend_init_epoll,
@@ -75,8 +101,8 @@ int net_backend_init()
 	g_backend = (struct net_backend*) hub_malloc_zero(sizeof(struct net_backend));
 	g_backend->common.num = 0;
 	g_backend->common.max = net_get_max_sockets();
-	g_backend->now = time(0);
-	timeout_queue_initialize(&g_backend->timeout_queue, g_backend->now, 120); /* FIXME: max 120 secs! */
+	net_backend_update_time();
+	timeout_queue_initialize(&g_backend->timeout_queue, g_backend->now_ms);
 	g_backend->cleaner = net_cleanup_initialize(g_backend->common.max);
 
 	for (n = 0; net_backend_init_funcs[n]; n++)
@@ -126,13 +152,13 @@ struct timeout_queue* net_backend_get_timeout_queue()
 int net_backend_process()
 {
 	int res = 0;
-	size_t secs = timeout_queue_get_next_timeout(&g_backend->timeout_queue, g_backend->now);
+	size_t ms = timeout_queue_get_next_timeout(&g_backend->timeout_queue, g_backend->now_ms);
 
 	if (g_backend->common.num)
-		res = g_backend->handler.backend_poll(g_backend->data, secs * 1000);
+		res = g_backend->handler.backend_poll(g_backend->data, (int) ms);
 
-	g_backend->now = time(0);
-	timeout_queue_process(&g_backend->timeout_queue, g_backend->now);
+	net_backend_update_time();
+	timeout_queue_process(&g_backend->timeout_queue, g_backend->now_ms);
 
 	if (res == -1)
 	{
@@ -154,6 +180,11 @@ time_t net_get_time()
 	return g_backend->now;
 }
 
+uint64_t net_get_time_ms()
+{
+	return g_backend->now_ms;
+}
+
 
 void net_con_initialize(struct net_connection* con, int sd, net_connection_cb callback, const void* ptr, int events)
 {
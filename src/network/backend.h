@@ -88,6 +88,12 @@ extern void net_backend_update(struct net_connection* con, int events);
  */
 time_t net_get_time();
 
+/**
+ * Get the current monotonic time in milliseconds.
+ * This is read once per event loop iteration.
+ */
+uint64_t net_get_time_ms();
+
 extern struct timeout_queue* net_backend_get_timeout_queue();
 
 struct net_cleanup_handler* net_cleanup_initialize(size_t max);
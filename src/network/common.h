@@ -26,6 +26,8 @@
 struct ssl_handle; /* abstract type */
 
 #define NET_CLEANUP               0x8000
+#define NET_READY_READ            0x0200 /* socket readable until it would block (edge-triggered backends) */
+#define NET_READY_WRITE           0x0400 /* socket writable until it would block (edge-triggered backends) */
 
 #define NET_CON_STRUCT_BASIC \
 	int                  sd;        /** socket descriptor */ \
@@ -33,6 +33,14 @@ static int is_blocked_or_interrupted()
 				|| err == EINTR;
 }
 
+void net_con_blocked(struct net_connection* con, int events)
+{
+	if (events & NET_EVENT_READ)
+		con->flags &= ~NET_READY_READ;
+	if (events & NET_EVENT_WRITE)
+		con->flags &= ~NET_READY_WRITE;
+}
+
 ssize_t net_con_send(struct net_connection* con, const void* buf, size_t len)
 {
 	int ret;
@@ -44,7 +52,10 @@ ssize_t net_con_send(struct net_connection* con, const void* buf, size_t len)
 		if (ret == -1)
 		{
 			if (is_blocked_or_interrupted())
+			{
+				net_con_blocked(con, NET_EVENT_WRITE);
 				return 0;
+			}
 			return -1;
 		}
 #ifdef SSL_SUPPORT
@@ -68,13 +79,21 @@ ssize_t net_con_recv(struct net_connection* con, void* buf, size_t len)
 		if (ret == -1)
 		{
 			if (is_blocked_or_interrupted())
+			{
+				net_con_blocked(con, NET_EVENT_READ);
 				return 0;
+			}
 			return -net_error();
 		}
 		else if (ret == 0)
 		{
 			return -1;
 		}
+		else if ((size_t) ret < len)
+		{
+			/* A short read means the socket buffer is drained. */
+			net_con_blocked(con, NET_EVENT_READ);
+		}
 #ifdef SSL_SUPPORT
 	}
 	else
@@ -91,11 +110,16 @@ ssize_t net_con_peek(struct net_connection* con, void* buf, size_t len)
 	if (ret == -1)
 	{
 		if (is_blocked_or_interrupted())
+		{
+			net_con_blocked(con, NET_EVENT_READ);
 			return 0;
+		}
 		return -net_error();
 	}
 	else if (ret == 0)
 		return -1;
+	else if ((size_t) ret < len)
+		net_con_blocked(con, NET_EVENT_READ);
 	return ret;
 }
 
@@ -532,16 +556,21 @@ static void timeout_callback(struct timeout_evt* evt)
 
 
 void net_con_set_timeout(struct net_connection* con, int seconds)
+{
+	net_con_set_timeout_ms(con, ((uint64_t) seconds) * 1000);
+}
+
+void net_con_set_timeout_ms(struct net_connection* con, uint64_t ms)
 {
 	if (!con->timeout)
 	{
 		con->timeout = hub_malloc_zero(sizeof(struct timeout_evt));
 		timeout_evt_initialize(con->timeout, timeout_callback, con);
-		timeout_queue_insert(net_backend_get_timeout_queue(), con->timeout, seconds);
+		timeout_queue_insert_ms(net_backend_get_timeout_queue(), con->timeout, ms);
 	}
 	else
 	{
-		timeout_queue_reschedule(net_backend_get_timeout_queue(), con->timeout, seconds);
+		timeout_queue_reschedule_ms(net_backend_get_timeout_queue(), con->timeout, ms);
 	}
 }
 
@@ -76,6 +76,16 @@ extern void net_con_reinitialize(struct net_connection* con, net_connection_cb c
 extern void net_con_update(struct net_connection* con, int events);
 extern void net_con_callback(struct net_connection* con, int events);
 
+/**
+ * Tell the backend that reading or writing would block.
+ * Edge-triggered backends keep dispatching a connection until this is
+ * known; net_con_send(), net_con_recv() and net_con_peek() call it
+ * automatically, so it is only needed for raw socket I/O.
+ *
+ * @param events NET_EVENT_READ and/or NET_EVENT_WRITE
+ */
+extern void net_con_blocked(struct net_connection* con, int events);
+
 /**
  * Close the connection.
  * This will ensure a connection is closed properly and will generate a NET_EVENT_DESTROYED event which indicates
@@ -114,6 +124,13 @@ extern ssize_t net_con_peek(struct net_connection* con, void* buf, size_t len);
  * @param seconds the number of seconds into the future.
  */
 extern void net_con_set_timeout(struct net_connection* con, int seconds);
+
+/**
+ * Set timeout for connection with millisecond precision.
+ *
+ * @param ms the number of milliseconds into the future.
+ */
+extern void net_con_set_timeout_ms(struct net_connection* con, uint64_t ms);
 extern void net_con_clear_timeout(struct net_connection* con);
 
 #endif /* HAVE_UHUB_NETWORK_CONNECTION_H */
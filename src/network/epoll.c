@@ -27,16 +27,27 @@
 
 #define EPOLL_EVBUFFER 512
 
+#ifndef EPOLLRDHUP
+#define EPOLLRDHUP 0
+#endif
+
 struct net_connection_epoll
 {
 	NET_CON_STRUCT_COMMON
 	struct epoll_event ev;
+	int want;                                   /** Wanted events (edge-triggered mode) */
+	struct net_connection_epoll** ready_list;   /** List the connection is queued on, if any */
+	struct net_connection_epoll* ready_prev;
+	struct net_connection_epoll* ready_next;
 };
 
 struct net_backend_epoll
 {
 	int epfd;
+	int edge;                                   /** Edge-triggered mode (EVENT_EPOLLET) */
 	struct net_connection_epoll** conns;
+	struct net_connection_epoll* ready;         /** Connections with wanted and ready events */
+	struct net_connection_epoll* again;         /** Still ready after being dispatched */
 	struct epoll_event events[EPOLL_EVBUFFER];
 	struct net_backend_common* common;
 };
@@ -48,19 +59,121 @@ const char* net_backend_name_epoll()
 	return "epoll";
 }
 
+const char* net_backend_name_epoll_edge()
+{
+	return "epoll (edge-triggered)";
+}
+
+/*
+ * In edge-triggered mode every socket is registered once for both reading
+ * and writing, and the readiness is tracked in the NET_READY_* connection
+ * flags until the socket would block (see net_con_blocked()).
+ * The wanted events are only kept in userspace, so no epoll_ctl() calls are
+ * needed when a send queue goes between empty and non-empty.
+ * Connections that are ready for a wanted event are kept on a ready list and
+ * dispatched until they are drained.
+ */
+static int epoll_con_pending(struct net_connection_epoll* con)
+{
+	return ((con->flags & NET_READY_READ) && (con->want & NET_EVENT_READ)) ||
+		((con->flags & NET_READY_WRITE) && (con->want & NET_EVENT_WRITE));
+}
+
+static void epoll_ready_push(struct net_connection_epoll** list, struct net_connection_epoll* con)
+{
+	if (con->ready_list)
+		return;
+	con->ready_list = list;
+	con->ready_prev = NULL;
+	con->ready_next = *list;
+	if (*list)
+		(*list)->ready_prev = con;
+	*list = con;
+}
+
+static void epoll_ready_unlink(struct net_connection_epoll* con)
+{
+	if (!con->ready_list)
+		return;
+	if (con->ready_prev)
+		con->ready_prev->ready_next = con->ready_next;
+	else
+		*con->ready_list = con->ready_next;
+	if (con->ready_next)
+		con->ready_next->ready_prev = con->ready_prev;
+	con->ready_list = NULL;
+	con->ready_prev = NULL;
+	con->ready_next = NULL;
+}
+
 int net_backend_poll_epoll(struct net_backend* data, int ms)
 {
 	struct net_backend_epoll* backend = (struct net_backend_epoll*) data;
-	int res = epoll_wait(backend->epfd, backend->events, MIN(backend->common->num, EPOLL_EVBUFFER), ms);
+	int res;
+	if (backend->ready)
+		ms = 0;
+	res = epoll_wait(backend->epfd, backend->events, MIN(backend->common->num, EPOLL_EVBUFFER), ms);
 	if (res == -1 && errno == EINTR)
 		return 0;
 	return res;
 }
 
+static void net_backend_process_epoll_edge(struct net_backend_epoll* backend, int res)
+{
+	int n, ev;
+	uint32_t events;
+	struct net_connection_epoll* con;
+
+	for (n = 0; n < res; n++)
+	{
+		con = backend->conns[backend->events[n].data.fd];
+		if (!con)
+			continue;
+
+		events = backend->events[n].events;
+		if (events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+			con->flags |= NET_READY_READ;
+		if (events & (EPOLLOUT | EPOLLHUP | EPOLLERR))
+			con->flags |= NET_READY_WRITE;
+		if (epoll_con_pending(con))
+			epoll_ready_push(&backend->ready, con);
+	}
+
+	while ((con = backend->ready))
+	{
+		epoll_ready_unlink(con);
+
+		ev = 0;
+		if ((con->flags & NET_READY_READ) && (con->want & NET_EVENT_READ))   ev |= NET_EVENT_READ;
+		if ((con->flags & NET_READY_WRITE) && (con->want & NET_EVENT_WRITE)) ev |= NET_EVENT_WRITE;
+		if (!ev)
+			continue;
+
+		net_con_callback((struct net_connection*) con, ev);
+
+		// Not drained yet, dispatch again in the next iteration
+		if (!(con->flags & NET_CLEANUP) && epoll_con_pending(con))
+			epoll_ready_push(&backend->again, con);
+	}
+
+	while ((con = backend->again))
+	{
+		epoll_ready_unlink(con);
+		epoll_ready_push(&backend->ready, con);
+	}
+}
+
 void net_backend_process_epoll(struct net_backend* data, int res)
 {
 	int n, ev;
 	struct net_backend_epoll* backend = (struct net_backend_epoll*) data;
+
+	if (backend->edge)
+	{
+		net_backend_process_epoll_edge(backend, res);
+		return;
+	}
+
 	for (n = 0; n < res; n++)
 	{
 		struct net_connection_epoll* con = backend->conns[backend->events[n].data.fd];
@@ -90,6 +203,8 @@ void net_con_initialize_epoll(struct net_backend* data, struct net_connection* c
 	con->ev.events = 0;
 	con->ptr = (void*) ptr;
 	con->ev.data.fd = sd;
+	con->want = 0;
+	con->ready_list = NULL;
 }
 
 void net_con_backend_add_epoll(struct net_backend* data, struct net_connection* con_, int events)
@@ -99,6 +214,12 @@ void net_con_backend_add_epoll(struct net_backend* data, struct net_connection*
 
 	backend->conns[con->sd] = con;
 
+	if (backend->edge)
+	{
+		con->want = events;
+		con->ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+	}
+
 	if (events & NET_EVENT_READ)  con->ev.events |= EPOLLIN;
 	if (events & NET_EVENT_WRITE) con->ev.events |= EPOLLOUT;
 
@@ -114,6 +235,15 @@ void net_con_backend_mod_epoll(struct net_backend* data, struct net_connection*
 	struct net_connection_epoll* con = (struct net_connection_epoll*) con_;
 
 	int newev = 0;
+
+	if (backend->edge)
+	{
+		con->want = events;
+		if (epoll_con_pending(con))
+			epoll_ready_push(&backend->ready, con);
+		return;
+	}
+
 	if (events & NET_EVENT_READ)  newev |= EPOLLIN;
 	if (events & NET_EVENT_WRITE) newev |= EPOLLOUT;
 
@@ -133,6 +263,7 @@ void net_con_backend_del_epoll(struct net_backend* data, struct net_connection*
 	struct net_connection_epoll* con = (struct net_connection_epoll*) con_;
 
 	backend->conns[con->sd] = 0;
+	epoll_ready_unlink(con);
 
 	if (epoll_ctl(backend->epfd, EPOLL_CTL_DEL, con->sd, &con->ev) == -1)
 	{
@@ -166,8 +297,11 @@ struct net_backend* net_backend_init_epoll(struct net_backend_handler* handler,
 
 	backend->conns = hub_malloc_zero(sizeof(struct net_connection_epoll*) * common->max);
 	backend->common = common;
+	backend->edge = getenv("EVENT_EPOLLET") ? 1 : 0;
 
 	net_backend_set_handlers(handler);
+	if (backend->edge)
+		handler->backend_name = net_backend_name_epoll_edge;
 	return (struct net_backend*) backend;
 }
 
@@ -488,3 +488,443 @@ int ip_in_range(struct ip_addr_encap* addr, struct ip_range* range)
 {
 	return (addr->af == range->lo.af && ip_compare(&range->lo, addr) <= 0 && ip_compare(addr, &range->hi) <= 0);
 }
+
+
+/*
+ * A compressed binary radix trie, one per address family.
+ *
+ * Every node is a prefix: the first bits of key, the rest of key is zero.
+ * Children extend the prefix of their parent, and which child depends on
+ * the first bit past it. Nodes holding no values only exist where two
+ * branches meet, so the depth is bounded by the address width and a
+ * lookup touches at most one node per distinct prefix length on its path.
+ *
+ * Ranges are stored as the smallest set of prefixes covering them exactly,
+ * which is a single prefix for anything written in CIDR notation.
+ */
+#define IP_TRIE_KEY_SIZE 16
+
+struct ip_trie_node
+{
+	unsigned char key[IP_TRIE_KEY_SIZE];
+	unsigned int bits;
+	struct ip_trie_node* child[2];
+	void** values;
+	size_t count;
+	size_t capacity;
+};
+
+struct ip_trie
+{
+	struct ip_trie_node* root[2];   /* IPv4 and IPv6 */
+	size_t count;
+};
+
+struct ip_trie_prefix
+{
+	unsigned char key[IP_TRIE_KEY_SIZE];
+	unsigned int bits;
+};
+
+/* A range splits into at most two prefixes per bit of the address */
+#define IP_TRIE_MAX_PREFIXES (2 * IP_TRIE_KEY_SIZE * 8)
+
+static unsigned int ip_trie_width(int family)
+{
+	return family ? 128 : 32;
+}
+
+/*
+ * Fill key with the address bits, and return the trie it belongs to,
+ * 0 for IPv4 and 1 for IPv6, or -1 if neither. IPv4 mapped IPv6 addresses,
+ * as seen on dual stack sockets, are treated as the IPv4 address.
+ */
+static int ip_trie_key(struct ip_addr_encap* addr, unsigned char* key)
+{
+	static const unsigned char mapped[12] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff };
+	const unsigned char* raw;
+
+	memset(key, 0, IP_TRIE_KEY_SIZE);
+	if (addr->af == AF_INET)
+	{
+		memcpy(key, &addr->internal_ip_data.in, 4);
+		return 0;
+	}
+
+	if (addr->af == AF_INET6)
+	{
+		raw = (const unsigned char*) &addr->internal_ip_data.in6;
+		if (memcmp(raw, mapped, sizeof(mapped)) == 0)
+		{
+			memcpy(key, raw + sizeof(mapped), 4);
+			return 0;
+		}
+		memcpy(key, raw, 16);
+		return 1;
+	}
+	return -1;
+}
+
+static int ip_trie_bit(const unsigned char* key, unsigned int n)
+{
+	return (key[n >> 3] >> (7 - (n & 7))) & 1;
+}
+
+/* @return 1 if the first bits of a and b are the same */
+static int ip_trie_match(const unsigned char* a, const unsigned char* b, unsigned int bits)
+{
+	unsigned int bytes = bits >> 3;
+	unsigned char mask;
+
+	if (memcmp(a, b, bytes) != 0)
+		return 0;
+	if (!(bits & 7))
+		return 1;
+	mask = (unsigned char) (0xff << (8 - (bits & 7)));
+	return ((a[bytes] ^ b[bytes]) & mask) == 0;
+}
+
+/* @return the number of leading bits a and b have in common, at most max */
+static unsigned int ip_trie_common(const unsigned char* a, const unsigned char* b, unsigned int max)
+{
+	unsigned int n = 0;
+	unsigned char diff;
+
+	while (n < max && a[n >> 3] == b[n >> 3])
+		n += 8;
+
+	if (n < max)
+	{
+		diff = a[n >> 3] ^ b[n >> 3];
+		while (!(diff & 0x80))
+		{
+			diff <<= 1;
+			n++;
+		}
+	}
+	return MIN(n, max);
+}
+
+static struct ip_trie_node* ip_trie_node_create(const unsigned char* key, unsigned int bits)
+{
+	struct ip_trie_node* node = hub_malloc_zero(sizeof(struct ip_trie_node));
+	if (!node)
+		return NULL;
+
+	memcpy(node->key, key, (bits + 7) >> 3);
+	if (bits & 7)
+		node->key[bits >> 3] &= (unsigned char) (0xff << (8 - (bits & 7)));
+	node->bits = bits;
+	return node;
+}
+
+static void ip_trie_node_destroy(struct ip_trie_node* node)
+{
+	if (!node)
+		return;
+	ip_trie_node_destroy(node->child[0]);
+	ip_trie_node_destroy(node->child[1]);
+	hub_free(node->values);
+	hub_free(node);
+}
+
+/*
+ * Split lo..hi into prefixes. Each one starts at the next address not yet
+ * covered and is as large as its alignment and the end of the range allow.
+ */
+static size_t ip_trie_split(struct ip_range* range, int* family, struct ip_trie_prefix* out)
+{
+	unsigned char cur[IP_TRIE_KEY_SIZE];
+	unsigned char end[IP_TRIE_KEY_SIZE];
+	unsigned char hi[IP_TRIE_KEY_SIZE];
+	unsigned int width, bytes, size, n;
+	size_t count = 0;
+	int carry;
+
+	*family = ip_trie_key(&range->lo, cur);
+	if (*family == -1 || ip_trie_key(&range->hi, hi) != *family)
+		return 0;
+
+	width = ip_trie_width(*family);
+	bytes = width >> 3;
+	if (memcmp(cur, hi, bytes) > 0)
+		return 0;
+
+	for (;;)
+	{
+		/* Largest aligned block starting at cur ... */
+		for (size = 0; size < width && !ip_trie_bit(cur, width - size - 1); size++);
+
+		/* ... that does not go past hi */
+		for (;;)
+		{
+			memcpy(end, cur, bytes);
+			for (n = width - size; n < width; n++)
+				end[n >> 3] |= (unsigned char) (0x80 >> (n & 7));
+			if (memcmp(end, hi, bytes) <= 0)
+				break;
+			size--;
+		}
+
+		memcpy(out[count].key, cur, IP_TRIE_KEY_SIZE);
+		out[count].bits = width - size;
+		count++;
+
+		if (memcmp(end, hi, bytes) == 0)
+			break;
+
+		/* cur = end + 1, which cannot wrap since end < hi */
+		memcpy(cur, end, bytes);
+		for (n = bytes, carry = 1; carry && n > 0; n--)
+		{
+			cur[n - 1]++;
+			carry = (cur[n - 1] == 0);
+		}
+	}
+	return count;
+}
+
+/* @return the node for exactly this prefix, created if needed */
+static struct ip_trie_node* ip_trie_get(struct ip_trie_node** link, const unsigned char* key, unsigned int bits)
+{
+	struct ip_trie_node* node;
+	struct ip_trie_node* leaf;
+	struct ip_trie_node* glue;
+	unsigned int common;
+
+	for (;;)
+	{
+		node = *link;
+		if (!node)
+		{
+			*link = ip_trie_node_create(key, bits);
+			return *link;
+		}
+
+		common = ip_trie_common(node->key, key, MIN(node->bits, bits));
+		if (common == node->bits && common == bits)
+			return node;
+
+		if (common == node->bits)
+		{
+			/* Somewhere below this node */
+			link = &node->child[ip_trie_bit(key, node->bits)];
+			continue;
+		}
+
+		if (common == bits)
+		{
+			/* The new prefix goes between this node and its parent */
+			leaf = ip_trie_node_create(key, bits);
+			if (!leaf)
+				return NULL;
+			leaf->child[ip_trie_bit(node->key, bits)] = node;
+			*link = leaf;
+			return leaf;
+		}
+
+		/* They differ after common bits, branch there */
+		leaf = ip_trie_node_create(key, bits);
+		glue = ip_trie_node_create(key, common);
+		if (!leaf || !glue)
+		{
+			hub_free(leaf);
+			hub_free(glue);
+			return NULL;
+		}
+		glue->child[ip_trie_bit(key, common)] = leaf;
+		glue->child[ip_trie_bit(node->key, common)] = node;
+		*link = glue;
+		return leaf;
+	}
+}
+
+static int ip_trie_node_add(struct ip_trie_node* node, void* value)
+{
+	void** values;
+	size_t capacity;
+
+	if (node->count == node->capacity)
+	{
+		capacity = node->capacity ? node->capacity * 2 : 1;
+		values = hub_realloc(node->values, capacity * sizeof(void*));
+		if (!values)
+			return 0;
+		node->values = values;
+		node->capacity = capacity;
+	}
+	node->values[node->count++] = value;
+	return 1;
+}
+
+/*
+ * Remove value from exactly this prefix, then any nodes no longer needed.
+ * An empty node is pruned even if value was not there.
+ */
+static int ip_trie_delete(struct ip_trie_node** link, const unsigned char* key, unsigned int bits, void* value)
+{
+	struct ip_trie_node** path[IP_TRIE_KEY_SIZE * 8 + 1];
+	struct ip_trie_node* node;
+	size_t depth = 0;
+	size_t n;
+	int found = 0;
+
+	for (;;)
+	{
+		node = *link;
+		if (!node || node->bits > bits || !ip_trie_match(node->key, key, node->bits))
+			return 0;
+		path[depth++] = link;
+		if (node->bits == bits)
+			break;
+		link = &node->child[ip_trie_bit(key, node->bits)];
+	}
+
+	for (n = 0; n < node->count; n++)
+	{
+		if (node->values[n] == value)
+		{
+			node->values[n] = node->values[--node->count];
+			found = 1;
+			break;
+		}
+	}
+
+	while (depth-- > 0)
+	{
+		node = *path[depth];
+		if (node->count || (node->child[0] && node->child[1]))
+			break;
+		*path[depth] = node->child[0] ? node->child[0] : node->child[1];
+		hub_free(node->values);
+		hub_free(node);
+	}
+	return found;
+}
+
+static size_t ip_trie_visit(struct ip_trie_node* node, ip_trie_visit_f visit, void* ptr)
+{
+	size_t count = 0;
+	size_t n;
+
+	if (!node)
+		return 0;
+
+	for (n = 0; n < node->count; n++)
+		visit(ptr, node->values[n]);
+	count += node->count;
+	count += ip_trie_visit(node->child[0], visit, ptr);
+	count += ip_trie_visit(node->child[1], visit, ptr);
+	return count;
+}
+
+struct ip_trie* ip_trie_create()
+{
+	return hub_malloc_zero(sizeof(struct ip_trie));
+}
+
+void ip_trie_destroy(struct ip_trie* trie)
+{
+	if (!trie)
+		return;
+	ip_trie_node_destroy(trie->root[0]);
+	ip_trie_node_destroy(trie->root[1]);
+	hub_free(trie);
+}
+
+int ip_trie_insert(struct ip_trie* trie, struct ip_range* range, void* value)
+{
+	struct ip_trie_prefix prefixes[IP_TRIE_MAX_PREFIXES];
+	struct ip_trie_node* node;
+	size_t count, n;
+	int family;
+
+	count = ip_trie_split(range, &family, prefixes);
+	for (n = 0; n < count; n++)
+	{
+		node = ip_trie_get(&trie->root[family], prefixes[n].key, prefixes[n].bits);
+		if (!node || !ip_trie_node_add(node, value))
+		{
+			/* Undo what was added so far, and any empty node left behind */
+			ip_trie_delete(&trie->root[family], prefixes[n].key, prefixes[n].bits, NULL);
+			while (n-- > 0)
+				ip_trie_delete(&trie->root[family], prefixes[n].key, prefixes[n].bits, value);
+			return 0;
+		}
+	}
+
+	if (count)
+		trie->count++;
+	return count ? 1 : 0;
+}
+
+int ip_trie_remove(struct ip_trie* trie, struct ip_range* range, void* value)
+{
+	struct ip_trie_prefix prefixes[IP_TRIE_MAX_PREFIXES];
+	size_t count, n;
+	int family;
+	int found = 0;
+
+	count = ip_trie_split(range, &family, prefixes);
+	for (n = 0; n < count; n++)
+		found |= ip_trie_delete(&trie->root[family], prefixes[n].key, prefixes[n].bits, value);
+
+	if (found)
+		trie->count--;
+	return found;
+}
+
+void* ip_trie_lookup(struct ip_trie* trie, struct ip_addr_encap* addr)
+{
+	unsigned char key[IP_TRIE_KEY_SIZE];
+	struct ip_trie_node* node;
+	void* found = NULL;
+	int family = ip_trie_key(addr, key);
+	unsigned int width;
+
+	if (family == -1)
+		return NULL;
+
+	width = ip_trie_width(family);
+
+	for (node = trie->root[family]; node && ip_trie_match(node->key, key, node->bits); node = node->child[ip_trie_bit(key, node->bits)])
+	{
+		if (node->count)
+			found = node->values[0];
+		if (node->bits == width)
+			break;
+	}
+	return found;
+}
+
+size_t ip_trie_find(struct ip_trie* trie, struct ip_range* range, ip_trie_visit_f visit, void* ptr)
+{
+	struct ip_trie_prefix prefixes[IP_TRIE_MAX_PREFIXES];
+	struct ip_trie_node* node;
+	size_t count, n;
+	size_t found = 0;
+	int family;
+
+	count = ip_trie_split(range, &family, prefixes);
+	for (n = 0; n < count; n++)
+	{
+		/* Find the top of the subtree inside this prefix */
+		for (node = trie->root[family]; node; node = node->child[ip_trie_bit(prefixes[n].key, node->bits)])
+		{
+			if (node->bits >= prefixes[n].bits)
+			{
+				if (ip_trie_match(node->key, prefixes[n].key, prefixes[n].bits))
+					found += ip_trie_visit(node, visit, ptr);
+				break;
+			}
+			if (!ip_trie_match(node->key, prefixes[n].key, node->bits))
+				break;
+		}
+	}
+	return found;
+}
+
+size_t ip_trie_count(struct ip_trie* trie)
+{
+	return trie->count;
+}
@@ -110,5 +110,50 @@ extern void ip_mask_apply_OR(struct ip_addr_encap* address, struct ip_addr_encap
  */
 extern int ip_compare(struct ip_addr_encap* a, struct ip_addr_encap* b);
 
+/**
+ * A radix trie mapping IPv4 and IPv6 address ranges to values,
+ * for looking up which ranges an address is in without scanning them all.
+ *
+ * Values are opaque, non-NULL pointers owned by the caller. The same value
+ * may be stored under several ranges, and several values under the same range.
+ */
+struct ip_trie;
+
+typedef void (*ip_trie_visit_f)(void* ptr, void* value);
+
+extern struct ip_trie* ip_trie_create();
+extern void ip_trie_destroy(struct ip_trie* trie);
+
+/**
+ * Store value for every address in range.
+ * @return 1 on success, 0 if the range is invalid or out of memory.
+ */
+extern int ip_trie_insert(struct ip_trie* trie, struct ip_range* range, void* value);
+
+/**
+ * Remove a value previously stored with exactly the same range.
+ * @return 1 if it was found, 0 otherwise.
+ */
+extern int ip_trie_remove(struct ip_trie* trie, struct ip_range* range, void* value);
+
+/**
+ * @return a value whose range contains addr, preferring the narrowest
+ *         range, or NULL if there is none.
+ */
+extern void* ip_trie_lookup(struct ip_trie* trie, struct ip_addr_encap* addr);
+
+/**
+ * Call visit for every value stored under a range lying inside range.
+ * Meant for tries of single addresses; a value stored under a wider range
+ * may be visited once per part of it that is inside.
+ * @return the number of values visited.
+ */
+extern size_t ip_trie_find(struct ip_trie* trie, struct ip_range* range, ip_trie_visit_f visit, void* ptr);
+
+/**
+ * @return the number of ranges stored.
+ */
+extern size_t ip_trie_count(struct ip_trie* trie);
+
 #endif /* HAVE_UHUB_IPCALC_H */
 
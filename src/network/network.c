@@ -724,6 +724,143 @@ ssize_t net_send(int fd, const void* buf, size_t len, int flags)
 }
 
 
+#ifndef WIN32
+ssize_t net_send_fds(int fd, const void* buf, size_t len, const int* fds, size_t num_fds)
+{
+	struct msghdr hdr;
+	struct iovec iov;
+	struct cmsghdr* cmsg;
+	char control[CMSG_SPACE(sizeof(int) * NET_MAX_PASSED_FDS)];
+	ssize_t ret;
+
+	if (num_fds > NET_MAX_PASSED_FDS)
+		return -1;
+
+	memset(&hdr, 0, sizeof(hdr));
+	memset(control, 0, sizeof(control));
+	iov.iov_base = (void*) buf;
+	iov.iov_len = len;
+	hdr.msg_iov = &iov;
+	hdr.msg_iovlen = 1;
+	hdr.msg_control = control;
+	hdr.msg_controllen = CMSG_SPACE(sizeof(int) * num_fds);
+
+	cmsg = CMSG_FIRSTHDR(&hdr);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(int) * num_fds);
+	memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * num_fds);
+
+	ret = sendmsg(fd, &hdr, UHUB_SEND_SIGNAL);
+	if (ret >= 0)
+		net_stats_add_tx(ret);
+	else if (net_error() != EWOULDBLOCK)
+		net_stats_add_error();
+	return ret;
+}
+
+ssize_t net_recv_fds(int fd, void* buf, size_t len, int* fds, size_t* num_fds)
+{
+	struct msghdr hdr;
+	struct iovec iov;
+	struct cmsghdr* cmsg;
+	char control[CMSG_SPACE(sizeof(int) * NET_MAX_PASSED_FDS)];
+	size_t max_fds = *num_fds;
+	size_t count;
+	size_t n;
+	int* data;
+	ssize_t ret;
+
+	memset(&hdr, 0, sizeof(hdr));
+	iov.iov_base = buf;
+	iov.iov_len = len;
+	hdr.msg_iov = &iov;
+	hdr.msg_iovlen = 1;
+	hdr.msg_control = control;
+	hdr.msg_controllen = sizeof(control);
+
+	*num_fds = 0;
+	ret = recvmsg(fd, &hdr, MSG_CMSG_CLOEXEC);
+	if (ret < 0)
+	{
+		if (net_error() != EWOULDBLOCK)
+			net_stats_add_error();
+		return ret;
+	}
+	net_stats_add_rx(ret);
+
+	for (cmsg = CMSG_FIRSTHDR(&hdr); cmsg; cmsg = CMSG_NXTHDR(&hdr, cmsg))
+	{
+		if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+			continue;
+
+		data = (int*) CMSG_DATA(cmsg);
+		count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+		for (n = 0; n < count; n++)
+		{
+			/* Descriptors that do not fit are closed rather than leaked */
+			if (*num_fds < max_fds)
+				fds[(*num_fds)++] = data[n];
+			else
+				close(data[n]);
+		}
+	}
+	return ret;
+}
+
+int net_connect_unix(const char* path)
+{
+	struct sockaddr_un addr;
+	int sd;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(addr.sun_path))
+	{
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+	strcpy(addr.sun_path, path);
+
+	sd = net_socket_create(AF_UNIX, SOCK_STREAM, 0);
+	if (sd == -1)
+		return -1;
+
+	if (net_set_nonblocking(sd, 1) == -1 || connect(sd, (struct sockaddr*) &addr, sizeof(addr)) == -1)
+	{
+		net_stats_add_error();
+		close(sd);
+		return -1;
+	}
+	return sd;
+}
+
+int net_get_peer_uid(int fd, uid_t* uid)
+{
+#ifdef SO_PEERCRED
+	struct ucred cred;
+	socklen_t len = sizeof(cred);
+	if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) == -1)
+		return -1;
+	*uid = cred.uid;
+	return 0;
+#else
+	gid_t gid;
+	return getpeereid(fd, uid, &gid);
+#endif
+}
+
+int net_is_local_socket(int fd)
+{
+	struct sockaddr_storage storage;
+	socklen_t len = sizeof(storage);
+	if (getsockname(fd, (struct sockaddr*) &storage, &len) == -1)
+		return 0;
+	return storage.ss_family == AF_UNIX;
+}
+#endif /* !WIN32 */
+
+
 int net_bind(int fd, const struct sockaddr *my_addr, socklen_t addrlen)
 {
 	int ret = bind(fd, my_addr, addrlen);
@@ -205,6 +205,43 @@ extern ssize_t net_recv(int fd, void* buf, size_t len, int flags);
  */
 extern ssize_t net_send(int fd, const void* buf, size_t len, int flags);
 
+#ifndef WIN32
+#define NET_MAX_PASSED_FDS 4
+
+/**
+ * Send data with file descriptors attached (SCM_RIGHTS) on a local socket.
+ * The descriptors arrive with the first byte of the data.
+ */
+extern ssize_t net_send_fds(int fd, const void* buf, size_t len, const int* fds, size_t num_fds);
+
+/**
+ * Receive data and any file descriptors passed with it.
+ *
+ * @param num_fds the size of fds, set to the number of descriptors received.
+ *        Descriptors beyond that are closed.
+ */
+extern ssize_t net_recv_fds(int fd, void* buf, size_t len, int* fds, size_t* num_fds);
+
+/**
+ * @return 1 if the socket is a local (AF_UNIX) socket.
+ */
+extern int net_is_local_socket(int fd);
+
+/**
+ * Connect to a unix domain socket. A local connect completes at once,
+ * so this either returns a connected, non-blocking socket or fails.
+ *
+ * @return the socket, or -1 on error.
+ */
+extern int net_connect_unix(const char* path);
+
+/**
+ * Get the user id of the process at the other end of a unix domain socket.
+ * @return 0 on success, -1 on error.
+ */
+extern int net_get_peer_uid(int fd, uid_t* uid);
+#endif
+
 /**
  * This tries to create a AF_INET6 socket.
  * If it succeeds it concludes IPv6 is supported on the host operating
@@ -55,6 +55,10 @@ static void notify_callback(struct net_connection* con, int event, void* ptr)
 		if (handle->callback)
 			handle->callback(handle, handle->ptr);
 	}
+	else
+	{
+		net_con_blocked(con, NET_EVENT_READ);
+	}
 }
 #endif
 
@@ -84,11 +88,11 @@ void net_notify_destroy(struct uhub_notify_handle* handle)
 {
 	LOG_TRACE("net_notify_destroy()");
 #ifndef WIN32
-	net_con_destroy(handle->con);
-	close(handle->pipe_fd[0]);
+	/* Closes the read end, and leaves the backend before the memory is freed */
+	net_con_close(handle->con);
 	close(handle->pipe_fd[1]);
 	handle->pipe_fd[0] = -1;
-	handle->pipe_fd[0] = -1;
+	handle->pipe_fd[1] = -1;
 #endif
 	hub_free(handle);
 }
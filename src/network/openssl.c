@@ -235,6 +235,7 @@ static int handle_openssl_error(struct net_connection* con, int ret, int read)
 			return -1;
 
 		case SSL_ERROR_WANT_READ:
+			net_con_blocked(con, NET_EVENT_READ);
 			if (read)
 				handle->ssl_read_events = NET_EVENT_READ;
 			else
@@ -242,6 +243,7 @@ static int handle_openssl_error(struct net_connection* con, int ret, int read)
 			return 0;
 
 		case SSL_ERROR_WANT_WRITE:
+			net_con_blocked(con, NET_EVENT_WRITE);
 			if (read)
 				handle->ssl_read_events = NET_EVENT_WRITE;
 			else
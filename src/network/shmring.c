@@ -0,0 +1,299 @@
+/*
+ * uhub - A tiny ADC p2p connection hub
+ * Copyright (C) 2007-2014, Jan Vidar Krey
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "uhub.h"
+
+#ifdef USE_SHM_RING
+
+#define SHM_RING_MAGIC  0x75685231 /* "uhR1" */
+#define SHM_RING_HEADER 256
+#define SHM_CACHE_LINE  64
+
+/*
+ * The ring header in shared memory. The producer owns head and the
+ * consumer owns tail, on separate cache lines. A side that is about to
+ * sleep sets its waiting flag and checks the ring again, and the other
+ * side clears the flag and signals after moving its own index.
+ */
+struct shm_ring
+{
+	uint32_t magic;
+	uint32_t size;
+	char     pad0[SHM_CACHE_LINE - 8];
+	uint64_t head;                      /** Bytes written, only moved by the producer */
+	char     pad1[SHM_CACHE_LINE - 8];
+	uint64_t tail;                      /** Bytes read, only moved by the consumer */
+	char     pad2[SHM_CACHE_LINE - 8];
+	uint32_t reader_waiting;
+	uint32_t writer_waiting;
+};
+
+struct shm_link
+{
+	char*             map;
+	size_t            map_size;
+	size_t            size;             /** Size of each ring */
+	struct shm_ring*  tx;
+	char*             tx_data;
+	struct shm_ring*  rx;
+	char*             rx_data;
+	int               memfd;
+	int               efd_local;        /** We wait on this one */
+	int               efd_remote;       /** The peer waits on this one */
+};
+
+static void shm_link_map_rings(struct shm_link* link, int creator)
+{
+	struct shm_ring* first  = (struct shm_ring*) link->map;
+	struct shm_ring* second = (struct shm_ring*) (link->map + SHM_RING_HEADER + link->size);
+
+	link->tx = creator ? first : second;
+	link->rx = creator ? second : first;
+	link->tx_data = (char*) link->tx + SHM_RING_HEADER;
+	link->rx_data = (char*) link->rx + SHM_RING_HEADER;
+}
+
+static void shm_link_close_fds(struct shm_link* link)
+{
+	if (link->memfd != -1)
+		close(link->memfd);
+	if (link->efd_local != -1)
+		close(link->efd_local);
+	if (link->efd_remote != -1)
+		close(link->efd_remote);
+}
+
+struct shm_link* shm_link_create(size_t size)
+{
+	struct shm_link* link;
+	size_t ring_size = SHM_LINK_MIN_SIZE;
+
+	while (ring_size < size && ring_size < SHM_LINK_MAX_SIZE)
+		ring_size *= 2;
+
+	link = hub_malloc_zero(sizeof(struct shm_link));
+	if (!link)
+		return NULL;
+
+	link->size = ring_size;
+	link->map_size = 2 * (SHM_RING_HEADER + ring_size);
+	link->memfd = memfd_create("uhub-shm-link", MFD_CLOEXEC);
+	link->efd_local = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	link->efd_remote = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+	if (link->memfd == -1 || link->efd_local == -1 || link->efd_remote == -1 ||
+		ftruncate(link->memfd, link->map_size) == -1)
+	{
+		LOG_ERROR("Unable to create shared memory link: %s", strerror(errno));
+		shm_link_close_fds(link);
+		hub_free(link);
+		return NULL;
+	}
+
+	link->map = mmap(NULL, link->map_size, PROT_READ | PROT_WRITE, MAP_SHARED, link->memfd, 0);
+	if (link->map == MAP_FAILED)
+	{
+		LOG_ERROR("Unable to map shared memory link: %s", strerror(errno));
+		shm_link_close_fds(link);
+		hub_free(link);
+		return NULL;
+	}
+
+	/* The memfd is zero filled, only the headers need to be set */
+	shm_link_map_rings(link, 1);
+	link->tx->magic = link->rx->magic = SHM_RING_MAGIC;
+	link->tx->size = link->rx->size = (uint32_t) ring_size;
+	return link;
+}
+
+struct shm_link* shm_link_attach(const int* fds)
+{
+	struct shm_link* link;
+	struct shm_ring* ring;
+	struct stat st;
+
+	link = hub_malloc_zero(sizeof(struct shm_link));
+	if (!link)
+	{
+		close(fds[0]);
+		close(fds[1]);
+		close(fds[2]);
+		return NULL;
+	}
+
+	link->memfd = fds[0];
+	link->efd_local = fds[1];
+	link->efd_remote = fds[2];
+	link->map = MAP_FAILED;
+
+	if (fstat(link->memfd, &st) == -1 || st.st_size < 2 * SHM_RING_HEADER + 2 * SHM_LINK_MIN_SIZE ||
+		st.st_size > 2 * SHM_RING_HEADER + 2 * SHM_LINK_MAX_SIZE)
+		goto invalid;
+
+	link->map_size = (size_t) st.st_size;
+	link->map = mmap(NULL, link->map_size, PROT_READ | PROT_WRITE, MAP_SHARED, link->memfd, 0);
+	if (link->map == MAP_FAILED)
+		goto invalid;
+
+	ring = (struct shm_ring*) link->map;
+	link->size = ring->size;
+	if (ring->magic != SHM_RING_MAGIC || (link->size & (link->size - 1)) ||
+		link->map_size != 2 * (SHM_RING_HEADER + link->size))
+		goto invalid;
+
+	shm_link_map_rings(link, 0);
+	if (link->tx->magic != SHM_RING_MAGIC || link->tx->size != link->size)
+		goto invalid;
+
+	return link;
+
+invalid:
+	LOG_ERROR("Invalid shared memory link");
+	if (link->map != MAP_FAILED)
+		munmap(link->map, link->map_size);
+	shm_link_close_fds(link);
+	hub_free(link);
+	return NULL;
+}
+
+void shm_link_destroy(struct shm_link* link)
+{
+	if (!link)
+		return;
+	munmap(link->map, link->map_size);
+	shm_link_close_fds(link);
+	hub_free(link);
+}
+
+void shm_link_get_peer_fds(struct shm_link* link, int* fds)
+{
+	fds[0] = link->memfd;
+	fds[1] = link->efd_remote;
+	fds[2] = link->efd_local;
+}
+
+size_t shm_link_get_size(struct shm_link* link)
+{
+	return link->size;
+}
+
+int shm_link_get_fd(struct shm_link* link)
+{
+	return link->efd_local;
+}
+
+int shm_link_clear(struct shm_link* link)
+{
+	uint64_t value;
+	return read(link->efd_local, &value, sizeof(value)) == sizeof(value);
+}
+
+static void shm_link_signal(int fd)
+{
+	uint64_t value = 1;
+	if (write(fd, &value, sizeof(value)) != sizeof(value) && errno != EAGAIN)
+		LOG_WARN("Unable to signal shared memory link: %s", strerror(errno));
+}
+
+void shm_link_wakeup(struct shm_link* link)
+{
+	shm_link_signal(link->efd_local);
+}
+
+/*
+ * Tell the other side to signal us, then look at the index it moves
+ * once more, so an update made before it could see the flag is not missed.
+ */
+static uint64_t shm_ring_wait(uint32_t* flag, uint64_t* index)
+{
+	__atomic_store_n(flag, 1, __ATOMIC_SEQ_CST);
+	return __atomic_load_n(index, __ATOMIC_SEQ_CST);
+}
+
+static void shm_ring_notify(struct shm_link* link, uint32_t* flag)
+{
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (__atomic_load_n(flag, __ATOMIC_RELAXED) && __atomic_exchange_n(flag, 0, __ATOMIC_SEQ_CST))
+		shm_link_signal(link->efd_remote);
+}
+
+size_t shm_link_write(struct shm_link* link, const void* buf, size_t len)
+{
+	struct shm_ring* ring = link->tx;
+	uint64_t head = ring->head;
+	uint64_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+	size_t used = (size_t) (head - tail);
+	size_t offset;
+	size_t first;
+
+	if (used >= link->size)
+	{
+		tail = shm_ring_wait(&ring->writer_waiting, &ring->tail);
+		used = (size_t) (head - tail);
+		if (used >= link->size)
+			return 0;
+	}
+
+	len = MIN(len, link->size - used);
+	offset = (size_t) (head & (link->size - 1));
+	first = MIN(len, link->size - offset);
+	memcpy(link->tx_data + offset, buf, first);
+	memcpy(link->tx_data, (const char*) buf + first, len - first);
+
+	__atomic_store_n(&ring->head, head + len, __ATOMIC_RELEASE);
+	shm_ring_notify(link, &ring->reader_waiting);
+	return len;
+}
+
+size_t shm_link_readable(struct shm_link* link)
+{
+	struct shm_ring* ring = link->rx;
+	uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+
+	if (head == ring->tail)
+		head = shm_ring_wait(&ring->reader_waiting, &ring->head);
+	return (size_t) (head - ring->tail);
+}
+
+ssize_t shm_link_read(struct shm_link* link, void* buf, size_t len)
+{
+	struct shm_ring* ring = link->rx;
+	uint64_t tail = ring->tail;
+	size_t available = shm_link_readable(link);
+	size_t offset;
+	size_t first;
+
+	if (available > link->size)
+		return -1;
+
+	len = MIN(len, available);
+	if (!len)
+		return 0;
+
+	offset = (size_t) (tail & (link->size - 1));
+	first = MIN(len, link->size - offset);
+	memcpy(buf, link->rx_data + offset, first);
+	memcpy((char*) buf + first, link->rx_data, len - first);
+
+	__atomic_store_n(&ring->tail, tail + len, __ATOMIC_RELEASE);
+	shm_ring_notify(link, &ring->writer_waiting);
+	return (ssize_t) len;
+}
+
+#endif /* USE_SHM_RING */
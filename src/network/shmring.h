@@ -0,0 +1,124 @@
+/*
+ * uhub - A tiny ADC p2p connection hub
+ * Copyright (C) 2007-2014, Jan Vidar Krey
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef HAVE_UHUB_NETWORK_SHM_RING_H
+#define HAVE_UHUB_NETWORK_SHM_RING_H
+
+#ifdef USE_SHM_RING
+
+/*
+ * A shared memory link between two processes on the same host.
+ *
+ * The link is a memfd holding two single producer, single consumer byte
+ * rings, one for each direction, and carries a byte stream like a socket
+ * does. Each side has an eventfd it waits on, which the other side only
+ * signals when the waiting side has said it is about to sleep, either on
+ * an empty ring (reading) or on a full ring (writing). A busy link is
+ * therefore passed without any system calls.
+ *
+ * The side that creates the link hands the memfd and the eventfds to the
+ * other side over a local socket, see shm_link_get_peer_fds() and
+ * net_send_fds().
+ */
+
+#define SHM_LINK_MIN_SIZE     (64 * 1024)
+#define SHM_LINK_MAX_SIZE     (64 * 1024 * 1024)
+#define SHM_LINK_DEFAULT_SIZE (1024 * 1024)
+#define SHM_LINK_PEER_FDS     3
+
+struct shm_link;
+
+/**
+ * Create a link with rings of the given size in each direction.
+ * The size is rounded up to a power of two between SHM_LINK_MIN_SIZE
+ * and SHM_LINK_MAX_SIZE.
+ *
+ * @return a link, or NULL on error.
+ */
+extern struct shm_link* shm_link_create(size_t size);
+
+/**
+ * Attach to a link created by the peer, from the descriptors returned
+ * by shm_link_get_peer_fds(). The descriptors are owned by the link
+ * afterwards, and closed if attaching fails.
+ *
+ * @return a link, or NULL if the memory does not hold a valid link.
+ */
+extern struct shm_link* shm_link_attach(const int* fds);
+
+/**
+ * Unmap the link and close its descriptors.
+ */
+extern void shm_link_destroy(struct shm_link*);
+
+/**
+ * Get the descriptors for the peer (SHM_LINK_PEER_FDS of them).
+ * They are still owned by the link.
+ */
+extern void shm_link_get_peer_fds(struct shm_link*, int* fds);
+
+/**
+ * @return the size of each ring.
+ */
+extern size_t shm_link_get_size(struct shm_link*);
+
+/**
+ * @return the eventfd to wait on for reading, and for room to write
+ *         after a short write. It is non-blocking.
+ */
+extern int shm_link_get_fd(struct shm_link*);
+
+/**
+ * Reset the eventfd after it has become readable.
+ * @return 1 if it was signalled, 0 otherwise.
+ */
+extern int shm_link_clear(struct shm_link*);
+
+/**
+ * Signal our own eventfd, to come back to a ring that still has data.
+ */
+extern void shm_link_wakeup(struct shm_link*);
+
+/**
+ * Write up to len bytes to the ring.
+ * If the ring is full, the peer is asked to signal once it has read.
+ *
+ * @return the number of bytes written, 0 if the ring is full.
+ */
+extern size_t shm_link_write(struct shm_link*, const void* buf, size_t len);
+
+/**
+ * Read up to len bytes from the ring.
+ * If the ring is empty, the peer is asked to signal once it has written.
+ *
+ * @return the number of bytes read, 0 if the ring is empty,
+ *         or -1 if the peer has corrupted the ring.
+ */
+extern ssize_t shm_link_read(struct shm_link*, void* buf, size_t len);
+
+/**
+ * @return the number of bytes that can be read.
+ * If the ring is empty, the peer is asked to signal once it has written,
+ * as for shm_link_read().
+ */
+extern size_t shm_link_readable(struct shm_link*);
+
+#endif /* USE_SHM_RING */
+
+#endif /* HAVE_UHUB_NETWORK_SHM_RING_H */
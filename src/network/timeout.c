@@ -13,24 +13,80 @@
  * GNU General Public License for more details.
  *
  * You should have received a copy of the GNU General Public License
- * along wtimeout_evtith this program.  If not, see <http://www.gnu.org/licenses/>.
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  *
  */
 
+
 #include "uhub.h"
 
+#define WHEEL_SHIFT(level)       ((level) * TIMEOUT_WHEEL_BITS)
+#define WHEEL_SPAN(level)        (((uint64_t) 1) << WHEEL_SHIFT(level))
+#define WHEEL_INDEX(time, level) ((int) (((time) >> WHEEL_SHIFT(level)) & TIMEOUT_WHEEL_MASK))
+#define WHEEL_RANGE              WHEEL_SPAN(TIMEOUT_WHEEL_LEVELS)
+
+/* The per-level bitmaps are 64 bits wide, one bit per slot. */
+#if TIMEOUT_WHEEL_SIZE != 64
+#error "TIMEOUT_WHEEL_BITS must be 6"
+#endif
+
+static int bitmap_first(uint64_t bits)
+{
+#if defined(__GNUC__)
+	return __builtin_ctzll(bits);
+#else
+	int n = 0;
+	while (!(bits & 1))
+	{
+		bits >>= 1;
+		n++;
+	}
+	return n;
+#endif
+}
+
+static uint64_t bitmap_rotate(uint64_t bits, int n)
+{
+	if (!n)
+		return bits;
+	return (bits >> n) | (bits << (64 - n));
+}
+
+static void evt_list_init(struct timeout_evt* head)
+{
+	head->next = head;
+	head->prev = head;
+}
+
+static void evt_list_append(struct timeout_evt* head, struct timeout_evt* evt)
+{
+	evt->prev = head->prev;
+	evt->next = head;
+	head->prev->next = evt;
+	head->prev = evt;
+}
+
+static void evt_list_unlink(struct timeout_evt* evt)
+{
+	evt->prev->next = evt->next;
+	evt->next->prev = evt->prev;
+}
+
 void timeout_evt_initialize(struct timeout_evt* t, timeout_evt_cb cb, void* ptr)
 {
+	t->timestamp = 0;
 	t->callback = cb;
 	t->ptr = ptr;
 	t->prev = 0;
 	t->next = 0;
+	t->slot = -1;
 }
 
 void timeout_evt_reset(struct timeout_evt* t)
 {
 	t->prev = 0;
 	t->next = 0;
+	t->slot = -1;
 }
 
 int timeout_evt_is_scheduled(struct timeout_evt* t)
@@ -38,226 +94,247 @@ int timeout_evt_is_scheduled(struct timeout_evt* t)
 	return t->prev != NULL;
 }
 
-void timeout_queue_initialize(struct timeout_queue* t, time_t now, size_t max)
-{
-	t->last = now;
-	t->max = max;
-	memset(&t->lock, 0, sizeof(t->lock));
-	t->events = hub_malloc_zero(max * sizeof(struct timeout_evt*));
-}
-
-void timeout_queue_shutdown(struct timeout_queue* t)
+void timeout_queue_initialize(struct timeout_queue* t, uint64_t now)
 {
-	hub_free(t->events);
-	t->events = 0;
-	t->max = 0;
+	size_t n;
+	memset(t, 0, sizeof(struct timeout_queue));
+	t->now = now;
+	evt_list_init(&t->lock);
+	for (n = 0; n < TIMEOUT_WHEEL_LEVELS * TIMEOUT_WHEEL_SIZE; n++)
+		evt_list_init(&t->slots[n]);
 }
 
-static int timeout_queue_locked(struct timeout_queue* t)
+static void timeout_queue_link(struct timeout_queue* t, struct timeout_evt* evt)
 {
-	return t->lock.ptr != NULL;
-}
+	uint64_t expires = evt->timestamp;
+	uint64_t delta = expires > t->now ? expires - t->now : 0;
+	int level = 0;
+	int index;
 
-static void timeout_queue_lock(struct timeout_queue* t)
-{
-	t->lock.ptr = t;
-}
-
-// unlock and flush the locked events to the main timeout queue.
-static void timeout_queue_unlock(struct timeout_queue* t)
-{
-	struct timeout_evt* evt, *tmp, *first;
-	size_t pos;
-	t->lock.ptr = NULL;
-
-	evt = t->lock.next;
-	while (evt)
+	if (!delta)
 	{
-		tmp = evt->next;
-		pos = evt->timestamp % t->max;
-		first = t->events[pos];
-		if (first)
-		{
-			first->prev->next = evt;
-			evt->prev = first->prev;
-			first->prev = evt;
-		}
-		else
-		{
-			t->events[pos] = evt;
-			evt->prev = evt;
-		}
-		evt->next = 0;
-		evt = tmp;
+		/* Already expired, run it the next time the wheel is processed. */
+		expires = t->now;
+	}
+	else if (delta >= WHEEL_RANGE)
+	{
+		/* Park it in the furthest slot, it is re-inserted when cascaded. */
+		delta = WHEEL_RANGE - 1;
+		expires = t->now + delta;
 	}
 
-	t->lock.next = 0;
-	t->lock.prev = 0;
-}
+	while (level < TIMEOUT_WHEEL_LEVELS - 1 && delta >= WHEEL_SPAN(level + 1))
+		level++;
 
+	index = WHEEL_INDEX(expires, level);
+	evt->slot = level * TIMEOUT_WHEEL_SIZE + index;
+	evt_list_append(&t->slots[evt->slot], evt);
+	t->bitmap[level] |= ((uint64_t) 1) << index;
+	t->count++;
+}
 
-size_t timeout_queue_process(struct timeout_queue* t, time_t now)
+static void timeout_queue_unlink(struct timeout_queue* t, struct timeout_evt* evt)
 {
-	size_t pos = (size_t) t->last;
-	size_t events = 0;
-	struct timeout_evt* evt = 0;
-	t->last = now;
-	timeout_queue_lock(t);
-	for (; pos <= now; pos++)
+	struct timeout_evt* head;
+	evt_list_unlink(evt);
+	if (evt->slot >= 0)
 	{
-		while ((evt = t->events[pos % t->max]))
-		{
-			timeout_queue_remove(t, evt);
-			evt->callback(evt);
-			events++;
-		}
+		head = &t->slots[evt->slot];
+		if (head->next == head)
+			t->bitmap[evt->slot / TIMEOUT_WHEEL_SIZE] &= ~(((uint64_t) 1) << (evt->slot & TIMEOUT_WHEEL_MASK));
+		t->count--;
 	}
-	timeout_queue_unlock(t);
-	return events;
+	timeout_evt_reset(evt);
 }
 
-size_t timeout_queue_get_next_timeout(struct timeout_queue* t, time_t now)
+void timeout_queue_shutdown(struct timeout_queue* t)
 {
-	size_t seconds = 0;
-	while (t->events[(now + seconds) % t->max] == NULL && seconds < t->max)
+	size_t n;
+	for (n = 0; n < TIMEOUT_WHEEL_LEVELS * TIMEOUT_WHEEL_SIZE; n++)
 	{
-		seconds++;
+		while (t->slots[n].next != &t->slots[n])
+			timeout_queue_unlink(t, t->slots[n].next);
 	}
-	if (seconds == 0)
-		return 1;
-	return seconds;
+	while (t->lock.next != &t->lock)
+		timeout_queue_unlink(t, t->lock.next);
 }
 
-static void timeout_queue_insert_locked(struct timeout_queue* t, struct timeout_evt* evt)
+/*
+ * Move all events in the given slot to lower levels, now that the
+ * wheel has reached the start of that slot.
+ */
+static void timeout_queue_cascade(struct timeout_queue* t, int level, int index)
 {
-	/* All events point back to the sentinel.
-	 * this means the event is considered schedule (see timeout_evt_is_scheduled),
-	 * and it is easy to tell if the event is in the wait queue or not.
-	 */
-	evt->prev = &t->lock;
-	evt->next = NULL;
-
-	// The sentinel next points to the first event in the locked queue
-	// The sentinel prev points to the last evetnt in the locked queue.
-	// NOTE: if prev is != NULL then next also must be != NULL.
-	if (t->lock.prev)
-	{
-		t->lock.prev->next = evt;
-		t->lock.prev = evt;
-	}
-	else
+	struct timeout_evt* head = &t->slots[level * TIMEOUT_WHEEL_SIZE + index];
+	struct timeout_evt tmp;
+
+	if (head->next == head)
+		return;
+
+	tmp.next = head->next;
+	tmp.prev = head->prev;
+	tmp.next->prev = &tmp;
+	tmp.prev->next = &tmp;
+	evt_list_init(head);
+	t->bitmap[level] &= ~(((uint64_t) 1) << index);
+
+	while (tmp.next != &tmp)
 	{
-		t->lock.next = evt;
-		t->lock.prev = evt;
+		struct timeout_evt* evt = tmp.next;
+		evt_list_unlink(evt);
+		t->count--;
+		timeout_queue_link(t, evt);
 	}
-	return;
 }
 
-static void timeout_queue_remove_locked(struct timeout_queue* t, struct timeout_evt* evt)
+/*
+ * Advance the wheel towards 'target', skipping over time where nothing
+ * can expire, and cascade higher levels when reaching their slot boundaries.
+ */
+static void timeout_queue_advance(struct timeout_queue* t, uint64_t target)
 {
-	uhub_assert(evt->prev == &t->lock);
-	if (t->lock.next == evt)
+	uint64_t next;
+	uint64_t pending;
+	int level = 0;
+	int index;
+
+	while (level < TIMEOUT_WHEEL_LEVELS && !t->bitmap[level])
+		level++;
+
+	if (level == TIMEOUT_WHEEL_LEVELS)
 	{
-		t->lock.next = evt->next;
-		if (t->lock.prev == evt)
-			t->lock.prev = evt->next;
+		next = target;
+	}
+	else if (level == 0)
+	{
+		index = WHEEL_INDEX(t->now, 0);
+		pending = t->bitmap[0] & ~((((uint64_t) 2) << index) - 1);
+		if (pending)
+			next = t->now - index + bitmap_first(pending);
+		else
+			next = (t->now | TIMEOUT_WHEEL_MASK) + 1;
 	}
 	else
 	{
-		struct timeout_evt *prev, *it;
-		prev = 0;
-		it = t->lock.next;
-		while (it)
-		{
-			prev = it;
-			it = it->next;
-			if (it == evt)
-			{
-				prev->next = it->next;
-				if (!prev->next)
-					t->lock.prev = prev;
-			}
-		}
+		next = ((t->now >> WHEEL_SHIFT(level)) + 1) << WHEEL_SHIFT(level);
 	}
-	timeout_evt_reset(evt);
-}
-
 
+	if (next > target)
+		next = target;
+	t->now = next;
 
-void timeout_queue_insert(struct timeout_queue* t, struct timeout_evt* evt, size_t seconds)
-{
-	struct timeout_evt* first;
-	size_t pos = ((t->last + seconds) % t->max);
-	evt->timestamp = t->last + seconds;
-	evt->next = 0;
-
-	if (timeout_queue_locked(t))
+	for (level = 1; level < TIMEOUT_WHEEL_LEVELS; level++)
 	{
-		timeout_queue_insert_locked(t, evt);
-		return;
+		if (t->now & (WHEEL_SPAN(level) - 1))
+			break;
+		timeout_queue_cascade(t, level, WHEEL_INDEX(t->now, level));
 	}
+}
 
-	first = t->events[pos];
+size_t timeout_queue_process(struct timeout_queue* t, uint64_t now)
+{
+	size_t events = 0;
+	struct timeout_evt* head;
+	struct timeout_evt* evt;
 
-	if (first)
+	t->locked = 1;
+	for (;;)
 	{
-		uhub_assert(first->timestamp == evt->timestamp);
-		first->prev->next = evt;
-		evt->prev = first->prev;
-		first->prev = evt;
+		head = &t->slots[WHEEL_INDEX(t->now, 0)];
+		while ((evt = head->next) != head)
+		{
+			timeout_queue_unlink(t, evt);
+			evt->callback(evt);
+			events++;
+		}
+
+		if (t->now >= now)
+			break;
+		timeout_queue_advance(t, now);
 	}
-	else
+	t->locked = 0;
+
+	// flush events that were scheduled by the callbacks.
+	while ((evt = t->lock.next) != &t->lock)
 	{
-		t->events[pos] = evt;
-		evt->prev = evt;
+		evt_list_unlink(evt);
+		timeout_queue_link(t, evt);
 	}
-	evt->next = 0;
+	return events;
 }
 
-void timeout_queue_remove(struct timeout_queue* t, struct timeout_evt* evt)
+size_t timeout_queue_get_next_timeout(struct timeout_queue* t, uint64_t now)
 {
-	size_t pos = (evt->timestamp % t->max);
-	struct timeout_evt* first = t->events[pos];
+	uint64_t next = 0;
+	uint64_t when;
+	int found = 0;
+	int level;
+	int index;
 
-	// Removing a locked event
-	if (evt->prev == &t->lock)
+	for (level = 0; level < TIMEOUT_WHEEL_LEVELS; level++)
 	{
-		timeout_queue_remove_locked(t, evt);
-		return;
-	}
-
-	if (!first || !evt->prev)
-		return;
+		if (!t->bitmap[level])
+			continue;
 
-	if (first == evt)
-	{
-		if (first->prev != first)
+		index = WHEEL_INDEX(t->now, level);
+		if (level == 0)
 		{
-			t->events[pos] = first->next;
-			t->events[pos]->prev = evt->prev;
+			when = t->now + bitmap_first(bitmap_rotate(t->bitmap[0], index));
 		}
 		else
 		{
-			t->events[pos] = 0;
+			/* The current slot of a level is not cascaded again until a full turn later. */
+			when = bitmap_first(bitmap_rotate(t->bitmap[level], (index + 1) & TIMEOUT_WHEEL_MASK)) + 1;
+			when = ((t->now >> WHEEL_SHIFT(level)) + when) << WHEEL_SHIFT(level);
 		}
+
+		if (!found || when < next)
+			next = when;
+		found = 1;
 	}
-	else if (evt == first->prev)
-	{
-		first->prev = evt->prev;
-		evt->prev->next = 0;
-	}
-	else
+
+	if (!found)
+		return TIMEOUT_QUEUE_MAX_WAIT;
+	if (next <= now)
+		return 0;
+	if (next - now > TIMEOUT_QUEUE_MAX_WAIT)
+		return TIMEOUT_QUEUE_MAX_WAIT;
+	return (size_t) (next - now);
+}
+
+void timeout_queue_insert_ms(struct timeout_queue* t, struct timeout_evt* evt, uint64_t ms)
+{
+	evt->timestamp = t->now + ms;
+
+	if (t->locked)
 	{
-		evt->prev->next = evt->next;
-		evt->next->prev = evt->prev;
+		evt->slot = -1;
+		evt_list_append(&t->lock, evt);
+		return;
 	}
-	timeout_evt_reset(evt);
+	timeout_queue_link(t, evt);
 }
 
-void timeout_queue_reschedule(struct timeout_queue* t, struct timeout_evt* evt, size_t seconds)
+void timeout_queue_insert(struct timeout_queue* t, struct timeout_evt* evt, size_t seconds)
+{
+	timeout_queue_insert_ms(t, evt, ((uint64_t) seconds) * 1000);
+}
+
+void timeout_queue_remove(struct timeout_queue* t, struct timeout_evt* evt)
+{
+	if (!timeout_evt_is_scheduled(evt))
+		return;
+	timeout_queue_unlink(t, evt);
+}
+
+void timeout_queue_reschedule_ms(struct timeout_queue* t, struct timeout_evt* evt, uint64_t ms)
 {
 	if (timeout_evt_is_scheduled(evt))
 		timeout_queue_remove(t, evt);
-	timeout_queue_insert(t, evt, seconds);
+	timeout_queue_insert_ms(t, evt, ms);
 }
 
+void timeout_queue_reschedule(struct timeout_queue* t, struct timeout_evt* evt, size_t seconds)
+{
+	timeout_queue_reschedule_ms(t, evt, ((uint64_t) seconds) * 1000);
+}
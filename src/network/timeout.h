@@ -20,6 +20,27 @@
 #ifndef HAVE_UHUB_TIMEOUT_HANDLER_H
 #define HAVE_UHUB_TIMEOUT_HANDLER_H
 
+/**
+ * Hierarchical timing wheel.
+ *
+ * Time is measured in milliseconds. Level 0 has one slot per millisecond,
+ * and every following level has slots that are TIMEOUT_WHEEL_SIZE times wider.
+ * Events are moved (cascaded) one level down whenever the wheel passes
+ * the start of their slot. Insert and remove are O(1), and there is no
+ * upper bound on the timeout; events beyond the range of the top level are
+ * parked in its furthest slot and re-inserted when cascaded.
+ */
+#define TIMEOUT_WHEEL_BITS   6
+#define TIMEOUT_WHEEL_SIZE   (1 << TIMEOUT_WHEEL_BITS)
+#define TIMEOUT_WHEEL_MASK   (TIMEOUT_WHEEL_SIZE - 1)
+#define TIMEOUT_WHEEL_LEVELS 6
+
+/**
+ * Maximum wait returned by timeout_queue_get_next_timeout() when
+ * nothing is scheduled.
+ */
+#define TIMEOUT_QUEUE_MAX_WAIT 60000
+
 struct timeout_evt;
 struct timeout_queue;
 
@@ -27,11 +48,12 @@ typedef void (*timeout_evt_cb)(struct timeout_evt*);
 
 struct timeout_evt
 {
-	time_t timestamp;
+	uint64_t timestamp; /**<< "Expiry time in milliseconds" */
 	timeout_evt_cb callback;
 	void* ptr;
 	struct timeout_evt* prev;
 	struct timeout_evt* next;
+	int slot; /**<< "Wheel slot the event is linked into, or -1 if deferred" */
 };
 
 void timeout_evt_initialize(struct timeout_evt*, timeout_evt_cb, void* ptr);
@@ -41,19 +63,38 @@ int  timeout_evt_is_scheduled(struct timeout_evt*);
 
 struct timeout_queue
 {
-	time_t last;
-	size_t max;
-	struct timeout_evt lock;
-	struct timeout_evt** events;
+	uint64_t now; /**<< "Time (ms) up to which the wheel has been processed" */
+	int locked; /**<< "Set while processing, inserts are deferred" */
+	struct timeout_evt lock; /**<< "List of deferred events" */
+	struct timeout_evt slots[TIMEOUT_WHEEL_LEVELS * TIMEOUT_WHEEL_SIZE]; /**<< "List heads for each slot" */
+	uint64_t bitmap[TIMEOUT_WHEEL_LEVELS]; /**<< "Non-empty slots per level" */
+	size_t count; /**<< "Number of events in the wheel" */
 };
 
-void timeout_queue_initialize(struct timeout_queue*, time_t now, size_t max);
+void timeout_queue_initialize(struct timeout_queue*, uint64_t now);
 void timeout_queue_shutdown(struct timeout_queue*);
-size_t timeout_queue_process(struct timeout_queue*, time_t now);
+
+/**
+ * Advance the wheel to 'now' (milliseconds) and invoke the callback of all
+ * events that expire on or before that time.
+ * Events scheduled from within a callback are not run until the next call.
+ *
+ * @return the number of events triggered.
+ */
+size_t timeout_queue_process(struct timeout_queue*, uint64_t now);
+
 void timeout_queue_insert(struct timeout_queue*, struct timeout_evt*, size_t seconds);
+void timeout_queue_insert_ms(struct timeout_queue*, struct timeout_evt*, uint64_t ms);
 void timeout_queue_remove(struct timeout_queue*, struct timeout_evt*);
 void timeout_queue_reschedule(struct timeout_queue*, struct timeout_evt*, size_t seconds);
+void timeout_queue_reschedule_ms(struct timeout_queue*, struct timeout_evt*, uint64_t ms);
 
-size_t timeout_queue_get_next_timeout(struct timeout_queue*, time_t now);
+/**
+ * Returns the number of milliseconds from 'now' until the wheel needs to be
+ * processed again, which is never later than the next event expires.
+ * Returns 0 if an event is already due, or TIMEOUT_QUEUE_MAX_WAIT if
+ * nothing is scheduled.
+ */
+size_t timeout_queue_get_next_timeout(struct timeout_queue*, uint64_t now);
 
 #endif /* HAVE_UHUB_TIMEOUT_HANDLER_H */
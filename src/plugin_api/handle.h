@@ -50,10 +50,10 @@ typedef plugin_st (*on_validate_nick_t)(struct plugin_handle*, const char* nick)
 typedef plugin_st (*on_validate_cid_t)(struct plugin_handle*, const char* cid);
 typedef plugin_st (*on_change_nick_t)(struct plugin_handle*, struct plugin_user*, const char* new_nick);
 
-typedef plugin_st (*on_chat_msg_t)(struct plugin_handle*, struct plugin_user* from, const char* message);
-typedef plugin_st (*on_private_msg_t)(struct plugin_handle*, struct plugin_user* from, struct plugin_user* to, const char* message);
-typedef plugin_st (*on_search_t)(struct plugin_handle*, struct plugin_user* from, const char* data);
-typedef plugin_st (*on_search_result_t)(struct plugin_handle*, struct plugin_user* from, struct plugin_user* to, const char* data);
+typedef plugin_st (*on_chat_msg_t)(struct plugin_handle*, struct plugin_user* from, const struct plugin_message_view* message);
+typedef plugin_st (*on_private_msg_t)(struct plugin_handle*, struct plugin_user* from, struct plugin_user* to, const struct plugin_message_view* message);
+typedef plugin_st (*on_search_t)(struct plugin_handle*, struct plugin_user* from, const struct plugin_message_view* search);
+typedef plugin_st (*on_search_result_t)(struct plugin_handle*, struct plugin_user* from, struct plugin_user* to, const struct plugin_message_view* result);
 typedef plugin_st (*on_p2p_connect_t)(struct plugin_handle*, struct plugin_user* from, struct plugin_user* to);
 typedef plugin_st (*on_p2p_revconnect_t)(struct plugin_handle*, struct plugin_user* from, struct plugin_user* to);
 
@@ -108,10 +108,17 @@ struct plugin_funcs
 struct plugin_command_handle;
 struct plugin_command;
 struct plugin_command_arg_data;
+struct plugin_message;
 
 typedef int (*hfunc_send_message)(struct plugin_handle*, struct plugin_user* user, const char* message);
 typedef int (*hfunc_send_broadcast_message)(struct plugin_handle*, const char* message);
 typedef int (*hfunc_send_status)(struct plugin_handle*, struct plugin_user* to, int code, const char* message);
+typedef struct plugin_message* (*hfunc_message_create)(struct plugin_handle*, const char* message);
+typedef int (*hfunc_send_prepared_message)(struct plugin_handle*, struct plugin_user* user, struct plugin_message* message);
+typedef void (*hfunc_message_release)(struct plugin_handle*, struct plugin_message* message);
+typedef const char* (*hfunc_message_get_argument)(struct plugin_handle*, const struct plugin_message_view* message, size_t index, size_t* length);
+typedef const char* (*hfunc_message_get_named_argument)(struct plugin_handle*, const struct plugin_message_view* message, const char* prefix, size_t* length);
+typedef const char* (*hfunc_message_get_text)(struct plugin_handle*, const struct plugin_message_view* message);
 typedef int (*hfunc_user_disconnect)(struct plugin_handle*, struct plugin_user* user);
 typedef int (*hfunc_command_add)(struct plugin_handle*, struct plugin_command_handle*);
 typedef int (*hfunc_command_del)(struct plugin_handle*, struct plugin_command_handle*);
@@ -126,6 +133,9 @@ typedef void  (*hfunc_set_hub_name)(struct plugin_handle*, const char*);
 typedef char* (*hfunc_get_hub_description)(struct plugin_handle*);
 typedef void  (*hfunc_set_hub_description)(struct plugin_handle*, const char*);
 
+typedef struct plugin_async* (*hfunc_async_defer)(struct plugin_handle*);
+typedef void (*hfunc_async_complete)(struct plugin_handle*, struct plugin_async*, plugin_st status);
+
 /**
  * These are functions created and initialized by the hub and which can be used
  * by plugins to access functionality internal to the hub.
@@ -145,6 +155,57 @@ struct plugin_hub_funcs
 	hfunc_set_hub_name set_name;
 	hfunc_get_hub_description get_description;
 	hfunc_set_hub_description set_description;
+
+	/*
+	 * Answering a hook later (API version 2).
+	 *
+	 * A hook that cannot answer right away, typically because it has to
+	 * wait for a database or another server, calls async_defer() and
+	 * returns st_pending. The hook's arguments stay valid, and the hub
+	 * waits without blocking, until the plugin calls async_complete()
+	 * with the answer, exactly once. async_complete() may be called from
+	 * any thread; the hub picks the answer up in its event loop.
+	 *
+	 * async_defer() returns NULL if the hook being called cannot be
+	 * answered later, and the plugin must then answer right away.
+	 * Currently only auth_get_user can be answered later, when it is
+	 * called for a user logging in.
+	 *
+	 * A plugin must complete all its deferred hooks before
+	 * plugin_unregister() returns.
+	 */
+	hfunc_async_defer async_defer;
+	hfunc_async_complete async_complete;
+
+	/*
+	 * Sending the same message to many users (API version 2).
+	 *
+	 * message_create() prepares a message like send_message() would send
+	 * it. It can be sent with send_prepared_message() as often as needed,
+	 * without being copied, until the plugin releases it. The hub keeps
+	 * its own reference while the message is queued for a user.
+	 */
+	hfunc_message_create message_create;
+	hfunc_send_prepared_message send_prepared_message;
+	hfunc_message_release message_release;
+
+	/*
+	 * Looking into a message passed to a hook (API version 2).
+	 *
+	 * message_get_argument() finds an argument by position, counting
+	 * from the first one after the command and SIDs.
+	 * message_get_named_argument() finds the first argument starting
+	 * with the two letter prefix, and returns what follows the prefix.
+	 * Both point into the message, escaped and not terminated, and
+	 * return NULL if there is no such argument.
+	 *
+	 * message_get_text() returns the first argument unescaped, which is
+	 * the text of a chat message. It is only unescaped the first time
+	 * it is asked for, and stays valid during the hook.
+	 */
+	hfunc_message_get_argument message_get_argument;
+	hfunc_message_get_named_argument message_get_named_argument;
+	hfunc_message_get_text message_get_text;
 };
 
 struct plugin_handle
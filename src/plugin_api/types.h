@@ -20,7 +20,7 @@
 #ifndef HAVE_UHUB_PLUGIN_TYPES_H
 #define HAVE_UHUB_PLUGIN_TYPES_H
 
-#define PLUGIN_API_VERSION 1
+#define PLUGIN_API_VERSION 2
 
 #ifndef MAX_NICK_LEN
 #define MAX_NICK_LEN 64
@@ -44,6 +44,7 @@ typedef uint32_t sid_t;
 #endif
 
 struct plugin_handle;
+struct plugin_async;
 
 struct plugin_user
 {
@@ -55,6 +56,22 @@ struct plugin_user
 	enum auth_credentials credentials;
 };
 
+/**
+ * A message from a user, as passed to the hooks that can stop it.
+ * It is only valid during the hook, and must not be modified.
+ *
+ * Arguments are as sent, escaped. Use the hub's message_get_* functions
+ * to find them without copying, or to get the text unescaped.
+ */
+struct plugin_message_view
+{
+	char command[5];                /* Such as "BSCH" or "DMSG" */
+	struct plugin_user* from;
+	struct plugin_user* to;         /* NULL unless sent to one user */
+	const char* data;               /* The whole message, not terminated */
+	size_t length;
+};
+
 struct plugin_hub_info
 {
 	const char* description;
@@ -65,6 +82,7 @@ enum plugin_status
 	st_default = 0,    /* Use default */
 	st_allow = 1,      /* Allow action */
 	st_deny = -1,      /* Deny action */
+	st_pending = 2,    /* Decided later, see plugin_hub_funcs::async_defer */
 };
 
 typedef enum plugin_status plugin_st;
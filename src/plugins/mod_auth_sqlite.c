@@ -24,60 +24,114 @@
 #include "util/misc.h"
 #include "util/log.h"
 #include "util/config_token.h"
+#include "util/hashtable.h"
+#include "util/threads.h"
 
 // #define DEBUG_SQL
 
+/*
+ * Recently used users, and recently looked up nicknames that are not
+ * registered, are kept in a cache, so most lookups never reach the
+ * database. The cache is limited to a number of entries, the least
+ * recently used are dropped first. Entries expire after a while, so
+ * changes made with uhub-passwd while the hub runs are picked up.
+ *
+ * Everything else is done by a worker thread, with its own connection
+ * to the database, in the order it was asked for:
+ * - users logging in that are not cached are looked up, and the hub is
+ *   told the answer later (see plugin_hub_funcs::async_defer).
+ * - users are registered, updated and deleted. Whether the user is
+ *   registered is checked before the write is queued, so the write
+ *   cannot be refused by the database. The cache is updated right away,
+ *   and holds on to the entry until it is written, so the hub sees the
+ *   change before it reaches the database.
+ *
+ * The cache is shared with the worker, and protected by a lock.
+ */
+
+#define SQL_CACHE_SIZE_DEFAULT 4096
+#define SQL_CACHE_TIME_DEFAULT 60
+
 static void set_error_message(struct plugin_handle* plugin, const char* msg)
 {
 	plugin->error_msg = msg;
 }
 
-struct sql_data
+struct sql_cache_entry
 {
-	int exclusive;
-	sqlite3* db;
+	struct sql_cache_entry* prev;       /* Most recently used first */
+	struct sql_cache_entry* next;
+	uint32_t hash;
+	time_t expires;
+	int writes;                         /* Writes not done yet, never dropped while > 0 */
+	int found;                          /* 0 if the user is not registered */
+	struct auth_info info;
 };
 
-static int null_callback(void* ptr, int argc, char **argv, char **colName) { return 0; }
-
-static int sql_execute(struct sql_data* sql, int (*callback)(void* ptr, int argc, char **argv, char **colName), void* ptr, const char* sql_fmt, ...)
+enum sql_job_type
 {
-	va_list args;
-	char query[1024];
-	char* errMsg;
-	int rc;
+	sql_job_lookup,
+	sql_job_insert,
+	sql_job_update,
+	sql_job_delete,
+};
 
-	va_start(args, sql_fmt);
-	vsnprintf(query, sizeof(query), sql_fmt, args);
+struct sql_job
+{
+	struct sql_job* next;
+	enum sql_job_type type;
+	struct plugin_async* async;         /* Lookups only */
+	struct auth_info* result;           /* Lookups only */
+	struct auth_info info;              /* The nickname to look up, or the user to write */
+};
 
-#ifdef DEBUG_SQL
-	printf("SQL: %s\n", query);
-#endif
+struct sql_conn
+{
+	sqlite3* db;
+	sqlite3_stmt* select;
+	sqlite3_stmt* insert;
+	sqlite3_stmt* update;
+	sqlite3_stmt* remove;
+};
 
-	rc = sqlite3_exec(sql->db, query, callback, ptr, &errMsg);
-	if (rc != SQLITE_OK)
-	{
-#ifdef DEBUG_SQL
-		fprintf(stderr, "ERROR: %s\n", errMsg);
-#endif
-		sqlite3_free(errMsg);
-		return -rc;
-	}
+struct sql_data
+{
+	int exclusive;
+	char* file;
+	size_t cache_size;
+	int cache_time;
+	struct sql_conn reader;             /* Used by the hub */
+	struct sql_conn writer;             /* Used by the worker */
+	uhub_thread_t* worker;
+	uhub_mutex_t lock;
+	uhub_cond_t cond;
+	struct hash_table* cache;
+	struct sql_cache_entry* lru_first;
+	struct sql_cache_entry* lru_last;
+	struct sql_job* first;              /* Jobs for the worker */
+	struct sql_job* last;
+	int stop;
+};
 
-	rc = sqlite3_changes(sql->db);
-	return rc;
+static void sql_data_free(struct sql_data* data)
+{
+	hub_free(data->file);
+	hub_free(data);
 }
 
-
 static struct sql_data* parse_config(const char* line, struct plugin_handle* plugin)
 {
 	struct sql_data* data = (struct sql_data*) hub_malloc_zero(sizeof(struct sql_data));
 	struct cfg_tokens* tokens = cfg_tokenize(line);
 	char* token = cfg_token_get_first(tokens);
+	int num;
 
 	if (!data)
 		return 0;
 
+	data->cache_size = SQL_CACHE_SIZE_DEFAULT;
+	data->cache_time = SQL_CACHE_TIME_DEFAULT;
+
 	while (token)
 	{
 		struct cfg_settings* setting = cfg_settings_split(token);
@@ -86,35 +140,34 @@ static struct sql_data* parse_config(const char* line, struct plugin_handle* plu
 		{
 			set_error_message(plugin, "Unable to parse startup parameters");
 			cfg_tokens_free(tokens);
-			hub_free(data);
+			sql_data_free(data);
 			return 0;
 		}
 
 		if (strcmp(cfg_settings_get_key(setting), "file") == 0)
 		{
-			if (!data->db)
-			{
-				if (sqlite3_open(cfg_settings_get_value(setting), &data->db))
-				{
-					cfg_tokens_free(tokens);
-					cfg_settings_free(setting);
-					hub_free(data);
-					set_error_message(plugin, "Unable to open database file");
-					return 0;
-				}
-			}
+			if (!data->file)
+				data->file = hub_strdup(cfg_settings_get_value(setting));
 		}
 		else if (strcmp(cfg_settings_get_key(setting), "exclusive") == 0)
 		{
 			if (!string_to_boolean(cfg_settings_get_value(setting), &data->exclusive))
 				data->exclusive = 1;
 		}
+		else if (strcmp(cfg_settings_get_key(setting), "cache") == 0 && is_number(cfg_settings_get_value(setting), &num) && num >= 0)
+		{
+			data->cache_size = (size_t) num;
+		}
+		else if (strcmp(cfg_settings_get_key(setting), "cache_time") == 0 && is_number(cfg_settings_get_value(setting), &num) && num >= 0)
+		{
+			data->cache_time = num;
+		}
 		else
 		{
 			set_error_message(plugin, "Unknown startup parameters given");
 			cfg_tokens_free(tokens);
 			cfg_settings_free(setting);
-			hub_free(data);
+			sql_data_free(data);
 			return 0;
 		}
 
@@ -123,140 +176,525 @@ static struct sql_data* parse_config(const char* line, struct plugin_handle* plu
 	}
 	cfg_tokens_free(tokens);
 
-	if (!data->db)
+	if (!data->file)
 	{
 	      set_error_message(plugin, "No database file is given, use file=<database>");
-	      hub_free(data);
+	      sql_data_free(data);
 	      return 0;
 	}
 	return data;
 }
 
-static const char* sql_escape_string(const char* str)
+static void sql_conn_close(struct sql_conn* conn)
 {
-	static char out[1024];
-	size_t i = 0;
-	size_t n = 0;
-	for (; n < strlen(str); n++)
+	sqlite3_finalize(conn->select);
+	sqlite3_finalize(conn->insert);
+	sqlite3_finalize(conn->update);
+	sqlite3_finalize(conn->remove);
+	sqlite3_close(conn->db);
+	memset(conn, 0, sizeof(struct sql_conn));
+}
+
+static int sql_prepare(struct sql_conn* conn, sqlite3_stmt** stmt, const char* query)
+{
+	if (sqlite3_prepare_v2(conn->db, query, -1, stmt, NULL) == SQLITE_OK)
+		return 1;
+#ifdef DEBUG_SQL
+	fprintf(stderr, "SQL: ERROR: %s\n", sqlite3_errmsg(conn->db));
+#endif
+	return 0;
+}
+
+/*
+ * Open a connection to the database. Only the writer prepares the
+ * statements that change it.
+ */
+static int sql_conn_open(struct sql_conn* conn, const char* file, int writer)
+{
+	if (sqlite3_open(file, &conn->db) != SQLITE_OK)
 	{
-		if (str[n] == '\'')
-			out[i++] = '\'';
-		out[i++] = str[n];
+		sql_conn_close(conn);
+		return 0;
 	}
-	out[i++] = '\0';
-	return out;
-}
 
-struct data_record {
-	struct auth_info* data;
-	int found;
-};
+	/* Wait for uhub-passwd rather than fail */
+	sqlite3_busy_timeout(conn->db, 1000);
 
-static int get_user_callback(void* ptr, int argc, char **argv, char **colName){
-	struct data_record* data = (struct data_record*) ptr;
-	int i = 0;
-	for (; i < argc; i++) {
-		if (strcmp(colName[i], "nickname") == 0)
-			strncpy(data->data->nickname, argv[i], MAX_NICK_LEN);
-		else if (strcmp(colName[i], "password") == 0)
-			strncpy(data->data->password, argv[i], MAX_PASS_LEN);
-		else if (strcmp(colName[i], "credentials") == 0)
-		{
-			auth_string_to_cred(argv[i], &data->data->credentials);
-			data->found = 1;
-		}
+	if (writer)
+	{
+		/* Readers do not block the writer and the other way around */
+		sqlite3_exec(conn->db, "PRAGMA journal_mode=WAL;", NULL, NULL, NULL);
+		sqlite3_exec(conn->db, "PRAGMA synchronous=NORMAL;", NULL, NULL, NULL);
 	}
 
-#ifdef DEBUG_SQL
-	printf("SQL: nickname=%s, password=%s, credentials=%s\n", data->data->nickname, data->data->password, auth_cred_to_string(data->data->credentials));
-#endif
-	return 0;
+	if (!sql_prepare(conn, &conn->select, "SELECT nickname, password, credentials FROM users WHERE nickname=?1;") ||
+		(writer && (
+			!sql_prepare(conn, &conn->insert, "INSERT INTO users (nickname, password, credentials) VALUES(?1, ?2, ?3);") ||
+			!sql_prepare(conn, &conn->update, "UPDATE users SET password=?2, credentials=?3 WHERE nickname=?1;") ||
+			!sql_prepare(conn, &conn->remove, "DELETE FROM users WHERE nickname=?1;"))))
+	{
+		sql_conn_close(conn);
+		return 0;
+	}
+	return 1;
 }
 
-static plugin_st get_user(struct plugin_handle* plugin, const char* nickname, struct auth_info* data)
+static plugin_st sql_get_user(struct sql_conn* conn, const char* nickname, struct auth_info* data)
 {
-	struct sql_data* sql = (struct sql_data*) plugin->ptr;
-	struct data_record result;
-	char query[1024];
-	char* errMsg;
+	sqlite3_stmt* stmt = conn->select;
+	int found = 0;
 	int rc;
 
-	snprintf(query, sizeof(query), "SELECT * FROM users WHERE nickname='%s';", sql_escape_string(nickname));
 	memset(data, 0, sizeof(struct auth_info));
+	sqlite3_bind_text(stmt, 1, nickname, -1, SQLITE_STATIC);
 
-	result.data = data;
-	result.found = 0;
-
+	rc = sqlite3_step(stmt);
+	if (rc == SQLITE_ROW)
+	{
+		strncpy(data->nickname, (const char*) sqlite3_column_text(stmt, 0), MAX_NICK_LEN);
+		strncpy(data->password, (const char*) sqlite3_column_text(stmt, 1), MAX_PASS_LEN);
+		auth_string_to_cred((const char*) sqlite3_column_text(stmt, 2), &data->credentials);
+		found = 1;
+	}
 #ifdef DEBUG_SQL
-	printf("SQL: %s\n", query);
+	else if (rc != SQLITE_DONE)
+		fprintf(stderr, "SQL: ERROR: %s\n", sqlite3_errmsg(conn->db));
+	printf("SQL: nickname=%s, password=%s, credentials=%s\n", data->nickname, data->password, auth_cred_to_string(data->credentials));
 #endif
 
-	rc = sqlite3_exec(sql->db, query , get_user_callback, &result, &errMsg);
-	if (rc != SQLITE_OK) {
+	sqlite3_reset(stmt);
+	sqlite3_clear_bindings(stmt);
+	return found ? st_allow : st_default;
+}
+
+/*
+ * @return 1 if a user was written, 0 otherwise.
+ */
+static int sql_write(struct sql_conn* conn, enum sql_job_type type, struct auth_info* user)
+{
+	sqlite3_stmt* stmt;
+	int rc;
+
+	switch (type)
+	{
+		case sql_job_insert: stmt = conn->insert; break;
+		case sql_job_update: stmt = conn->update; break;
+		case sql_job_delete: stmt = conn->remove; break;
+		default:
+			return 0;
+	}
+
+	sqlite3_bind_text(stmt, 1, user->nickname, -1, SQLITE_STATIC);
+	if (type != sql_job_delete)
+	{
+		sqlite3_bind_text(stmt, 2, user->password, -1, SQLITE_STATIC);
+		sqlite3_bind_text(stmt, 3, auth_cred_to_string(user->credentials), -1, SQLITE_STATIC);
+	}
+
+	rc = sqlite3_step(stmt);
 #ifdef DEBUG_SQL
-		fprintf(stderr, "SQL: ERROR: %s\n", errMsg);
+	if (rc != SQLITE_DONE)
+		fprintf(stderr, "SQL: ERROR: %s\n", sqlite3_errmsg(conn->db));
 #endif
-		sqlite3_free(errMsg);
-		return st_default;
+	sqlite3_reset(stmt);
+	sqlite3_clear_bindings(stmt);
+	return rc == SQLITE_DONE && sqlite3_changes(conn->db) > 0;
+}
+
+static int sql_cache_equals(const void* a, const void* b)
+{
+	return strcmp((const char*) a, (const char*) b) == 0;
+}
+
+static uint32_t sql_cache_hash(const char* nickname)
+{
+	return hash_table_hash_data(nickname, strlen(nickname));
+}
+
+static void sql_cache_unlink(struct sql_data* sql, struct sql_cache_entry* entry)
+{
+	if (entry->prev)
+		entry->prev->next = entry->next;
+	else
+		sql->lru_first = entry->next;
+	if (entry->next)
+		entry->next->prev = entry->prev;
+	else
+		sql->lru_last = entry->prev;
+	entry->prev = NULL;
+	entry->next = NULL;
+}
+
+static void sql_cache_link(struct sql_data* sql, struct sql_cache_entry* entry)
+{
+	entry->next = sql->lru_first;
+	if (sql->lru_first)
+		sql->lru_first->prev = entry;
+	else
+		sql->lru_last = entry;
+	sql->lru_first = entry;
+}
+
+static void sql_cache_remove(struct sql_data* sql, struct sql_cache_entry* entry)
+{
+	hash_table_remove(sql->cache, entry->hash, entry->info.nickname);
+	sql_cache_unlink(sql, entry);
+	hub_free(entry);
+}
+
+/*
+ * Drop the least recently used entries above the limit, except keep.
+ */
+static void sql_cache_trim(struct sql_data* sql, struct sql_cache_entry* keep)
+{
+	struct sql_cache_entry* entry = sql->lru_last;
+	struct sql_cache_entry* prev;
+
+	while (entry && hash_table_size(sql->cache) > sql->cache_size)
+	{
+		prev = entry->prev;
+		if (!entry->writes && entry != keep)
+			sql_cache_remove(sql, entry);
+		entry = prev;
 	}
+}
 
-	if (result.found)
-		return st_allow;
-	return st_default;
+/*
+ * @return the cached entry for nickname, or NULL. Must hold the lock.
+ */
+static struct sql_cache_entry* sql_cache_get(struct sql_data* sql, const char* nickname)
+{
+	struct sql_cache_entry* entry = hash_table_get(sql->cache, sql_cache_hash(nickname), nickname);
+	if (!entry)
+		return NULL;
+
+	if (!entry->writes && entry->expires <= time(NULL))
+	{
+		sql_cache_remove(sql, entry);
+		return NULL;
+	}
+
+	sql_cache_unlink(sql, entry);
+	sql_cache_link(sql, entry);
+	return entry;
 }
 
-static plugin_st register_user(struct plugin_handle* plugin, struct auth_info* user)
+/*
+ * Add or update the cached entry for nickname, info is NULL if the user
+ * is not registered. Must hold the lock.
+ */
+static struct sql_cache_entry* sql_cache_put(struct sql_data* sql, const char* nickname, struct auth_info* info)
+{
+	uint32_t hash = sql_cache_hash(nickname);
+	struct sql_cache_entry* entry = hash_table_get(sql->cache, hash, nickname);
+
+	if (!entry)
+	{
+		entry = hub_malloc_zero(sizeof(struct sql_cache_entry));
+		if (!entry)
+			return NULL;
+
+		entry->hash = hash;
+		strncpy(entry->info.nickname, nickname, MAX_NICK_LEN);
+		if (hash_table_insert(sql->cache, hash, entry->info.nickname, entry) != 1)
+		{
+			hub_free(entry);
+			return NULL;
+		}
+		sql_cache_link(sql, entry);
+	}
+	else
+	{
+		sql_cache_unlink(sql, entry);
+		sql_cache_link(sql, entry);
+	}
+
+	entry->found = info ? 1 : 0;
+	if (info)
+		memcpy(&entry->info, info, sizeof(struct auth_info));
+	else
+		memset(entry->info.password, 0, sizeof(entry->info.password));
+	entry->expires = time(NULL) + sql->cache_time;
+
+	sql_cache_trim(sql, entry);
+	return entry;
+}
+
+/*
+ * Cache the result of a lookup, unless a newer result is cached already.
+ */
+static void sql_cache_lookup_done(struct sql_data* sql, const char* nickname, plugin_st status, struct auth_info* info)
+{
+	if (!sql->cache_size)
+		return;
+
+	uhub_mutex_lock(&sql->lock);
+	if (!hash_table_get(sql->cache, sql_cache_hash(nickname), nickname))
+		sql_cache_put(sql, nickname, status == st_allow ? info : NULL);
+	uhub_mutex_unlock(&sql->lock);
+}
+
+/*
+ * A write is done. If it failed the cached entry is no longer right.
+ */
+static void sql_cache_write_done(struct sql_data* sql, const char* nickname, int ok)
+{
+	struct sql_cache_entry* entry;
+
+	uhub_mutex_lock(&sql->lock);
+	entry = hash_table_get(sql->cache, sql_cache_hash(nickname), nickname);
+	if (entry)
+	{
+		entry->writes--;
+		if (!entry->writes && !ok)
+			sql_cache_remove(sql, entry);
+		else
+			entry->expires = time(NULL) + sql->cache_time;
+		sql_cache_trim(sql, NULL);
+	}
+	uhub_mutex_unlock(&sql->lock);
+}
+
+static void sql_job_run(struct plugin_handle* plugin, struct sql_job* job)
 {
 	struct sql_data* sql = (struct sql_data*) plugin->ptr;
-	char* nick = strdup(sql_escape_string(user->nickname));
-	char* pass = strdup(sql_escape_string(user->password));
-	const char* cred = auth_cred_to_string(user->credentials);
-	int rc = sql_execute(sql, null_callback, NULL, "INSERT INTO users (nickname, password, credentials) VALUES('%s', '%s', '%s');", nick, pass, cred);
+	plugin_st status;
+	int ok;
+
+	if (job->type == sql_job_lookup)
+	{
+		status = sql_get_user(&sql->writer, job->info.nickname, job->result);
+		sql_cache_lookup_done(sql, job->info.nickname, status, job->result);
+		plugin->hub.async_complete(plugin, job->async, status);
+	}
+	else
+	{
+		ok = sql_write(&sql->writer, job->type, &job->info);
+		sql_cache_write_done(sql, job->info.nickname, ok);
+	}
+}
 
-	free(nick);
-	free(pass);
+static void* sql_worker(void* ptr)
+{
+	struct plugin_handle* plugin = (struct plugin_handle*) ptr;
+	struct sql_data* sql = (struct sql_data*) plugin->ptr;
+	struct sql_job* job;
 
-	if (rc <= 0)
+	for (;;)
 	{
-		fprintf(stderr, "Unable to add user \"%s\"\n", user->nickname);
-		return st_deny;
+		uhub_mutex_lock(&sql->lock);
+		while (!sql->first && !sql->stop)
+			uhub_cond_wait(&sql->cond, &sql->lock);
+
+		/* Finish everything queued before stopping */
+		job = sql->first;
+		if (job)
+		{
+			sql->first = job->next;
+			if (!sql->first)
+				sql->last = NULL;
+		}
+		uhub_mutex_unlock(&sql->lock);
+
+		if (!job)
+			break;
+
+		sql_job_run(plugin, job);
+		hub_free(job);
 	}
-	return st_allow;
+	return NULL;
+}
+
+/*
+ * Queue a job for the worker. Must hold the lock.
+ */
+static void sql_job_queue(struct plugin_handle* plugin, struct sql_job* job)
+{
+	struct sql_data* sql = (struct sql_data*) plugin->ptr;
 
+	if (sql->last)
+		sql->last->next = job;
+	else
+		sql->first = job;
+	sql->last = job;
+	uhub_cond_signal(&sql->cond);
 }
 
-static plugin_st update_user(struct plugin_handle* plugin, struct auth_info* user)
+static plugin_st get_user(struct plugin_handle* plugin, const char* nickname, struct auth_info* data)
+{
+	struct sql_data* sql = (struct sql_data*) plugin->ptr;
+	struct sql_cache_entry* entry;
+	struct sql_job* job;
+	plugin_st status;
+
+	uhub_mutex_lock(&sql->lock);
+	entry = sql_cache_get(sql, nickname);
+	if (entry)
+	{
+		memcpy(data, &entry->info, sizeof(struct auth_info));
+		status = entry->found ? st_allow : st_default;
+		uhub_mutex_unlock(&sql->lock);
+		return status;
+	}
+
+	if (sql->worker)
+	{
+		job = hub_malloc_zero(sizeof(struct sql_job));
+		if (job)
+		{
+			job->async = plugin->hub.async_defer(plugin);
+			if (job->async)
+			{
+				job->type = sql_job_lookup;
+				job->result = data;
+				strncpy(job->info.nickname, nickname, MAX_NICK_LEN);
+				sql_job_queue(plugin, job);
+				uhub_mutex_unlock(&sql->lock);
+				return st_pending;
+			}
+			hub_free(job);
+		}
+	}
+	uhub_mutex_unlock(&sql->lock);
+
+	/* Writes are always cached until done, so this sees them */
+	status = sql_get_user(&sql->reader, nickname, data);
+	sql_cache_lookup_done(sql, nickname, status, data);
+	return status;
+}
+
+/*
+ * Update the cache and have the worker write the user.
+ */
+static plugin_st sql_queue_write(struct plugin_handle* plugin, enum sql_job_type type, struct auth_info* user)
 {
 	struct sql_data* sql = (struct sql_data*) plugin->ptr;
+	struct sql_cache_entry* entry;
+	struct sql_job* job;
+	int ok;
 
-	char* nick = strdup(sql_escape_string(user->nickname));
-	char* pass = strdup(sql_escape_string(user->password));
-	const char* cred = auth_cred_to_string(user->credentials);
-	int rc = sql_execute(sql, null_callback, NULL, "INSERT INTO users (nickname, password, credentials) VALUES('%s', '%s', '%s');", nick, pass, cred);
+	if (!sql->worker)
+	{
+		uhub_mutex_lock(&sql->lock);
+		entry = hash_table_get(sql->cache, sql_cache_hash(user->nickname), user->nickname);
+		if (entry)
+			sql_cache_remove(sql, entry);
+		uhub_mutex_unlock(&sql->lock);
+
+		ok = sql_write(&sql->writer, type, user);
+		return ok ? st_allow : st_deny;
+	}
 
-	free(nick);
-	free(pass);
+	job = hub_malloc_zero(sizeof(struct sql_job));
+	if (!job)
+		return st_deny;
 
-	if (rc <= 0)
+	job->type = type;
+	memcpy(&job->info, user, sizeof(struct auth_info));
+
+	uhub_mutex_lock(&sql->lock);
+	entry = sql_cache_put(sql, user->nickname, type == sql_job_delete ? NULL : user);
+	if (!entry)
 	{
-		fprintf(stderr, "Unable to add user \"%s\"\n", user->nickname);
+		uhub_mutex_unlock(&sql->lock);
+		hub_free(job);
 		return st_deny;
 	}
+	entry->writes++;
+	sql_job_queue(plugin, job);
+	uhub_mutex_unlock(&sql->lock);
 	return st_allow;
+}
 
+/*
+ * @return 1 if the cache knows whether the user is registered, and
+ * found is set accordingly.
+ */
+static int sql_cache_known(struct sql_data* sql, const char* nickname, int* found)
+{
+	struct sql_cache_entry* entry;
+	uhub_mutex_lock(&sql->lock);
+	entry = sql_cache_get(sql, nickname);
+	if (entry)
+		*found = entry->found;
+	uhub_mutex_unlock(&sql->lock);
+	return entry != NULL;
 }
 
-static plugin_st delete_user(struct plugin_handle* plugin, struct auth_info* user)
+/*
+ * @return 1 if the user is registered, 0 otherwise. Queued writes are
+ * cached until done, so the cache is asked first, then the database.
+ */
+static int sql_user_exists(struct sql_data* sql, const char* nickname)
+{
+	struct auth_info info;
+	plugin_st status;
+	int found;
+
+	if (sql_cache_known(sql, nickname, &found))
+		return found;
+
+	status = sql_get_user(&sql->reader, nickname, &info);
+	sql_cache_lookup_done(sql, nickname, status, &info);
+	return status == st_allow;
+}
+
+static plugin_st register_user(struct plugin_handle* plugin, struct auth_info* user)
+{
+	struct sql_data* sql = (struct sql_data*) plugin->ptr;
+
+	if (sql_user_exists(sql, user->nickname))
+		return st_deny;
+	return sql_queue_write(plugin, sql_job_insert, user);
+}
+
+static plugin_st update_user(struct plugin_handle* plugin, struct auth_info* user)
 {
 	struct sql_data* sql = (struct sql_data*) plugin->ptr;
-	if (sql->exclusive)
+
+	if (!sql_user_exists(sql, user->nickname))
 		return st_deny;
-	return st_default;
+	return sql_queue_write(plugin, sql_job_update, user);
+}
+
+static plugin_st delete_user(struct plugin_handle* plugin, struct auth_info* user)
+{
+	struct sql_data* sql = (struct sql_data*) plugin->ptr;
+
+	if (!sql_user_exists(sql, user->nickname))
+		return sql->exclusive ? st_deny : st_default;
+	return sql_queue_write(plugin, sql_job_delete, user);
+}
+
+static void sql_shutdown(struct sql_data* sql)
+{
+	struct sql_cache_entry* entry;
+
+	if (sql->worker)
+	{
+		uhub_mutex_lock(&sql->lock);
+		sql->stop = 1;
+		uhub_cond_signal(&sql->cond);
+		uhub_mutex_unlock(&sql->lock);
+		uhub_thread_join(sql->worker);
+	}
+	uhub_cond_destroy(&sql->cond);
+	uhub_mutex_destroy(&sql->lock);
+
+	while ((entry = sql->lru_first))
+		sql_cache_remove(sql, entry);
+	hash_table_destroy(sql->cache);
+
+	sql_conn_close(&sql->writer);
+	sql_conn_close(&sql->reader);
+	sql_data_free(sql);
 }
 
 int plugin_register(struct plugin_handle* plugin, const char* config)
 {
-	PLUGIN_INITIALIZE(plugin, "SQLite authentication plugin", "1.0", "Authenticate users based on a SQLite database.");
+	struct sql_data* sql;
+
+	PLUGIN_INITIALIZE(plugin, "SQLite authentication plugin", "1.2", "Authenticate users based on a SQLite database.");
 
 	// Authentication actions.
 	plugin->funcs.auth_get_user = get_user;
@@ -264,19 +702,38 @@ int plugin_register(struct plugin_handle* plugin, const char* config)
 	plugin->funcs.auth_update_user = update_user;
 	plugin->funcs.auth_delete_user = delete_user;
 
-	plugin->ptr = parse_config(config, plugin);
-	if (plugin->ptr)
-		return 0;
-	return -1;
+	sql = parse_config(config, plugin);
+	if (!sql)
+		return -1;
+
+	if (!sql_conn_open(&sql->writer, sql->file, 1) || !sql_conn_open(&sql->reader, sql->file, 0))
+	{
+		sql_conn_close(&sql->writer);
+		sql_data_free(sql);
+		set_error_message(plugin, "Unable to open database file, or it has no users table");
+		return -1;
+	}
+
+	sql->cache = hash_table_create(sql_cache_equals, 0);
+	if (!sql->cache)
+	{
+		sql_conn_close(&sql->writer);
+		sql_conn_close(&sql->reader);
+		sql_data_free(sql);
+		set_error_message(plugin, "Out of memory");
+		return -1;
+	}
+
+	plugin->ptr = sql;
+	uhub_mutex_init(&sql->lock);
+	uhub_cond_init(&sql->cond);
+	sql->worker = uhub_thread_create(sql_worker, plugin);
+	return 0;
 }
 
 int plugin_unregister(struct plugin_handle* plugin)
 {
-	struct sql_data* sql;
 	set_error_message(plugin, 0);
-	sql = (struct sql_data*) plugin->ptr;
-	sqlite3_close(sql->db);
-	hub_free(sql);
+	sql_shutdown((struct sql_data*) plugin->ptr);
 	return 0;
 }
-
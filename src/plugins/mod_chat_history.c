@@ -22,35 +22,98 @@
 #include "util/config_token.h"
 #include "util/memory.h"
 #include "util/misc.h"
-#include "util/list.h"
 #include "util/cbuffer.h"
 
 #define MAX_HISTORY_SIZE 16384
+#define HISTORY_LINE_SIZE 256
+
+/*
+ * Messages are stored back to back in a circular arena of bytes, and an
+ * offsets ring records where each one starts. Adding a message drops the
+ * oldest ones until both the message and its slot fit, so nothing is
+ * allocated after startup. A message may wrap around the end of the
+ * arena.
+ *
+ * The history sent to users logging in is rendered once, and the same
+ * prepared message is sent to all of them until the next chat message.
+ */
+
+struct chat_history_slot
+{
+	size_t offset;           ///<<< "Start of the message in the arena."
+	size_t length;
+};
 
 struct chat_history_data
 {
 	size_t history_max;      ///<<< "the maximum number of chat messages kept in history."
 	size_t history_default;  ///<<< "the default number of chat messages returned if no limit was provided"
 	size_t history_connect;  ///<<< "the number of chat messages provided when users connect to the hub."
-	struct linked_list* chat_history; ///<<< "The chat history storage."
+	char* arena;             ///<<< "The chat history storage."
+	size_t arena_size;
+	size_t arena_used;       ///<<< "Bytes used by the messages in the ring."
+	struct chat_history_slot* slots; ///<<< "Ring of history_max messages, oldest first."
+	size_t first;            ///<<< "Slot of the oldest message."
+	size_t count;            ///<<< "Number of messages."
+	struct plugin_message* connect_message; ///<<< "History sent on login, or NULL if not rendered."
 	struct plugin_command_handle* command_history_handle; ///<<< "A handle to the !history command."
 };
 
+static void history_drop_first(struct chat_history_data* data)
+{
+	data->arena_used -= data->slots[data->first].length;
+	data->first = (data->first + 1) % data->history_max;
+	data->count--;
+}
+
 /**
  * Add a chat message to history.
  */
 static void history_add(struct plugin_handle* plugin, struct plugin_user* from, const char* message, int flags)
 {
-	size_t loglen = strlen(message) + strlen(from->nick) + 13;
 	struct chat_history_data* data = (struct chat_history_data*) plugin->ptr;
-	char* log = hub_malloc(loglen + 1);
+	struct chat_history_slot* slot;
+	char log[MAX_HISTORY_SIZE];
+	size_t offset;
+	size_t part;
+	int len;
+
+	if (!data->history_max)
+		return;
+
+	len = snprintf(log, sizeof(log), "%s <%s> %s\n", get_timestamp(time(NULL)), from->nick, message);
+	if (len < 0)
+		return;
+	len = MIN((size_t) len, MIN(sizeof(log) - 1, data->arena_size));
+
+	while (data->count && (data->count == data->history_max || data->arena_used + len > data->arena_size))
+		history_drop_first(data);
 
-	snprintf(log, loglen, "%s <%s> %s\n", get_timestamp(time(NULL)), from->nick, message);
-	log[loglen] = '\0';
-	list_append(data->chat_history, log);
-	while (list_size(data->chat_history) > data->history_max)
+	if (data->count)
 	{
-		list_remove_first(data->chat_history, hub_free);
+		slot = &data->slots[(data->first + data->count - 1) % data->history_max];
+		offset = (slot->offset + slot->length) % data->arena_size;
+	}
+	else
+	{
+		data->first = 0;
+		offset = 0;
+	}
+
+	part = MIN((size_t) len, data->arena_size - offset);
+	memcpy(data->arena + offset, log, part);
+	memcpy(data->arena, log + part, len - part);
+
+	slot = &data->slots[(data->first + data->count) % data->history_max];
+	slot->offset = offset;
+	slot->length = len;
+	data->arena_used += len;
+	data->count++;
+
+	if (data->connect_message)
+	{
+		plugin->hub.message_release(plugin, data->connect_message);
+		data->connect_message = NULL;
 	}
 }
 
@@ -61,47 +124,46 @@ static void history_add(struct plugin_handle* plugin, struct plugin_user* from,
  */
 static size_t get_messages(struct chat_history_data* data, size_t num, struct cbuffer* outbuf)
 {
-	struct linked_list* messages = data->chat_history;
-	char* message;
-	int skiplines = 0;
-	size_t lines = 0;
-	size_t total = list_size(messages);
+	struct chat_history_slot* slot;
+	size_t n;
+	size_t part;
 
-	if (total == 0)
+	if (data->count == 0)
 		return 0;
 
-	if (num <= 0 || num > total)
-		num = total;
-
-	if (num != total)
-		skiplines = total - num;
+	if (num <= 0 || num > data->count)
+		num = data->count;
 
 	cbuf_append(outbuf, "\n");
-	LIST_FOREACH(char*, message, messages,
+	for (n = data->count - num; n < data->count; n++)
 	{
-		if (--skiplines < 0)
-		{
-			cbuf_append(outbuf, message);
-			lines++;
-		}
-	});
+		slot = &data->slots[(data->first + n) % data->history_max];
+		part = MIN(slot->length, data->arena_size - slot->offset);
+		cbuf_append_bytes(outbuf, data->arena + slot->offset, part);
+		cbuf_append_bytes(outbuf, data->arena, slot->length - part);
+	}
 	cbuf_append(outbuf, "\n");
-	return lines;
+	return num;
 }
 
 void user_login(struct plugin_handle* plugin, struct plugin_user* user)
 {
 	struct chat_history_data* data = (struct chat_history_data*) plugin->ptr;
 	struct cbuffer* buf = NULL;
-	// size_t messages = 0;
 
-	if (data->history_connect > 0 && list_size(data->chat_history) > 0)
+	if (data->history_connect > 0 && data->count > 0)
 	{
-		buf = cbuf_create(MAX_HISTORY_SIZE);
-		cbuf_append(buf, "Chat history:\n");
-		get_messages(data, data->history_connect, buf);
-		plugin->hub.send_message(plugin, user, cbuf_get(buf));
-		cbuf_destroy(buf);
+		if (!data->connect_message)
+		{
+			buf = cbuf_create(MAX_HISTORY_SIZE);
+			cbuf_append(buf, "Chat history:\n");
+			get_messages(data, data->history_connect, buf);
+			data->connect_message = plugin->hub.message_create(plugin, cbuf_get(buf));
+			cbuf_destroy(buf);
+		}
+
+		if (data->connect_message)
+			plugin->hub.send_prepared_message(plugin, user, data->connect_message);
 	}
 }
 
@@ -128,7 +190,7 @@ static int command_history(struct plugin_handle* plugin, struct plugin_user* use
 	struct plugin_command_arg_data* arg = plugin->hub.command_arg_next(plugin, cmd, plugin_cmd_arg_type_integer);
 	int maxlines;
 
-	if (!list_size(data->chat_history))
+	if (!data->count)
 		return command_status(plugin, user, cmd, cbuf_create_const("No messages."));
 
 	if (arg)
@@ -161,7 +223,6 @@ static struct chat_history_data* parse_config(const char* line, struct plugin_ha
 	data->history_max = 200;
 	data->history_default = 25;
 	data->history_connect = 5;
-	data->chat_history = list_create();
 
 	while (token)
 	{
@@ -206,7 +267,7 @@ static struct chat_history_data* parse_config(const char* line, struct plugin_ha
 int plugin_register(struct plugin_handle* plugin, const char* config)
 {
 	struct chat_history_data* data;
-	PLUGIN_INITIALIZE(plugin, "Chat history plugin", "1.0", "Provide a global chat history log.");
+	PLUGIN_INITIALIZE(plugin, "Chat history plugin", "1.1", "Provide a global chat history log.");
 
 	plugin->funcs.on_user_chat_message = history_add;
 	plugin->funcs.on_user_login = user_login;
@@ -216,6 +277,18 @@ int plugin_register(struct plugin_handle* plugin, const char* config)
 
 	plugin->ptr = data;
 
+	data->arena_size = MAX(data->history_max * HISTORY_LINE_SIZE, MAX_HISTORY_SIZE);
+	data->arena = hub_malloc(data->arena_size);
+	data->slots = hub_malloc_zero(MAX(data->history_max, 1) * sizeof(struct chat_history_slot));
+	if (!data->arena || !data->slots)
+	{
+		hub_free(data->arena);
+		hub_free(data->slots);
+		hub_free(data);
+		set_error_message(plugin, "Out of memory");
+		return -1;
+	}
+
 	data->command_history_handle = (struct plugin_command_handle*) hub_malloc(sizeof(struct plugin_command_handle));
 	PLUGIN_COMMAND_INITIALIZE(data->command_history_handle, plugin, "history", "?N", auth_cred_guest, &command_history, "Show chat message history.");
 	plugin->hub.command_add(plugin, data->command_history_handle);
@@ -229,8 +302,10 @@ int plugin_unregister(struct plugin_handle* plugin)
 
 	if (data)
 	{
-		list_clear(data->chat_history, &hub_free);
-		list_destroy(data->chat_history);
+		if (data->connect_message)
+			plugin->hub.message_release(plugin, data->connect_message);
+		hub_free(data->arena);
+		hub_free(data->slots);
 
 		plugin->hub.command_del(plugin, data->command_history_handle);
 		hub_free(data->command_history_handle);
@@ -25,8 +25,42 @@
 #include "util/misc.h"
 #include "util/list.h"
 #include "util/cbuffer.h"
+#include "util/threads.h"
 
 #define MAX_HISTORY_SIZE 16384
+#define HISTORY_INSERT "INSERT INTO chat_history (from_nick, message, time) VALUES(?1, ?2, ?3);"
+
+/*
+ * The last history_max messages are kept in memory, loaded from the
+ * database at startup, and the database is only written to.
+ *
+ * The history sent to users logging in is prepared once and shared by
+ * all of them, until the next chat message.
+ *
+ * Messages are written by a background thread, which writes everything
+ * that has come in since it last woke up in one transaction.
+ */
+
+struct chat_history_line
+{
+	char* from;
+	char* message;
+	char time[20];
+	/* from and message follow */
+};
+
+enum chat_history_job_type
+{
+	history_job_insert,
+	history_job_clear,
+};
+
+struct chat_history_job
+{
+	struct chat_history_job* next;
+	enum chat_history_job_type type;
+	struct chat_history_line* line;     /* A copy, for inserts */
+};
 
 struct chat_history_data
 {
@@ -36,32 +70,20 @@ struct chat_history_data
 	sqlite3* db;		///<<< "The chat history storage database."
 	struct plugin_command_handle* command_history_handle;		///<<< "A handle to the !history command."
 	struct plugin_command_handle* command_historycleanup_handle;	///<<< "A handle to the !historycleanup command."
-};
-
-struct chat_history_line
-{
-	char message[MAX_HISTORY_SIZE];
-	char from[MAX_NICK_LEN];
-	char time[20];
+	struct chat_history_line** lines;	///<<< "Ring of the last history_max messages."
+	size_t first;			///<<< "Index of the oldest message in the ring."
+	size_t count;			///<<< "Number of messages in the ring."
+	struct plugin_message* connect_message;	///<<< "History sent on login, or NULL if not prepared."
+	uhub_thread_t* writer;
+	uhub_mutex_t lock;
+	uhub_cond_t cond;
+	struct chat_history_job* jobs_first;	///<<< "Jobs for the writer, protected by the lock."
+	struct chat_history_job* jobs_last;
+	int stop;
 };
 
 static int null_callback(void* ptr, int argc, char **argv, char **colName) { return 0; }
 
-static const char* sql_escape_string(const char* str)
-{
-	static char out[MAX_HISTORY_SIZE];
-	size_t i = 0;
-	size_t n = 0;
-	for (; n < strlen(str); n++)
-	{
-		if (str[n] == '\'')
-			out[i++] = '\'';
-		out[i++] = str[n];
-	}
-	out[i++] = '\0';
-	return out;
-}
-
 static int sql_execute(struct chat_history_data* sql, int (*callback)(void* ptr, int argc, char **argv, char **colName), void* ptr, const char* sql_fmt, ...)
 {
 	va_list args;
@@ -95,73 +117,271 @@ static void create_tables(struct plugin_handle* plugin)
 	struct chat_history_data* data = (struct chat_history_data*) plugin->ptr;
 	sql_execute(data, null_callback, NULL, table_create);
 }
+
+static struct chat_history_line* history_line_create(const char* from, const char* message, const char* time)
+{
+	size_t from_len = strlen(from);
+	size_t message_len = strlen(message);
+	struct chat_history_line* line = hub_malloc(sizeof(struct chat_history_line) + from_len + message_len + 2);
+	if (!line)
+		return NULL;
+
+	line->from = (char*) (line + 1);
+	line->message = line->from + from_len + 1;
+	memcpy(line->from, from, from_len + 1);
+	memcpy(line->message, message, message_len + 1);
+	strncpy(line->time, time, sizeof(line->time) - 1);
+	line->time[sizeof(line->time) - 1] = '\0';
+	return line;
+}
+
+static struct chat_history_line* history_line_copy(struct chat_history_line* line)
+{
+	return history_line_create(line->from, line->message, line->time);
+}
+
 /**
- * Add a chat message to history.
+ * @return the n'th newest message, starting at 0.
  */
-static void history_add(struct plugin_handle* plugin, struct plugin_user* from, const char* message, int flags)
+static struct chat_history_line* history_get(struct chat_history_data* data, size_t n)
+{
+	return data->lines[(data->first + data->count - 1 - n) % data->history_max];
+}
+
+/**
+ * Add a message to the ring, dropping the oldest one if full.
+ */
+static void history_push(struct chat_history_data* data, struct chat_history_line* line)
+{
+	size_t last;
+
+	if (data->count == data->history_max)
+	{
+		hub_free(data->lines[data->first]);
+		data->first = (data->first + 1) % data->history_max;
+		data->count--;
+	}
+	last = (data->first + data->count) % data->history_max;
+	data->lines[last] = line;
+	data->count++;
+}
+
+static void history_clear(struct chat_history_data* data)
+{
+	while (data->count)
+	{
+		hub_free(data->lines[data->first]);
+		data->first = (data->first + 1) % data->history_max;
+		data->count--;
+	}
+	data->first = 0;
+}
+
+static void history_invalidate(struct plugin_handle* plugin)
 {
 	struct chat_history_data* data = (struct chat_history_data*) plugin->ptr;
-	char* history_line = strdup(sql_escape_string(message));
-	char* history_nick = strdup(sql_escape_string(from->nick));
+	if (data->connect_message)
+	{
+		plugin->hub.message_release(plugin, data->connect_message);
+		data->connect_message = NULL;
+	}
+}
+
+/**
+ * Format the newest messages, oldest first.
+ */
+static void history_format(struct chat_history_data* data, struct cbuffer* buf, size_t lines)
+{
+	struct chat_history_line* line;
+	size_t n = MIN(lines, data->count);
+
+	while (n--)
+	{
+		line = history_get(data, n);
+		cbuf_append_format(buf, "[%s] <%s> %s\n", line->time, line->from, line->message);
+	}
+}
+
+/**
+ * Read the history kept in the database into the ring.
+ */
+static int history_load_callback(void* ptr, int argc, char **argv, char **colName)
+{
+	struct chat_history_data* data = (struct chat_history_data*) ptr;
+	struct chat_history_line* line;
+
+	if (argc != 3)
+		return 0;
 
-	sql_execute(data, null_callback, NULL, "INSERT INTO chat_history (from_nick, message) VALUES('%s', '%s');DELETE FROM chat_history WHERE time <= (SELECT time FROM chat_history ORDER BY time DESC LIMIT %d,1);", history_nick, history_line, data->history_max);
+	line = history_line_create(argv[0] ? argv[0] : "", argv[1] ? argv[1] : "", argv[2] ? argv[2] : "");
+	if (line)
+		history_push(data, line);
+	return 0;
+}
 
-	hub_free(history_line);
-	hub_free(history_nick);
+static void history_load(struct chat_history_data* data)
+{
+	sql_execute(data, history_load_callback, data,
+		"SELECT from_nick, message, time FROM (SELECT rowid, * FROM chat_history ORDER BY rowid DESC LIMIT %d) ORDER BY rowid ASC;",
+		(int) data->history_max);
 }
 
 /**
- * Obtain messages from the chat history as a linked list
+ * Write a batch of jobs in one transaction.
  */
+static void history_write(struct chat_history_data* data, sqlite3_stmt* insert, struct chat_history_job* job)
+{
+	struct chat_history_job* next;
+	int vacuum = 0;
 
-static int get_messages_callback(void* ptr, int argc, char **argv, char **colName)
+	sql_execute(data, null_callback, NULL, "BEGIN;");
+	for (; job; job = next)
+	{
+		next = job->next;
+		if (job->type == history_job_insert)
+		{
+			sqlite3_bind_text(insert, 1, job->line->from, -1, SQLITE_STATIC);
+			sqlite3_bind_text(insert, 2, job->line->message, -1, SQLITE_STATIC);
+			sqlite3_bind_text(insert, 3, job->line->time, -1, SQLITE_STATIC);
+			sqlite3_step(insert);
+			sqlite3_reset(insert);
+			sqlite3_clear_bindings(insert);
+		}
+		else
+		{
+			sql_execute(data, null_callback, NULL, "DELETE FROM chat_history;");
+			vacuum = 1;
+		}
+		hub_free(job->line);
+		hub_free(job);
+	}
+
+	sql_execute(data, null_callback, NULL,
+		"DELETE FROM chat_history WHERE rowid <= (SELECT rowid FROM chat_history ORDER BY rowid DESC LIMIT 1 OFFSET %d);",
+		(int) data->history_max);
+	sql_execute(data, null_callback, NULL, "COMMIT;");
+
+	if (vacuum)
+		sql_execute(data, null_callback, NULL, "VACUUM;");
+}
+
+static void* history_writer(void* ptr)
 {
-	struct linked_list* messages = (struct linked_list*) ptr;
-	struct chat_history_line* line = hub_malloc(sizeof(struct chat_history_line));
-	int i = 0;
-	
-	memset(line, 0, sizeof(struct chat_history_line));
-	
-	for (; i < argc; i++) {
-		if (strcmp(colName[i], "from_nick") == 0)
-			strncpy(line->from, argv[i], MAX_NICK_LEN);
-		else if (strcmp(colName[i], "message") == 0)
-			strncpy(line->message, argv[i], MAX_HISTORY_SIZE);
-		else if (strcmp(colName[i], "time") == 0)
-			strncpy(line->time, argv[i], 20);
+	struct chat_history_data* data = (struct chat_history_data*) ptr;
+	struct chat_history_job* jobs;
+	sqlite3_stmt* insert = NULL;
+
+	sqlite3_prepare_v2(data->db, HISTORY_INSERT, -1, &insert, NULL);
+
+	for (;;)
+	{
+		uhub_mutex_lock(&data->lock);
+		while (!data->jobs_first && !data->stop)
+			uhub_cond_wait(&data->cond, &data->lock);
+
+		/* Take everything, and write what is left before stopping */
+		jobs = data->jobs_first;
+		data->jobs_first = NULL;
+		data->jobs_last = NULL;
+		uhub_mutex_unlock(&data->lock);
+
+		if (!jobs)
+			break;
+
+		if (insert)
+			history_write(data, insert, jobs);
 	}
-	
-	list_append(messages, line);
-	
-	return 0;
+
+	sqlite3_finalize(insert);
+	return NULL;
+}
+
+/**
+ * Queue a job for the writer, or write it right away if there is none.
+ */
+static void history_job_queue(struct chat_history_data* data, struct chat_history_job* job)
+{
+	sqlite3_stmt* insert = NULL;
+
+	if (!data->writer)
+	{
+		if (sqlite3_prepare_v2(data->db, HISTORY_INSERT, -1, &insert, NULL) == SQLITE_OK)
+			history_write(data, insert, job);
+		else
+		{
+			hub_free(job->line);
+			hub_free(job);
+		}
+		sqlite3_finalize(insert);
+		return;
+	}
+
+	uhub_mutex_lock(&data->lock);
+	if (data->jobs_last)
+		data->jobs_last->next = job;
+	else
+		data->jobs_first = job;
+	data->jobs_last = job;
+	uhub_cond_signal(&data->cond);
+	uhub_mutex_unlock(&data->lock);
+}
+
+/**
+ * Add a chat message to history.
+ */
+static void history_add(struct plugin_handle* plugin, struct plugin_user* from, const char* message, int flags)
+{
+	struct chat_history_data* data = (struct chat_history_data*) plugin->ptr;
+	struct chat_history_line* line;
+	struct chat_history_job* job;
+	char timestamp[20];
+	time_t now = time(NULL);
+
+	if (!data->history_max)
+		return;
+
+	/* The same format as DATETIME('NOW') */
+	strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M:%S", gmtime(&now));
+
+	line = history_line_create(from->nick, message, timestamp);
+	if (!line)
+		return;
+
+	history_push(data, line);
+	history_invalidate(plugin);
+
+	job = hub_malloc_zero(sizeof(struct chat_history_job));
+	if (!job)
+		return;
+	job->type = history_job_insert;
+	job->line = history_line_copy(line);
+	if (!job->line)
+	{
+		hub_free(job);
+		return;
+	}
+	history_job_queue(data, job);
 }
 
 void user_login(struct plugin_handle* plugin, struct plugin_user* user)
 {
 	struct chat_history_data* data = (struct chat_history_data*) plugin->ptr;
-	struct cbuffer* buf = NULL;
-	struct linked_list* found = (struct linked_list*) list_create();
-	
-	sql_execute(data, get_messages_callback, found, "SELECT * FROM chat_history ORDER BY time DESC LIMIT 0,%d;", (int) data->history_connect);
+	struct cbuffer* buf;
+
+	if (!data->history_connect || !data->count)
+		return;
 
-	if (data->history_connect > 0 && list_size(found) > 0)
+	if (!data->connect_message)
 	{
 		buf = cbuf_create(MAX_HISTORY_SIZE);
 		cbuf_append(buf, "Chat history:\n\n");
-		struct chat_history_line* history_line;
-		history_line = (struct chat_history_line*) list_get_last(found);
-		while (history_line)
-		{
-			cbuf_append_format(buf, "[%s] <%s> %s\n", history_line->time, history_line->from, history_line->message);
-			list_remove(found, history_line);
-			hub_free(history_line);
-			history_line = (struct chat_history_line*) list_get_last(found);
-		}
-		plugin->hub.send_message(plugin, user, cbuf_get(buf));
+		history_format(data, buf, data->history_connect);
+		data->connect_message = plugin->hub.message_create(plugin, cbuf_get(buf));
 		cbuf_destroy(buf);
 	}
-	list_clear(found, &hub_free);
-	list_destroy(found);
+
+	if (data->connect_message)
+		plugin->hub.send_prepared_message(plugin, user, data->connect_message);
 }
 
 /**
@@ -171,7 +391,6 @@ static int command_history(struct plugin_handle* plugin, struct plugin_user* use
 {
 	struct chat_history_data* data = (struct chat_history_data*) plugin->ptr;
 	struct cbuffer* buf = cbuf_create(MAX_HISTORY_SIZE);
-	struct linked_list* found = (struct linked_list*) list_create();
 	struct plugin_command_arg_data* arg = plugin->hub.command_arg_next(plugin, cmd, plugin_cmd_arg_type_integer);
 	int maxlines;
 
@@ -180,22 +399,10 @@ static int command_history(struct plugin_handle* plugin, struct plugin_user* use
 	else
 		maxlines = data->history_default;
 
-	sql_execute(data, get_messages_callback, found, "SELECT * FROM chat_history ORDER BY time DESC LIMIT 0,%d;", maxlines);
-
-	size_t linecount = list_size(found);
-
-	if (linecount > 0)
+	if (maxlines > 0 && data->count > 0)
 	{
 		cbuf_append_format(buf, "*** %s: Chat History:\n\n", cmd->prefix);
-		struct chat_history_line* history_line;
-		history_line = (struct chat_history_line*) list_get_last(found);
-		while (history_line)
-		{
-			cbuf_append_format(buf, "[%s] <%s> %s\n", history_line->time, history_line->from, history_line->message);
-			list_remove(found, history_line);
-			hub_free(history_line);
-			history_line = (struct chat_history_line*) list_get_last(found);
-		}
+		history_format(data, buf, (size_t) maxlines);
 	}
 	else
 	{
@@ -204,9 +411,6 @@ static int command_history(struct plugin_handle* plugin, struct plugin_user* use
 
 	plugin->hub.send_message(plugin, user, cbuf_get(buf));
 	cbuf_destroy(buf);
-	list_clear(found, &hub_free);
-	list_destroy(found);
-
 	return 0;
 }
 
@@ -214,20 +418,23 @@ static int command_historycleanup(struct plugin_handle* plugin, struct plugin_us
 {
 	struct chat_history_data* data = (struct chat_history_data*) plugin->ptr;
 	struct cbuffer* buf = cbuf_create(128);
-	int rc = 0;
+	struct chat_history_job* job = hub_malloc_zero(sizeof(struct chat_history_job));
 
-	rc = sql_execute(data, null_callback, NULL, "DELETE FROM chat_history;");
- 
-	if (!rc)
+	if (!job)
+	{
 		cbuf_append_format(buf, "*** %s: Unable to clean chat history table.", cmd->prefix);
+	}
 	else
+	{
+		history_clear(data);
+		history_invalidate(plugin);
+		job->type = history_job_clear;
+		history_job_queue(data, job);
 		cbuf_append_format(buf, "*** %s: Cleaned chat history table.", cmd->prefix);
+	}
 
 	plugin->hub.send_message(plugin, user, cbuf_get(buf));
 	cbuf_destroy(buf);
-
-	sql_execute(data, null_callback, NULL, "VACUUM;");
-
 	return 0;
 }
 
@@ -305,12 +512,12 @@ static struct chat_history_data* parse_config(const char* line, struct plugin_ha
 int plugin_register(struct plugin_handle* plugin, const char* config)
 {
 	struct chat_history_data* data;
-	PLUGIN_INITIALIZE(plugin, "SQLite chat history plugin", "1.0", "Provide a global chat history log.");
+	PLUGIN_INITIALIZE(plugin, "SQLite chat history plugin", "1.1", "Provide a global chat history log.");
 
 	plugin->funcs.on_user_chat_message = history_add;
 	plugin->funcs.on_user_login = user_login;
 	data = parse_config(config, plugin);
-	
+
 	if (!data)
 		return -1;
 
@@ -318,6 +525,13 @@ int plugin_register(struct plugin_handle* plugin, const char* config)
 
 	create_tables(plugin);
 
+	data->lines = hub_malloc_zero(MAX(data->history_max, 1) * sizeof(struct chat_history_line*));
+	history_load(data);
+
+	uhub_mutex_init(&data->lock);
+	uhub_cond_init(&data->cond);
+	data->writer = uhub_thread_create(history_writer, data);
+
 	data->command_history_handle = (struct plugin_command_handle*) hub_malloc(sizeof(struct plugin_command_handle));
 	PLUGIN_COMMAND_INITIALIZE(data->command_history_handle, plugin, "history", "?N", auth_cred_guest, &command_history, "Show chat message history.");
 	plugin->hub.command_add(plugin, data->command_history_handle);
@@ -335,8 +549,21 @@ int plugin_unregister(struct plugin_handle* plugin)
 
 	if (data)
 	{
+		uhub_mutex_lock(&data->lock);
+		data->stop = 1;
+		uhub_cond_signal(&data->cond);
+		uhub_mutex_unlock(&data->lock);
+		if (data->writer)
+			uhub_thread_join(data->writer);
+		uhub_cond_destroy(&data->cond);
+		uhub_mutex_destroy(&data->lock);
+
 		sqlite3_close(data->db);
 
+		history_invalidate(plugin);
+		history_clear(data);
+		hub_free(data->lines);
+
 		plugin->hub.command_del(plugin, data->command_history_handle);
 		plugin->hub.command_del(plugin, data->command_historycleanup_handle);
 		hub_free(data->command_history_handle);
@@ -346,4 +573,3 @@ int plugin_unregister(struct plugin_handle* plugin)
 
 	return 0;
 }
-
@@ -132,14 +132,14 @@ static void on_user_logout(struct plugin_handle* plugin, struct plugin_user* use
 	info->sid = 0;
 }
 
-plugin_st on_chat_msg(struct plugin_handle* plugin, struct plugin_user* from, const char* message)
+plugin_st on_chat_msg(struct plugin_handle* plugin, struct plugin_user* from, const struct plugin_message_view* message)
 {
 	struct chat_data* data = (struct chat_data*) plugin->ptr;
 	if (from->credentials >=
 	return st_default;
 }
 
-plugin_st on_private_msg(struct plugin_handle* plugin, struct plugin_user* from, struct plugin_user* to, const char* message)
+plugin_st on_private_msg(struct plugin_handle* plugin, struct plugin_user* from, struct plugin_user* to, const struct plugin_message_view* message)
 {
 	return st_default;
 }
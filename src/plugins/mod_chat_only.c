@@ -86,12 +86,12 @@ static struct user_info* get_user_info(struct chat_only_data* data, sid_t sid)
 	return u;
 }
 
-static plugin_st on_search_result(struct plugin_handle* plugin, struct plugin_user* from, struct plugin_user* to, const char* search_data)
+static plugin_st on_search_result(struct plugin_handle* plugin, struct plugin_user* from, struct plugin_user* to, const struct plugin_message_view* result)
 {
 	return st_deny;
 }
 
-static plugin_st on_search(struct plugin_handle* plugin, struct plugin_user* user, const char* search_data)
+static plugin_st on_search(struct plugin_handle* plugin, struct plugin_user* user, const struct plugin_message_view* search)
 {
 	struct chat_only_data* data = (struct chat_only_data*) plugin->ptr;
 	struct user_info* info = get_user_info(data, user->sid);
@@ -26,10 +26,16 @@
 
 #include "util/misc.h"
 #include "util/config_token.h"
+#include "util/threads.h"
+#include "util/logring.h"
 #ifndef WIN32
 #include <syslog.h>
+#include <sys/uio.h>
 #endif
 
+#define LOG_RING_SLOTS 4096
+#define LOG_MESSAGE_SIZE 1024
+
 struct ip_addr_encap;
 
 struct log_data
@@ -40,6 +46,7 @@ struct log_data
 	} logmode;
 	char* logfile;
 	int fd;
+	struct log_ring* ring;  /* NULL if writing from the event loop */
 };
 
 static void reset(struct log_data* data)
@@ -48,6 +55,7 @@ static void reset(struct log_data* data)
 	data->logmode = mode_file;
 	data->logfile = NULL;
 	data->fd = -1;
+	data->ring = NULL;
 }
 
 static void set_error_message(struct plugin_handle* plugin, const char* msg)
@@ -155,8 +163,116 @@ static struct log_data* parse_config(const char* line, struct plugin_handle* plu
 	return data;
 }
 
+static void log_sync(struct log_data* data)
+{
+#ifdef WIN32
+	_commit(data->fd);
+#else
+#if defined _POSIX_SYNCHRONIZED_IO && _POSIX_SYNCHRONIZED_IO > 0
+	fdatasync(data->fd);
+#else
+	fsync(data->fd);
+#endif
+#endif
+}
+
+static size_t log_timestamp(time_t t, char* buf)
+{
+	struct tm tm;
+#ifdef WIN32
+	localtime_s(&tm, &t);
+#else
+	localtime_r(&t, &tm);
+#endif
+	return strftime(buf, 32, "%Y-%m-%d %H:%M:%S ", &tm);
+}
+
+/*
+ * Called by the writer thread with as many messages as have piled up.
+ * They are written together and synced once.
+ */
+static void log_write(void* ptr, struct log_ring_entry* entries, size_t count, size_t dropped)
+{
+	struct log_data* data = (struct log_data*) ptr;
+	char timestamps[LOG_RING_BATCH][32];
+	char notice[64];
+	size_t n;
+
+	if (data->logmode == mode_file)
+	{
+#ifndef WIN32
+		struct iovec iov[LOG_RING_BATCH * 2];
+		struct iovec* next = iov;
+		int iovcnt = 0;
+		ssize_t ret;
+#endif
+
+		if (dropped)
+		{
+			snprintf(notice, sizeof(notice), "Dropped     " PRINTF_SIZE_T " log messages\n", dropped);
+			log_timestamp(time(NULL), timestamps[0]);
+			if (write(data->fd, timestamps[0], 20) < 0 || write(data->fd, notice, strlen(notice)) < 0)
+				return;
+		}
+
+#ifndef WIN32
+		for (n = 0; n < count; n++)
+		{
+			iov[iovcnt].iov_base = timestamps[n];
+			iov[iovcnt++].iov_len = log_timestamp(entries[n].time, timestamps[n]);
+			iov[iovcnt].iov_base = (void*) entries[n].message;
+			iov[iovcnt++].iov_len = entries[n].length;
+		}
+
+		while (iovcnt)
+		{
+			ret = writev(data->fd, next, iovcnt);
+			if (ret < 0)
+			{
+				if (errno == EINTR)
+					continue;
+				fprintf(stderr, "Unable to write full log. Error=%d: %s\n", errno, strerror(errno));
+				return;
+			}
+
+			while (iovcnt && (size_t) ret >= next->iov_len)
+			{
+				ret -= next->iov_len;
+				next++;
+				iovcnt--;
+			}
+
+			if (iovcnt)
+			{
+				next->iov_base = (char*) next->iov_base + ret;
+				next->iov_len -= ret;
+			}
+		}
+#else
+		for (n = 0; n < count; n++)
+		{
+			if (write(data->fd, timestamps[0], log_timestamp(entries[n].time, timestamps[0])) < 0 || write(data->fd, entries[n].message, entries[n].length) < 0)
+				return;
+		}
+#endif
+		log_sync(data);
+	}
+#ifndef WIN32
+	else
+	{
+		if (dropped)
+			syslog(LOG_WARNING, "Dropped " PRINTF_SIZE_T " log messages", dropped);
+		for (n = 0; n < count; n++)
+			syslog(LOG_INFO, "%s", entries[n].message);
+	}
+#endif
+}
+
 static void log_close(struct log_data* data)
 {
+	/* Writes out whatever is left */
+	log_ring_destroy(data->ring);
+
 	if (data->logmode == mode_file)
 	{
 		hub_free(data->logfile);
@@ -173,21 +289,26 @@ static void log_close(struct log_data* data)
 
 static void log_message(struct log_data* data, const char *format, ...)
 {
-	static char logmsg[1024];
-	struct tm *tmp;
-	time_t t;
+	static char logmsg[LOG_MESSAGE_SIZE];
 	va_list args;
 	ssize_t size = 0;
 
+	if (data->ring)
+	{
+		va_start(args, format);
+		log_ring_add(data->ring, 0, format, args);
+		va_end(args);
+		return;
+	}
+
 	if (data->logmode == mode_file)
 	{
-		t = time(NULL);
-		tmp = localtime(&t);
-		strftime(logmsg, 32, "%Y-%m-%d %H:%M:%S ", tmp);
+		log_timestamp(time(NULL), logmsg);
 
 		va_start(args, format);
-		size = vsnprintf(logmsg + 20, 1004, format, args);
+		size = vsnprintf(logmsg + 20, LOG_MESSAGE_SIZE - 20, format, args);
 		va_end(args);
+		size = MIN(size, LOG_MESSAGE_SIZE - 21);
 
 		if (write(data->fd, logmsg, size + 20) < (size+20))
 		{
@@ -195,15 +316,7 @@ static void log_message(struct log_data* data, const char *format, ...)
 		}
 		else
 		{
-#ifdef WIN32
-			_commit(data->fd);
-#else
-#if defined _POSIX_SYNCHRONIZED_IO && _POSIX_SYNCHRONIZED_IO > 0
-			fdatasync(data->fd);
-#else
-			fsync(data->fd);
-#endif
-#endif
+			log_sync(data);
 		}
 	}
 #ifndef WIN32
@@ -254,6 +367,9 @@ int plugin_register(struct plugin_handle* plugin, const char* config)
 	plugin->ptr = parse_config(config, plugin);
 	if (!plugin->ptr)
 		return -1;
+
+	/* Keep the disk out of the event loop, or write directly if we cannot */
+	((struct log_data*) plugin->ptr)->ring = log_ring_create(LOG_RING_SLOTS, LOG_MESSAGE_SIZE, log_write, plugin->ptr);
 	return 0;
 }
 
@@ -20,14 +20,14 @@
 #include "plugin_api/handle.h"
 #include "util/memory.h"
 
-static plugin_st on_search_result(struct plugin_handle* plugin, struct plugin_user* from, struct plugin_user* to, const char* search_data)
+static plugin_st on_search_result(struct plugin_handle* plugin, struct plugin_user* from, struct plugin_user* to, const struct plugin_message_view* result)
 {
 	if (to->credentials >= auth_cred_user)
 		return st_default;
 	return st_deny;
 }
 
-static plugin_st on_search(struct plugin_handle* plugin, struct plugin_user* user, const char* search_data)
+static plugin_st on_search(struct plugin_handle* plugin, struct plugin_user* user, const struct plugin_message_view* search)
 {
 	// Registered users are allowed to search.
 	if (user->credentials >= auth_cred_user)
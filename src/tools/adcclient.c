@@ -21,7 +21,6 @@
 
 #define ADC_HANDSHAKE "HSUP ADBASE ADTIGR ADPING\n"
 #define ADC_CID_SIZE 39
-#define BIG_BUFSIZE 32768
 #define TIGERSIZE 24
 #define MAX_RECV_BUFFER 65536
 
@@ -56,6 +55,7 @@ enum ADC_client_flags
 	cflag_ssl = 1,
 	cflag_choke = 2,
 	cflag_pipe = 4,
+	cflag_local = 8, /* hostname is the path of a unix socket */
 };
 
 struct ADC_client_address
@@ -398,34 +398,51 @@ static int ADC_client_on_recv_line(struct ADC_client* client, const char* line,
 
 static ssize_t ADC_client_recv(struct ADC_client* client)
 {
-	static char buf[BIG_BUFSIZE];
 	struct ioq_recv* q = client->recv_queue;
-	size_t buf_size = ioq_recv_get(q, buf, BIG_BUFSIZE);
+	char* buf;
+	size_t space;
 	ssize_t size;
 
 	ADC_TRACE;
 
-	if (client->flags & cflag_choke)
-		buf_size = 0;
-	size = net_con_recv(client->con, buf + buf_size, BIG_BUFSIZE - buf_size);
+	buf = ioq_recv_reserve(q, &space);
+	if (!buf)
+		return -1;
+
+	if (!space)
+	{
+		ioq_recv_clear(q);
+		client->flags |= cflag_choke;
+		LOG_WARN("Received message past MAX_RECV_BUFFER (%d), dropping message.", MAX_RECV_BUFFER);
+		buf = ioq_recv_reserve(q, &space);
+		if (!buf)
+			return -1;
+	}
 
-	if (size > 0)
-		buf_size += size;
+	size = net_con_recv(client->con, buf, space);
 
 	if (size < 0)
+	{
+		ioq_recv_commit(q, 0);
 		return -1;
+	}
 	else if (size == 0)
+	{
+		ioq_recv_commit(q, 0);
 		return 0;
+	}
 	else
 	{
-		char* lastPos = 0;
-		char* start = buf;
+		char* start;
 		char* pos = 0;
-		size_t remaining = buf_size;
+		size_t remaining;
+
+		ioq_recv_commit(q, size);
+		buf = ioq_recv_data(q, &remaining);
+		start = buf;
 
 		while ((pos = memchr(start, '\n', remaining)))
 		{
-			lastPos = pos+1;
 			pos[0] = '\0';
 
 #ifdef DEBUG_SENDQ
@@ -449,22 +466,19 @@ static ssize_t ADC_client_recv(struct ADC_client* client)
 			start = pos;
 		}
 
-		if (lastPos || remaining)
+		/* The unparsed tail stays in the buffer */
+		ioq_recv_consume(q, start - buf);
+
+		if (remaining && (client->flags & cflag_choke))
 		{
-			if (remaining < (size_t) MAX_RECV_BUFFER)
-			{
-				ioq_recv_set(q, lastPos ? lastPos : buf, remaining);
-			}
-			else
-			{
-				ioq_recv_set(q, 0, 0);
-				client->flags |= cflag_choke;
-				LOG_WARN("Received message past MAX_RECV_BUFFER (%d), dropping message.", MAX_RECV_BUFFER);
-			}
+			/* Still the rest of a message that is being dropped */
+			ioq_recv_clear(q);
 		}
-		else
+		else if (remaining >= (size_t) MAX_RECV_BUFFER)
 		{
-			ioq_recv_set(q, 0, 0);
+			ioq_recv_clear(q);
+			client->flags |= cflag_choke;
+			LOG_WARN("Received message past MAX_RECV_BUFFER (%d), dropping message.", MAX_RECV_BUFFER);
 		}
 	}
 	return 0;
@@ -559,7 +573,7 @@ struct ADC_client* ADC_client_create(const char* nickname, const char* descripti
 	client->desc = hub_strdup(description);
 
 	client->send_queue = ioq_send_create();
-	client->recv_queue = ioq_recv_create();
+	client->recv_queue = ioq_recv_create(MAX_RECV_BUFFER);
 
 	client->ptr = ptr;
 
@@ -638,6 +652,23 @@ int ADC_client_connect(struct ADC_client* client, const char* address)
 	}
 
 	ADC_client_set_state(client, ps_conn);
+
+#ifndef WIN32
+	if (client->flags & cflag_local)
+	{
+		int sd = net_connect_unix(client->address.hostname);
+		if (sd == -1)
+		{
+			ADC_client_set_state(client, ps_none);
+			return 0;
+		}
+		client->con = net_con_create();
+		net_con_initialize(client->con, sd, event_callback, client, 0);
+		ADC_client_on_connected(client);
+		return 1;
+	}
+#endif
+
 	client->connect_job = net_con_connect(client->address.hostname, client->address.port, connect_callback, client);
 	if (!client->connect_job)
 	{
@@ -727,6 +758,17 @@ static int ADC_client_parse_address(struct ADC_client* client, const char* arg)
 	if (!arg)
 		return 0;
 
+	/* A hub on the same host, "unix:<path>" */
+	if (!strncmp(arg, "unix:", 5) && arg[5])
+	{
+		client->flags &= ~cflag_ssl;
+		client->flags |= cflag_local;
+		client->address.protocol = ADC;
+		client->address.port = 0;
+		client->address.hostname = strdup(arg + 5);
+		return 1;
+	}
+
 	/* Minimum length of a valid address */
 	if (strlen(arg) < 9)
 		return 0;
@@ -172,6 +172,7 @@ static void perf_chat(struct ADC_client* client, int priv)
 		cmd = adc_msg_construct_source_dest(ADC_CMD_DMSG, ADC_client_get_sid(client), ADC_client_get_sid(client), strlen(msg));
 	else
 		cmd = adc_msg_construct_source(ADC_CMD_BMSG, ADC_client_get_sid(client), strlen(msg));
+	adc_msg_add_argument(cmd, msg);
 	hub_free(msg);
 
 	ADC_client_send(client, cmd);
@@ -466,7 +467,7 @@ static void print_usage(const char* program)
 {
 	print_version();
 
-	printf("Usage: %s [adc[s]://<host>:<port>] [options]\n", program);
+	printf("Usage: %s [adc[s]://<host>:<port> | unix:<path>] [options]\n", program);
 
 	printf("\n");
 	printf("  OPTIONS\n");
@@ -483,6 +484,12 @@ static void print_usage(const char* program)
 
 int parse_address(const char* arg)
 {
+	if (arg && !strncmp(arg, "unix:", 5) && arg[5])
+	{
+		cfg_uri = arg;
+		return 1;
+	}
+
 	if (!arg || strlen(arg) < 9)
 		return 0;
 
@@ -238,7 +238,7 @@ int main(int argc, char** argv)
 {
 	if (argc < 2)
 	{
-		printf("Usage: %s adc[s]://host:port\n", argv[0]);
+		printf("Usage: %s adc[s]://host:port | unix:path\n", argv[0]);
 		return 1;
 	}
 
@@ -0,0 +1,330 @@
+/*
+ * uhub - A tiny ADC p2p connection hub
+ * Copyright (C) 2007-2014, Jan Vidar Krey
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * Loads an authentication plugin the way the hub does, and looks up
+ * users at a fixed rate, reporting how long the answers take.
+ *
+ * The database is filled with registered users first if it has none,
+ * named user0, user1, ... A share of the lookups are for nicknames
+ * that are not registered, like guests logging in.
+ */
+
+#include "uhub.h"
+#include <sqlite3.h>
+#include <dlfcn.h>
+
+#define AUTHBENCH_USERS_DEFAULT 500000
+#define AUTHBENCH_RATE_DEFAULT 10000
+#define AUTHBENCH_TIME_DEFAULT 10
+
+struct authbench_op
+{
+	uint64_t start;                     /* ns */
+	uint64_t latency;                   /* ns, 0 if not answered yet */
+	struct auth_info info;
+};
+
+static int g_users = AUTHBENCH_USERS_DEFAULT;
+static int g_rate = AUTHBENCH_RATE_DEFAULT;
+static int g_time = AUTHBENCH_TIME_DEFAULT;
+static int g_guests = 10;               /* percent */
+static int g_async = 0;
+static const char* g_config = "";
+
+static struct authbench_op* g_ops;
+static struct authbench_op* g_offered;  /* Offered to the plugin during a lookup */
+static size_t g_found;
+static uhub_mutex_t g_lock;
+static size_t g_answered;
+
+static uint64_t authbench_now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static struct plugin_async* authbench_async_defer(struct plugin_handle* plugin)
+{
+	struct authbench_op* op = g_offered;
+	g_offered = NULL;
+	return (struct plugin_async*) op;
+}
+
+static void authbench_async_complete(struct plugin_handle* plugin, struct plugin_async* async, plugin_st status)
+{
+	struct authbench_op* op = (struct authbench_op*) async;
+	uint64_t latency = authbench_now() - op->start;
+
+	uhub_mutex_lock(&g_lock);
+	op->latency = latency ? latency : 1;
+	g_answered++;
+	if (status == st_allow)
+		g_found++;
+	uhub_mutex_unlock(&g_lock);
+}
+
+static int authbench_populate(const char* file)
+{
+	sqlite3* db;
+	sqlite3_stmt* stmt;
+	char nick[MAX_NICK_LEN+1];
+	char pass[MAX_PASS_LEN+1];
+	int users = 0;
+	int n;
+
+	if (sqlite3_open(file, &db) != SQLITE_OK)
+	{
+		fprintf(stderr, "Unable to open %s\n", file);
+		return 0;
+	}
+
+	if (sqlite3_prepare_v2(db, "SELECT COUNT(*) FROM users;", -1, &stmt, NULL) == SQLITE_OK)
+	{
+		if (sqlite3_step(stmt) == SQLITE_ROW)
+			users = sqlite3_column_int(stmt, 0);
+		sqlite3_finalize(stmt);
+		if (users)
+		{
+			g_users = users;
+			sqlite3_close(db);
+			return 1;
+		}
+	}
+
+	printf("Creating %d users...\n", g_users);
+	sqlite3_exec(db, "CREATE TABLE IF NOT EXISTS users"
+		"("
+			"nickname CHAR NOT NULL UNIQUE,"
+			"password CHAR NOT NULL,"
+			"credentials CHAR NOT NULL DEFAULT 'user',"
+			"created TIMESTAMP DEFAULT (DATETIME('NOW')),"
+			"activity TIMESTAMP DEFAULT (DATETIME('NOW'))"
+		");", NULL, NULL, NULL);
+	sqlite3_exec(db, "BEGIN;", NULL, NULL, NULL);
+
+	if (sqlite3_prepare_v2(db, "INSERT INTO users (nickname, password) VALUES(?1, ?2);", -1, &stmt, NULL) != SQLITE_OK)
+	{
+		fprintf(stderr, "Unable to create users: %s\n", sqlite3_errmsg(db));
+		sqlite3_close(db);
+		return 0;
+	}
+
+	for (n = 0; n < g_users; n++)
+	{
+		snprintf(nick, sizeof(nick), "user%d", n);
+		snprintf(pass, sizeof(pass), "pass%d", n);
+		sqlite3_bind_text(stmt, 1, nick, -1, SQLITE_STATIC);
+		sqlite3_bind_text(stmt, 2, pass, -1, SQLITE_STATIC);
+		sqlite3_step(stmt);
+		sqlite3_reset(stmt);
+	}
+	sqlite3_finalize(stmt);
+	sqlite3_exec(db, "COMMIT;", NULL, NULL, NULL);
+	sqlite3_close(db);
+	return 1;
+}
+
+static int authbench_compare(const void* a, const void* b)
+{
+	uint64_t x = *((const uint64_t*) a);
+	uint64_t y = *((const uint64_t*) b);
+	return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+static void authbench_report(size_t count, uint64_t elapsed)
+{
+	uint64_t* latency = hub_malloc(count * sizeof(uint64_t));
+	size_t n;
+
+	for (n = 0; n < count; n++)
+		latency[n] = g_ops[n].latency;
+	qsort(latency, count, sizeof(uint64_t), authbench_compare);
+
+	printf("Lookups:  " PRINTF_SIZE_T " (" PRINTF_SIZE_T " registered) in %.2f seconds, %.0f/s\n",
+		count, g_found, elapsed / 1e9, count / (elapsed / 1e9));
+	printf("Latency:  p50 %.1f us, p90 %.1f us, p99 %.1f us, p99.9 %.1f us, max %.1f us\n",
+		latency[count / 2] / 1e3,
+		latency[count * 90 / 100] / 1e3,
+		latency[count * 99 / 100] / 1e3,
+		latency[count * 999 / 1000] / 1e3,
+		latency[count - 1] / 1e3);
+	hub_free(latency);
+}
+
+static int authbench_run(const char* filename, const char* database)
+{
+	struct plugin_handle plugin;
+	plugin_register_f register_f;
+	plugin_unregister_f unregister_f;
+	struct authbench_op* op;
+	char config[1024];
+	char nick[MAX_NICK_LEN+1];
+	size_t count = (size_t) g_rate * g_time;
+	uint64_t interval = 1000000000 / g_rate;
+	uint64_t started, now, elapsed;
+	size_t n;
+	int id;
+	plugin_st status;
+	void* handle;
+
+	handle = dlopen(filename, RTLD_LAZY);
+	if (!handle)
+	{
+		fprintf(stderr, "Unable to load %s: %s\n", filename, dlerror());
+		return 0;
+	}
+
+	register_f = (plugin_register_f) dlsym(handle, "plugin_register");
+	unregister_f = (plugin_unregister_f) dlsym(handle, "plugin_unregister");
+	if (!register_f || !unregister_f)
+	{
+		fprintf(stderr, "%s is not a plugin\n", filename);
+		return 0;
+	}
+
+	memset(&plugin, 0, sizeof(plugin));
+	plugin.hub.async_defer = authbench_async_defer;
+	plugin.hub.async_complete = authbench_async_complete;
+	snprintf(config, sizeof(config), "file=%s %s", database, g_config);
+
+	if (register_f(&plugin, config) != 0 || !plugin.funcs.auth_get_user)
+	{
+		fprintf(stderr, "Unable to initialize %s: %s\n", filename, plugin.error_msg ? plugin.error_msg : "no auth_get_user");
+		return 0;
+	}
+	printf("%s %s: %d lookups/s for %d seconds, %d%% unregistered, answered %s\n",
+		plugin.name, plugin.version, g_rate, g_time, g_guests, g_async ? "later" : "right away");
+
+	g_ops = hub_malloc_zero(count * sizeof(struct authbench_op));
+	uhub_mutex_init(&g_lock);
+	srand(1);
+
+	started = authbench_now();
+	for (n = 0; n < count; n++)
+	{
+		/* Keep to the rate, without catching up in bursts */
+		now = authbench_now();
+		if (now < started + n * interval)
+		{
+			struct timespec ts;
+			ts.tv_sec = 0;
+			ts.tv_nsec = (long) (started + n * interval - now);
+			nanosleep(&ts, NULL);
+		}
+
+		id = rand() % g_users;
+		if (rand() % 100 < g_guests)
+			snprintf(nick, sizeof(nick), "guest%d", id);
+		else
+			snprintf(nick, sizeof(nick), "user%d", id);
+
+		op = &g_ops[n];
+		g_offered = g_async ? op : NULL;
+		op->start = authbench_now();
+		status = plugin.funcs.auth_get_user(&plugin, nick, &op->info);
+		g_offered = NULL;
+		if (status != st_pending)
+			authbench_async_complete(&plugin, (struct plugin_async*) op, status);
+	}
+
+	/* Wait for the answers still pending */
+	for (;;)
+	{
+		uhub_mutex_lock(&g_lock);
+		n = g_answered;
+		uhub_mutex_unlock(&g_lock);
+		if (n == count)
+			break;
+		usleep(1000);
+	}
+	elapsed = authbench_now() - started;
+
+	authbench_report(count, elapsed);
+	unregister_f(&plugin);
+	uhub_mutex_destroy(&g_lock);
+	hub_free(g_ops);
+	dlclose(handle);
+	return 1;
+}
+
+static void print_usage(const char* program)
+{
+	fprintf(stderr, "Usage: %s [options] <plugin> <database>\n"
+		"Looks up users in an authentication plugin at a fixed rate.\n\n"
+		"Options:\n"
+		"   -u <num>    Registered users to create, if the database has none (default: %d)\n"
+		"   -r <num>    Lookups per second (default: %d)\n"
+		"   -t <secs>   Seconds to run (default: %d)\n"
+		"   -g <pct>    Percentage of lookups for unregistered users (default: 10)\n"
+		"   -a          Let the plugin answer later, as when users log in\n"
+		"   -c <params> Additional plugin parameters\n"
+		"   -h          This message.\n"
+		"\n", program, AUTHBENCH_USERS_DEFAULT, AUTHBENCH_RATE_DEFAULT, AUTHBENCH_TIME_DEFAULT);
+}
+
+int main(int argc, char** argv)
+{
+	int opt;
+
+	while ((opt = getopt(argc, argv, "u:r:t:g:ac:h")) != -1)
+	{
+		switch (opt)
+		{
+			case 'u':
+				g_users = uhub_atoi(optarg);
+				break;
+
+			case 'r':
+				g_rate = uhub_atoi(optarg);
+				break;
+
+			case 't':
+				g_time = uhub_atoi(optarg);
+				break;
+
+			case 'g':
+				g_guests = uhub_atoi(optarg);
+				break;
+
+			case 'a':
+				g_async = 1;
+				break;
+
+			case 'c':
+				g_config = optarg;
+				break;
+
+			default:
+				print_usage(argv[0]);
+				return EXIT_FAILURE;
+		}
+	}
+
+	if (argc - optind != 2 || g_users < 1 || g_rate < 1 || g_time < 1)
+	{
+		print_usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	if (!authbench_populate(argv[optind + 1]) || !authbench_run(argv[optind], argv[optind + 1]))
+		return EXIT_FAILURE;
+	return EXIT_SUCCESS;
+}
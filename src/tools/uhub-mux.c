@@ -0,0 +1,1424 @@
+/*
+ * uhub - A tiny ADC p2p connection hub
+ * Copyright (C) 2007-2014, Jan Vidar Krey
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/*
+ * uhub-mux accepts client connections and carries the users to a hub
+ * over a single MUX1 link (see core/mux.h), so the accept, TLS and
+ * socket work can be spread over several processes or hosts while the
+ * hub only does the routing.
+ *
+ * A hub on the same host can be reached over a unix socket, in which case
+ * the link moves to a shared memory ring once connected (see network/shmring.h).
+ */
+
+#include "uhub.h"
+
+#define MUXD_MAX_HUBS      16
+#define MUXD_MAX_LINE      (MUX1_MAX_FRAME - 1 - 8)  /* an 'M' frame with one record */
+#define MUXD_MAX_FRAME     (16 * 1024 * 1024)        /* largest frame accepted from a hub */
+#define MUXD_MAX_FEATURES  16
+#define MUXD_RECONNECT     5                         /* seconds */
+#define MUXD_BACKLOG       1024
+#define MUXD_RING_READS    16                        /* reads from the ring per wakeup */
+#ifdef USE_SHM_RING
+#define MUXD_RING_SIZE     SHM_LINK_DEFAULT_SIZE
+#else
+#define MUXD_RING_SIZE     0
+#endif
+
+enum muxd_ring_state
+{
+	muxd_ring_none,                                  /* frames go over the socket */
+	muxd_ring_requested,                             /* waiting for the hub's reply */
+	muxd_ring_switch,                                /* frames go to the ring once the send queue is empty */
+	muxd_ring_up,                                    /* frames in both directions go over the ring */
+};
+
+struct muxd_client;
+
+struct muxd_hub
+{
+	char*                   name;               /** For logging */
+	char*                   address;            /** Hub address, or the socket path for a local hub */
+	uint16_t                port;
+	int                     local;              /** Connected over a unix socket */
+	char*                   listen_address;     /** Where clients for this hub are accepted */
+	uint16_t                listen_port;
+	struct net_connection*  server;
+	struct net_connection*  con;                /** The MUX link, if connected */
+	struct net_connect_handle* connect_job;
+	struct timeout_evt      reconnect;
+	struct ioq_send*        send_queue;
+	char*                   recv_buf;           /** Frames from the hub, which may exceed MAX_RECV_BUF */
+	size_t                  recv_size;
+	size_t                  recv_capacity;
+	struct adc_message*     batch;              /** Frames for the hub, written once per loop iteration */
+	size_t                  batch_frame;        /** Offset of the last frame in the batch */
+	uint32_t                next_cookie;
+	struct muxd_client*     pending_first;      /** Clients waiting for a SID, in the order they were announced */
+	struct muxd_client*     pending_last;
+	struct muxd_client**    sids;               /** Clients by SID */
+	size_t                  sids_size;
+	struct muxd_client*     online_first;       /** Logged in clients, which receive broadcasts */
+	enum muxd_ring_state    ring_state;
+	struct shm_link*        ring;               /** Frames from the hub come from here once set */
+	struct net_connection*  ring_con;           /** Wakeups from the hub, on a dup of the ring's eventfd */
+	int                     ring_fds[NET_MAX_PASSED_FDS]; /** Received with the hub's reply */
+	size_t                  num_ring_fds;
+};
+
+struct muxd_client
+{
+	struct muxd_hub*        hub;
+	struct net_connection*  con;
+	struct ip_addr_encap    addr;
+	struct ioq_recv*        recv_queue;
+	struct ioq_send*        send_queue;
+	uint32_t                cookie;
+	sid_t                   sid;                /** 0 until the hub has assigned one */
+	int                     logged_in;          /** Receives broadcasts */
+	int                     probed;             /** The first bytes have been examined */
+	size_t                  num_features;
+	fourcc_t                features[MUXD_MAX_FEATURES]; /** From the SU flag of the client's INF */
+	struct muxd_client*     next;               /** Pending list */
+	struct muxd_client*     prev;
+	struct muxd_client*     online_next;        /** Logged in list */
+	struct muxd_client*     online_prev;
+};
+
+/* Marks a SID that was given up by the frontend, until the hub confirms it. */
+static struct muxd_client muxd_closing;
+
+static struct muxd_hub g_hubs[MUXD_MAX_HUBS];
+static size_t g_num_hubs = 0;
+static volatile int g_running = 1;
+static int g_verbosity = 3;
+static size_t g_ring_size = MUXD_RING_SIZE;
+#ifdef SSL_SUPPORT
+static const char* g_tls_certificate = NULL;
+static const char* g_tls_private_key = NULL;
+static struct ssl_context_handle* g_ssl_ctx = NULL;
+#endif
+
+static void muxd_hub_connect(struct muxd_hub* hub);
+static void muxd_client_disconnect(struct muxd_client* client, int notify_hub);
+
+static void muxd_put_u32(char* p, uint32_t value)
+{
+	p[0] = (char) ((value >> 24) & 0xff);
+	p[1] = (char) ((value >> 16) & 0xff);
+	p[2] = (char) ((value >>  8) & 0xff);
+	p[3] = (char) ((value      ) & 0xff);
+}
+
+static uint32_t muxd_get_u32(const char* p)
+{
+	const unsigned char* b = (const unsigned char*) p;
+	return ((uint32_t) b[0] << 24) | ((uint32_t) b[1] << 16) | ((uint32_t) b[2] << 8) | (uint32_t) b[3];
+}
+
+static struct adc_message* muxd_msg_create(const char* data, size_t length)
+{
+	struct adc_message* msg = adc_msg_construct_binary(length);
+	if (!msg)
+		return NULL;
+	memcpy(msg->cache, data, length);
+	msg->length = length;
+	msg->cache[length] = 0;
+	return msg;
+}
+
+/*
+ * Frames for the hub
+ */
+
+static char* muxd_batch_reserve(struct muxd_hub* hub, size_t size)
+{
+	size_t capacity;
+
+	if (!hub->batch)
+	{
+		hub->batch = adc_msg_construct_binary(MUX1_BATCH_SIZE);
+		if (!hub->batch)
+			return NULL;
+	}
+
+	if (hub->batch->length + size >= hub->batch->capacity)
+	{
+		capacity = hub->batch->capacity * 2;
+		while (capacity <= hub->batch->length + size)
+			capacity *= 2;
+		if (!adc_msg_grow(hub->batch, capacity))
+			return NULL;
+	}
+	return hub->batch->cache + hub->batch->length;
+}
+
+/*
+ * Return room for 'size' bytes of body, appended to the last frame if it
+ * is of the same type and stays within what the hub accepts.
+ */
+static char* muxd_frame_append(struct muxd_hub* hub, char type, size_t size, int extend)
+{
+	char* frame;
+	char* p;
+
+	if (extend && hub->batch && hub->batch->length > hub->batch_frame + MUX1_HEADER)
+	{
+		frame = hub->batch->cache + hub->batch_frame;
+		if (frame[4] == type && muxd_get_u32(frame) + size <= MUX1_MAX_FRAME)
+		{
+			p = muxd_batch_reserve(hub, size);
+			if (!p)
+				return NULL;
+			frame = hub->batch->cache + hub->batch_frame;
+			muxd_put_u32(frame, muxd_get_u32(frame) + (uint32_t) size);
+			hub->batch->length += size;
+			return p;
+		}
+	}
+
+	p = muxd_batch_reserve(hub, MUX1_HEADER + size);
+	if (!p)
+		return NULL;
+	muxd_put_u32(p, (uint32_t) (size + 1));
+	p[4] = type;
+	hub->batch_frame = hub->batch->length;
+	hub->batch->length += MUX1_HEADER + size;
+	return p + MUX1_HEADER;
+}
+
+#ifdef USE_SHM_RING
+static int muxd_ring_write(void* desc, const void* buf, size_t len)
+{
+	return (int) shm_link_write((struct shm_link*) desc, buf, len);
+}
+#endif
+
+static void muxd_hub_write(struct muxd_hub* hub)
+{
+	int ret = 0;
+	size_t bytes;
+
+#ifdef USE_SHM_RING
+	if (hub->ring_state == muxd_ring_up)
+	{
+		/* Until the ring is full, which asks the hub for a wakeup */
+		while ((bytes = ioq_send_get_bytes(hub->send_queue)))
+		{
+			ioq_send_write(hub->send_queue, muxd_ring_write, hub->ring);
+			if (ioq_send_get_bytes(hub->send_queue) == bytes)
+				break;
+		}
+		return;
+	}
+#endif
+
+	while ((bytes = ioq_send_get_bytes(hub->send_queue)))
+	{
+		ret = ioq_send_send(hub->send_queue, hub->con);
+		if (ret <= 0)
+			break;
+	}
+
+	if (ioq_send_get_bytes(hub->send_queue))
+	{
+		net_con_update(hub->con, NET_EVENT_READ | NET_EVENT_WRITE);
+	}
+	else
+	{
+		net_con_update(hub->con, NET_EVENT_READ);
+		if (hub->ring_state == muxd_ring_switch)
+			hub->ring_state = muxd_ring_up;
+	}
+}
+
+static void muxd_hub_flush(struct muxd_hub* hub)
+{
+	if (!hub->batch)
+		return;
+
+	/* Held back until the switch to the ring is out on the socket */
+	if (hub->ring_state == muxd_ring_switch)
+		return;
+
+	if (hub->con && hub->batch->length)
+	{
+		int was_empty = ioq_send_is_empty(hub->send_queue);
+		ioq_send_add(hub->send_queue, hub->batch);
+		if (was_empty)
+			muxd_hub_write(hub);
+	}
+	adc_msg_free(hub->batch);
+	hub->batch = NULL;
+}
+
+static void muxd_hub_check_flush(struct muxd_hub* hub)
+{
+	if (hub->batch && hub->batch->length >= MUX1_BATCH_FLUSH)
+		muxd_hub_flush(hub);
+}
+
+static void muxd_hub_send_sid(struct muxd_hub* hub, char type, sid_t sid)
+{
+	char* p = muxd_frame_append(hub, type, 4, 0);
+	if (p)
+		muxd_put_u32(p, sid);
+}
+
+static void muxd_hub_credit(struct muxd_hub* hub, sid_t sid, size_t bytes)
+{
+	char* p = muxd_frame_append(hub, 'C', 8, 1);
+	if (!p)
+		return;
+	muxd_put_u32(p, sid);
+	muxd_put_u32(p + 4, (uint32_t) bytes);
+	muxd_hub_check_flush(hub);
+}
+
+/*
+ * SID table
+ */
+
+static int muxd_sid_set(struct muxd_hub* hub, sid_t sid, struct muxd_client* client)
+{
+	if (sid >= hub->sids_size)
+	{
+		size_t size = MAX(hub->sids_size * 2, 1024);
+		struct muxd_client** sids;
+		while (size <= sid)
+			size *= 2;
+		sids = hub_realloc(hub->sids, size * sizeof(struct muxd_client*));
+		if (!sids)
+			return 0;
+		memset(sids + hub->sids_size, 0, (size - hub->sids_size) * sizeof(struct muxd_client*));
+		hub->sids = sids;
+		hub->sids_size = size;
+	}
+	hub->sids[sid] = client;
+	return 1;
+}
+
+static struct muxd_client* muxd_sid_get(struct muxd_hub* hub, sid_t sid)
+{
+	struct muxd_client* client;
+	if (sid >= hub->sids_size)
+		return NULL;
+	client = hub->sids[sid];
+	return client == &muxd_closing ? NULL : client;
+}
+
+/*
+ * Clients
+ */
+
+static void muxd_pending_remove(struct muxd_hub* hub, struct muxd_client* client)
+{
+	if (client->next)
+		client->next->prev = client->prev;
+	else
+		hub->pending_last = client->prev;
+
+	if (client->prev)
+		client->prev->next = client->next;
+	else
+		hub->pending_first = client->next;
+
+	client->next = NULL;
+	client->prev = NULL;
+}
+
+static void muxd_online_add(struct muxd_hub* hub, struct muxd_client* client)
+{
+	client->logged_in = 1;
+	client->online_prev = NULL;
+	client->online_next = hub->online_first;
+	if (hub->online_first)
+		hub->online_first->online_prev = client;
+	hub->online_first = client;
+}
+
+static void muxd_online_remove(struct muxd_hub* hub, struct muxd_client* client)
+{
+	if (client->online_next)
+		client->online_next->online_prev = client->online_prev;
+
+	if (client->online_prev)
+		client->online_prev->online_next = client->online_next;
+	else
+		hub->online_first = client->online_next;
+
+	client->online_next = NULL;
+	client->online_prev = NULL;
+	client->logged_in = 0;
+}
+
+static void muxd_client_write(struct muxd_client* client)
+{
+	size_t before = ioq_send_get_bytes(client->send_queue);
+	size_t after;
+	int ret = 0;
+
+	while (ioq_send_get_bytes(client->send_queue))
+	{
+		ret = ioq_send_send(client->send_queue, client->con);
+		if (ret <= 0)
+			break;
+	}
+
+	/* Return the delivered bytes to the hub */
+	after = ioq_send_get_bytes(client->send_queue);
+	if (before > after && client->sid)
+		muxd_hub_credit(client->hub, client->sid, before - after);
+
+	if (ret < 0)
+	{
+		muxd_client_disconnect(client, 1);
+		return;
+	}
+
+	if (after)
+		net_con_update(client->con, NET_EVENT_READ | NET_EVENT_WRITE);
+	else
+		net_con_update(client->con, NET_EVENT_READ);
+}
+
+static void muxd_client_deliver(struct muxd_client* client, struct adc_message* msg)
+{
+	if (ioq_send_is_empty(client->send_queue))
+	{
+		ioq_send_add(client->send_queue, msg);
+		muxd_client_write(client);
+	}
+	else
+	{
+		ioq_send_add(client->send_queue, msg);
+	}
+}
+
+static void muxd_client_destroy(struct muxd_client* client)
+{
+	if (client->con)
+	{
+		net_con_close(client->con);
+		client->con = NULL;
+	}
+	ioq_recv_destroy(client->recv_queue);
+	ioq_send_destroy(client->send_queue);
+	hub_free(client);
+}
+
+/*
+ * Close a client. The hub is told unless it asked for the disconnect.
+ */
+static void muxd_client_disconnect(struct muxd_client* client, int notify_hub)
+{
+	struct muxd_hub* hub = client->hub;
+
+	if (client->logged_in)
+		muxd_online_remove(hub, client);
+
+	if (client->sid)
+	{
+		if (notify_hub)
+		{
+			/* Keep the SID until the hub has released it */
+			muxd_sid_set(hub, client->sid, &muxd_closing);
+			muxd_hub_send_sid(hub, '-', client->sid);
+		}
+		else
+		{
+			muxd_sid_set(hub, client->sid, NULL);
+		}
+	}
+	else
+	{
+		muxd_pending_remove(hub, client);
+	}
+
+	LOG_DEBUG("Client %s disconnected", ip_convert_to_string(&client->addr));
+
+	muxd_client_destroy(client);
+}
+
+static void muxd_client_parse_features(struct muxd_client* client, const char* line, size_t length)
+{
+	const char* end = line + length;
+	const char* p = line;
+
+	while ((p = memchr(p, ' ', end - p)))
+	{
+		p++;
+		if (end - p >= 2 && p[0] == 'S' && p[1] == 'U')
+			break;
+	}
+
+	if (!p)
+		return;
+
+	p += 2;
+	client->num_features = 0;
+	while (end - p >= 4 && client->num_features < MUXD_MAX_FEATURES)
+	{
+		client->features[client->num_features++] = FOURCC(p[0], p[1], p[2], p[3]);
+		p += 4;
+		if (p == end || *p != ',')
+			break;
+		p++;
+	}
+}
+
+/*
+ * Only a basic sanity check, the hub validates the messages.
+ */
+static int muxd_client_line_ok(const char* line, size_t length)
+{
+	if (length < 4 || memchr(line, '\0', length))
+		return 0;
+
+	switch (line[0])
+	{
+		case 'B':
+		case 'D':
+		case 'E':
+		case 'F':
+		case 'H':
+			return 1;
+	}
+	return 0;
+}
+
+static int muxd_client_parse(struct muxd_client* client)
+{
+	struct muxd_hub* hub = client->hub;
+	size_t remaining;
+	size_t length;
+	char* buf = ioq_recv_data(client->recv_queue, &remaining);
+	char* start = buf;
+	char* pos;
+	char* p;
+
+	while ((pos = memchr(start, '\n', remaining)))
+	{
+		length = pos - start;
+		if (length)
+		{
+			if (!muxd_client_line_ok(start, length))
+				return -1;
+
+			if (length > 4 && memcmp(start, "BINF", 4) == 0)
+				muxd_client_parse_features(client, start, length);
+
+			p = muxd_frame_append(hub, 'M', 8 + length, 1);
+			if (!p)
+				return -1;
+			muxd_put_u32(p, client->sid);
+			muxd_put_u32(p + 4, (uint32_t) length);
+			memcpy(p + 8, start, length);
+		}
+		pos++;
+		remaining -= (pos - start);
+		start = pos;
+	}
+
+	ioq_recv_consume(client->recv_queue, start - buf);
+	if (remaining >= MUXD_MAX_LINE)
+		return -1;
+
+	muxd_hub_check_flush(hub);
+	return 0;
+}
+
+static void muxd_client_read(struct muxd_client* client)
+{
+	size_t space;
+	ssize_t size;
+	char* buf = ioq_recv_reserve(client->recv_queue, &space);
+
+	if (!buf)
+	{
+		muxd_client_disconnect(client, 1);
+		return;
+	}
+
+	if (!space)
+	{
+		/* Waiting for a SID with a full buffer, stop reading for now */
+		ioq_recv_commit(client->recv_queue, 0);
+		net_con_update(client->con, 0);
+		return;
+	}
+
+	size = net_con_recv(client->con, buf, space);
+	if (size < 0)
+	{
+		ioq_recv_commit(client->recv_queue, 0);
+		muxd_client_disconnect(client, 1);
+		return;
+	}
+
+	ioq_recv_commit(client->recv_queue, size);
+
+	/* Lines are held back until the hub has assigned a SID */
+	if (client->sid && muxd_client_parse(client) == -1)
+		muxd_client_disconnect(client, 1);
+}
+
+static void muxd_client_event(struct net_connection* con, int event, void* arg)
+{
+	struct muxd_client* client = (struct muxd_client*) arg;
+
+	if (event == NET_EVENT_TIMEOUT)
+		return;
+
+#ifdef SSL_SUPPORT
+	if (!client->probed && (event & NET_EVENT_READ))
+	{
+		char byte;
+		client->probed = 1;
+		if (g_ssl_ctx && net_con_peek(con, &byte, 1) == 1 && byte == 22)
+		{
+			net_con_ssl_handshake(con, net_con_ssl_mode_server, g_ssl_ctx);
+			return;
+		}
+	}
+#endif
+
+	if (event & NET_EVENT_READ)
+	{
+		muxd_client_read(client);
+		return; /* the client may be gone */
+	}
+
+	if (event & NET_EVENT_WRITE)
+		muxd_client_write(client);
+}
+
+static void muxd_on_accept(struct net_connection* con, int event, void* arg)
+{
+	struct muxd_hub* hub = (struct muxd_hub*) arg;
+	struct muxd_client* client;
+	struct ip_addr_encap addr;
+	char* p;
+	int fd;
+
+	for (;;)
+	{
+		fd = net_accept(net_con_get_sd(con), &addr);
+		if (fd == -1)
+		{
+			if (net_error() == EWOULDBLOCK)
+				net_con_blocked(con, NET_EVENT_READ);
+			else
+				LOG_ERROR("Accept error: %d %s", net_error(), strerror(net_error()));
+			break;
+		}
+
+		if (!hub->con)
+		{
+			/* No link to the hub */
+			net_close(fd);
+			continue;
+		}
+
+		client = hub_malloc_zero(sizeof(struct muxd_client));
+		if (!client)
+		{
+			net_close(fd);
+			break;
+		}
+
+		client->hub = hub;
+		client->addr = addr;
+		client->cookie = ++hub->next_cookie;
+		client->recv_queue = ioq_recv_create(MUXD_MAX_LINE);
+		client->send_queue = ioq_send_create();
+		client->con = net_con_create();
+		net_con_initialize(client->con, fd, muxd_client_event, client, NET_EVENT_READ);
+
+		client->prev = hub->pending_last;
+		if (hub->pending_last)
+			hub->pending_last->next = client;
+		else
+			hub->pending_first = client;
+		hub->pending_last = client;
+
+		p = muxd_frame_append(hub, '+', addr.af == AF_INET6 ? 21 : 9, 0);
+		if (!p)
+		{
+			muxd_client_disconnect(client, 0);
+			continue;
+		}
+		muxd_put_u32(p, client->cookie);
+		if (addr.af == AF_INET6)
+		{
+			p[4] = 6;
+			memcpy(p + 5, &addr.internal_ip_data.in6, 16);
+		}
+		else
+		{
+			p[4] = 4;
+			memcpy(p + 5, &addr.internal_ip_data.in, 4);
+		}
+	}
+}
+
+/*
+ * Frames from the hub
+ */
+
+static void muxd_hub_on_user(struct muxd_hub* hub, uint32_t cookie, sid_t sid)
+{
+	struct muxd_client* client;
+
+	for (client = hub->pending_first; client; client = client->next)
+	{
+		if (client->cookie == cookie)
+			break;
+	}
+
+	if (!client)
+	{
+		/* The client left before the hub answered */
+		muxd_sid_set(hub, sid, &muxd_closing);
+		muxd_hub_send_sid(hub, '-', sid);
+		return;
+	}
+
+	muxd_pending_remove(hub, client);
+	if (!muxd_sid_set(hub, sid, client))
+	{
+		muxd_client_destroy(client);
+		muxd_hub_send_sid(hub, '-', sid);
+		return;
+	}
+
+	client->sid = sid;
+	net_con_update(client->con, NET_EVENT_READ);
+	if (muxd_client_parse(client) == -1)
+		muxd_client_disconnect(client, 1);
+}
+
+static void muxd_hub_on_quit(struct muxd_hub* hub, sid_t sid)
+{
+	struct muxd_client* client;
+
+	if (sid >= hub->sids_size)
+		return;
+
+	client = hub->sids[sid];
+	if (client == &muxd_closing)
+		hub->sids[sid] = NULL;
+	else if (client)
+		muxd_client_disconnect(client, 0);
+}
+
+/* Feature cast: "FXXX SSSS +FEAT -FEAT ..." */
+static int muxd_client_wants(struct muxd_client* client, const char* msg, size_t length)
+{
+	const char* p = msg + 10;
+	const char* end = msg + length;
+	fourcc_t feature;
+	size_t n;
+	int found;
+
+	if (!client->num_features)
+		return 0;
+
+	while (end - p >= 5 && (p[0] == '+' || p[0] == '-'))
+	{
+		feature = FOURCC(p[1], p[2], p[3], p[4]);
+		found = 0;
+		for (n = 0; n < client->num_features; n++)
+		{
+			if (client->features[n] == feature)
+			{
+				found = 1;
+				break;
+			}
+		}
+
+		if (found != (p[0] == '+'))
+			return 0;
+
+		p += 5;
+		if (p == end || *p != ' ')
+			break;
+		p++;
+	}
+	return 1;
+}
+
+static void muxd_hub_fan_out(struct muxd_hub* hub, const char* data, size_t length, int feature_cast)
+{
+	struct muxd_client* client;
+	struct muxd_client* next;
+	struct adc_message* msg = muxd_msg_create(data, length);
+
+	if (!msg)
+		return;
+
+	/* Delivering may disconnect the client, but never another one */
+	for (client = hub->online_first; client; client = next)
+	{
+		next = client->online_next;
+
+		if (feature_cast && (length < 10 || !muxd_client_wants(client, data, length)))
+			continue;
+
+		muxd_client_deliver(client, msg);
+	}
+	adc_msg_free(msg);
+}
+
+static void muxd_ring_close_fds(struct muxd_hub* hub)
+{
+	while (hub->num_ring_fds)
+		close(hub->ring_fds[--hub->num_ring_fds]);
+}
+
+#ifdef USE_SHM_RING
+static void muxd_ring_event(struct net_connection* con, int event, void* arg);
+#endif
+
+/*
+ * The hub's reply to a ring request. If granted, frames from the hub come
+ * over the ring from here on, and ours follow once the confirmation is
+ * written to the socket.
+ */
+static int muxd_hub_on_ring(struct muxd_hub* hub, const char* body, size_t size)
+{
+#ifdef USE_SHM_RING
+	int fd;
+#endif
+
+	if (size != 5 || hub->ring_state != muxd_ring_requested)
+		return -1;
+
+	hub->ring_state = muxd_ring_none;
+	if (!body[0])
+	{
+		LOG_INFO("Hub %s does not offer a shared memory ring", hub->name);
+		muxd_ring_close_fds(hub);
+		return 0;
+	}
+
+#ifdef USE_SHM_RING
+	if (hub->num_ring_fds != SHM_LINK_PEER_FDS)
+		return -1;
+
+	hub->num_ring_fds = 0;
+	hub->ring = shm_link_attach(hub->ring_fds);
+	if (!hub->ring || (fd = dup(shm_link_get_fd(hub->ring))) == -1)
+		return -1;
+
+	hub->ring_con = net_con_create();
+	net_con_initialize(hub->ring_con, fd, muxd_ring_event, hub, NET_EVENT_READ);
+
+	/* Last on the socket */
+	muxd_frame_append(hub, 'U', 0, 0);
+	muxd_hub_flush(hub);
+	hub->ring_state = ioq_send_is_empty(hub->send_queue) ? muxd_ring_up : muxd_ring_switch;
+
+	/* The hub may have written to the ring already */
+	shm_link_wakeup(hub->ring);
+	LOG_INFO("Link to hub %s moved to a shared memory ring of %d bytes", hub->name, (int) shm_link_get_size(hub->ring));
+	return 0;
+#else
+	return -1;
+#endif
+}
+
+static int muxd_hub_on_frame(struct muxd_hub* hub, char type, const char* body, size_t size)
+{
+	struct muxd_client* client;
+	struct adc_message* msg;
+	size_t offset;
+	size_t length;
+
+	switch (type)
+	{
+		case '+':
+			if (size != 8)
+				return -1;
+			muxd_hub_on_user(hub, muxd_get_u32(body), muxd_get_u32(body + 4));
+			return 0;
+
+		case '-':
+			if (size != 4)
+				return -1;
+			muxd_hub_on_quit(hub, muxd_get_u32(body));
+			return 0;
+
+		case 'L':
+			if (size != 4)
+				return -1;
+			if ((client = muxd_sid_get(hub, muxd_get_u32(body))) && !client->logged_in)
+				muxd_online_add(hub, client);
+			return 0;
+
+		case 'M':
+			for (offset = 0; offset < size; offset += length)
+			{
+				if (size - offset < 8)
+					return -1;
+				client = muxd_sid_get(hub, muxd_get_u32(body + offset));
+				length = muxd_get_u32(body + offset + 4);
+				offset += 8;
+				if (length > size - offset)
+					return -1;
+
+				if (client && (msg = muxd_msg_create(body + offset, length)))
+				{
+					muxd_client_deliver(client, msg);
+					adc_msg_free(msg);
+				}
+			}
+			return 0;
+
+		case 'S':
+			if (size < 4)
+				return -1;
+			length = muxd_get_u32(body);
+			if (length > size - 4 || (size - 4 - length) % 4)
+				return -1;
+
+			msg = muxd_msg_create(body + 4, length);
+			if (!msg)
+				return 0;
+			for (offset = 4 + length; offset < size; offset += 4)
+			{
+				if ((client = muxd_sid_get(hub, muxd_get_u32(body + offset))))
+					muxd_client_deliver(client, msg);
+			}
+			adc_msg_free(msg);
+			return 0;
+
+		case 'B':
+			muxd_hub_fan_out(hub, body, size, 0);
+			return 0;
+
+		case 'F':
+			muxd_hub_fan_out(hub, body, size, 1);
+			return 0;
+
+		case 'U':
+			return muxd_hub_on_ring(hub, body, size);
+
+		default:
+			return 0;
+	}
+}
+
+static void muxd_hub_disconnect(struct muxd_hub* hub)
+{
+	struct muxd_client* client;
+	size_t n;
+
+	if (hub->con)
+	{
+		if (g_running)
+			LOG_WARN("Lost connection to hub %s", hub->name);
+		net_con_close(hub->con);
+		hub->con = NULL;
+	}
+
+#ifdef USE_SHM_RING
+	if (hub->ring_con)
+		net_con_close(hub->ring_con);
+	shm_link_destroy(hub->ring);
+	hub->ring_con = NULL;
+	hub->ring = NULL;
+#endif
+	muxd_ring_close_fds(hub);
+	hub->ring_state = muxd_ring_none;
+
+	while ((client = hub->pending_first))
+		muxd_client_disconnect(client, 0);
+
+	for (n = 0; n < hub->sids_size; n++)
+	{
+		if ((client = muxd_sid_get(hub, (sid_t) n)))
+			muxd_client_disconnect(client, 0);
+		hub->sids[n] = NULL;
+	}
+
+	if (hub->batch)
+	{
+		adc_msg_free(hub->batch);
+		hub->batch = NULL;
+	}
+	ioq_send_destroy(hub->send_queue);
+	hub->send_queue = NULL;
+	hub->recv_size = 0;
+
+	if (g_running)
+		timeout_queue_insert(net_backend_get_timeout_queue(), &hub->reconnect, MUXD_RECONNECT);
+}
+
+/*
+ * Receive from the socket or the ring, returning as net_con_recv() does.
+ */
+static ssize_t muxd_hub_recv(struct muxd_hub* hub, int from_ring, char* buf, size_t len)
+{
+#ifdef USE_SHM_RING
+	ssize_t size;
+
+	if (from_ring)
+	{
+		size = shm_link_read(hub->ring, buf, len);
+		return size < 0 ? -2 : size;
+	}
+
+	if (hub->ring_state == muxd_ring_requested)
+	{
+		/* The reply carries the ring's descriptors */
+		size_t num_fds = NET_MAX_PASSED_FDS - hub->num_ring_fds;
+		size = net_recv_fds(net_con_get_sd(hub->con), buf, len, hub->ring_fds + hub->num_ring_fds, &num_fds);
+		hub->num_ring_fds += num_fds;
+		if (size == -1 && net_error() == EWOULDBLOCK)
+		{
+			net_con_blocked(hub->con, NET_EVENT_READ);
+			return 0;
+		}
+		return size == 0 ? -1 : (size < 0 ? -2 : size);
+	}
+#endif
+	return net_con_recv(hub->con, buf, len);
+}
+
+static void muxd_hub_read(struct muxd_hub* hub, int from_ring)
+{
+	size_t offset = 0;
+	size_t length;
+	ssize_t size;
+
+	if (hub->recv_capacity - hub->recv_size < MAX_RECV_BUF)
+	{
+		size_t capacity = MAX(hub->recv_capacity * 2, MAX_RECV_BUF * 2);
+		char* buf = hub_realloc(hub->recv_buf, capacity);
+		if (!buf)
+		{
+			muxd_hub_disconnect(hub);
+			return;
+		}
+		hub->recv_buf = buf;
+		hub->recv_capacity = capacity;
+	}
+
+	size = muxd_hub_recv(hub, from_ring, hub->recv_buf + hub->recv_size, hub->recv_capacity - hub->recv_size);
+	if (size < 0 || (size > 0 && hub->ring && !from_ring))
+	{
+		/* Only the ring carries data once it is set up */
+		muxd_hub_disconnect(hub);
+		return;
+	}
+	hub->recv_size += size;
+
+	while (hub->recv_size - offset >= 4)
+	{
+		length = muxd_get_u32(hub->recv_buf + offset);
+		if (length == 0 || length > MUXD_MAX_FRAME)
+		{
+			LOG_ERROR("Invalid frame from hub %s", hub->name);
+			muxd_hub_disconnect(hub);
+			return;
+		}
+
+		if (hub->recv_size - offset - 4 < length)
+			break;
+
+		if (muxd_hub_on_frame(hub, hub->recv_buf[offset + 4], hub->recv_buf + offset + MUX1_HEADER, length - 1) == -1)
+		{
+			LOG_ERROR("Invalid frame from hub %s", hub->name);
+			muxd_hub_disconnect(hub);
+			return;
+		}
+		offset += 4 + length;
+
+		if (hub->ring && !from_ring)
+		{
+			/* The rest comes over the ring */
+			if (hub->recv_size != offset)
+			{
+				LOG_ERROR("Invalid frame from hub %s", hub->name);
+				muxd_hub_disconnect(hub);
+				return;
+			}
+			break;
+		}
+	}
+
+	memmove(hub->recv_buf, hub->recv_buf + offset, hub->recv_size - offset);
+	hub->recv_size -= offset;
+}
+
+static void muxd_hub_event(struct net_connection* con, int event, void* arg)
+{
+	struct muxd_hub* hub = (struct muxd_hub*) arg;
+
+	if (event == NET_EVENT_TIMEOUT)
+		return;
+
+	if (event & NET_EVENT_READ)
+	{
+		muxd_hub_read(hub, 0);
+		if (!hub->con)
+			return;
+	}
+
+	if (event & NET_EVENT_WRITE)
+		muxd_hub_write(hub);
+}
+
+#ifdef USE_SHM_RING
+static void muxd_ring_event(struct net_connection* con, int event, void* arg)
+{
+	struct muxd_hub* hub = (struct muxd_hub*) arg;
+	int n = 0;
+
+	if (event == NET_EVENT_TIMEOUT)
+		return;
+
+	/* Reading the eventfd resets it, so it is drained */
+	shm_link_clear(hub->ring);
+	net_con_blocked(con, NET_EVENT_READ);
+
+	/* The hub has made room in a full ring */
+	if (hub->ring_state == muxd_ring_up)
+		muxd_hub_write(hub);
+
+	for (; n < MUXD_RING_READS && shm_link_readable(hub->ring); n++)
+	{
+		muxd_hub_read(hub, 1);
+		if (!hub->con)
+			return;
+	}
+
+	if (n == MUXD_RING_READS && shm_link_readable(hub->ring))
+		shm_link_wakeup(hub->ring);
+}
+#endif
+
+static void muxd_hub_attach(struct muxd_hub* hub, struct net_connection* con)
+{
+	char* p;
+
+	LOG_INFO("Connected to hub %s", hub->name);
+	hub->con = con;
+	hub->send_queue = ioq_send_create();
+	net_con_reinitialize(con, muxd_hub_event, hub, NET_EVENT_READ);
+
+	p = muxd_batch_reserve(hub, MUX1_HELLO_LEN);
+	if (p)
+	{
+		memcpy(p, MUX1_HELLO, MUX1_HELLO_LEN);
+		hub->batch->length += MUX1_HELLO_LEN;
+		hub->batch_frame = hub->batch->length;
+	}
+
+#ifdef USE_SHM_RING
+	if (hub->local && g_ring_size && (p = muxd_frame_append(hub, 'U', 4, 0)))
+	{
+		muxd_put_u32(p, (uint32_t) g_ring_size);
+		hub->ring_state = muxd_ring_requested;
+	}
+#endif
+}
+
+static void muxd_hub_on_connect(struct net_connect_handle* handle, enum net_connect_status status, struct net_connection* con, void* ptr)
+{
+	struct muxd_hub* hub = (struct muxd_hub*) ptr;
+
+	hub->connect_job = NULL;
+	if (status != net_connect_status_ok)
+	{
+		LOG_WARN("Unable to connect to hub %s, retrying in %d seconds", hub->name, MUXD_RECONNECT);
+		if (g_running)
+			timeout_queue_insert(net_backend_get_timeout_queue(), &hub->reconnect, MUXD_RECONNECT);
+		return;
+	}
+	muxd_hub_attach(hub, con);
+}
+
+/*
+ * A local connect completes at once, or fails when the hub is not
+ * there or its backlog is full, in which case it is retried later.
+ */
+static int muxd_hub_connect_local(struct muxd_hub* hub)
+{
+	struct net_connection* con;
+	int sd = net_connect_unix(hub->address);
+	if (sd == -1)
+		return 0;
+
+	con = net_con_create();
+	net_con_initialize(con, sd, muxd_hub_event, hub, NET_EVENT_READ);
+	muxd_hub_attach(hub, con);
+	return 1;
+}
+
+static void muxd_hub_reconnect(struct timeout_evt* evt)
+{
+	muxd_hub_connect((struct muxd_hub*) evt->ptr);
+}
+
+static void muxd_hub_connect(struct muxd_hub* hub)
+{
+	if (hub->local)
+	{
+		if (!muxd_hub_connect_local(hub))
+		{
+			LOG_WARN("Unable to connect to hub %s, retrying in %d seconds", hub->name, MUXD_RECONNECT);
+			timeout_queue_insert(net_backend_get_timeout_queue(), &hub->reconnect, MUXD_RECONNECT);
+		}
+		return;
+	}
+
+	hub->connect_job = net_con_connect(hub->address, hub->port, muxd_hub_on_connect, hub);
+	if (!hub->connect_job)
+	{
+		LOG_ERROR("Unable to connect to hub %s", hub->name);
+		timeout_queue_insert(net_backend_get_timeout_queue(), &hub->reconnect, MUXD_RECONNECT);
+	}
+}
+
+static int muxd_listen(struct muxd_hub* hub)
+{
+	struct sockaddr_storage addr;
+	socklen_t sockaddr_size;
+	int sd;
+
+	if (ip_convert_address(hub->listen_address, hub->listen_port, (struct sockaddr*) &addr, &sockaddr_size) == -1)
+		return 0;
+
+	sd = net_socket_create(addr.ss_family, SOCK_STREAM, IPPROTO_TCP);
+	if (sd == -1)
+		return 0;
+
+	if (net_set_reuseaddress(sd, 1) == -1 || net_set_nonblocking(sd, 1) == -1 ||
+		net_bind(sd, (struct sockaddr*) &addr, sockaddr_size) == -1 ||
+		net_listen(sd, MUXD_BACKLOG) == -1)
+	{
+		LOG_ERROR("Unable to listen on %s:%d: %s", hub->listen_address, (int) hub->listen_port, net_error_string(net_error()));
+		net_close(sd);
+		return 0;
+	}
+
+	hub->server = net_con_create();
+	net_con_initialize(hub->server, sd, muxd_on_accept, hub, NET_EVENT_READ);
+	LOG_INFO("Listening on %s:%d for hub %s", hub->listen_address, (int) hub->listen_port, hub->name);
+	return 1;
+}
+
+static void muxd_shutdown()
+{
+	size_t n;
+	struct muxd_hub* hub;
+
+	for (n = 0; n < g_num_hubs; n++)
+	{
+		hub = &g_hubs[n];
+		timeout_queue_remove(net_backend_get_timeout_queue(), &hub->reconnect);
+		if (hub->connect_job)
+			net_connect_destroy(hub->connect_job);
+		if (hub->server)
+			net_con_close(hub->server);
+		muxd_hub_disconnect(hub);
+		hub_free(hub->sids);
+		hub_free(hub->recv_buf);
+		hub_free(hub->address);
+		hub_free(hub->name);
+		hub_free(hub->listen_address);
+	}
+}
+
+static void muxd_handle_signal(int sig)
+{
+	g_running = 0;
+}
+
+/*
+ * Split "address:port", where an IPv6 address may be given as "[address]:port".
+ */
+static int muxd_parse_address(const char* arg, char** address, uint16_t* port)
+{
+	const char* sep = strrchr(arg, ':');
+	const char* start = arg;
+	size_t length;
+	int value;
+
+	if (!sep || sep == arg)
+		return 0;
+
+	value = uhub_atoi(sep + 1);
+	if (value <= 0 || value > 65535)
+		return 0;
+
+	length = sep - arg;
+	if (arg[0] == '[' && sep[-1] == ']')
+	{
+		start++;
+		length -= 2;
+	}
+
+	*address = hub_strndup(start, length);
+	*port = (uint16_t) value;
+	return *address != NULL;
+}
+
+static void print_usage(const char* program)
+{
+	fprintf(stderr, "Usage: %s [options] <listen address:port> <hub address:port|unix:path> [...]\n"
+		"Accepts ADC clients and connects them to the hub over a MUX link.\n"
+		"Several listen/hub pairs may be given.\n\n"
+		"Options:\n"
+		"   -v          Verbose mode. Add more -v's for higher verbosity.\n"
+		"   -q          Quiet mode - no output\n"
+#ifdef SSL_SUPPORT
+		"   -c <file>   TLS certificate (PEM) for clients connecting with ADCS\n"
+		"   -k <file>   TLS private key (PEM)\n"
+#endif
+#ifdef USE_SHM_RING
+		"   -s <bytes>  Shared memory ring size for hubs on a unix socket, 0 to disable\n"
+#endif
+		"   -h          This message.\n"
+		"\n", program);
+}
+
+static void parse_command_line(int argc, char** argv)
+{
+	int opt;
+	int n;
+
+	while ((opt = getopt(argc, argv, "vqhc:k:s:")) != -1)
+	{
+		switch (opt)
+		{
+			case 'v':
+				g_verbosity++;
+				break;
+
+			case 'q':
+				g_verbosity -= 99;
+				break;
+
+#ifdef SSL_SUPPORT
+			case 'c':
+				g_tls_certificate = optarg;
+				break;
+
+			case 'k':
+				g_tls_private_key = optarg;
+				break;
+#endif
+
+#ifdef USE_SHM_RING
+			case 's':
+				g_ring_size = (size_t) MAX(uhub_atoi(optarg), 0);
+				break;
+#endif
+
+			default:
+				print_usage(argv[0]);
+				exit(EXIT_FAILURE);
+		}
+	}
+
+	if (optind >= argc || (argc - optind) % 2 || (argc - optind) / 2 > MUXD_MAX_HUBS)
+	{
+		print_usage(argv[0]);
+		exit(EXIT_FAILURE);
+	}
+
+	for (n = optind; n < argc; n += 2)
+	{
+		struct muxd_hub* hub = &g_hubs[g_num_hubs++];
+		if (strncmp(argv[n + 1], "unix:", 5) == 0)
+		{
+			hub->local = 1;
+			hub->address = hub_strdup(argv[n + 1] + 5);
+		}
+
+		hub->name = hub_strdup(argv[n + 1]);
+		if (!muxd_parse_address(argv[n], &hub->listen_address, &hub->listen_port) ||
+			(!hub->local && !muxd_parse_address(argv[n + 1], &hub->address, &hub->port)) ||
+			!hub->address || !*hub->address)
+		{
+			fprintf(stderr, "Invalid address: %s %s\n", argv[n], argv[n + 1]);
+			exit(EXIT_FAILURE);
+		}
+		timeout_evt_initialize(&hub->reconnect, muxd_hub_reconnect, hub);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	size_t n;
+	int ok = 1;
+
+	parse_command_line(argc, argv);
+
+	hub_log_initialize(NULL, 0);
+	hub_set_log_verbosity(g_verbosity);
+	net_initialize();
+
+#ifndef WIN32
+	signal(SIGPIPE, SIG_IGN);
+	signal(SIGINT,  muxd_handle_signal);
+	signal(SIGTERM, muxd_handle_signal);
+#endif
+
+#ifdef SSL_SUPPORT
+	if (g_tls_certificate && g_tls_private_key)
+	{
+		g_ssl_ctx = net_ssl_context_create("1.2", "ECDH+AESGCM:DH+AESGCM:ECDH+AES256:DH+AES256:ECDH+AES128:DH+AES:RSA+AESGCM:RSA+AES:!aNULL:!MD5:!DSS");
+		if (!g_ssl_ctx || !ssl_load_certificate(g_ssl_ctx, g_tls_certificate) ||
+			!ssl_load_private_key(g_ssl_ctx, g_tls_private_key) || !ssl_check_private_key(g_ssl_ctx))
+		{
+			LOG_FATAL("Unable to load TLS certificate and key.");
+			return EXIT_FAILURE;
+		}
+	}
+#endif
+
+	for (n = 0; n < g_num_hubs && ok; n++)
+	{
+		ok = muxd_listen(&g_hubs[n]);
+		if (ok)
+			muxd_hub_connect(&g_hubs[n]);
+	}
+
+	while (ok && g_running)
+	{
+		net_backend_process();
+		for (n = 0; n < g_num_hubs; n++)
+			muxd_hub_flush(&g_hubs[n]);
+	}
+
+	muxd_shutdown();
+#ifdef SSL_SUPPORT
+	if (g_ssl_ctx)
+		net_ssl_context_destroy(g_ssl_ctx);
+#endif
+	ioq_recv_pool_shutdown();
+	net_destroy();
+	hub_log_shutdown();
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -65,22 +65,26 @@ extern "C" {
 #include "util/getopt.h"
 #include "util/list.h"
 #include "util/log.h"
+#include "util/logring.h"
 #include "util/memory.h"
 #include "util/misc.h"
 #include "util/tiger.h"
 #include "util/threads.h"
 #include "util/rbtree.h"
+#include "util/hashtable.h"
 
 #include "adc/sid.h"
 #include "adc/message.h"
 
 #include "network/network.h"
 #include "network/notify.h"
+#include "network/shmring.h"
 #include "network/connection.h"
 #include "network/dnsresolver.h"
 #include "network/ipcalc.h"
 #include "network/timeout.h"
 
+#include "core/admission.h"
 #include "core/auth.h"
 #include "core/config.h"
 #include "core/eventid.h"
@@ -89,6 +93,8 @@ extern "C" {
 #include "core/netevent.h"
 #include "core/ioqueue.h"
 #include "core/user.h"
+#include "core/zlif.h"
+#include "core/loginqueue.h"
 #include "core/usermanager.h"
 #include "core/route.h"
 #include "core/pluginloader.h"
@@ -98,6 +104,7 @@ extern "C" {
 #include "core/inf.h"
 #include "core/hubevent.h"
 #include "core/plugincallback.h"
+#include "core/pluginasync.h"
 #include "core/plugininvoke.h"
 #include "core/pluginloader.h"
 
@@ -0,0 +1,301 @@
+/*
+ * uhub - A tiny ADC p2p connection hub
+ * Copyright (C) 2007-2014, Jan Vidar Krey
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "uhub.h"
+#include "hashtable.h"
+
+#define HASH_TABLE_MIN_CAPACITY 16
+
+/* Number of old slots migrated for each insert or remove while growing */
+#define HASH_TABLE_MIGRATE_STEP 4
+
+/*
+ * Slots in the old table are never reused while migrating, so removed
+ * or migrated entries are marked with a tombstone to keep probe
+ * sequences intact.
+ */
+static const char hash_table_tombstone = 0;
+#define TOMBSTONE ((const void*) &hash_table_tombstone)
+
+static size_t round_up_pow2(size_t n)
+{
+	size_t capacity = HASH_TABLE_MIN_CAPACITY;
+	while (capacity < n)
+		capacity <<= 1;
+	return capacity;
+}
+
+struct hash_table* hash_table_create(hash_table_equals equals, size_t capacity)
+{
+	struct hash_table* table = (struct hash_table*) hub_malloc_zero(sizeof(struct hash_table));
+	if (!table)
+		return NULL;
+
+	table->capacity = round_up_pow2(capacity);
+	table->slots = (struct hash_table_slot*) hub_malloc_zero(sizeof(struct hash_table_slot) * table->capacity);
+	if (!table->slots)
+	{
+		hub_free(table);
+		return NULL;
+	}
+
+	table->equals = equals;
+	return table;
+}
+
+void hash_table_destroy(struct hash_table* table)
+{
+	if (!table)
+		return;
+	hub_free(table->old_slots);
+	hub_free(table->slots);
+	hub_free(table);
+}
+
+static struct hash_table_slot* slot_find(struct hash_table_slot* slots, size_t capacity, uint32_t hash, hash_table_equals equals, const void* key)
+{
+	size_t mask = capacity - 1;
+	size_t n = hash & mask;
+
+	while (slots[n].key)
+	{
+		if (slots[n].key != TOMBSTONE && slots[n].hash == hash && equals(slots[n].key, key))
+			return &slots[n];
+		n = (n + 1) & mask;
+	}
+	return NULL;
+}
+
+/* Store a key which is known not to exist in the current table */
+static void slot_store(struct hash_table* table, uint32_t hash, const void* key, void* value)
+{
+	size_t mask = table->capacity - 1;
+	size_t n = hash & mask;
+
+	while (table->slots[n].key)
+		n = (n + 1) & mask;
+
+	table->slots[n].hash = hash;
+	table->slots[n].key = key;
+	table->slots[n].value = value;
+	table->elements++;
+}
+
+/* Backward shift deletion, keeps the current table free of tombstones */
+static void slot_erase(struct hash_table* table, struct hash_table_slot* slot)
+{
+	size_t mask = table->capacity - 1;
+	size_t i = slot - table->slots;
+	size_t j = i;
+	size_t k;
+
+	for (;;)
+	{
+		j = (j + 1) & mask;
+		if (!table->slots[j].key)
+			break;
+
+		k = table->slots[j].hash & mask;
+		if ((j > i && (k <= i || k > j)) || (j < i && (k <= i && k > j)))
+		{
+			table->slots[i] = table->slots[j];
+			i = j;
+		}
+	}
+
+	table->slots[i].key = NULL;
+	table->slots[i].value = NULL;
+	table->elements--;
+}
+
+static void migrate(struct hash_table* table, size_t steps)
+{
+	struct hash_table_slot* slot;
+
+	while (table->old_slots && steps--)
+	{
+		slot = &table->old_slots[table->old_cursor++];
+		if (slot->key && slot->key != TOMBSTONE)
+		{
+			slot_store(table, slot->hash, slot->key, slot->value);
+			slot->key = TOMBSTONE;
+			table->old_elements--;
+		}
+
+		if (!table->old_elements || table->old_cursor == table->old_capacity)
+		{
+			hub_free(table->old_slots);
+			table->old_slots = NULL;
+			table->old_capacity = 0;
+			table->old_elements = 0;
+			table->old_cursor = 0;
+		}
+	}
+}
+
+static int grow(struct hash_table* table)
+{
+	struct hash_table_slot* slots;
+
+	/* Previous resize still in progress, complete it first. */
+	if (table->old_slots)
+		migrate(table, table->old_capacity);
+
+	slots = (struct hash_table_slot*) hub_malloc_zero(sizeof(struct hash_table_slot) * table->capacity * 2);
+	if (!slots)
+		return 0;
+
+	table->old_slots = table->slots;
+	table->old_capacity = table->capacity;
+	table->old_elements = table->elements;
+	table->old_cursor = 0;
+
+	table->slots = slots;
+	table->capacity *= 2;
+	table->elements = 0;
+	return 1;
+}
+
+int hash_table_insert(struct hash_table* table, uint32_t hash, const void* key, void* value)
+{
+	uhub_assert(key && key != TOMBSTONE);
+
+	if (hash_table_find(table, hash, table->equals, key, NULL))
+		return 0;
+
+	/* Keep the load factor at or below 1/2 */
+	if ((table->elements + table->old_elements + 1) * 2 > table->capacity)
+	{
+		if (!grow(table))
+			return -1;
+	}
+
+	slot_store(table, hash, key, value);
+	migrate(table, HASH_TABLE_MIGRATE_STEP);
+	return 1;
+}
+
+int hash_table_remove(struct hash_table* table, uint32_t hash, const void* key)
+{
+	struct hash_table_slot* slot = slot_find(table->slots, table->capacity, hash, table->equals, key);
+	if (slot)
+	{
+		slot_erase(table, slot);
+	}
+	else if (table->old_slots)
+	{
+		slot = slot_find(table->old_slots, table->old_capacity, hash, table->equals, key);
+		if (!slot)
+			return 0;
+		slot->key = TOMBSTONE;
+		slot->value = NULL;
+		table->old_elements--;
+	}
+	else
+	{
+		return 0;
+	}
+
+	migrate(table, HASH_TABLE_MIGRATE_STEP);
+	return 1;
+}
+
+void* hash_table_get(struct hash_table* table, uint32_t hash, const void* key)
+{
+	struct hash_table_slot* slot = slot_find(table->slots, table->capacity, hash, table->equals, key);
+	if (!slot && table->old_slots)
+		slot = slot_find(table->old_slots, table->old_capacity, hash, table->equals, key);
+	return slot ? slot->value : NULL;
+}
+
+static void* find_all(struct hash_table_slot* slots, size_t capacity, uint32_t hash, hash_table_equals match, const void* key, size_t* matches)
+{
+	size_t mask = capacity - 1;
+	size_t n = hash & mask;
+	void* value = NULL;
+
+	while (slots[n].key)
+	{
+		if (slots[n].key != TOMBSTONE && slots[n].hash == hash && match(slots[n].key, key))
+		{
+			if (!*matches)
+				value = slots[n].value;
+			(*matches)++;
+		}
+		n = (n + 1) & mask;
+	}
+	return value;
+}
+
+void* hash_table_find(struct hash_table* table, uint32_t hash, hash_table_equals match, const void* key, size_t* matches)
+{
+	size_t count = 0;
+	void* value;
+	void* old_value = NULL;
+
+	if (!matches)
+	{
+		struct hash_table_slot* slot = slot_find(table->slots, table->capacity, hash, match, key);
+		if (!slot && table->old_slots)
+			slot = slot_find(table->old_slots, table->old_capacity, hash, match, key);
+		return slot ? slot->value : NULL;
+	}
+
+	value = find_all(table->slots, table->capacity, hash, match, key, &count);
+	if (table->old_slots)
+		old_value = find_all(table->old_slots, table->old_capacity, hash, match, key, &count);
+
+	*matches = count;
+	return value ? value : old_value;
+}
+
+size_t hash_table_size(struct hash_table* table)
+{
+	return table->elements + table->old_elements;
+}
+
+uint32_t hash_table_hash_data(const void* data, size_t len)
+{
+	const unsigned char* p = (const unsigned char*) data;
+	uint32_t hash = 2166136261u;
+	size_t n;
+
+	for (n = 0; n < len; n++)
+	{
+		hash ^= p[n];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+uint32_t hash_table_hash_string_nocase(const char* str)
+{
+	const unsigned char* p = (const unsigned char*) str;
+	uint32_t hash = 2166136261u;
+	unsigned char c;
+
+	while ((c = *p++))
+	{
+		if (c >= 'A' && c <= 'Z')
+			c += ('a' - 'A');
+		hash ^= c;
+		hash *= 16777619u;
+	}
+	return hash;
+}
@@ -0,0 +1,119 @@
+/*
+ * uhub - A tiny ADC p2p connection hub
+ * Copyright (C) 2007-2014, Jan Vidar Krey
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef HAVE_UHUB_HASH_TABLE_H
+#define HAVE_UHUB_HASH_TABLE_H
+
+/**
+ * Open addressing hash table (linear probing).
+ *
+ * The caller computes the hash of a key, and the table caches it next to
+ * the key pointer, so probing only calls the equality function when the
+ * full hash matches. The capacity is always a power of two.
+ *
+ * Growing the table is incremental: a new table is allocated and every
+ * subsequent operation migrates a few slots from the old one, so no single
+ * insert has to rehash the whole table.
+ *
+ * Keys and values are not copied, the caller owns them and must keep
+ * the key valid for as long as it is in the table.
+ */
+
+struct hash_table_slot
+{
+	uint32_t hash;
+	const void* key;  /* NULL if empty */
+	void* value;
+};
+
+/**
+ * Returns 1 if the stored key a equals the lookup key b, 0 otherwise.
+ */
+typedef int (*hash_table_equals)(const void* a, const void* b);
+
+struct hash_table
+{
+	struct hash_table_slot* slots;
+	size_t capacity;                    /* number of slots, power of two */
+	size_t elements;                    /* number of keys stored in slots */
+	struct hash_table_slot* old_slots;  /* table being migrated, or NULL */
+	size_t old_capacity;
+	size_t old_elements;                /* number of keys left in old_slots */
+	size_t old_cursor;                  /* next old slot to migrate */
+	hash_table_equals equals;
+};
+
+/**
+ * Create a hash table.
+ *
+ * @param equals Key equality function
+ * @param capacity Initial number of slots (rounded up to a power of two), or 0 for a default.
+ * @return a hash table handle, or NULL if out of memory.
+ */
+extern struct hash_table* hash_table_create(hash_table_equals equals, size_t capacity);
+
+/**
+ * Delete the table. Keys and values are not freed.
+ */
+extern void hash_table_destroy(struct hash_table*);
+
+/**
+ * Insert a key into the table.
+ * @return 1 if successful, 0 if the key already existed or -1 if out of memory.
+ */
+extern int hash_table_insert(struct hash_table* table, uint32_t hash, const void* key, void* value);
+
+/**
+ * Remove a key from the table.
+ * @return 1 if the key was removed, 0 if it was not found.
+ */
+extern int hash_table_remove(struct hash_table* table, uint32_t hash, const void* key);
+
+/**
+ * @return the value stored for key, or NULL if not found.
+ */
+extern void* hash_table_get(struct hash_table* table, uint32_t hash, const void* key);
+
+/**
+ * Lookup using a different equality function than the table's own.
+ * This is useful for looser matching (i.e. case insensitive) as long
+ * as keys that match also produce the same hash.
+ *
+ * @param[out] matches if not NULL, the number of matching keys.
+ * @return the value of the first matching key, or NULL if not found.
+ */
+extern void* hash_table_find(struct hash_table* table, uint32_t hash, hash_table_equals match, const void* key, size_t* matches);
+
+/**
+ * Returns the number of keys in the table.
+ */
+extern size_t hash_table_size(struct hash_table* table);
+
+/**
+ * Hash a buffer (32 bit FNV-1a).
+ */
+extern uint32_t hash_table_hash_data(const void* data, size_t len);
+
+/**
+ * Hash a string after folding ASCII upper case letters to lower case,
+ * so that strings differing only in case produce the same hash.
+ */
+extern uint32_t hash_table_hash_string_nocase(const char* str);
+
+#endif /* HAVE_UHUB_HASH_TABLE_H */
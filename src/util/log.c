@@ -21,6 +21,7 @@
 #include <locale.h>
 
 #ifndef WIN32
+#include <sys/uio.h>
 
 #ifdef SYSTEMD
 #define SD_JOURNAL_SUPPRESS_LOCATION
@@ -33,8 +34,16 @@
 static int use_syslog = 0;
 #endif
 
+#define LOG_MESSAGE_SIZE 1024
+#define LOG_RING_SLOTS   1024
+
 static int verbosity = 4;
 static FILE* logfile = NULL;
+static int log_async = 0;
+static struct log_ring* log_ring = NULL;
+static size_t log_dropped = 0;
+
+int hub_log_max_verbosity = 3;
 
 #ifdef MEMORY_DEBUG
 static FILE* memfile = NULL;
@@ -64,6 +73,188 @@ static const char* prefixes[] =
 };
 
 
+static void log_update_max_verbosity()
+{
+	int max = verbosity - 1;
+
+#ifndef WIN32
+	if (use_syslog && verbosity >= log_info && max < log_debug)
+		max = log_debug;
+#endif
+
+#if defined(MEMORY_DEBUG) || defined(NETWORK_DUMP_DEBUG)
+	max = log_plugin;
+#endif
+
+	hub_log_max_verbosity = max;
+}
+
+static void log_syslog(int log_verbosity, const char* message)
+{
+#ifndef WIN32
+	int level = 0;
+
+	if (!use_syslog || verbosity < log_info)
+		return;
+
+	switch (log_verbosity)
+	{
+		case log_fatal:    level = LOG_CRIT; break;
+		case log_error:    level = LOG_ERR; break;
+		case log_warning:  level = LOG_WARNING; break;
+                #ifdef SYSTEMD
+                case log_user:     level = LOG_INFO; break;
+
+                #else
+                case log_user:     level = LOG_INFO | LOG_AUTH; break;
+                #endif
+		case log_info:     level = LOG_INFO; break;
+		case log_debug:    level = LOG_DEBUG; break;
+
+		default:
+			level = 0;
+			break;
+	}
+
+	if (level == 0)
+		return;
+
+        #ifdef SYSTEMD
+	sd_journal_print(level, "%s", message);
+
+        #else
+	level |= (LOG_USER | LOG_DAEMON);
+	syslog(level, "%s", message);
+        #endif
+#endif
+}
+
+#ifndef WIN32
+static void log_writev(int fd, struct iovec* iov, int count)
+{
+	ssize_t ret;
+
+	while (count)
+	{
+		ret = writev(fd, iov, count);
+		if (ret < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			return;
+		}
+
+		while (count && (size_t) ret >= iov->iov_len)
+		{
+			ret -= iov->iov_len;
+			iov++;
+			count--;
+		}
+
+		if (count)
+		{
+			iov->iov_base = (char*) iov->iov_base + ret;
+			iov->iov_len -= ret;
+		}
+	}
+}
+#endif
+
+static const char* log_timestamp(time_t t)
+{
+	static time_t stamp_time = 0;
+	static char timestamp[32];
+	struct tm tm;
+
+	if (t != stamp_time)
+	{
+		/* Not localtime(), the hub thread uses its static result */
+		stamp_time = t;
+#ifdef WIN32
+		localtime_s(&tm, &t);
+#else
+		localtime_r(&t, &tm);
+#endif
+		strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M:%S", &tm);
+	}
+	return timestamp;
+}
+
+/*
+ * Called by the writer thread. The file gets one write per batch,
+ * syslog still needs one call per message.
+ */
+static void log_ring_write(void* ptr, struct log_ring_entry* entries, size_t count, size_t dropped)
+{
+	char prefix[LOG_RING_BATCH][48];
+	FILE* out = logfile ? logfile : stderr;
+	size_t n;
+#ifndef WIN32
+	struct iovec iov[LOG_RING_BATCH * 3];
+	int iovcnt = 0;
+#endif
+
+	if (dropped)
+	{
+		snprintf(prefix[0], sizeof(prefix[0]), PRINTF_SIZE_T " log messages dropped", dropped);
+		if (log_warning < verbosity)
+		{
+			fprintf(out, "%s %6s: %s\n", log_timestamp(time(NULL)), prefixes[log_warning], prefix[0]);
+			fflush(out);
+		}
+		log_syslog(log_warning, prefix[0]);
+	}
+
+	for (n = 0; n < count; n++)
+	{
+		log_syslog(entries[n].level, entries[n].message);
+		if (entries[n].level >= verbosity)
+			continue;
+
+		snprintf(prefix[n], sizeof(prefix[n]), "%s %6s: ", log_timestamp(entries[n].time), prefixes[entries[n].level]);
+#ifndef WIN32
+		iov[iovcnt].iov_base = prefix[n];
+		iov[iovcnt++].iov_len = strlen(prefix[n]);
+		iov[iovcnt].iov_base = (void*) entries[n].message;
+		iov[iovcnt++].iov_len = entries[n].length;
+		iov[iovcnt].iov_base = (void*) "\n";
+		iov[iovcnt++].iov_len = 1;
+#else
+		fprintf(out, "%s%s\n", prefix[n], entries[n].message);
+#endif
+	}
+
+#ifndef WIN32
+	if (iovcnt)
+		log_writev(fileno(out), iov, iovcnt);
+#else
+	fflush(out);
+#endif
+}
+
+static void log_ring_start()
+{
+	if (!log_async || log_ring || !logfile)
+		return;
+
+	fflush(logfile);
+	log_ring = log_ring_create(LOG_RING_SLOTS, LOG_MESSAGE_SIZE, log_ring_write, NULL);
+	if (!log_ring)
+		fprintf(logfile, "Unable to start logging thread, logging synchronously.\n");
+}
+
+static void log_ring_stop()
+{
+	struct log_ring* ring = log_ring;
+	if (!ring)
+		return;
+
+	log_ring = NULL;
+	log_dropped += log_ring_dropped(ring);
+	log_ring_destroy(ring);
+}
+
+
 void hub_log_initialize(const char* file, int syslog)
 {
 
@@ -97,25 +288,21 @@ void hub_log_initialize(const char* file, int syslog)
 	}
 #endif
 
+	if (file)
+		logfile = fopen(file, "a");
 
-	if (!file)
-	{
-		logfile = stderr;
-		return;
-	}
-
-	logfile = fopen(file, "a");
 	if (!logfile)
-	{
 		logfile = stderr;
-		return;
-	}
 
+	log_update_max_verbosity();
+	log_ring_start();
 }
 
 
 void hub_log_shutdown()
 {
+	log_ring_stop();
+
 	if (logfile && logfile != stderr)
 	{
 		fclose(logfile);
@@ -147,18 +334,47 @@ void hub_log_shutdown()
                 #endif
 	}
 #endif
+	log_update_max_verbosity();
+}
+
+
+void hub_log_set_async(int async)
+{
+	static int registered = 0;
+
+	log_async = async;
+	if (!async)
+	{
+		log_ring_stop();
+		return;
+	}
+
+	/* Whatever is still queued should be written if we exit() */
+	if (!registered)
+	{
+		atexit(log_ring_stop);
+		registered = 1;
+	}
+	log_ring_start();
+}
+
+
+size_t hub_log_dropped()
+{
+	return log_dropped + (log_ring ? log_ring_dropped(log_ring) : 0);
 }
 
 
 void hub_set_log_verbosity(int verb)
 {
 	verbosity = verb;
+	log_update_max_verbosity();
 }
 
 void hub_log(int log_verbosity, const char *format, ...)
 {
-	static char logmsg[1024];
-	static char timestamp[32];
+	char logmsg[LOG_MESSAGE_SIZE];
+	char timestamp[32];
 	struct tm *tmp;
 	time_t t;
 	va_list args;
@@ -167,7 +383,7 @@ void hub_log(int log_verbosity, const char *format, ...)
 	if (memfile && log_verbosity == log_memory)
 	{
 		va_start(args, format);
-		vsnprintf(logmsg, 1024, format, args);
+		vsnprintf(logmsg, sizeof(logmsg), format, args);
 		va_end(args);
 		fprintf(memfile, "%s\n", logmsg);
 		fflush(memfile);
@@ -179,7 +395,7 @@ void hub_log(int log_verbosity, const char *format, ...)
 	if (netdump && log_verbosity == log_protocol)
 	{
 		va_start(args, format);
-		vsnprintf(logmsg, 1024, format, args);
+		vsnprintf(logmsg, sizeof(logmsg), format, args);
 		va_end(args);
 		fprintf(netdump, "%s\n", logmsg);
 		fflush(netdump);
@@ -187,14 +403,26 @@ void hub_log(int log_verbosity, const char *format, ...)
 	}
 #endif
 
+	if (log_verbosity > hub_log_max_verbosity || log_verbosity < 0 || log_verbosity > log_plugin)
+		return;
+
+	if (log_ring)
+	{
+		va_start(args, format);
+		log_ring_add(log_ring, log_verbosity, format, args);
+		va_end(args);
+		return;
+	}
+
+	va_start(args, format);
+	vsnprintf(logmsg, sizeof(logmsg), format, args);
+	va_end(args);
+
 	if (log_verbosity < verbosity)
 	{
 		t = time(NULL);
 		tmp = localtime(&t);
-		strftime(timestamp, 32, "%Y-%m-%d %H:%M:%S", tmp);
-		va_start(args, format);
-		vsnprintf(logmsg, 1024, format, args);
-		va_end(args);
+		strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M:%S", tmp);
 
 		if (logfile)
 		{
@@ -207,48 +435,5 @@ void hub_log(int log_verbosity, const char *format, ...)
 		}
 	}
 
-#ifndef WIN32
-	if (use_syslog)
-	{
-		int level = 0;
-
-		if (verbosity < log_info)
-			return;
-
-		va_start(args, format);
-		vsnprintf(logmsg, 1024, format, args);
-		va_end(args);
-
-		switch (log_verbosity)
-		{
-			case log_fatal:    level = LOG_CRIT; break;
-			case log_error:    level = LOG_ERR; break;
-			case log_warning:  level = LOG_WARNING; break;
-                        #ifdef SYSTEMD
-                        case log_user:     level = LOG_INFO; break;
-
-                        #else
-                        case log_user:     level = LOG_INFO | LOG_AUTH; break;
-                        #endif
-			case log_info:     level = LOG_INFO; break;
-			case log_debug:    level = LOG_DEBUG; break;
-
-			default:
-				level = 0;
-				break;
-		}
-
-		if (level == 0)
-			return;
-
-                #ifdef SYSTEMD
-		sd_journal_print(level, "%s", logmsg);
-
-                #else
-		level |= (LOG_USER | LOG_DAEMON);
-		syslog(level, "%s", logmsg);
-                #endif
-	}
-#endif
-
+	log_syslog(log_verbosity, logmsg);
 }
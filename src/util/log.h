@@ -34,16 +34,25 @@ enum log_verbosity {
 	log_plugin   = 10,
 };
 
-#define LOG_FATAL(format, ...)  hub_log(log_fatal,    format, ## __VA_ARGS__)
-#define LOG_ERROR(format, ...)  hub_log(log_error,    format, ## __VA_ARGS__)
-#define LOG_WARN(format, ...)   hub_log(log_warning,  format, ## __VA_ARGS__)
-#define LOG_USER(format, ...)   hub_log(log_user,     format, ## __VA_ARGS__)
-#define LOG_INFO(format, ...)   hub_log(log_info,     format, ## __VA_ARGS__)
+/**
+ * The highest level anything is logged at. Arguments to messages above it
+ * are not even evaluated.
+ */
+extern int hub_log_max_verbosity;
+
+#define LOG_ENABLED(level) ((level) <= hub_log_max_verbosity)
+#define LOG_AT(level, format, ...) do { if (LOG_ENABLED(level)) hub_log(level, format, ## __VA_ARGS__); } while (0)
+
+#define LOG_FATAL(format, ...)  LOG_AT(log_fatal,    format, ## __VA_ARGS__)
+#define LOG_ERROR(format, ...)  LOG_AT(log_error,    format, ## __VA_ARGS__)
+#define LOG_WARN(format, ...)   LOG_AT(log_warning,  format, ## __VA_ARGS__)
+#define LOG_USER(format, ...)   LOG_AT(log_user,     format, ## __VA_ARGS__)
+#define LOG_INFO(format, ...)   LOG_AT(log_info,     format, ## __VA_ARGS__)
 
 #ifdef DEBUG
-# define LOG_DEBUG(format, ...)  hub_log(log_debug,    format, ## __VA_ARGS__)
-# define LOG_TRACE(format, ...)  hub_log(log_trace,    format, ## __VA_ARGS__)
-# define LOG_PLUGIN(format, ...) hub_log(log_plugin,   format, ## __VA_ARGS__)
+# define LOG_DEBUG(format, ...)  LOG_AT(log_debug,    format, ## __VA_ARGS__)
+# define LOG_TRACE(format, ...)  LOG_AT(log_trace,    format, ## __VA_ARGS__)
+# define LOG_PLUGIN(format, ...) LOG_AT(log_plugin,   format, ## __VA_ARGS__)
 #else
 # define LOG_DEBUG(format, ...)  do { } while(0)
 # define LOG_TRACE(format, ...)  do { } while(0)
@@ -51,9 +60,9 @@ enum log_verbosity {
 #endif
 
 #ifdef LOWLEVEL_DEBUG
-# define LOG_DUMP(format, ...)   hub_log(log_dump,     format, ## __VA_ARGS__)
-# define LOG_MEMORY(format, ...) hub_log(log_memory,   format, ## __VA_ARGS__)
-# define LOG_PROTO(format, ...)  hub_log(log_protocol, format, ## __VA_ARGS__)
+# define LOG_DUMP(format, ...)   LOG_AT(log_dump,     format, ## __VA_ARGS__)
+# define LOG_MEMORY(format, ...) LOG_AT(log_memory,   format, ## __VA_ARGS__)
+# define LOG_PROTO(format, ...)  LOG_AT(log_protocol, format, ## __VA_ARGS__)
 #else
 # define LOG_DUMP(format, ...)   do { } while(0)
 # define LOG_MEMORY(format, ...) do { } while(0)
@@ -84,4 +93,18 @@ extern void hub_log_initialize(const char* file, int syslog);
  */
 extern void hub_log_shutdown();
 
+/**
+ * Write the log from a background thread, so that logging never waits
+ * for the disk. Messages are dropped rather than waited for if the
+ * thread falls behind.
+ * Must only be called once the process has forked, and stays in effect
+ * when the log is initialized again.
+ */
+extern void hub_log_set_async(int async);
+
+/**
+ * @return the number of log messages dropped.
+ */
+extern size_t hub_log_dropped();
+
 #endif /* HAVE_UHUB_LOG_H */
@@ -0,0 +1,239 @@
+/*
+ * uhub - A tiny ADC p2p connection hub
+ * Copyright (C) 2007-2014, Jan Vidar Krey
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "uhub.h"
+
+/*
+ * Each slot has a sequence number telling whose turn it is.
+ * A slot at position pos is free when its sequence is pos, and holds
+ * a message when it is pos + 1. A producer claims a free slot by moving
+ * the tail past it, formats into it and then publishes it. The writer
+ * hands it back for position pos + slots once the message is written.
+ */
+struct log_ring_slot
+{
+	size_t sequence;
+	int level;
+	time_t time;
+	size_t length;
+};
+
+struct log_ring
+{
+	size_t tail;                    /** Next position to claim, shared by producers */
+	char padding[64 - sizeof(size_t)];
+	size_t head;                    /** Next position to write, writer only */
+	size_t mask;
+	size_t slot_size;
+	struct log_ring_slot* slots;
+	char* messages;
+	size_t dropped;
+	size_t reported;                /** Drops already passed to write, writer only */
+	int sleeping;                   /** The writer is waiting for a signal */
+	int stop;
+	uhub_mutex_t lock;
+	uhub_cond_t cond;
+	uhub_thread_t* thread;
+	log_ring_write_f write;
+	void* ptr;
+};
+
+static int log_ring_ready(struct log_ring* ring, size_t pos)
+{
+	struct log_ring_slot* slot = &ring->slots[pos & ring->mask];
+	return __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) == pos + 1;
+}
+
+static void* log_ring_writer(void* ptr)
+{
+	struct log_ring* ring = (struct log_ring*) ptr;
+	struct log_ring_entry entries[LOG_RING_BATCH];
+	struct log_ring_slot* slot;
+	size_t count, dropped, n;
+
+	for (;;)
+	{
+		if (!log_ring_ready(ring, ring->head))
+		{
+			uhub_mutex_lock(&ring->lock);
+			for (;;)
+			{
+				/* Pairs with the fence in log_ring_add */
+				__atomic_store_n(&ring->sleeping, 1, __ATOMIC_SEQ_CST);
+				__atomic_thread_fence(__ATOMIC_SEQ_CST);
+				if (log_ring_ready(ring, ring->head) || ring->stop)
+					break;
+				uhub_cond_wait(&ring->cond, &ring->lock);
+			}
+			__atomic_store_n(&ring->sleeping, 0, __ATOMIC_RELAXED);
+			uhub_mutex_unlock(&ring->lock);
+
+			if (!log_ring_ready(ring, ring->head))
+			{
+				/* Stopped, and nothing left to write but the drop count */
+				dropped = __atomic_load_n(&ring->dropped, __ATOMIC_RELAXED);
+				if (dropped != ring->reported)
+					ring->write(ring->ptr, entries, 0, dropped - ring->reported);
+				break;
+			}
+		}
+
+		for (count = 0; count < LOG_RING_BATCH && log_ring_ready(ring, ring->head + count); count++)
+		{
+			slot = &ring->slots[(ring->head + count) & ring->mask];
+			entries[count].level = slot->level;
+			entries[count].time = slot->time;
+			entries[count].length = slot->length;
+			entries[count].message = ring->messages + ((ring->head + count) & ring->mask) * ring->slot_size;
+		}
+
+		dropped = __atomic_load_n(&ring->dropped, __ATOMIC_RELAXED);
+		ring->write(ring->ptr, entries, count, dropped - ring->reported);
+		ring->reported = dropped;
+
+		for (n = 0; n < count; n++)
+		{
+			slot = &ring->slots[ring->head & ring->mask];
+			__atomic_store_n(&slot->sequence, ring->head + ring->mask + 1, __ATOMIC_RELEASE);
+			ring->head++;
+		}
+	}
+	return NULL;
+}
+
+struct log_ring* log_ring_create(size_t slots, size_t slot_size, log_ring_write_f write, void* ptr)
+{
+	struct log_ring* ring;
+	size_t size = 2;
+	size_t n;
+
+	while (size < slots)
+		size <<= 1;
+
+	ring = hub_malloc_zero(sizeof(struct log_ring));
+	if (!ring)
+		return NULL;
+
+	ring->mask = size - 1;
+	ring->slot_size = MAX(slot_size, 16);
+	ring->slots = hub_malloc_zero(size * sizeof(struct log_ring_slot));
+	ring->messages = hub_malloc(size * ring->slot_size);
+	ring->write = write;
+	ring->ptr = ptr;
+
+	if (!ring->slots || !ring->messages)
+	{
+		hub_free(ring->slots);
+		hub_free(ring->messages);
+		hub_free(ring);
+		return NULL;
+	}
+
+	for (n = 0; n < size; n++)
+		ring->slots[n].sequence = n;
+
+	uhub_mutex_init(&ring->lock);
+	uhub_cond_init(&ring->cond);
+
+	ring->thread = uhub_thread_create(log_ring_writer, ring);
+	if (!ring->thread)
+	{
+		uhub_cond_destroy(&ring->cond);
+		uhub_mutex_destroy(&ring->lock);
+		hub_free(ring->slots);
+		hub_free(ring->messages);
+		hub_free(ring);
+		return NULL;
+	}
+	return ring;
+}
+
+void log_ring_destroy(struct log_ring* ring)
+{
+	if (!ring)
+		return;
+
+	uhub_mutex_lock(&ring->lock);
+	ring->stop = 1;
+	uhub_cond_signal(&ring->cond);
+	uhub_mutex_unlock(&ring->lock);
+	uhub_thread_join(ring->thread);
+
+	uhub_cond_destroy(&ring->cond);
+	uhub_mutex_destroy(&ring->lock);
+	hub_free(ring->slots);
+	hub_free(ring->messages);
+	hub_free(ring);
+}
+
+int log_ring_add(struct log_ring* ring, int level, const char* format, va_list args)
+{
+	struct log_ring_slot* slot;
+	size_t pos = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+	size_t sequence;
+	char* message;
+	int length;
+
+	for (;;)
+	{
+		slot = &ring->slots[pos & ring->mask];
+		sequence = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+
+		if (sequence == pos)
+		{
+			if (__atomic_compare_exchange_n(&ring->tail, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				break;
+		}
+		else if (sequence < pos)
+		{
+			/* Full, the writer has not caught up */
+			__atomic_add_fetch(&ring->dropped, 1, __ATOMIC_RELAXED);
+			return 0;
+		}
+		else
+		{
+			pos = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+		}
+	}
+
+	message = ring->messages + (pos & ring->mask) * ring->slot_size;
+	length = vsnprintf(message, ring->slot_size, format, args);
+	if (length < 0)
+		length = 0;
+
+	slot->level = level;
+	slot->time = time(NULL);
+	slot->length = MIN((size_t) length, ring->slot_size - 1);
+	__atomic_store_n(&slot->sequence, pos + 1, __ATOMIC_RELEASE);
+
+	/* Only take the lock if the writer has gone to sleep */
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&ring->sleeping, __ATOMIC_RELAXED))
+	{
+		uhub_mutex_lock(&ring->lock);
+		uhub_cond_signal(&ring->cond);
+		uhub_mutex_unlock(&ring->lock);
+	}
+	return 1;
+}
+
+size_t log_ring_dropped(struct log_ring* ring)
+{
+	return __atomic_load_n(&ring->dropped, __ATOMIC_RELAXED);
+}
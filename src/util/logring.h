@@ -0,0 +1,78 @@
+/*
+ * uhub - A tiny ADC p2p connection hub
+ * Copyright (C) 2007-2014, Jan Vidar Krey
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef HAVE_UHUB_LOG_RING_H
+#define HAVE_UHUB_LOG_RING_H
+
+/**
+ * A bounded ring of log messages, written out by a background thread.
+ *
+ * Any number of threads may add messages. Adding never blocks and never
+ * allocates: the message is formatted straight into a free slot, and if
+ * there is none the message is dropped and counted instead.
+ *
+ * The writer thread takes the messages in order, as many as are ready,
+ * and hands them to the write function in batches.
+ */
+
+#define LOG_RING_BATCH 64
+
+struct log_ring;
+
+struct log_ring_entry
+{
+	int level;
+	time_t time;
+	size_t length;
+	const char* message;    /* length bytes, zero terminated */
+};
+
+/**
+ * Called by the writer thread with a batch of at most LOG_RING_BATCH
+ * messages, which are only valid until it returns.
+ * dropped is the number of messages dropped since the previous call.
+ */
+typedef void (*log_ring_write_f)(void* ptr, struct log_ring_entry* entries, size_t count, size_t dropped);
+
+/**
+ * Create a ring and start its writer thread.
+ *
+ * @param slots Number of messages the ring holds, rounded up to a power of two.
+ * @param slot_size Maximum length of a message, longer ones are truncated.
+ * @return the ring, or NULL on error.
+ */
+extern struct log_ring* log_ring_create(size_t slots, size_t slot_size, log_ring_write_f write, void* ptr);
+
+/**
+ * Write out what is left, stop the writer thread and free the ring.
+ */
+extern void log_ring_destroy(struct log_ring* ring);
+
+/**
+ * Add a message.
+ * @return 1 if added, 0 if dropped.
+ */
+extern int log_ring_add(struct log_ring* ring, int level, const char* format, va_list args);
+
+/**
+ * @return the number of messages dropped so far.
+ */
+extern size_t log_ring_dropped(struct log_ring* ring);
+
+#endif /* HAVE_UHUB_LOG_RING_H */
@@ -250,11 +250,12 @@ int file_read_lines(const char* file, void* data, file_line_handler_t handler)
 {
 	int fd;
 	ssize_t ret;
-	char buf[MAX_RECV_BUF];
+	char* buf;
+	char* tmp;
+	size_t size = MAX_RECV_BUF;
+	size_t length = 0;
 	struct file_read_line_data split_data;
 
-	memset(buf, 0, MAX_RECV_BUF);
-
 	LOG_TRACE("Opening file %s for line reading.", file);
 
 	fd = open(file, 0);
@@ -264,27 +265,57 @@ int file_read_lines(const char* file, void* data, file_line_handler_t handler)
 		return -2;
 	}
 
-	ret = read(fd, buf, MAX_RECV_BUF-1);
+	/* Read the whole file, files like the ACL can be large */
+	buf = hub_malloc(size);
+	while (buf)
+	{
+		ret = read(fd, buf + length, size - length - 1);
+		if (ret <= 0)
+			break;
+
+		length += ret;
+		if (length + 1 == size)
+		{
+			tmp = hub_realloc(buf, size * 2);
+			if (!tmp)
+			{
+				hub_free(buf);
+				buf = NULL;
+				break;
+			}
+			buf = tmp;
+			size *= 2;
+		}
+	}
 	close(fd);
 
-	if (ret < 0)
+	if (!buf)
+	{
+		LOG_ERROR("Unable to read from file %s: Out of memory", file);
+		return -1;
+	}
+	else if (ret < 0)
 	{
 		LOG_ERROR("Unable to read from file %s: %s", file, strerror(errno));
+		hub_free(buf);
 		return -1;
 	}
-	else  if (ret == 0)
+	else if (length == 0)
 	{
 		LOG_WARN("File is empty.");
+		hub_free(buf);
 		return 0;
 	}
 
-	buf[ret] = 0;
+	buf[length] = 0;
 
 	/* Parse configuration */
 	split_data.handler = handler;
 	split_data.data = data;
 
-	return string_split(buf, "\n", &split_data, file_read_line_handler);
+	ret = string_split(buf, "\n", &split_data, file_read_line_handler);
+	hub_free(buf);
+	return (int) ret;
 }
 
 
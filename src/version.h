@@ -0,0 +1,36 @@
+/*
+ * uhub - A tiny ADC p2p connection hub
+ * Copyright (C) 2007-2013, Jan Vidar Krey
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/* THIS FILE IS AUTO-GENERATED BY CMAKE - DO NOT EDIT MANUALLY! */
+
+#ifndef VERSION
+#define VERSION "0.5.0"
+#endif
+
+#define GIT_VERSION "0.5.0-git-8e13820"
+
+#ifndef PRODUCT
+#define PRODUCT "uhub"
+#endif
+
+#define PRODUCT_STRING PRODUCT "/" GIT_VERSION
+
+#ifndef COPYRIGHT
+#define COPYRIGHT "Copyright (c) 2007-2014, Jan Vidar Krey <janvidar@extatic.org>"
+#endif